@@ -33,6 +33,8 @@ TK(STMT_END)
 
 // Symbols
 TK_PUNCT(COMMA, ",")
+TK_PUNCT(OPEN_PAREN, "(")
+TK_PUNCT(CLOSE_PAREN, ")")
 
 // MIPS General Purpose Registers
 TK_REGISTER(R0, "r0")
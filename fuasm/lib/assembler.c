@@ -78,6 +78,8 @@ static fuasm_token expect(fuasm_assembler* asm, fuasm_token_kind kind, const cha
 static void expect_comma(fuasm_assembler* asm);
 static gfu_register expect_register(fuasm_assembler* asm);
 static fuasm_token_kind expect_label(fuasm_assembler* asm, i64* out_label);
+static i32 expect_branch_offset(fuasm_assembler* asm, i64 addr);
+static gfu_register expect_memory_operand(fuasm_assembler* asm, u32* out_offset);
 
 static void precalculate_symbol_addresses(fuasm_assembler* asm);
 static void read_statement(fuasm_assembler* asm);
@@ -310,6 +312,31 @@ static fuasm_token_kind expect_label(fuasm_assembler* asm, i64* out_label) {
     return token.kind;
 }
 
+// the branch offset is in instructions, relative to the delay slot
+static i32 expect_branch_offset(fuasm_assembler* asm, i64 addr) {
+    i64 label;
+    if (expect_label(asm, &label) != FUASM_TK_LOCAL_LABEL) {
+        choir_diag_issue_source_bytes(asm->unit->context, CHOIR_FATAL, asm->unit->source, current(asm).begin, "Relocations are not yet implemented.");
+        exit(1);
+    }
+
+    return kos_cast(i32) ((label - (addr + 4)) / 4);
+}
+
+// offset(base), where the offset is optional
+static gfu_register expect_memory_operand(fuasm_assembler* asm, u32* out_offset) {
+    *out_offset = 0;
+    if (is_at(asm, FUASM_TK_IMMEDIATE)) {
+        *out_offset = current(asm).immediate_value;
+        advance(asm);
+    }
+
+    kos_discard expect(asm, FUASM_TK_OPEN_PAREN, "'('");
+    gfu_register base = expect_register(asm);
+    kos_discard expect(asm, FUASM_TK_CLOSE_PAREN, "')'");
+    return base;
+}
+
 static void precalculate_symbol_addresses(fuasm_assembler* asm) {
     ssize_t current_section_index = -1;
     while (!is_at_end(asm)) {
@@ -453,18 +480,103 @@ static void read_statement(fuasm_assembler* asm) {
             }
         } break;
 
-        case FUASM_TK_MN_B: {
+        case FUASM_TK_MN_ADDU: {
             advance(asm);
-            i64 label;
-            if (expect_label(asm, &label) == FUASM_TK_LOCAL_LABEL) {
-                i32 offs = kos_cast(i32) (label - (addr + 4));
-                kos_da_push(&section->instructions, GFU_INST_B(offs));
+            gfu_register rd = expect_register(asm); expect_comma(asm);
+            gfu_register rs = expect_register(asm); expect_comma(asm);
+            if (is_at(asm, FUASM_TK_IMMEDIATE)) {
+                u32 imm = current(asm).immediate_value; advance(asm);
+                kos_da_push(&section->instructions, GFU_INST_ADDIU(rd, rs, imm));
             } else {
-                choir_diag_issue_source_bytes(asm->unit->context, CHOIR_FATAL, asm->unit->source, current(asm).begin, "Relocations are not yet implemented.");
-                exit(1);
+                gfu_register rt = expect_register(asm);
+                kos_da_push(&section->instructions, GFU_INST_ADDU(rd, rs, rt));
+            }
+        } break;
+
+        case FUASM_TK_MN_B: {
+            advance(asm);
+            i32 offs = expect_branch_offset(asm, addr);
+            kos_da_push(&section->instructions, GFU_INST_B(offs));
+        } break;
+
+        case FUASM_TK_MN_BEQ: {
+            advance(asm);
+            gfu_register rs = expect_register(asm); expect_comma(asm);
+            gfu_register rt = expect_register(asm); expect_comma(asm);
+            i32 offs = expect_branch_offset(asm, addr);
+            kos_da_push(&section->instructions, GFU_INST_BEQ(rt, rs, offs));
+        } break;
+
+        case FUASM_TK_MN_BNE: {
+            advance(asm);
+            gfu_register rs = expect_register(asm); expect_comma(asm);
+            gfu_register rt = expect_register(asm); expect_comma(asm);
+            i32 offs = expect_branch_offset(asm, addr);
+            kos_da_push(&section->instructions, GFU_INST_BNE(rs, rt, offs));
+        } break;
+
+        case FUASM_TK_MN_LUI: {
+            advance(asm);
+            gfu_register rt = expect_register(asm); expect_comma(asm);
+            u32 imm = expect(asm, FUASM_TK_IMMEDIATE, "an immediate").immediate_value;
+            kos_da_push(&section->instructions, GFU_INST_LUI(rt, imm));
+        } break;
+
+        case FUASM_TK_MN_SLL: {
+            advance(asm);
+            gfu_register rd = expect_register(asm); expect_comma(asm);
+            gfu_register rt = expect_register(asm); expect_comma(asm);
+            u32 sa = expect(asm, FUASM_TK_IMMEDIATE, "a shift amount").immediate_value;
+            kos_da_push(&section->instructions, GFU_INST_SLL(rd, rt, sa));
+        } break;
+
+        case FUASM_TK_MN_LBU:
+        case FUASM_TK_MN_LW:
+        case FUASM_TK_MN_SB:
+        case FUASM_TK_MN_SW: {
+            fuasm_token_kind kind = current(asm).kind;
+            advance(asm);
+            gfu_register rt = expect_register(asm); expect_comma(asm);
+            u32 offset;
+            gfu_register base = expect_memory_operand(asm, &offset);
+            switch (kind) {
+                case FUASM_TK_MN_LBU: kos_da_push(&section->instructions, GFU_INST_LBU(rt, offset, base)); break;
+                case FUASM_TK_MN_LW: kos_da_push(&section->instructions, GFU_INST_LW(rt, offset, base)); break;
+                case FUASM_TK_MN_SB: kos_da_push(&section->instructions, GFU_INST_SB(rt, offset, base)); break;
+                case FUASM_TK_MN_SW: kos_da_push(&section->instructions, GFU_INST_SW(rt, offset, base)); break;
+                default: choir_assert(asm->unit->context, false, "you fucked up"); break;
+            }
+        } break;
+
+        case FUASM_TK_MN_MULT:
+        case FUASM_TK_MN_MULTU:
+        case FUASM_TK_MN_DIV:
+        case FUASM_TK_MN_DIVU: {
+            fuasm_token_kind kind = current(asm).kind;
+            advance(asm);
+            gfu_register rs = expect_register(asm); expect_comma(asm);
+            gfu_register rt = expect_register(asm);
+            switch (kind) {
+                case FUASM_TK_MN_MULT: kos_da_push(&section->instructions, GFU_INST_MULT(rs, rt)); break;
+                case FUASM_TK_MN_MULTU: kos_da_push(&section->instructions, GFU_INST_MULTU(rs, rt)); break;
+                case FUASM_TK_MN_DIV: kos_da_push(&section->instructions, GFU_INST_DIV(rs, rt)); break;
+                case FUASM_TK_MN_DIVU: kos_da_push(&section->instructions, GFU_INST_DIVU(rs, rt)); break;
+                default: choir_assert(asm->unit->context, false, "you fucked up"); break;
             }
         } break;
 
+        case FUASM_TK_MN_MFHI: {
+            advance(asm);
+            gfu_register rd = expect_register(asm);
+            kos_da_push(&section->instructions, GFU_INST_MFHI(rd));
+        } break;
+
+        case FUASM_TK_MN_MFLO: {
+            advance(asm);
+            gfu_register rd = expect_register(asm);
+            kos_da_push(&section->instructions, GFU_INST_MFLO(rd));
+        } break;
+
         case FUASM_TK_MN_NOP: {
             advance(asm);
             kos_da_push(&section->instructions, GFU_INST_NOP());
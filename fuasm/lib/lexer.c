@@ -111,6 +111,16 @@ fuasm_token fuasm_read_token(fuasm_lexer* lexer) {
             advance(lexer);
         } break;
 
+        case '(': {
+            result.kind = FUASM_TK_OPEN_PAREN;
+            advance(lexer);
+        } break;
+
+        case ')': {
+            result.kind = FUASM_TK_CLOSE_PAREN;
+            advance(lexer);
+        } break;
+
         default: {
             if (is_idstart(c)) {
                 bool is_local_label = c == '.';
@@ -102,7 +102,7 @@ static int emit_elf(fuasm_translation_unit* unit, const char* output_path) {
         .type = ELF_SECT_PROGBITS,
         .flags = ELF_SECTFLAG_EXECINSTR,
         .virtual_address = 0,
-        .offset = kos_cast(elf32_word) kos_align_to(kos_cast(i64) (header_shnames.offset + header_shnames.size), 4) + (header.sh_entry_size * header.sh_count),
+        .offset = kos_cast(elf32_word) kos_align_to(kos_cast(i64) (header_shnames.offset + header_shnames.size), 4),
         .size = text_size,
         .link = 0,
         .info = 0,
@@ -0,0 +1,129 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX-AOT - GameFU Station Ahead-of-time Compiler                      ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#define KOS_IMPLEMENTATION
+#include <kos.h>
+
+#define GFUARCH_IMPLEMENTATION
+#include <gamefu/arch.h>
+
+#define GFU_ELF_IMPL
+#include <gamefu/elf.h>
+
+#include <gamefu/gfusx.h>
+
+#include <ctype.h>
+
+static void gfusx_aot_print_usage(FILE* stream, const char* program);
+static const char* gfusx_aot_default_name(const char* elf_path);
+static bool gfusx_aot_is_identifier(const char* name);
+
+int main(int argc, char** argv) {
+    const char* elf_path = NULL;
+    const char* output_path = NULL;
+    const char* name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (0 == strcmp("-o", arg) && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (0 == strcmp("--name", arg) && i + 1 < argc) {
+            name = argv[++i];
+        } else if (0 == strcmp("--help", arg)) {
+            gfusx_aot_print_usage(stdout, argv[0]);
+            return 0;
+        } else if (arg[0] == '-' || elf_path != NULL) {
+            fprintf(stderr, "Unknown option '%s'.\n", arg);
+            gfusx_aot_print_usage(stderr, argv[0]);
+            return 1;
+        } else {
+            elf_path = arg;
+        }
+    }
+
+    if (elf_path == NULL) {
+        gfusx_aot_print_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    if (name == NULL) name = gfusx_aot_default_name(elf_path);
+    if (!gfusx_aot_is_identifier(name)) {
+        fprintf(stderr, "'%s' is not a valid C identifier.\n", name);
+        return 1;
+    }
+
+    FILE* stream = stdout;
+    if (output_path != NULL) {
+        stream = fopen(output_path, "w");
+        if (stream == NULL) {
+            fprintf(stderr, "Could not create output file '%s'.\n", output_path);
+            return 1;
+        }
+    }
+
+    bool generated = gfusx_aot_generate(stream, elf_path, name);
+    if (stream != stdout && fclose(stream) != 0) generated = false;
+
+    // don't leave half a file behind for the build to pick up
+    if (!generated && output_path != NULL) remove(output_path);
+
+    return generated ? 0 : 1;
+}
+
+static void gfusx_aot_print_usage(FILE* stream, const char* program) {
+    fprintf(stream, "Usage: %s <program.elf> [-o <output.c>] [--name <symbol>]\n", program);
+    fprintf(stream, "Compiles the code of a GameFU program to C, for linking against gfusx.\n\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -o <output.c>      Where to write the code, instead of stdout.\n");
+    fprintf(stream, "  --name <symbol>    The name of the gfusx_aot_program to define, by default\n");
+    fprintf(stream, "                     the file name of the program followed by '_aot'.\n");
+}
+
+static const char* gfusx_aot_default_name(const char* elf_path) {
+    const char* file_name = elf_path;
+    for (const char* c = elf_path; *c != 0; c++) {
+        if (*c == '/' || *c == '\\') file_name = c + 1;
+    }
+
+    usize length = strlen(file_name);
+    const char* extension = strrchr(file_name, '.');
+    if (extension != NULL && extension != file_name) length = (usize)(extension - file_name);
+
+    static char name[256];
+    usize count = 0;
+    if (length == 0 || isdigit((unsigned char)file_name[0])) name[count++] = '_';
+    for (usize i = 0; i < length && count + 5 < sizeof name; i++) {
+        unsigned char c = (unsigned char)file_name[i];
+        name[count++] = isalnum(c) ? (char)c : '_';
+    }
+
+    memcpy(name + count, "_aot", 5);
+    return name;
+}
+
+static bool gfusx_aot_is_identifier(const char* name) {
+    if (name[0] == 0 || isdigit((unsigned char)name[0])) return false;
+
+    for (const char* c = name; *c != 0; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_') return false;
+    }
+
+    return true;
+}
@@ -47,6 +47,28 @@
 
 #define GFUSX_CYCLE_BIAS 2
 
+// The instruction cache holds 4 KiB of code in 16 byte lines. A miss refills the
+// line from the missed word to its end, which costs a fixed bus setup plus a
+// transfer per word on top of the instruction itself.
+#define GFUSX_ICACHE_SIZE 0x1000
+#define GFUSX_ICACHE_LINE_SIZE 16
+#define GFUSX_ICACHE_WORD_COUNT (GFUSX_ICACHE_SIZE / 4)
+#define GFUSX_ICACHE_MISS_CYCLES 4
+#define GFUSX_ICACHE_WORD_CYCLES 2
+// never a word address, so it never matches a fetch
+#define GFUSX_ICACHE_INVALID 0xFFFFFFFFu
+
+#define GFUSX_PAGE_SHIFT 12
+#define GFUSX_PAGE_SIZE (1u << GFUSX_PAGE_SHIFT)
+#define GFUSX_PAGE_MASK (GFUSX_PAGE_SIZE - 1)
+
+// the whole 32-bit guest address space, in pages
+#define GFUSX_ADDRESS_PAGE_COUNT (1u << (32 - GFUSX_PAGE_SHIFT))
+
+// code can only run out of RAM and ROM, which sit at the bottom of the address space
+#define GFUSX_CODE_SIZE GFU_MEM_SIZE
+#define GFUSX_CODE_PAGE_COUNT (GFUSX_CODE_SIZE >> GFUSX_PAGE_SHIFT)
+
 /// ======================================================================== ///
 /// Virtual Machine State.                                                   ///
 /// ======================================================================== ///
@@ -72,7 +94,10 @@ typedef union gfusx_cop0_regs {
     };
 } gfusx_cop0_regs;
 
-/*
+// Isolate cache: loads and stores only reach the cache, never memory.
+#define GFUSX_COP0_STATUS_ISC (1u << 16)
+// Swap caches: isolated stores reach the instruction cache instead of the data cache.
+#define GFUSX_COP0_STATUS_SWC (1u << 17)
 
 typedef union gfusx_bytes32 {
 #if GFUSX_IS_NATIVE_BIG_ENDIAN
@@ -111,8 +136,8 @@ typedef struct gfusx_cop2_svector2 {
 } gfusx_cop2_svector2;
 
 typedef struct gfusx_cop2_svector2z {
-    i16 z, unused;
-} gfusx_cop2_svector2;
+    u16 z, unused;
+} gfusx_cop2_svector2z;
 
 typedef struct gfusx_cop2_svector3 {
     i16 x, y, z, unused;
@@ -158,58 +183,973 @@ typedef union gfusx_cop2_data_ctrl {
         i32 h;
         i32 dqa, dqb;
         i32 zsf3, zsf4;
-        i32 flag;
+        u32 flag;
     };
 } gfusx_cop2_data_ctrl;
 
-*/
+// FLAG bits raised by GTE commands. Bit 31 is set whenever any of the ones in
+// GFUSX_GTE_FLAG_ERROR_MASK is.
+#define GFUSX_GTE_FLAG_ERROR (1u << 31)
+#define GFUSX_GTE_FLAG_MAC_POSITIVE(Index) (1u << (31 - (Index)))
+#define GFUSX_GTE_FLAG_MAC_NEGATIVE(Index) (1u << (28 - (Index)))
+#define GFUSX_GTE_FLAG_IR(Index) (1u << (25 - (Index)))
+#define GFUSX_GTE_FLAG_COLOR(Index) (1u << (22 - (Index)))
+#define GFUSX_GTE_FLAG_SZ_OTZ (1u << 18)
+#define GFUSX_GTE_FLAG_DIVIDE (1u << 17)
+#define GFUSX_GTE_FLAG_MAC0_POSITIVE (1u << 16)
+#define GFUSX_GTE_FLAG_MAC0_NEGATIVE (1u << 15)
+#define GFUSX_GTE_FLAG_SX2 (1u << 14)
+#define GFUSX_GTE_FLAG_SY2 (1u << 13)
+#define GFUSX_GTE_FLAG_IR0 (1u << 12)
+#define GFUSX_GTE_FLAG_ERROR_MASK 0x7F87E000u
 
 typedef enum gfusx_exception_kind {
     GFUSX_EX_ARITHMETIC_OVERFLOW,
+    GFUSX_EX_ADDRESS_ERROR_LOAD,
+    GFUSX_EX_ADDRESS_ERROR_STORE,
 } gfusx_exception_kind;
 
+typedef enum gfusx_cpu_engine {
+    GFUSX_ENGINE_DEFAULT,
+    // Fetches and decodes every instruction from memory right before executing it.
+    GFUSX_ENGINE_INTERPRETER,
+    // Executes pre-decoded instructions, decoding a guest page at a time on first use.
+    GFUSX_ENGINE_CACHED_INTERPRETER,
+    // Executes pre-decoded instructions with threaded (computed goto) dispatch where
+    // the compiler supports it, or a single switch over the decoded op otherwise.
+    GFUSX_ENGINE_THREADED_INTERPRETER,
+    // Translates guest blocks to native code. Falls back to the threaded
+    // interpreter on hosts without a recompiler backend.
+    GFUSX_ENGINE_RECOMPILER,
+    // Runs the blocks gfusx-aot compiled ahead of time into
+    // `gfusx_settings.cpu.aot_program`, and interprets all other code.
+    GFUSX_ENGINE_PRECOMPILED,
+} gfusx_cpu_engine;
+
+typedef struct gfusx_vm gfusx_vm;
+typedef struct gfusx_aot_program gfusx_aot_program;
+
+/// Called after every retired instruction while set. Tracing makes the
+/// recompiler engine interpret instead, so keep it off for throughput runs.
+typedef void (*gfusx_trace_hook)(gfusx_vm* vm, void* user_data);
+
+typedef enum gfusx_log_class {
+    GFUSX_LC_CPU,
+    GFUSX_LC_MEMORY,
+    GFUSX_LC_LOADER,
+    GFUSX_LC_INPUT,
+} gfusx_log_class;
+
 typedef struct gfusx_settings {
+    struct {
+        gfusx_cpu_engine engine;
+        // Run GTE commands through the scalar reference kernels rather than the
+        // SIMD ones the host supports, to check one against the other.
+        bool gte_reference;
+        // Interpret idle loops and WAIT cycle by cycle rather than skipping
+        // ahead to the next event. Skipping gives the same results, this is
+        // for checking that it does.
+        bool no_idle_skip;
+        // the program run by GFUSX_ENGINE_PRECOMPILED, see gfusx_aot_generate
+        const gfusx_aot_program* aot_program;
+    } cpu;
+    struct {
+        // Have the batch runner attach every library routine it finds in the
+        // symbol table of a program, see gfusx_vm_hle_attach_symbols.
+        bool enabled;
+        // cycles charged for a call and for every byte it touches, 0 for
+        // GFUSX_HLE_DEFAULT_CALL_CYCLES and GFUSX_HLE_DEFAULT_BYTE_CYCLES
+        u32 call_cycles;
+        u32 byte_cycles;
+    } hle;
+    struct {
+        // Reserve the whole guest address space on the host so loads and stores
+        // need no page table lookup. Only available on 64-bit Linux hosts,
+        // anywhere else the page tables are used as usual.
+        bool fastmem;
+    } memory;
     struct {
         bool debug;
+        gfusx_trace_hook trace;
+        void* trace_user_data;
     } debug;
+    struct {
+        // bit n turns log class n off
+        u32 disabled_classes;
+        // messages let through per call site every GFUSX_LOG_RATE_WINDOW cycles,
+        // 0 for GFUSX_LOG_DEFAULT_RATE_LIMIT
+        u32 rate_limit;
+    } log;
 } gfusx_settings;
 
-typedef enum gfusx_log_class {
-    GFUSX_LC_CPU,
-} gfusx_log_class;
+typedef enum gfusx_stop_reason {
+    GFUSX_STOP_NONE,
+    // The cycle budget given to gfusx_vm_run ran out.
+    GFUSX_STOP_BUDGET,
+    // The guest executed SYSCALL; its exit status was taken from $a0.
+    GFUSX_STOP_EXIT,
+    // The guest executed BREAK.
+    GFUSX_STOP_BREAK,
+    // An input replay no longer matches what the guest is doing.
+    GFUSX_STOP_DESYNC,
+    // Execution reached a breakpoint, whose address is the stop code. The
+    // instruction there has not run yet.
+    GFUSX_STOP_BREAKPOINT,
+    // The guest accessed watched memory, at the address in the stop code. The
+    // instruction that did has run.
+    GFUSX_STOP_WATCHPOINT,
+    // A halfword or word load or store was off its natural alignment, at the
+    // address in the stop code, which is also in the BadVaddr register. The
+    // instruction has not run, and running on from there raises it again.
+    GFUSX_STOP_ADDRESS_ERROR,
+    // The engine under a lockstep check no longer matches its reference, see
+    // gfusx_lockstep_run. Only ever set on jobs, never by gfusx_vm_run.
+    GFUSX_STOP_DIVERGED,
+} gfusx_stop_reason;
 
+
+// NOTE(local): Recompiled code accesses the delayed load and delay slot state
+// directly, so none of it can live in bitfields.
 typedef struct gfusx_delayed_load_info {
     u32 index, value, mask, pc_value;
-    bool active : 1;
-    bool pc_active : 1;
-    bool from_link : 1;
+    bool active;
+    bool pc_active;
+    bool from_link;
 } gfusx_delayed_load_info;
 
-typedef struct gfusx_vm {
+typedef struct gfusx_decoded_page gfusx_decoded_page;
+typedef struct gfusx_gte_kernels gfusx_gte_kernels;
+typedef struct gfusx_jit gfusx_jit;
+typedef struct gfusx_aot gfusx_aot;
+typedef struct gfusx_log gfusx_log;
+
+typedef u64 gfusx_event_id;
+
+/// Called once `vm->cycle` has reached the cycle the event was scheduled for,
+/// which is passed in so periodic events can be rescheduled without drifting.
+typedef void (*gfusx_event_callback)(gfusx_vm* vm, void* user_data, u64 cycle);
+
+typedef struct gfusx_event {
+    u64 cycle;
+    gfusx_event_id id;
+    gfusx_event_callback callback;
+    void* user_data;
+} gfusx_event;
+
+/// A binary min-heap ordered by cycle, then by id so events scheduled for the
+/// same cycle run in the order they were scheduled.
+typedef struct gfusx_events {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_event);
+} gfusx_events;
+typedef struct gfusx_input_log gfusx_input_log;
+typedef struct gfusx_call_stack gfusx_call_stack;
+
+/// Handlers for a memory mapped I/O range. `size` is the access width in bytes.
+typedef u32 (*gfusx_mmio_read)(gfusx_vm* vm, void* user_data, u32 addr, u32 size);
+typedef void (*gfusx_mmio_write)(gfusx_vm* vm, void* user_data, u32 addr, u32 value, u32 size);
+
+typedef struct gfusx_mmio_region {
+    u32 base, size;
+    gfusx_mmio_read read;
+    gfusx_mmio_write write;
+    void* user_data;
+} gfusx_mmio_region;
+
+typedef struct gfusx_mmio_regions {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_mmio_region);
+} gfusx_mmio_regions;
+
+/// Library routines that can run natively on the host instead of being
+/// interpreted, with the symbol name they are attached by.
+#define GFUSX_HLE_FUNCTIONS(X) \
+    X(MEMCPY, "memcpy") \
+    X(MEMSET, "memset") \
+    X(STRLEN, "strlen") \
+    X(INIT_HEAP, "InitHeap") \
+    X(MALLOC, "malloc") \
+    X(FREE, "free")
+
+typedef enum gfusx_hle_function {
+#define X(Id, Name) GFUSX_HLE_##Id,
+    GFUSX_HLE_FUNCTIONS(X)
+#undef X
+    GFUSX_HLE_FUNCTION_COUNT,
+} gfusx_hle_function;
+
+#define GFUSX_HLE_DEFAULT_CALL_CYCLES 24
+#define GFUSX_HLE_DEFAULT_BYTE_CYCLES 1
+
+typedef struct gfusx_hle_entry {
+    u32 address;
+    gfusx_hle_function function;
+} gfusx_hle_entry;
+
+/// Sorted by address.
+typedef struct gfusx_hle_entries {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_hle_entry);
+} gfusx_hle_entries;
+
+typedef struct gfusx_hle_block {
+    u32 address, size;
+    bool used;
+} gfusx_hle_block;
+
+/// The blocks of the memory handed to InitHeap, sorted by address. The heap
+/// keeps its bookkeeping on the host, the guest memory only holds the data.
+typedef struct gfusx_hle_heap {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_hle_block);
+} gfusx_hle_heap;
+
+/// Sorted.
+typedef struct gfusx_breakpoints {
+    KOS_DYNAMIC_ARRAY_FIELDS(u32);
+} gfusx_breakpoints;
+
+typedef enum gfusx_watch_kind {
+    GFUSX_WATCH_READ = 1 << 0,
+    GFUSX_WATCH_WRITE = 1 << 1,
+    GFUSX_WATCH_ACCESS = GFUSX_WATCH_READ | GFUSX_WATCH_WRITE,
+} gfusx_watch_kind;
+
+typedef struct gfusx_watchpoint {
+    u32 address, size;
+    gfusx_watch_kind kind;
+} gfusx_watchpoint;
+
+typedef struct gfusx_watchpoints {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_watchpoint);
+} gfusx_watchpoints;
+
+// Every user of `gfusx_vm.dirty_pages` owns a bit, which it clears once it has
+// caught up with the page. Stores set all of them.
+#define GFUSX_DIRTY_SAVESTATE (1u << 0)
+#define GFUSX_DIRTY_REWIND (1u << 1)
+#define GFUSX_DIRTY_LOCKSTEP (1u << 2)
+#define GFUSX_DIRTY_ALL 0xFFu
+
+struct gfusx_vm {
     gfusx_mips_gpregs gpr;
     gfusx_cop0_regs cop0;
-    //gfusx_cop2_data_regs cop2d;
-    //gfusx_cop2_data_ctrl cop2c;
+    gfusx_cop2_data_regs cop2d;
+    gfusx_cop2_data_ctrl cop2c;
     u32 pc; // program counter
     u32 code; // current instruction
     u64 cycle;
     u64 previous_cycles;
-    // TODO(local): etc...
-    u8 icache_addr[0x1000];
-    u8 icache_code[0x1000];
+    // The address each instruction cache word was last filled from, or
+    // GFUSX_ICACHE_INVALID. Only the tags are kept, fetches still go through the
+    // pre-decoded code, so a hit is a single compare.
+    u32 icache_tags[GFUSX_ICACHE_WORD_COUNT];
+
+    u8* ram; // GFU_MEM_SIZE_MAIN_RAM bytes at GFU_MEM_OFFSET_MAIN_RAM
+    u8* rom; // GFU_MEM_SIZE_ROM bytes at GFU_MEM_OFFSET_ROM
+    // Host pointer to every guest page, GFUSX_ADDRESS_PAGE_COUNT entries each.
+    // A NULL entry sends the access down the slow path: MMIO, unmapped memory,
+    // ROM writes, and writes to RAM pages that hold pre-decoded code.
+    u8** read_pages;
+    u8** write_pages;
+    gfusx_mmio_regions mmio_regions;
+    // the 4 GiB fastmem reservation, if in use, and the one guest accesses go
+    // through, which is NULL while a faulting access is replayed
+    u8* fastmem_view;
+    u8* fastmem;
+    // GFUSX_DIRTY_* bits for every RAM and ROM page; a byte per page so the
+    // store fast paths need no read-modify-write
+    u8 dirty_pages[GFUSX_CODE_PAGE_COUNT];
+
+    // pre-decoded instructions, one entry per guest page, allocated on first execution
+    gfusx_decoded_page* decoded_pages[GFUSX_CODE_PAGE_COUNT];
+    // invalidated pages that running code may still point into, freed once the engine is left
+    gfusx_decoded_page* retired_decoded_pages;
 
     gfusx_delayed_load_info delayed_load_info[2];
-    u32 current_delayed_load : 1;
-    bool next_is_delay_slot : 1;
-    bool in_delay_slot : 1;
+    u32 current_delayed_load;
+    bool next_is_delay_slot;
+    bool in_delay_slot;
+
+    // the GTE kernels picked for this host at power on
+    const gfusx_gte_kernels* gte;
+
+    // routines serviced on the host, see gfusx_vm_hle_attach
+    gfusx_hle_entries hle_entries;
+    // saved and restored along with the CPU state, see gfusx_vm_save_state
+    gfusx_hle_heap hle_heap;
+
+    // see gfusx_vm_add_breakpoint
+    gfusx_breakpoints breakpoints;
+    // the breakpoint execution stopped at last and the cycle it stopped on, so
+    // running on from there executes the instruction instead of stopping again
+    u32 breakpoint_pc;
+    u64 breakpoint_cycle;
+    // see gfusx_vm_add_watchpoint
+    gfusx_watchpoints watchpoints;
+    // the GFUSX_WATCH_* kinds watched anywhere on each RAM and ROM page
+    u8 watched_pages[GFUSX_CODE_PAGE_COUNT];
+
+    // recompiler state, only present while the recompiler engine is in use
+    gfusx_jit* jit;
+    // lookup of the precompiled blocks, only present while that engine is in use
+    gfusx_aot* aot;
+
+    // bit n is set while log class n is enabled
+    u32 log_mask;
+    gfusx_log* log;
+
+    // saved and restored along with the CPU state, see gfusx_vm_save_state
+    gfusx_events events;
+    gfusx_event_id next_event_id;
+
+    // where nondeterministic inputs are recorded to or replayed from, if anywhere;
+    // set by the host after power on
+    gfusx_input_log* input;
+    // the shadow call stack, while call graph profiling is on
+    gfusx_call_stack* call_stack;
+
+    // execution leaves the engine once `cycle` reaches this
+    u64 cycle_target;
+    // also leave once a branch delay slot has run, see gfusx_vm_step
+    bool single_step;
+    // the idle loop branch taken last and the cycle it was taken at, so an
+    // iteration is measured before any are skipped, see gfusx_vm_idle_loop
+    u32 idle_loop_pc;
+    u64 idle_loop_cycle;
+    gfusx_stop_reason stop_reason;
+    // exit status for GFUSX_STOP_EXIT, the code field for GFUSX_STOP_BREAK, an
+    // address for the breakpoint, watchpoint and address error stops
+    u32 stop_code;
 
     gfusx_settings settings;
-} gfusx_vm;
+};
 
 void gfusx_vm_power_on(gfusx_vm* vm);
 void gfusx_vm_power_off(gfusx_vm* vm);
 void gfusx_vm_dump_regs(gfusx_vm* vm, FILE* stream);
+/// Executes instructions until a branch delay slot has run, or until the guest
+/// exits or breaks.
 void gfusx_vm_step(gfusx_vm* vm);
-void gfusx_vm_logf(gfusx_vm* vm, gfusx_log_class log_class, const char* format, ...);
+/// Executes instructions until `cycle_budget` cycles have passed or the guest
+/// exits or breaks, and returns which one happened. Scheduled events run in
+/// between, as their cycle comes up. The budget and event deadlines are checked
+/// per instruction by the interpreters and per block by the recompiler, so the
+/// VM may run a few cycles past them.
+gfusx_stop_reason gfusx_vm_run(gfusx_vm* vm, u64 cycle_budget);
+/// Must be called whenever guest code memory is changed from outside of the VM
+/// without going through gfusx_vm_write_bytes, so stale pre-decoded instructions
+/// are thrown away.
+void gfusx_vm_invalidate_code(gfusx_vm* vm, u32 addr, u32 size);
+const char* gfusx_stop_reason_name(gfusx_stop_reason reason);
+
+/// ======================================================================== ///
+/// Logging.                                                                 ///
+/// ======================================================================== ///
+
+#define GFUSX_LOG_RATE_WINDOW (1ull << 25)
+#define GFUSX_LOG_DEFAULT_RATE_LIMIT 16
+
+static inline bool gfusx_vm_log_enabled(const gfusx_vm* vm, gfusx_log_class log_class) {
+    return (vm->log_mask >> log_class) & 1;
+}
+
+/// Queues a message on the VM's log, which a background thread formats and
+/// writes to stderr. Use gfusx_vm_logf instead, which skips the call entirely
+/// while the class is disabled. The format is only read once the message is
+/// printed, so it has to be a string literal; `%s` arguments are copied. When
+/// the queue is full, or a call site logs more than the rate limit allows,
+/// messages are dropped and counted instead.
+void gfusx_vm_log_push(gfusx_vm* vm, gfusx_log_class log_class, const char* format, ...);
+
+/// The arguments are not evaluated while `LogClass` is disabled.
+#define gfusx_vm_logf(Vm, LogClass, ...) \
+    do { \
+        gfusx_vm* gfusx_logf_vm_ = (Vm); \
+        if (gfusx_vm_log_enabled(gfusx_logf_vm_, (LogClass))) gfusx_vm_log_push(gfusx_logf_vm_, (LogClass), __VA_ARGS__); \
+    } while (0)
+
+/// ======================================================================== ///
+/// Memory.                                                                  ///
+/// ======================================================================== ///
+
+/// Maps `size` bytes at `base` to the given handlers. Both must be page aligned
+/// and must not overlap RAM or ROM. Has to be called after power on.
+/// Guest loops that do nothing but poll a register are skipped ahead to the
+/// next scheduled event, so what `read` returns should only change from events
+/// and writes. Schedule an event for anything else the guest may be waiting on.
+bool gfusx_vm_map_mmio(gfusx_vm* vm, u32 base, u32 size, gfusx_mmio_read read, gfusx_mmio_write write, void* user_data);
+/// Copies host data into RAM or ROM, ignoring ROM write protection. Returns false
+/// if the range is not fully backed by either.
+bool gfusx_vm_write_bytes(gfusx_vm* vm, u32 addr, const void* data, usize size);
+
+// Host side accesses. These take any address, and do misaligned ones a byte at a time.
+u8 gfusx_vm_read8(gfusx_vm* vm, u32 addr);
+u16 gfusx_vm_read16(gfusx_vm* vm, u32 addr);
+u32 gfusx_vm_read32(gfusx_vm* vm, u32 addr);
+void gfusx_vm_write8(gfusx_vm* vm, u32 addr, u8 value);
+void gfusx_vm_write16(gfusx_vm* vm, u32 addr, u16 value);
+void gfusx_vm_write32(gfusx_vm* vm, u32 addr, u32 value);
+
+/// ======================================================================== ///
+/// Scheduling.                                                              ///
+/// ======================================================================== ///
+
+/// Schedules `callback` to run once the VM reaches the absolute `cycle`. Can be
+/// called from device handlers while the VM is running. Events for a cycle that
+/// has already passed run as soon as the engine is left.
+gfusx_event_id gfusx_vm_schedule(gfusx_vm* vm, u64 cycle, gfusx_event_callback callback, void* user_data);
+/// Returns false if the event has already run or was never scheduled.
+bool gfusx_vm_cancel_event(gfusx_vm* vm, gfusx_event_id id);
+
+/// ======================================================================== ///
+/// Savestates.                                                              ///
+/// ======================================================================== ///
+
+/// Everything a savestate keeps besides guest memory.
+typedef struct gfusx_cpu_state {
+    gfusx_mips_gpregs gpr;
+    gfusx_cop0_regs cop0;
+    gfusx_cop2_data_regs cop2d;
+    gfusx_cop2_data_ctrl cop2c;
+    u32 pc;
+    u32 code;
+    u64 cycle;
+    u64 previous_cycles;
+    u32 icache_tags[GFUSX_ICACHE_WORD_COUNT];
+    gfusx_delayed_load_info delayed_load_info[2];
+    u32 current_delayed_load;
+    bool next_is_delay_slot;
+    bool in_delay_slot;
+} gfusx_cpu_state;
+
+/// The contents of one RAM or ROM page as of the snapshot that saved it.
+typedef struct gfusx_savestate_page {
+    u32 snapshot;
+    u8* data;
+} gfusx_savestate_page;
+
+typedef struct gfusx_savestate_pages {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_savestate_page);
+} gfusx_savestate_pages;
+
+typedef struct gfusx_page_indices {
+    KOS_DYNAMIC_ARRAY_FIELDS(u32);
+} gfusx_page_indices;
+
+typedef struct gfusx_snapshot {
+    gfusx_cpu_state cpu;
+    // the events pending at the time, in heap order
+    gfusx_events events;
+    gfusx_event_id next_event_id;
+    // the blocks of the HLE heap at the time
+    gfusx_hle_heap hle_heap;
+    // the pages this snapshot saved, every one of them for the first
+    gfusx_page_indices pages;
+} gfusx_snapshot;
+
+typedef struct gfusx_snapshots {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_snapshot);
+} gfusx_snapshots;
+
+/// A chain of snapshots of a single VM. The first one saves all of RAM and ROM,
+/// every later one only the pages written since the previous save or load.
+/// Zero initialize it before the first save.
+typedef struct gfusx_savestates {
+    gfusx_snapshots snapshots;
+    // every saved version of each page, in snapshot order
+    gfusx_savestate_pages pages[GFUSX_CODE_PAGE_COUNT];
+    // the snapshot guest memory matched at the last save or load, apart from
+    // the pages marked GFUSX_DIRTY_SAVESTATE since
+    isize current;
+} gfusx_savestates;
+
+/// Saves the CPU state, pending events, HLE heap and guest memory and returns
+/// the index of the new snapshot. Must not be called from inside the engine,
+/// e.g. from an MMIO handler. Events keep their callbacks and user data, so
+/// whatever they point to has to outlive the snapshot.
+isize gfusx_vm_save_state(gfusx_vm* vm, gfusx_savestates* states);
+/// Restores any earlier snapshot, only copying back the pages that differ from
+/// it. Later snapshots are kept and can still be loaded. Returns false if there
+/// is no such snapshot.
+bool gfusx_vm_load_state(gfusx_vm* vm, gfusx_savestates* states, isize snapshot);
+void gfusx_savestates_free(gfusx_savestates* states);
+
+/// ======================================================================== ///
+/// Rewind.                                                                  ///
+/// ======================================================================== ///
+
+/// A bounded history of frames for stepping backwards. Every frame holds the
+/// CPU state, the pending events, the HLE heap and, for each page written since
+/// the frame before it, the XOR of its old and new contents with runs of
+/// unchanged words left out. The frames live in a ring buffer of a fixed size,
+/// and the oldest ones are dropped to make room for new ones.
+typedef struct gfusx_rewind {
+    u8* buffer;
+    usize capacity;
+    // the start of the oldest frame and the end of the newest one
+    usize tail;
+    usize head;
+    usize used;
+    isize frame_count;
+    // RAM and ROM as of the newest frame, GFUSX_CODE_SIZE bytes outside of the budget
+    u8* shadow;
+    // a single frame is encoded and decoded here
+    u8* scratch;
+    usize scratch_capacity;
+} gfusx_rewind;
+
+/// Allocates a rewind buffer of `budget` bytes for a powered on VM, starting
+/// from its current memory.
+bool gfusx_rewind_init(gfusx_rewind* rewind, gfusx_vm* vm, usize budget);
+void gfusx_rewind_free(gfusx_rewind* rewind);
+/// Records a frame. Only the pages written since the previous one are looked at.
+void gfusx_rewind_push(gfusx_vm* vm, gfusx_rewind* rewind);
+/// Steps back `frames` frames, or as far as the buffer goes, and drops the frames
+/// stepped over. Returns how many frames were stepped back.
+isize gfusx_rewind_seek(gfusx_vm* vm, gfusx_rewind* rewind, isize frames);
+
+/// ======================================================================== ///
+/// Input Recording.                                                         ///
+/// ======================================================================== ///
+
+typedef enum gfusx_input_kind {
+    // A read from an input port. MMIO reads are recorded as these, with the
+    // address as the source.
+    GFUSX_INPUT_PORT,
+    // A read of a host clock.
+    GFUSX_INPUT_TIMER,
+    // Anything else a device picks up from the host.
+    GFUSX_INPUT_EVENT,
+} gfusx_input_kind;
+
+typedef enum gfusx_input_mode {
+    GFUSX_INPUT_RECORD,
+    GFUSX_INPUT_REPLAY,
+} gfusx_input_mode;
+
+typedef struct gfusx_input_data {
+    KOS_DYNAMIC_ARRAY_FIELDS(u8);
+} gfusx_input_data;
+
+/// Every nondeterministic input the VM saw, in order. Each one is stored as
+/// the cycles since the previous one, its kind, its source and its value, with
+/// the numbers as LEB128 varints.
+struct gfusx_input_log {
+    gfusx_input_mode mode;
+    gfusx_input_data data;
+    // where the next input is read from while replaying
+    isize position;
+    // the cycle of the previous input
+    u64 last_cycle;
+    // set once a replay has stopped the VM, from then on inputs pass through
+    bool desynced;
+};
+
+/// Routes an input through the VM's input log. While recording, `value` is
+/// logged and returned. While replaying, the logged value is returned instead,
+/// and the VM stops with GFUSX_STOP_DESYNC if the guest reads a different input
+/// than it did while recording. Devices have to call this for every value they
+/// take from the host.
+u32 gfusx_vm_input(gfusx_vm* vm, gfusx_input_kind kind, u32 source, u32 value);
+/// Looks at the next input to replay without taking it, so the host can deliver
+/// events at the cycle they were recorded at. Returns false if there is none.
+bool gfusx_vm_input_peek(gfusx_vm* vm, u64* cycle, gfusx_input_kind* kind, u32* source);
+/// Reads a recorded log from a file, ready for replay.
+bool gfusx_input_log_load(gfusx_input_log* log, const char* file_path);
+bool gfusx_input_log_save(const gfusx_input_log* log, const char* file_path);
+void gfusx_input_log_free(gfusx_input_log* log);
+
+/// ======================================================================== ///
+/// Tracing.                                                                 ///
+/// ======================================================================== ///
+
+typedef struct gfusx_trace_writer gfusx_trace_writer;
+typedef struct gfusx_trace_reader gfusx_trace_reader;
+
+/// Starts writing every retired instruction to a binary trace file, through the
+/// VM's trace hook. Any hook that was already set keeps getting called. The file
+/// is written by a background thread. Returns NULL if it cannot be created.
+gfusx_trace_writer* gfusx_trace_begin(gfusx_vm* vm, const char* file_path);
+/// Writes out the rest of the trace and puts the previous trace hook back.
+/// Returns false if anything could not be written.
+bool gfusx_trace_end(gfusx_vm* vm, gfusx_trace_writer* writer);
+
+/// One retired instruction, read back from a trace.
+typedef struct gfusx_trace_entry {
+    u32 pc;
+    u32 code;
+    // bit n is set if register n changed, with hi and lo as 32 and 33
+    u64 changed;
+    // every register once the instruction retired
+    gfusx_mips_gpregs gpr;
+} gfusx_trace_entry;
+
+/// Returns NULL if the file cannot be read or is not a trace.
+gfusx_trace_reader* gfusx_trace_open(const char* file_path);
+/// Returns false at the end of the trace, or if the rest of it is malformed.
+bool gfusx_trace_next(gfusx_trace_reader* reader, gfusx_trace_entry* entry);
+void gfusx_trace_close(gfusx_trace_reader* reader);
+
+/// ======================================================================== ///
+/// Profiling.                                                               ///
+/// ======================================================================== ///
+
+/// A function from an ELF symbol table.
+typedef struct gfusx_symbol {
+    u32 address;
+    // 0 if the symbol table does not say
+    u32 size;
+    // an offset into the table's names
+    u32 name;
+} gfusx_symbol;
+
+/// The functions of a program, sorted by address.
+typedef struct gfusx_symbols {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_symbol);
+    char* names;
+} gfusx_symbols;
+
+/// Reads the function symbols out of the `.symtab` of an ELF file. Symbols of
+/// relocatable objects are placed where their sections are loaded.
+bool gfusx_symbols_load(gfusx_symbols* symbols, const char* file_path);
+void gfusx_symbols_free(gfusx_symbols* symbols);
+/// Returns the function containing `address`, or NULL. A symbol without a size
+/// is taken to run up to the next one.
+const gfusx_symbol* gfusx_symbols_find(const gfusx_symbols* symbols, u32 address);
+static inline const char* gfusx_symbol_name(const gfusx_symbols* symbols, const gfusx_symbol* symbol) {
+    return symbols->names + symbol->name;
+}
+
+typedef struct gfusx_profile_bucket {
+    u32 pc;
+    u64 count;
+} gfusx_profile_bucket;
+
+/// A histogram of the pc, sampled every `interval` cycles through a scheduled
+/// event. A VM without a profiler pays nothing for it.
+typedef struct gfusx_profiler {
+    u64 interval;
+    u64 sample_count;
+    // open addressing on the pc, where a count of 0 marks an empty bucket
+    gfusx_profile_bucket* buckets;
+    isize capacity;
+    isize used;
+    gfusx_event_id event;
+} gfusx_profiler;
+
+/// Starts sampling the pc every `interval` cycles. Samples are only taken at
+/// the points where the engine hands control back to the scheduler, which for
+/// the recompiler are block boundaries.
+void gfusx_profiler_begin(gfusx_vm* vm, gfusx_profiler* profiler, u64 interval);
+/// Stops sampling. The histogram is kept until the profiler is freed.
+void gfusx_profiler_end(gfusx_vm* vm, gfusx_profiler* profiler);
+void gfusx_profiler_free(gfusx_profiler* profiler);
+/// Prints the samples per function, hottest first. `symbols` may be NULL, in
+/// which case every address is its own entry.
+void gfusx_profiler_print(FILE* stream, const gfusx_profiler* profiler, const gfusx_symbols* symbols);
+/// Writes the samples in the collapsed stack format read by flamegraph tools,
+/// one `function count` line per function.
+bool gfusx_profiler_write_collapsed(const gfusx_profiler* profiler, const gfusx_symbols* symbols, const char* file_path);
+
+/// One distinct path through the call graph: a function, called from the path
+/// of its parent node.
+typedef struct gfusx_call_node {
+    u32 function;
+    // -1 for the root
+    i32 parent;
+    u64 calls;
+    // cycles spent in the function itself, and in it and everything it called
+    u64 self_cycles;
+    u64 total_cycles;
+} gfusx_call_node;
+
+typedef struct gfusx_call_nodes {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_call_node);
+} gfusx_call_nodes;
+
+typedef struct gfusx_call_frame {
+    i32 node;
+    u32 return_addr;
+    // the stack pointer at the call, which the function gives back when it returns
+    u32 sp;
+    u64 enter_cycle;
+    u64 child_cycles;
+    // the last function called from this frame and its node, which is usually
+    // the next one too
+    u32 last_callee;
+    i32 last_callee_node;
+} gfusx_call_frame;
+
+/// A shadow of the guest's call stack, built from JAL and from writes to $sp,
+/// with the cycles spent on every path through the call graph. A frame is
+/// pushed on every JAL. It is popped once $sp is raised back to where it was at
+/// the call, once execution jumps to its return address, or once another call
+/// is made with $sp at or above it, which only happens after a leaf returned.
+struct gfusx_call_stack {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_call_frame);
+    gfusx_call_nodes nodes;
+    // open addressing from (parent, function) to a node index, -1 when empty
+    i32* node_table;
+    isize node_table_capacity;
+};
+
+/// Starts tracking calls, with the code at the pc as the root of the graph.
+void gfusx_call_stack_begin(gfusx_vm* vm, gfusx_call_stack* call_stack);
+/// Stops tracking calls. Every frame still open is closed at the current cycle.
+void gfusx_call_stack_end(gfusx_vm* vm, gfusx_call_stack* call_stack);
+void gfusx_call_stack_free(gfusx_call_stack* call_stack);
+/// Prints the calls and the inclusive and exclusive cycles of every function,
+/// by inclusive cycles. Recursive calls are only counted once towards the
+/// inclusive cycles. `symbols` may be NULL.
+void gfusx_call_stack_print(FILE* stream, const gfusx_call_stack* call_stack, const gfusx_symbols* symbols);
+/// Writes the exclusive cycles of every path through the call graph in the
+/// collapsed stack format read by flamegraph tools.
+bool gfusx_call_stack_write_collapsed(const gfusx_call_stack* call_stack, const gfusx_symbols* symbols, const char* file_path);
+
+/// ======================================================================== ///
+/// Program Loading.                                                         ///
+/// ======================================================================== ///
+
+/// Loads the loadable segments of a GameFU ELF file into guest memory and sets
+/// the pc to its entry point. Relocatable objects without program headers have
+/// their allocated sections loaded at their addresses instead. The whole host
+/// pages of each segment are mapped from the file copy-on-write, and only the
+/// partial pages at either end are copied. Segments are copied outright if the
+/// host can't map files, with fastmem on, or if the segment's file offset and
+/// guest address don't line up on a host page. The VM has to be powered on.
+/// Errors are logged through the VM.
+bool gfusx_vm_load_elf(gfusx_vm* vm, const char* file_path);
+
+/// ======================================================================== ///
+/// High Level Emulation.                                                    ///
+/// ======================================================================== ///
+
+/// Runs `function` natively whenever execution reaches `address`, which has to
+/// be the first instruction of the guest's own version of it. The arguments are
+/// taken from $a0-$a3, the result goes to $v0, and execution returns to $ra
+/// right away, charging the cycles from `gfusx_settings.hle` instead of the
+/// ones the guest loop would have taken. Has to be called after power on.
+/// Returns false if `address` is not code memory.
+bool gfusx_vm_hle_attach(gfusx_vm* vm, u32 address, gfusx_hle_function function);
+/// Attaches every function in `symbols` named like one in GFUSX_HLE_FUNCTIONS
+/// and returns how many were.
+isize gfusx_vm_hle_attach_symbols(gfusx_vm* vm, const gfusx_symbols* symbols);
+const char* gfusx_hle_function_name(gfusx_hle_function function);
+
+/// ======================================================================== ///
+/// Debugging.                                                               ///
+/// ======================================================================== ///
+
+// Neither breakpoints nor watchpoints cost anything while none are set.
+// Breakpoints replace their instruction in the pre-decoded code, watchpoints
+// send the pages they are on down the slow path of the page tables.
+
+/// Stops execution with GFUSX_STOP_BREAKPOINT right before the instruction at
+/// `address` runs. Running on from there executes it rather than stopping
+/// again. Has to be called after power on. Returns false if `address` is not
+/// code memory.
+bool gfusx_vm_add_breakpoint(gfusx_vm* vm, u32 address);
+/// Returns false if there was no breakpoint at `address`.
+bool gfusx_vm_remove_breakpoint(gfusx_vm* vm, u32 address);
+/// Stops execution with GFUSX_STOP_WATCHPOINT after an instruction that made a
+/// `kind` access to any of the `size` bytes at `address`. This includes the
+/// accesses of HLE routines and of the gfusx_vm_read/write functions, but not
+/// instruction fetches. Has to be called after power on. Returns false for an
+/// empty range or one that wraps around.
+bool gfusx_vm_add_watchpoint(gfusx_vm* vm, u32 address, u32 size, gfusx_watch_kind kind);
+/// Removes a watchpoint added with the same arguments. Returns false if there
+/// was none.
+bool gfusx_vm_remove_watchpoint(gfusx_vm* vm, u32 address, u32 size, gfusx_watch_kind kind);
+
+/// Runs the SIMD GTE kernels of this host and the scalar reference ones on
+/// `iterations` random inputs generated from `seed`, and prints the first input
+/// they disagree on. Returns true if they always agreed, or if the host has no
+/// SIMD kernels to check.
+bool gfusx_gte_check_kernels(u64 seed, u64 iterations, FILE* stream);
+
+/// ======================================================================== ///
+/// Ahead-of-time Compilation.                                               ///
+/// ======================================================================== ///
+
+// gfusx-aot turns the code of a linked program into C, one function per basic
+// block, to be built with the host compiler and linked against this library.
+// A block is only entered at its first instruction, and only while the page it
+// is on still holds the code it was compiled from and has no HLE entry or
+// breakpoint on it. Everything else, like indirect jumps to addresses that were
+// not known to be targets, goes through the interpreter.
+
+/// Runs the block of precompiled code starting at the pc. Returns true if
+/// execution has to leave the engine.
+typedef bool (*gfusx_aot_function)(gfusx_vm* vm);
+
+typedef struct gfusx_aot_block {
+    u32 address;
+    gfusx_aot_function function;
+} gfusx_aot_block;
+
+/// The words a range of code held when it was compiled.
+typedef struct gfusx_aot_code {
+    u32 address;
+    u32 count;
+    const u32* words;
+} gfusx_aot_code;
+
+struct gfusx_aot_program {
+    // sorted by address
+    const gfusx_aot_block* blocks;
+    isize block_count;
+    const gfusx_aot_code* code;
+    isize code_count;
+};
+
+/// Writes C source defining `const gfusx_aot_program <name>` for the executable
+/// segments of a GameFU ELF file, or its executable sections if it has no
+/// program headers. Blocks start at the entry point, at function symbols and at
+/// every direct branch target. Errors are reported on stderr.
+bool gfusx_aot_generate(FILE* stream, const char* elf_path, const char* name);
+
+// The rest of this section is what generated code calls. Each instruction goes
+// through the same steps as in the interpreters, which these mirror.
+
+void gfusx_aot_icache_miss(gfusx_vm* vm, u32 pc);
+/// Runs the interpreter's handler for the instruction at `pc`.
+void gfusx_aot_execute(gfusx_vm* vm, u32 pc);
+/// The full per-instruction epilogue. Returns true once execution has to leave
+/// the engine.
+bool gfusx_aot_retire(gfusx_vm* vm);
+/// Returns true if a store threw away the precompiled code of the page of `pc`.
+bool gfusx_aot_code_dropped(gfusx_vm* vm, u32 pc);
+
+static inline void gfusx_aot_begin_inst(gfusx_vm* vm, u32 pc, u32 code) {
+    if (vm->icache_tags[(pc >> 2) & (GFUSX_ICACHE_WORD_COUNT - 1)] != pc) {
+        gfusx_aot_icache_miss(vm, pc);
+    }
+
+    vm->code = code;
+    vm->pc = pc + 4;
+    vm->cycle += GFUSX_CYCLE_BIAS;
+}
+
+/// Only needed for the instructions that can be in a branch delay slot.
+static inline void gfusx_aot_begin_delay_slot(gfusx_vm* vm) {
+    if (vm->next_is_delay_slot) {
+        vm->in_delay_slot = true;
+        vm->next_is_delay_slot = false;
+    }
+}
+
+/// The per-instruction epilogue when no load, branch or delay slot is pending.
+static inline void gfusx_aot_retire_fast(gfusx_vm* vm) {
+    vm->current_delayed_load ^= 1;
+}
+
+/// Drops a pending load into `reg`, which the current instruction overwrites.
+static inline void gfusx_aot_cancel_load(gfusx_vm* vm, u32 reg) {
+    gfusx_delayed_load_info* other = &vm->delayed_load_info[vm->current_delayed_load ^ 1];
+    if (other->index == reg) other->active = false;
+}
+
+static inline void gfusx_aot_branch(gfusx_vm* vm, u32 target) {
+    gfusx_delayed_load_info* delayed_load = &vm->delayed_load_info[vm->current_delayed_load];
+    vm->next_is_delay_slot = true;
+    delayed_load->pc_active = true;
+    delayed_load->pc_value = target;
+    delayed_load->from_link = false;
+}
+
+/// ======================================================================== ///
+/// Lockstep Checking.                                                       ///
+/// ======================================================================== ///
+
+// Two VMs running the same program on different engines are advanced about a
+// block of the candidate at a time, and whichever is behind then runs until
+// both are at the same cycle. At that point the registers, pc, cycle, stop reason
+// and every page either of them wrote since the last check have to match.
+
+typedef enum gfusx_lockstep_mismatch {
+    GFUSX_LOCKSTEP_MATCH,
+    // The values are the gfusx_stop_reason of each VM.
+    GFUSX_LOCKSTEP_STOP,
+    GFUSX_LOCKSTEP_PC,
+    GFUSX_LOCKSTEP_CYCLE,
+    // The index is the register, with 32 and 33 for hi and lo.
+    GFUSX_LOCKSTEP_GPR,
+    // The index is the address of the first byte that differs.
+    GFUSX_LOCKSTEP_MEMORY,
+} gfusx_lockstep_mismatch;
+
+typedef struct gfusx_lockstep_report {
+    gfusx_lockstep_mismatch mismatch;
+    // comparisons made, the failed one included
+    u64 checks;
+    // the last point both VMs matched at
+    u32 good_pc;
+    u64 good_cycle;
+    // the state of the reference at the first mismatch
+    u32 pc;
+    u64 cycle;
+    u32 index;
+    u64 reference_value;
+    u64 candidate_value;
+} gfusx_lockstep_report;
+
+/// Runs two VMs that have been powered on and loaded the same way for
+/// `cycle_budget` cycles of the reference, or until both stop the same way.
+/// Returns false at the first mismatch, which `report` describes. Leaving the
+/// engine after every block keeps idle loops from being skipped, so both
+/// should run with `no_idle_skip` to compare like with like.
+bool gfusx_lockstep_run(gfusx_vm* reference, gfusx_vm* candidate, u64 cycle_budget, gfusx_lockstep_report* report);
+void gfusx_lockstep_print_report(FILE* stream, const gfusx_lockstep_report* report);
+
+/// ======================================================================== ///
+/// Batch Execution.                                                         ///
+/// ======================================================================== ///
+
+/// One guest program to run headless. The inputs are set by the caller, the
+/// rest is filled in once the job has finished.
+typedef struct gfusx_job {
+    const char* elf_path;
+    u64 cycle_budget;
+    // an input log to replay, or to record to if `record_input` is set
+    const char* input_path;
+    bool record_input;
+    // where to write an execution trace, if anywhere
+    const char* trace_path;
+    // sample the pc every this many cycles, or not at all if 0
+    u64 profile_interval;
+    // where to write the profile as collapsed stacks, or NULL to print it to stderr
+    const char* profile_path;
+    // track calls through a shadow call stack
+    bool call_graph;
+    // where to write the call graph as collapsed stacks, or NULL to print it to stderr
+    const char* call_graph_path;
+    // run a second VM on this engine in lockstep with the first, and stop
+    // with GFUSX_STOP_DIVERGED as soon as they differ
+    bool lockstep;
+    gfusx_cpu_engine lockstep_reference;
+
+    bool loaded;
+    gfusx_stop_reason stop_reason;
+    // the stop code, which for GFUSX_STOP_EXIT is the guest's exit status
+    u32 exit_code;
+    u64 cycles;
+    // host time spent running the program, not counting loading it
+    double seconds;
+    u32 pc;
+    gfusx_mips_gpregs gpr;
+    // where the engines went apart, for GFUSX_STOP_DIVERGED
+    gfusx_lockstep_report lockstep_report;
+} gfusx_job;
+
+typedef struct gfusx_batch_options {
+    // used to power on every VM
+    gfusx_settings settings;
+    // worker threads to use, 0 for one per online core
+    int thread_count;
+    // pin worker n to core n, wrapping around; Linux only
+    bool pin_threads;
+} gfusx_batch_options;
+
+/// Runs every job on its own VM across a pool of worker threads and blocks until
+/// all of them are done. Workers take jobs from their own share first and steal
+/// from the others once it runs out.
+void gfusx_run_batch(gfusx_job* jobs, isize job_count, const gfusx_batch_options* options);
 
 #endif /* GFUSX_H_ */
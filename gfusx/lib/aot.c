@@ -0,0 +1,608 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <gamefu/elf.h>
+
+#include <string.h>
+
+/// Precompiled blocks are looked up through a table per code page, which is
+/// filled in the first time the page runs. Only blocks whose code still matches
+/// what the program was compiled from go in, so code the guest overwrote,
+/// patched for HLE or put breakpoints on is interpreted instead.
+
+// Keeps generated functions to a size host compilers still optimize quickly.
+#define GFUSX_AOT_MAX_BLOCK_INSTS 64
+
+typedef struct gfusx_aot_page {
+    gfusx_aot_function functions[GFUSX_PAGE_SIZE / 4];
+} gfusx_aot_page;
+
+struct gfusx_aot {
+    const gfusx_aot_program* program;
+    // NULL until the page first runs
+    gfusx_aot_page* pages[GFUSX_CODE_PAGE_COUNT];
+};
+
+/// A range of guest code to compile.
+typedef struct gfusx_aot_range {
+    u32 address;
+    u32 size;
+} gfusx_aot_range;
+
+typedef struct gfusx_aot_ranges {
+    KOS_DYNAMIC_ARRAY_FIELDS(gfusx_aot_range);
+} gfusx_aot_ranges;
+
+// What the generator knows about every word of code memory.
+typedef enum gfusx_aot_word_flags {
+    GFUSX_AOT_WORD_CODE = 1 << 0,
+    // something jumps or calls here, so a block has to start here
+    GFUSX_AOT_WORD_TARGET = 1 << 1,
+} gfusx_aot_word_flags;
+
+// shared by every page none of whose code can run precompiled
+static gfusx_aot_page gfusx_aot_empty_page;
+
+static const char* const gfusx_aot_op_names[GFUSX_OP_COUNT] = {
+#define X(Id, Name, Flags) [GFUSX_OP_##Id] = #Name,
+    GFUSX_OPS(X)
+#undef X
+};
+
+static gfusx_aot_page* gfusx_aot_build_page(gfusx_vm* vm, u32 page_index);
+static void gfusx_aot_find_stale_code(gfusx_vm* vm, u32 page_addr, bool* stale);
+static bool gfusx_aot_collect_ranges(const elf32_raw* elf, const char* elf_path, gfusx_aot_ranges* ranges);
+static void gfusx_aot_add_range(gfusx_aot_ranges* ranges, const char* elf_path, u32 address, u32 size);
+static int gfusx_aot_range_compare(const void* a, const void* b);
+static void gfusx_aot_mark_targets(gfusx_vm* vm, const gfusx_aot_ranges* ranges, const gfusx_symbols* symbols, u8* words);
+static void gfusx_aot_mark_target(u8* words, u32 address);
+static isize gfusx_aot_emit_blocks(FILE* stream, gfusx_vm* vm, const gfusx_aot_ranges* ranges, const u8* words, const char* name, bool prototypes);
+static u32 gfusx_aot_block_end(gfusx_vm* vm, const gfusx_aot_range* range, const u8* words, u32 start_pc);
+static void gfusx_aot_emit_block(FILE* stream, gfusx_vm* vm, u32 start_pc, u32 end_pc, const char* name);
+static void gfusx_aot_emit_op(FILE* stream, const gfusx_decoded_inst* inst, u32 pc);
+
+/// ======================================================================== ///
+/// Runtime.                                                                 ///
+/// ======================================================================== ///
+
+bool gfusx_aot_create(gfusx_vm* vm) {
+    if (vm->settings.cpu.aot_program == NULL) return false;
+
+    gfusx_aot* aot = calloc(1, sizeof *aot);
+    if (aot == NULL) return false;
+
+    aot->program = vm->settings.cpu.aot_program;
+    vm->aot = aot;
+    return true;
+}
+
+void gfusx_aot_destroy(gfusx_vm* vm) {
+    gfusx_aot* aot = vm->aot;
+    if (aot == NULL) return;
+
+    for (u32 i = 0; i < GFUSX_CODE_PAGE_COUNT; i++) {
+        gfusx_aot_invalidate_page(vm, i);
+    }
+
+    free(aot);
+    vm->aot = NULL;
+}
+
+void gfusx_aot_invalidate_page(gfusx_vm* vm, u32 page_index) {
+    gfusx_aot* aot = vm->aot;
+    if (aot == NULL || page_index >= GFUSX_CODE_PAGE_COUNT) return;
+
+    if (aot->pages[page_index] != &gfusx_aot_empty_page) free(aot->pages[page_index]);
+    aot->pages[page_index] = NULL;
+}
+
+void gfusx_aot_step(gfusx_vm* vm) {
+    gfusx_aot* aot = vm->aot;
+    for (;;) {
+        u32 pc = vm->pc;
+        u32 page_index = pc >> GFUSX_PAGE_SHIFT;
+
+        gfusx_aot_function function = NULL;
+        // precompiled code never calls the trace hook, and only stops after a
+        // watched access when fastmem faults on it
+        bool interpret = vm->settings.debug.trace != NULL || (vm->watchpoints.count != 0 && vm->fastmem == NULL);
+        if (!interpret && page_index < GFUSX_CODE_PAGE_COUNT && (pc & 3) == 0) {
+            gfusx_aot_page* page = aot->pages[page_index];
+            if (page == NULL) page = gfusx_aot_build_page(vm, page_index);
+            function = page->functions[(pc & GFUSX_PAGE_MASK) >> 2];
+        }
+
+        if (function == NULL) {
+            if (gfusx_vm_interpret_inst(vm)) return;
+            continue;
+        }
+
+        if (function(vm)) return;
+        // blocks only check the cycle target on their full retires
+        if (vm->cycle >= vm->cycle_target) return;
+    }
+}
+
+void gfusx_aot_icache_miss(gfusx_vm* vm, u32 pc) {
+    gfusx_vm_icache_miss(vm, pc);
+}
+
+void gfusx_aot_execute(gfusx_vm* vm, u32 pc) {
+    const gfusx_decoded_inst* inst = gfusx_vm_decoded_inst_at(vm, pc);
+    inst->handler(vm, inst);
+}
+
+bool gfusx_aot_retire(gfusx_vm* vm) {
+    return gfusx_vm_retire(vm);
+}
+
+bool gfusx_aot_code_dropped(gfusx_vm* vm, u32 pc) {
+    return vm->aot->pages[pc >> GFUSX_PAGE_SHIFT] == NULL;
+}
+
+static gfusx_aot_page* gfusx_aot_build_page(gfusx_vm* vm, u32 page_index) {
+    gfusx_aot* aot = vm->aot;
+    const gfusx_aot_program* program = aot->program;
+    u32 page_addr = page_index << GFUSX_PAGE_SHIFT;
+    u32 page_end = page_addr + GFUSX_PAGE_SIZE;
+
+    // the first block at or after the start of the page
+    isize low = 0, high = program->block_count;
+    while (low < high) {
+        isize middle = low + (high - low) / 2;
+        if (program->blocks[middle].address < page_addr) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    gfusx_aot_page* page = &gfusx_aot_empty_page;
+    if (low == program->block_count || program->blocks[low].address >= page_end) {
+        aot->pages[page_index] = page;
+        return page;
+    }
+
+    bool stale[GFUSX_PAGE_SIZE / 4];
+    gfusx_aot_find_stale_code(vm, page_addr, stale);
+
+    // blocks are laid out back to back, so each one ends at the latest where the next one starts
+    for (isize i = low; i < program->block_count && program->blocks[i].address < page_end; i++) {
+        u32 start = program->blocks[i].address & GFUSX_PAGE_MASK;
+        u32 end = i + 1 < program->block_count && program->blocks[i + 1].address < page_end ? program->blocks[i + 1].address & GFUSX_PAGE_MASK : GFUSX_PAGE_SIZE;
+
+        bool usable = true;
+        for (u32 offset = start; offset < end && usable; offset += 4) {
+            usable = !stale[offset >> 2];
+        }
+
+        if (!usable) continue;
+
+        if (page == &gfusx_aot_empty_page) {
+            page = calloc(1, sizeof *page);
+            kos_assert(page != NULL);
+        }
+
+        page->functions[start >> 2] = program->blocks[i].function;
+    }
+
+    aot->pages[page_index] = page;
+    return page;
+}
+
+/// Compares the decoded page against the code the program was compiled from.
+/// HLE entries and breakpoints replace their instruction in the decoded page
+/// only, which precompiled code would run right past, so they count as stale.
+static void gfusx_aot_find_stale_code(gfusx_vm* vm, u32 page_addr, bool* stale) {
+    const gfusx_aot_program* program = vm->aot->program;
+    u64 page_end = (u64)page_addr + GFUSX_PAGE_SIZE;
+
+    // no block covers anything the program has no code for
+    memset(stale, 0, GFUSX_PAGE_SIZE / 4 * sizeof *stale);
+
+    for (isize i = 0; i < program->code_count; i++) {
+        const gfusx_aot_code* code = &program->code[i];
+        u64 code_end = (u64)code->address + (u64)code->count * 4;
+        u64 start = code->address > page_addr ? code->address : page_addr;
+        u64 end = code_end < page_end ? code_end : page_end;
+
+        for (u64 addr = start; addr < end; addr += 4) {
+            const gfusx_decoded_inst* inst = gfusx_vm_decoded_inst_at(vm, (u32)addr);
+            bool patched = inst->op == GFUSX_OP_HLE || inst->op == GFUSX_OP_BREAKPOINT;
+            stale[(addr - page_addr) >> 2] = patched || inst->code != code->words[(addr - code->address) >> 2];
+        }
+    }
+}
+
+/// ======================================================================== ///
+/// Code Generation.                                                         ///
+/// ======================================================================== ///
+
+// Generated blocks follow the recompiler's: they end after the delay slot of
+// their first branch, after anything that can stop the VM and at the end of
+// their page, and leave once a store dropped the code they are running. On
+// top of that a block ends right before the next branch target, so every
+// known target starts a block of its own. Simple ALU operations and branches
+// are written out in C, everything else calls the interpreter's handler.
+
+bool gfusx_aot_generate(FILE* stream, const char* elf_path, const char* name) {
+    bool result = true;
+
+    gfusx_vm* vm = NULL;
+    u8* words = NULL;
+    gfusx_aot_ranges ranges = {0};
+    gfusx_symbols symbols = {0};
+
+    elf32_raw elf = elf32_read_raw_from_file(elf_path);
+    if (elf.error_message != nullptr) {
+        fprintf(stderr, "Error reading ELF file '%s': %s\n", elf_path, elf.error_message);
+        kos_return_defer(false);
+    }
+
+    if (!gfusx_aot_collect_ranges(&elf, elf_path, &ranges)) kos_return_defer(false);
+
+    // the code is decoded by a VM of its own, so the generator sees exactly
+    // what the interpreter would, idle loop hints included
+    vm = calloc(1, sizeof *vm);
+    kos_assert(vm != NULL);
+    vm->settings.cpu.engine = GFUSX_ENGINE_CACHED_INTERPRETER;
+    gfusx_vm_power_on(vm);
+    if (!gfusx_vm_load_elf(vm, elf_path)) kos_return_defer(false);
+
+    words = calloc(GFUSX_CODE_SIZE / 4, 1);
+    kos_assert(words != NULL);
+
+    // a program without a symbol table only has its entry point and branch targets
+    gfusx_symbols_load(&symbols, elf_path);
+    gfusx_aot_mark_target(words, vm->pc);
+    gfusx_aot_mark_targets(vm, &ranges, &symbols, words);
+
+    fprintf(stream, "// Generated by gfusx-aot from '%s', do not edit.\n", elf_path);
+    fprintf(stream, "// Build gfusx with it using `nob aot`, or link it against libgfusx and run\n");
+    fprintf(stream, "// with `gfusx_settings.cpu.engine` set to GFUSX_ENGINE_PRECOMPILED and\n");
+    fprintf(stream, "// `gfusx_settings.cpu.aot_program` to &%s.\n\n", name);
+    fprintf(stream, "#include <gamefu/gfusx.h>\n\n");
+
+    gfusx_aot_emit_blocks(stream, vm, &ranges, words, name, true);
+    fprintf(stream, "\n");
+
+    for (isize i = 0; i < ranges.count; i++) {
+        const gfusx_aot_range* range = &ranges.data[i];
+        fprintf(stream, "static const u32 %s_code_%08X[] = {", name, range->address);
+        for (u32 offset = 0; offset < range->size; offset += 4) {
+            if (offset % 32 == 0) fprintf(stream, "\n   ");
+            fprintf(stream, " 0x%08Xu,", gfusx_vm_decoded_inst_at(vm, range->address + offset)->code);
+        }
+
+        fprintf(stream, "\n};\n\n");
+    }
+
+    fprintf(stream, "static const gfusx_aot_code %s_code[] = {\n", name);
+    for (isize i = 0; i < ranges.count; i++) {
+        const gfusx_aot_range* range = &ranges.data[i];
+        fprintf(stream, "    { 0x%08Xu, %u, %s_code_%08X },\n", range->address, range->size / 4, name, range->address);
+    }
+
+    fprintf(stream, "};\n\n");
+
+    fprintf(stream, "static const gfusx_aot_block %s_blocks[] = {\n", name);
+    isize block_count = gfusx_aot_emit_blocks(stream, vm, &ranges, words, name, false);
+    fprintf(stream, "};\n\n");
+
+    fprintf(stream, "extern const gfusx_aot_program %s;\n", name);
+    fprintf(stream, "const gfusx_aot_program %s = {\n", name);
+    fprintf(stream, "    .blocks = %s_blocks,\n", name);
+    fprintf(stream, "    .block_count = %td,\n", block_count);
+    fprintf(stream, "    .code = %s_code,\n", name);
+    fprintf(stream, "    .code_count = %td,\n", ranges.count);
+    fprintf(stream, "};\n");
+
+    for (isize i = 0; i < ranges.count; i++) {
+        const gfusx_aot_range* range = &ranges.data[i];
+        for (u32 pc = range->address; pc - range->address < range->size;) {
+            u32 end_pc = gfusx_aot_block_end(vm, range, words, pc);
+            fprintf(stream, "\n");
+            gfusx_aot_emit_block(stream, vm, pc, end_pc, name);
+            pc = end_pc;
+        }
+    }
+
+    if (ferror(stream)) {
+        fprintf(stderr, "Error writing the code generated for '%s'.\n", elf_path);
+        kos_return_defer(false);
+    }
+
+defer:;
+    if (vm != NULL) {
+        gfusx_vm_power_off(vm);
+        free(vm);
+    }
+
+    free(words);
+    gfusx_symbols_free(&symbols);
+    kos_da_dealloc(&ranges);
+    elf32_raw_free(&elf);
+    return result;
+}
+
+/// Finds the code to compile: executable segments, or executable sections for
+/// relocatable objects, like the loader loads them. Returns them sorted and
+/// without overlaps.
+static bool gfusx_aot_collect_ranges(const elf32_raw* elf, const char* elf_path, gfusx_aot_ranges* ranges) {
+    if (elf->header.ph_count != 0) {
+        for (elf32_word i = 0; i < elf->header.ph_count; i++) {
+            const elf32_segment_header* segment = &elf->segments[i];
+            if (segment->type != ELF_SEG_LOAD || (segment->flags & ELF_SEGFLAG_X) == 0) continue;
+            gfusx_aot_add_range(ranges, elf_path, segment->virtual_address, segment->file_size);
+        }
+    } else {
+        for (elf32_word i = 0; i < elf->header.sh_count; i++) {
+            const elf32_section_header* section = &elf->sections[i];
+            if ((section->flags & ELF_SECTFLAG_EXECINSTR) == 0 || section->type == ELF_SECT_NOBITS) continue;
+            gfusx_aot_add_range(ranges, elf_path, section->virtual_address, section->size);
+        }
+    }
+
+    if (ranges->count == 0) {
+        fprintf(stderr, "ELF file '%s' has no executable code.\n", elf_path);
+        return false;
+    }
+
+    qsort(ranges->data, (usize)ranges->count, sizeof *ranges->data, gfusx_aot_range_compare);
+
+    isize kept = 0;
+    for (isize i = 0; i < ranges->count; i++) {
+        gfusx_aot_range range = ranges->data[i];
+        if (kept != 0) {
+            gfusx_aot_range* previous = &ranges->data[kept - 1];
+            u32 previous_end = previous->address + previous->size;
+            if (range.address + range.size <= previous_end) continue;
+
+            // overlapping and adjacent ranges become one
+            if (range.address <= previous_end) {
+                previous->size = range.address + range.size - previous->address;
+                continue;
+            }
+        }
+
+        ranges->data[kept++] = range;
+    }
+
+    ranges->count = kept;
+    return true;
+}
+
+static void gfusx_aot_add_range(gfusx_aot_ranges* ranges, const char* elf_path, u32 address, u32 size) {
+    // only whole instructions
+    u32 start = (address + 3) & ~3u;
+    u64 end = ((u64)address + size) & ~(u64)3;
+    if (end > GFUSX_CODE_SIZE) {
+        fprintf(stderr, "Code at 0x%08X in '%s' is outside of RAM and ROM and will be interpreted.\n", address, elf_path);
+        end = GFUSX_CODE_SIZE;
+    }
+
+    if (end <= start) return;
+
+    gfusx_aot_range range = {
+        .address = start,
+        .size = (u32)(end - start),
+    };
+
+    kos_da_push(ranges, range);
+}
+
+static int gfusx_aot_range_compare(const void* a, const void* b) {
+    const gfusx_aot_range* range_a = a;
+    const gfusx_aot_range* range_b = b;
+    return range_a->address < range_b->address ? -1 : range_a->address > range_b->address;
+}
+
+static void gfusx_aot_mark_targets(gfusx_vm* vm, const gfusx_aot_ranges* ranges, const gfusx_symbols* symbols, u8* words) {
+    for (isize i = 0; i < ranges->count; i++) {
+        const gfusx_aot_range* range = &ranges->data[i];
+        for (u32 offset = 0; offset < range->size; offset += 4) {
+            words[(range->address + offset) >> 2] |= GFUSX_AOT_WORD_CODE;
+        }
+    }
+
+    for (isize i = 0; i < symbols->count; i++) {
+        gfusx_aot_mark_target(words, symbols->data[i].address);
+    }
+
+    for (isize i = 0; i < ranges->count; i++) {
+        const gfusx_aot_range* range = &ranges->data[i];
+        for (u32 offset = 0; offset < range->size; offset += 4) {
+            const gfusx_decoded_inst* inst = gfusx_vm_decoded_inst_at(vm, range->address + offset);
+            if (inst->op == GFUSX_OP_JAL || inst->op == GFUSX_OP_BEQ || inst->op == GFUSX_OP_BNE) {
+                gfusx_aot_mark_target(words, inst->imm);
+            }
+        }
+    }
+}
+
+static void gfusx_aot_mark_target(u8* words, u32 address) {
+    if ((address & 3) != 0 || address >= GFUSX_CODE_SIZE) return;
+    words[address >> 2] |= GFUSX_AOT_WORD_TARGET;
+}
+
+/// Writes either the prototype or the block table entry of every block, and
+/// returns how many there are.
+static isize gfusx_aot_emit_blocks(FILE* stream, gfusx_vm* vm, const gfusx_aot_ranges* ranges, const u8* words, const char* name, bool prototypes) {
+    isize block_count = 0;
+    for (isize i = 0; i < ranges->count; i++) {
+        const gfusx_aot_range* range = &ranges->data[i];
+        for (u32 pc = range->address; pc - range->address < range->size; pc = gfusx_aot_block_end(vm, range, words, pc)) {
+            if (prototypes) {
+                fprintf(stream, "static bool %s_block_%08X(gfusx_vm* vm);\n", name, pc);
+            } else {
+                fprintf(stream, "    { 0x%08Xu, %s_block_%08X },\n", pc, name, pc);
+            }
+
+            block_count++;
+        }
+    }
+
+    return block_count;
+}
+
+/// Returns the address right after the last instruction of the block starting
+/// at `start_pc`.
+static u32 gfusx_aot_block_end(gfusx_vm* vm, const gfusx_aot_range* range, const u8* words, u32 start_pc) {
+    u32 range_end = range->address + range->size;
+    u32 page_end = (start_pc | GFUSX_PAGE_MASK) + 1;
+
+    bool after_branch = false;
+    u32 pc = start_pc;
+    for (u32 i = 0; i < GFUSX_AOT_MAX_BLOCK_INSTS; i++) {
+        gfusx_op_flags flags = gfusx_op_flags_table[gfusx_vm_decoded_inst_at(vm, pc)->op];
+        pc += 4;
+
+        if (after_branch || (flags & (GFUSX_OPF_STOP | GFUSX_OPF_BLOCK_END)) != 0) break;
+        if (pc == range_end || pc == page_end || (words[pc >> 2] & GFUSX_AOT_WORD_TARGET) != 0) break;
+        after_branch = (flags & GFUSX_OPF_BRANCH) != 0;
+    }
+
+    return pc;
+}
+
+static void gfusx_aot_emit_block(FILE* stream, gfusx_vm* vm, u32 start_pc, u32 end_pc, const char* name) {
+    // A block starts on a delay slot when the branch before it ended the
+    // previous block or the one before that stopped the VM. Nothing after the
+    // delay slot belongs to the block then, so it has to leave once the branch
+    // has been taken.
+    bool maybe_delay_slot = true;
+    if ((start_pc & GFUSX_PAGE_MASK) != 0) {
+        const gfusx_decoded_inst* previous = gfusx_vm_decoded_inst_at(vm, start_pc - 4);
+        maybe_delay_slot = (gfusx_op_flags_table[previous->op] & GFUSX_OPF_BRANCH) != 0;
+    }
+
+    fprintf(stream, "static bool %s_block_%08X(gfusx_vm* vm) {\n", name, start_pc);
+
+    bool after_branch = false;
+    bool after_load = false;
+    for (u32 pc = start_pc; pc != end_pc; pc += 4) {
+        const gfusx_decoded_inst* inst = gfusx_vm_decoded_inst_at(vm, pc);
+        gfusx_op_flags flags = gfusx_op_flags_table[inst->op];
+        bool first = pc == start_pc;
+        // only the first instruction or the one after a branch can be in a delay slot
+        bool dynamic = first || after_branch;
+        bool stops = (flags & (GFUSX_OPF_STOP | GFUSX_OPF_BLOCK_END)) != 0;
+        bool last = pc + 4 == end_pc;
+
+        if (!first) fprintf(stream, "\n");
+        fprintf(stream, "    // %08X: %08X %s\n", pc, inst->code, gfusx_aot_op_names[inst->op]);
+        fprintf(stream, "    gfusx_aot_begin_inst(vm, 0x%08Xu, 0x%08Xu);\n", pc, inst->code);
+        if (dynamic) fprintf(stream, "    gfusx_aot_begin_delay_slot(vm);\n");
+
+        // a misaligned load or store raises an address error, which stops the
+        // VM on it, so the block must not carry on past it
+        u32 alignment_mask = gfusx_op_alignment_mask(inst->op);
+        if (alignment_mask != 0) {
+            fprintf(stream, "    if (((vm->gpr.r[%u] + 0x%08Xu) & %uu) != 0) {\n", inst->rs, inst->imm, alignment_mask);
+            fprintf(stream, "        gfusx_aot_execute(vm, 0x%08Xu);\n", pc);
+            fprintf(stream, "        return gfusx_aot_retire(vm);\n");
+            fprintf(stream, "    }\n");
+        }
+
+        gfusx_aot_emit_op(stream, inst, pc);
+
+        if (dynamic || after_load || stops) {
+            // a pending pc or register load, delay slot or stop has to go through the full retire
+            fprintf(stream, "    if (gfusx_aot_retire(vm)) return true;\n");
+            if (first && maybe_delay_slot && !last) fprintf(stream, "    if (vm->pc != 0x%08Xu) return false;\n", pc + 4);
+        } else {
+            fprintf(stream, "    gfusx_aot_retire_fast(vm);\n");
+        }
+
+        if ((flags & GFUSX_OPF_STORE) != 0 && !last) {
+            fprintf(stream, "    if (gfusx_aot_code_dropped(vm, 0x%08Xu)) return false;\n", pc);
+        }
+
+        after_branch = (flags & GFUSX_OPF_BRANCH) != 0;
+        after_load = (flags & GFUSX_OPF_LOAD) != 0;
+    }
+
+    fprintf(stream, "    return false;\n");
+    fprintf(stream, "}\n");
+}
+
+static void gfusx_aot_emit_op(FILE* stream, const gfusx_decoded_inst* inst, u32 pc) {
+    switch (inst->op) {
+        default: {
+            fprintf(stream, "    gfusx_aot_execute(vm, 0x%08Xu);\n", pc);
+        } break;
+
+        case GFUSX_OP_NOP: break;
+
+        // writes to $sp go through the handler for the call stack
+        case GFUSX_OP_ADDIU:
+        case GFUSX_OP_ORI:
+        case GFUSX_OP_LUI: {
+            if (inst->rt == GFU_REG_SP) {
+                fprintf(stream, "    gfusx_aot_execute(vm, 0x%08Xu);\n", pc);
+                break;
+            }
+
+            if (inst->rt == 0) break;
+
+            fprintf(stream, "    gfusx_aot_cancel_load(vm, %u);\n", inst->rt);
+            if (inst->op == GFUSX_OP_ADDIU) {
+                fprintf(stream, "    vm->gpr.r[%u] = vm->gpr.r[%u] + 0x%08Xu;\n", inst->rt, inst->rs, inst->imm);
+            } else if (inst->op == GFUSX_OP_ORI) {
+                fprintf(stream, "    vm->gpr.r[%u] = vm->gpr.r[%u] | 0x%08Xu;\n", inst->rt, inst->rs, inst->imm);
+            } else {
+                fprintf(stream, "    vm->gpr.r[%u] = 0x%08Xu;\n", inst->rt, inst->imm);
+            }
+        } break;
+
+        case GFUSX_OP_SLL: {
+            if (inst->rd == 0) break;
+
+            fprintf(stream, "    gfusx_aot_cancel_load(vm, %u);\n", inst->rd);
+            fprintf(stream, "    vm->gpr.r[%u] = vm->gpr.r[%u] << %u;\n", inst->rd, inst->rt, inst->shamt);
+        } break;
+
+        case GFUSX_OP_ADDU: {
+            if (inst->rd == GFU_REG_SP) {
+                fprintf(stream, "    gfusx_aot_execute(vm, 0x%08Xu);\n", pc);
+                break;
+            }
+
+            if (inst->rd == 0) break;
+
+            fprintf(stream, "    gfusx_aot_cancel_load(vm, %u);\n", inst->rd);
+            fprintf(stream, "    vm->gpr.r[%u] = vm->gpr.r[%u] + vm->gpr.r[%u];\n", inst->rd, inst->rs, inst->rt);
+        } break;
+
+        // idle loops are measured and skipped by the handler
+        case GFUSX_OP_BEQ:
+        case GFUSX_OP_BNE: {
+            if ((inst->hints & GFUSX_HINT_IDLE_LOOP) != 0) {
+                fprintf(stream, "    gfusx_aot_execute(vm, 0x%08Xu);\n", pc);
+                break;
+            }
+
+            const char* compare = inst->op == GFUSX_OP_BEQ ? "==" : "!=";
+            fprintf(stream, "    if (vm->gpr.r[%u] %s vm->gpr.r[%u]) gfusx_aot_branch(vm, 0x%08Xu);\n", inst->rs, compare, inst->rt, inst->imm);
+        } break;
+    }
+}
@@ -0,0 +1,323 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+// pthread_setaffinity_np is a GNU extension
+#define _GNU_SOURCE
+
+#include "vm_internal.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Jobs are handed out as contiguous index ranges, one per worker. A worker
+/// takes jobs from the front of its own range and, once that is empty, steals
+/// the back half of the fullest range it can find. Jobs run whole guest
+/// programs, so a mutex per range costs nothing worth measuring.
+
+typedef struct gfusx_batch_queue {
+    pthread_mutex_t lock;
+    isize head, tail;
+} gfusx_batch_queue;
+
+typedef struct gfusx_batch gfusx_batch;
+
+typedef struct gfusx_batch_worker {
+    gfusx_batch* batch;
+    pthread_t thread;
+    int index;
+    gfusx_batch_queue queue;
+} gfusx_batch_worker;
+
+struct gfusx_batch {
+    gfusx_job* jobs;
+    const gfusx_batch_options* options;
+    gfusx_batch_worker* workers;
+    int worker_count;
+};
+
+static void* gfusx_batch_worker_main(void* arg);
+static bool gfusx_batch_take(gfusx_batch_worker* worker, isize* job_index);
+static bool gfusx_batch_steal(gfusx_batch_worker* worker);
+static bool gfusx_batch_load(gfusx_vm* vm, const gfusx_job* job);
+static void gfusx_batch_run_job(gfusx_vm* vm, gfusx_job* job, const gfusx_settings* settings);
+static void gfusx_batch_report_profile(gfusx_vm* vm, gfusx_job* job, const gfusx_profiler* profiler, const gfusx_call_stack* call_stack);
+
+void gfusx_run_batch(gfusx_job* jobs, isize job_count, const gfusx_batch_options* options) {
+    if (job_count <= 0) return;
+
+    int worker_count = options->thread_count;
+    if (worker_count <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = online > 0 ? (int)online : 1;
+    }
+
+    if (worker_count > job_count) worker_count = (int)job_count;
+
+    gfusx_batch batch = {
+        .jobs = jobs,
+        .options = options,
+        .workers = calloc((usize)worker_count, sizeof(gfusx_batch_worker)),
+        .worker_count = worker_count,
+    };
+
+    kos_assert(batch.workers != NULL);
+
+    for (int i = 0; i < worker_count; i++) {
+        gfusx_batch_worker* worker = &batch.workers[i];
+        worker->batch = &batch;
+        worker->index = i;
+        worker->queue.head = job_count * i / worker_count;
+        worker->queue.tail = job_count * (i + 1) / worker_count;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    // the calling thread is worker 0
+    for (int i = 1; i < worker_count; i++) {
+        int error = pthread_create(&batch.workers[i].thread, NULL, gfusx_batch_worker_main, &batch.workers[i]);
+        kos_assert(error == 0);
+    }
+
+    gfusx_batch_worker_main(&batch.workers[0]);
+
+    for (int i = 1; i < worker_count; i++) {
+        pthread_join(batch.workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_mutex_destroy(&batch.workers[i].queue.lock);
+    }
+
+    free(batch.workers);
+}
+
+static void* gfusx_batch_worker_main(void* arg) {
+    gfusx_batch_worker* worker = arg;
+    gfusx_batch* batch = worker->batch;
+
+#if defined(__linux__)
+    if (batch->options->pin_threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        if (online > 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(worker->index % online, &cpus);
+            // a failure to pin only costs some cache locality
+            kos_discard(pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus));
+        }
+    }
+#endif
+
+    // NOTE(local): The VM is far too large for a worker's stack.
+    gfusx_vm* vm = calloc(1, sizeof *vm);
+    kos_assert(vm != NULL);
+
+    isize job_index;
+    while (gfusx_batch_take(worker, &job_index) || (gfusx_batch_steal(worker) && gfusx_batch_take(worker, &job_index))) {
+        gfusx_batch_run_job(vm, &batch->jobs[job_index], &batch->options->settings);
+    }
+
+    free(vm);
+    return NULL;
+}
+
+static bool gfusx_batch_take(gfusx_batch_worker* worker, isize* job_index) {
+    gfusx_batch_queue* queue = &worker->queue;
+    bool result = false;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        *job_index = queue->head++;
+        result = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return result;
+}
+
+/// Moves the back half of the fullest other queue into this worker's queue.
+/// Returns false once there is nothing left anywhere.
+static bool gfusx_batch_steal(gfusx_batch_worker* worker) {
+    gfusx_batch* batch = worker->batch;
+
+    for (;;) {
+        gfusx_batch_worker* victim = NULL;
+        isize victim_size = 0;
+
+        // the sizes are only a hint, they are checked again under the lock
+        for (int i = 0; i < batch->worker_count; i++) {
+            gfusx_batch_worker* other = &batch->workers[i];
+            if (other == worker) continue;
+
+            pthread_mutex_lock(&other->queue.lock);
+            isize size = other->queue.tail - other->queue.head;
+            pthread_mutex_unlock(&other->queue.lock);
+
+            if (size > victim_size) {
+                victim = other;
+                victim_size = size;
+            }
+        }
+
+        if (victim == NULL) return false;
+
+        isize head = 0, tail = 0;
+        pthread_mutex_lock(&victim->queue.lock);
+        isize size = victim->queue.tail - victim->queue.head;
+        if (size > 0) {
+            isize count = (size + 1) / 2;
+            tail = victim->queue.tail;
+            head = tail - count;
+            victim->queue.tail = head;
+        }
+        pthread_mutex_unlock(&victim->queue.lock);
+
+        // somebody else got there first, look again
+        if (head == tail) continue;
+
+        pthread_mutex_lock(&worker->queue.lock);
+        worker->queue.head = head;
+        worker->queue.tail = tail;
+        pthread_mutex_unlock(&worker->queue.lock);
+        return true;
+    }
+}
+
+static void gfusx_batch_report_profile(gfusx_vm* vm, gfusx_job* job, const gfusx_profiler* profiler, const gfusx_call_stack* call_stack) {
+    // a program without a symbol table is profiled by address
+    gfusx_symbols symbols = {0};
+    const gfusx_symbols* maybe_symbols = gfusx_symbols_load(&symbols, job->elf_path) ? &symbols : NULL;
+
+    if (job->profile_interval != 0) {
+        if (job->profile_path == NULL) {
+            fprintf(stderr, "Profile of '%s':\n", job->elf_path);
+            gfusx_profiler_print(stderr, profiler, maybe_symbols);
+        } else if (!gfusx_profiler_write_collapsed(profiler, maybe_symbols, job->profile_path)) {
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Could not write profile '%s'.", job->profile_path);
+        }
+    }
+
+    if (job->call_graph) {
+        if (job->call_graph_path == NULL) {
+            fprintf(stderr, "Call graph of '%s':\n", job->elf_path);
+            gfusx_call_stack_print(stderr, call_stack, maybe_symbols);
+        } else if (!gfusx_call_stack_write_collapsed(call_stack, maybe_symbols, job->call_graph_path)) {
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Could not write call graph '%s'.", job->call_graph_path);
+        }
+    }
+
+    gfusx_symbols_free(&symbols);
+}
+
+static bool gfusx_batch_load(gfusx_vm* vm, const gfusx_job* job) {
+    if (!gfusx_vm_load_elf(vm, job->elf_path)) return false;
+
+    if (vm->settings.hle.enabled) {
+        // a program without a symbol table simply runs everything itself
+        gfusx_symbols symbols = {0};
+        if (gfusx_symbols_load(&symbols, job->elf_path)) gfusx_vm_hle_attach_symbols(vm, &symbols);
+        gfusx_symbols_free(&symbols);
+    }
+
+    return true;
+}
+
+static void gfusx_batch_run_job(gfusx_vm* vm, gfusx_job* job, const gfusx_settings* settings) {
+    vm->settings = *settings;
+    // idle loops could only ever be skipped by one side, see gfusx_lockstep_run
+    if (job->lockstep) vm->settings.cpu.no_idle_skip = true;
+    gfusx_vm_power_on(vm);
+
+    gfusx_vm* reference = NULL;
+    if (job->lockstep) {
+        reference = calloc(1, sizeof *reference);
+        kos_assert(reference != NULL);
+        reference->settings = vm->settings;
+        reference->settings.cpu.engine = job->lockstep_reference;
+        gfusx_vm_power_on(reference);
+    }
+
+    gfusx_input_log input = {
+        .mode = GFUSX_INPUT_RECORD,
+    };
+
+    job->loaded = gfusx_batch_load(vm, job) && (reference == NULL || gfusx_batch_load(reference, job));
+
+    if (job->loaded && job->input_path != NULL && !job->record_input) {
+        job->loaded = gfusx_input_log_load(&input, job->input_path);
+        if (!job->loaded) gfusx_vm_logf(vm, GFUSX_LC_INPUT, "Could not read input log '%s'.", job->input_path);
+    }
+
+    if (job->loaded) {
+        if (job->input_path != NULL) vm->input = &input;
+
+        gfusx_trace_writer* trace = NULL;
+        if (job->trace_path != NULL) {
+            trace = gfusx_trace_begin(vm, job->trace_path);
+            if (trace == NULL) gfusx_vm_logf(vm, GFUSX_LC_CPU, "Could not create trace file '%s'.", job->trace_path);
+        }
+
+        gfusx_profiler profiler = {0};
+        if (job->profile_interval != 0) gfusx_profiler_begin(vm, &profiler, job->profile_interval);
+
+        gfusx_call_stack call_stack = {0};
+        if (job->call_graph) gfusx_call_stack_begin(vm, &call_stack);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (reference != NULL) {
+            bool matched = gfusx_lockstep_run(reference, vm, job->cycle_budget, &job->lockstep_report);
+            job->stop_reason = matched ? vm->stop_reason : GFUSX_STOP_DIVERGED;
+        } else {
+            job->stop_reason = gfusx_vm_run(vm, job->cycle_budget);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        job->exit_code = vm->stop_code;
+        job->seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+        if (trace != NULL && !gfusx_trace_end(vm, trace)) {
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Could not write trace file '%s'.", job->trace_path);
+        }
+
+        if (job->profile_interval != 0 || job->call_graph) {
+            if (job->profile_interval != 0) gfusx_profiler_end(vm, &profiler);
+            if (job->call_graph) gfusx_call_stack_end(vm, &call_stack);
+            gfusx_batch_report_profile(vm, job, &profiler, &call_stack);
+            gfusx_profiler_free(&profiler);
+            gfusx_call_stack_free(&call_stack);
+        }
+    }
+
+    if (job->loaded && job->record_input && job->input_path != NULL && !gfusx_input_log_save(&input, job->input_path)) {
+        gfusx_vm_logf(vm, GFUSX_LC_INPUT, "Could not write input log '%s'.", job->input_path);
+    }
+
+    job->cycles = vm->cycle;
+    job->pc = vm->pc;
+    job->gpr = vm->gpr;
+
+    gfusx_input_log_free(&input);
+    gfusx_vm_power_off(vm);
+
+    if (reference != NULL) {
+        gfusx_vm_power_off(reference);
+        free(reference);
+    }
+}
@@ -0,0 +1,290 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#define GFUSX_CALL_STACK_INITIAL_TABLE_CAPACITY 256
+
+// never a valid pc, so the root frame can only be left by gfusx_call_stack_end
+#define GFUSX_CALL_STACK_ROOT_RETURN_ADDR UINT32_MAX
+
+/// The totals of one function over every node it appears in.
+typedef struct gfusx_call_function {
+    u32 function;
+    u64 calls;
+    u64 self_cycles;
+    u64 total_cycles;
+} gfusx_call_function;
+
+static i32 gfusx_call_stack_node(gfusx_call_stack* call_stack, i32 parent, u32 function);
+static void gfusx_call_stack_push(gfusx_call_stack* call_stack, i32 node, u32 return_addr, u32 sp, u64 cycle);
+static void gfusx_call_stack_pop(gfusx_call_stack* call_stack, u64 cycle);
+static usize gfusx_call_stack_hash(i32 parent, u32 function);
+static bool gfusx_call_node_is_recursive(const gfusx_call_stack* call_stack, i32 node);
+static void gfusx_call_stack_function_name(const gfusx_symbols* symbols, u32 function, char* buffer, usize buffer_size);
+static int gfusx_call_function_compare_address(const void* a, const void* b);
+static int gfusx_call_function_compare_total(const void* a, const void* b);
+
+void gfusx_call_stack_begin(gfusx_vm* vm, gfusx_call_stack* call_stack) {
+    vm->call_stack = call_stack;
+
+    i32 root = gfusx_call_stack_node(call_stack, -1, vm->pc);
+    gfusx_call_stack_push(call_stack, root, GFUSX_CALL_STACK_ROOT_RETURN_ADDR, UINT32_MAX, vm->cycle);
+}
+
+void gfusx_call_stack_end(gfusx_vm* vm, gfusx_call_stack* call_stack) {
+    while (call_stack->count != 0) {
+        gfusx_call_stack_pop(call_stack, vm->cycle);
+    }
+
+    vm->call_stack = NULL;
+}
+
+void gfusx_call_stack_free(gfusx_call_stack* call_stack) {
+    kos_da_dealloc(call_stack);
+    kos_da_dealloc(&call_stack->nodes);
+    free(call_stack->node_table);
+    *call_stack = (gfusx_call_stack) {0};
+}
+
+void gfusx_call_stack_call(gfusx_vm* vm, u32 function, u32 return_addr, u32 sp) {
+    gfusx_call_stack* call_stack = vm->call_stack;
+
+    // NOTE(local): A function making a call with the stack pointer where its
+    // caller left it has not set up a frame of its own, so it is taken to be a
+    // leaf that already returned. This is wrong for the rare function that
+    // keeps its return address in a register instead of on the stack.
+    while (call_stack->count > 1 && call_stack->data[call_stack->count - 1].sp <= sp) {
+        gfusx_call_stack_pop(call_stack, vm->cycle);
+    }
+
+    gfusx_call_frame* caller = &call_stack->data[call_stack->count - 1];
+    if (caller->last_callee_node == -1 || caller->last_callee != function) {
+        caller->last_callee = function;
+        caller->last_callee_node = gfusx_call_stack_node(call_stack, caller->node, function);
+    }
+
+    gfusx_call_stack_push(call_stack, caller->last_callee_node, return_addr, sp, vm->cycle);
+}
+
+void gfusx_call_stack_release(gfusx_vm* vm, u32 sp) {
+    gfusx_call_stack* call_stack = vm->call_stack;
+    while (call_stack->count > 1 && call_stack->data[call_stack->count - 1].sp <= sp) {
+        gfusx_call_stack_pop(call_stack, vm->cycle);
+    }
+}
+
+void gfusx_call_stack_return(gfusx_vm* vm) {
+    gfusx_call_stack* call_stack = vm->call_stack;
+    if (call_stack->count > 1) {
+        gfusx_call_stack_pop(call_stack, vm->cycle);
+    }
+}
+
+void gfusx_call_stack_print(FILE* stream, const gfusx_call_stack* call_stack, const gfusx_symbols* symbols) {
+    isize node_count = call_stack->nodes.count;
+    gfusx_call_function* functions = malloc((usize)(node_count == 0 ? 1 : node_count) * sizeof *functions);
+
+    for (isize i = 0; i < node_count; i++) {
+        const gfusx_call_node* node = &call_stack->nodes.data[i];
+        functions[i] = (gfusx_call_function) {
+            .function = node->function,
+            .calls = node->calls,
+            .self_cycles = node->self_cycles,
+            // a recursive call is already part of the cycles of the outer one
+            .total_cycles = gfusx_call_node_is_recursive(call_stack, (i32)i) ? 0 : node->total_cycles,
+        };
+    }
+
+    if (node_count != 0) qsort(functions, (usize)node_count, sizeof *functions, gfusx_call_function_compare_address);
+
+    isize function_count = 0;
+    for (isize i = 0; i < node_count; i++) {
+        if (function_count != 0 && functions[function_count - 1].function == functions[i].function) {
+            gfusx_call_function* merged = &functions[function_count - 1];
+            merged->calls += functions[i].calls;
+            merged->self_cycles += functions[i].self_cycles;
+            merged->total_cycles += functions[i].total_cycles;
+        } else {
+            functions[function_count++] = functions[i];
+        }
+    }
+
+    if (function_count != 0) qsort(functions, (usize)function_count, sizeof *functions, gfusx_call_function_compare_total);
+
+    // the root spans the whole run
+    u64 all_cycles = node_count == 0 ? 0 : call_stack->nodes.data[0].total_cycles;
+    double scale = all_cycles == 0 ? 0.0 : 100.0 / (double)all_cycles;
+
+    fprintf(stream, "%llu cycles.\n", (unsigned long long)all_cycles);
+    fprintf(stream, "%10s %14s %7s %14s %7s  %s\n", "calls", "inclusive", "%", "exclusive", "%", "function");
+    for (isize i = 0; i < function_count; i++) {
+        const gfusx_call_function* function = &functions[i];
+
+        char name[256];
+        gfusx_call_stack_function_name(symbols, function->function, name, sizeof name);
+        fprintf(
+            stream,
+            "%10llu %14llu %6.2f%% %14llu %6.2f%%  %s\n",
+            (unsigned long long)function->calls,
+            (unsigned long long)function->total_cycles,
+            (double)function->total_cycles * scale,
+            (unsigned long long)function->self_cycles,
+            (double)function->self_cycles * scale,
+            name
+        );
+    }
+
+    free(functions);
+}
+
+bool gfusx_call_stack_write_collapsed(const gfusx_call_stack* call_stack, const gfusx_symbols* symbols, const char* file_path) {
+    FILE* stream = fopen(file_path, "w");
+    if (stream == NULL) return false;
+
+    struct {
+        KOS_DYNAMIC_ARRAY_FIELDS(i32);
+    } path = {0};
+
+    for (isize i = 0; i < call_stack->nodes.count; i++) {
+        const gfusx_call_node* node = &call_stack->nodes.data[i];
+        if (node->self_cycles == 0) continue;
+
+        // walk up to the root, then print back down
+        path.count = 0;
+        for (i32 current = (i32)i; current != -1; current = call_stack->nodes.data[current].parent) {
+            kos_da_push(&path, current);
+        }
+
+        for (isize j = path.count - 1; j >= 0; j--) {
+            char name[256];
+            gfusx_call_stack_function_name(symbols, call_stack->nodes.data[path.data[j]].function, name, sizeof name);
+            fprintf(stream, "%s%c", name, j == 0 ? ' ' : ';');
+        }
+
+        fprintf(stream, "%llu\n", (unsigned long long)node->self_cycles);
+    }
+
+    kos_da_dealloc(&path);
+    return 0 == fclose(stream);
+}
+
+static i32 gfusx_call_stack_node(gfusx_call_stack* call_stack, i32 parent, u32 function) {
+    // keep the table at most half full, every node is in it
+    if (call_stack->nodes.count * 2 >= call_stack->node_table_capacity) {
+        isize capacity = call_stack->node_table_capacity == 0 ? GFUSX_CALL_STACK_INITIAL_TABLE_CAPACITY : call_stack->node_table_capacity * 2;
+        free(call_stack->node_table);
+        call_stack->node_table = malloc((usize)capacity * sizeof *call_stack->node_table);
+        call_stack->node_table_capacity = capacity;
+        memset(call_stack->node_table, 0xFF, (usize)capacity * sizeof *call_stack->node_table);
+
+        usize mask = (usize)capacity - 1;
+        for (isize i = 0; i < call_stack->nodes.count; i++) {
+            const gfusx_call_node* node = &call_stack->nodes.data[i];
+            usize index = gfusx_call_stack_hash(node->parent, node->function) & mask;
+            while (call_stack->node_table[index] != -1) index = (index + 1) & mask;
+            call_stack->node_table[index] = (i32)i;
+        }
+    }
+
+    usize mask = (usize)call_stack->node_table_capacity - 1;
+    usize index = gfusx_call_stack_hash(parent, function) & mask;
+    for (;; index = (index + 1) & mask) {
+        i32 existing = call_stack->node_table[index];
+        if (existing == -1) break;
+
+        const gfusx_call_node* node = &call_stack->nodes.data[existing];
+        if (node->parent == parent && node->function == function) return existing;
+    }
+
+    gfusx_call_node node = {
+        .function = function,
+        .parent = parent,
+    };
+
+    kos_da_push(&call_stack->nodes, node);
+    call_stack->node_table[index] = (i32)(call_stack->nodes.count - 1);
+    return (i32)(call_stack->nodes.count - 1);
+}
+
+static void gfusx_call_stack_push(gfusx_call_stack* call_stack, i32 node, u32 return_addr, u32 sp, u64 cycle) {
+    call_stack->nodes.data[node].calls++;
+
+    gfusx_call_frame frame = {
+        .node = node,
+        .return_addr = return_addr,
+        .sp = sp,
+        .enter_cycle = cycle,
+        .last_callee_node = -1,
+    };
+
+    kos_da_push(call_stack, frame);
+}
+
+static void gfusx_call_stack_pop(gfusx_call_stack* call_stack, u64 cycle) {
+    gfusx_call_frame* frame = &call_stack->data[--call_stack->count];
+    u64 total = cycle - frame->enter_cycle;
+
+    gfusx_call_node* node = &call_stack->nodes.data[frame->node];
+    node->self_cycles += total - frame->child_cycles;
+    node->total_cycles += total;
+
+    if (call_stack->count != 0) {
+        call_stack->data[call_stack->count - 1].child_cycles += total;
+    }
+}
+
+static usize gfusx_call_stack_hash(i32 parent, u32 function) {
+    return (usize)(((u64)(u32)parent << 32 | (function >> 2)) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+static bool gfusx_call_node_is_recursive(const gfusx_call_stack* call_stack, i32 node) {
+    u32 function = call_stack->nodes.data[node].function;
+    for (i32 current = call_stack->nodes.data[node].parent; current != -1; current = call_stack->nodes.data[current].parent) {
+        if (call_stack->nodes.data[current].function == function) return true;
+    }
+
+    return false;
+}
+
+static void gfusx_call_stack_function_name(const gfusx_symbols* symbols, u32 function, char* buffer, usize buffer_size) {
+    const gfusx_symbol* symbol = symbols == NULL ? NULL : gfusx_symbols_find(symbols, function);
+    if (symbol == NULL) {
+        snprintf(buffer, buffer_size, "0x%08X", function);
+    } else if (symbol->address == function) {
+        snprintf(buffer, buffer_size, "%s", gfusx_symbol_name(symbols, symbol));
+    } else {
+        snprintf(buffer, buffer_size, "%s+0x%X", gfusx_symbol_name(symbols, symbol), function - symbol->address);
+    }
+}
+
+static int gfusx_call_function_compare_address(const void* a, const void* b) {
+    const gfusx_call_function* function_a = a;
+    const gfusx_call_function* function_b = b;
+    return function_a->function < function_b->function ? -1 : function_a->function > function_b->function;
+}
+
+static int gfusx_call_function_compare_total(const void* a, const void* b) {
+    const gfusx_call_function* function_a = a;
+    const gfusx_call_function* function_b = b;
+
+    if (function_a->total_cycles != function_b->total_cycles) return function_a->total_cycles > function_b->total_cycles ? -1 : 1;
+    return function_a->function < function_b->function ? -1 : function_a->function > function_b->function;
+}
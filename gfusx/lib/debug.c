@@ -0,0 +1,149 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <string.h>
+
+static void gfusx_debug_update_watched_pages(gfusx_vm* vm, u32 address, u32 size);
+static void gfusx_debug_watching_changed(gfusx_vm* vm);
+
+bool gfusx_vm_add_breakpoint(gfusx_vm* vm, u32 address) {
+    if ((address & 3) != 0 || address >= GFUSX_CODE_SIZE) return false;
+
+    gfusx_breakpoints* breakpoints = &vm->breakpoints;
+    isize index = gfusx_debug_breakpoint_lower_bound(vm, address);
+    if (index < breakpoints->count && breakpoints->data[index] == address) return true;
+
+    kos_da_push(breakpoints, 0);
+    memmove(&breakpoints->data[index + 1], &breakpoints->data[index], (usize)(breakpoints->count - 1 - index) * sizeof *breakpoints->data);
+    breakpoints->data[index] = address;
+
+    // code that is already decoded has to be decoded again to pick it up, and
+    // the uncached interpreter only looks for breakpoints if it was entered with any
+    gfusx_vm_invalidate_code(vm, address, 4);
+    if (breakpoints->count == 1) gfusx_vm_reenter(vm);
+    return true;
+}
+
+bool gfusx_vm_remove_breakpoint(gfusx_vm* vm, u32 address) {
+    gfusx_breakpoints* breakpoints = &vm->breakpoints;
+    isize index = gfusx_debug_breakpoint_lower_bound(vm, address);
+    if (index == breakpoints->count || breakpoints->data[index] != address) return false;
+
+    memmove(&breakpoints->data[index], &breakpoints->data[index + 1], (usize)(breakpoints->count - 1 - index) * sizeof *breakpoints->data);
+    breakpoints->count--;
+
+    gfusx_vm_invalidate_code(vm, address, 4);
+    return true;
+}
+
+bool gfusx_vm_add_watchpoint(gfusx_vm* vm, u32 address, u32 size, gfusx_watch_kind kind) {
+    if (size == 0 || (u64)address + size > (u64)GFUSX_ADDRESS_PAGE_COUNT << GFUSX_PAGE_SHIFT) return false;
+    if ((kind & GFUSX_WATCH_ACCESS) == 0) return false;
+
+    gfusx_watchpoint watchpoint = {
+        .address = address,
+        .size = size,
+        .kind = kind & GFUSX_WATCH_ACCESS,
+    };
+
+    kos_da_push(&vm->watchpoints, watchpoint);
+    gfusx_debug_update_watched_pages(vm, address, size);
+    if (vm->watchpoints.count == 1) gfusx_debug_watching_changed(vm);
+    return true;
+}
+
+bool gfusx_vm_remove_watchpoint(gfusx_vm* vm, u32 address, u32 size, gfusx_watch_kind kind) {
+    gfusx_watchpoints* watchpoints = &vm->watchpoints;
+    for (isize i = 0; i < watchpoints->count; i++) {
+        gfusx_watchpoint* watchpoint = &watchpoints->data[i];
+        if (watchpoint->address != address || watchpoint->size != size || watchpoint->kind != (kind & GFUSX_WATCH_ACCESS)) continue;
+
+        // the order does not matter, every one of them is checked
+        *watchpoint = watchpoints->data[--watchpoints->count];
+        gfusx_debug_update_watched_pages(vm, address, size);
+        if (watchpoints->count == 0) gfusx_debug_watching_changed(vm);
+        return true;
+    }
+
+    return false;
+}
+
+isize gfusx_debug_breakpoint_lower_bound(gfusx_vm* vm, u32 address) {
+    isize low = 0, high = vm->breakpoints.count;
+    while (low < high) {
+        isize middle = low + (high - low) / 2;
+        if (vm->breakpoints.data[middle] < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+bool gfusx_debug_has_breakpoint(gfusx_vm* vm, u32 address) {
+    isize index = gfusx_debug_breakpoint_lower_bound(vm, address);
+    return index < vm->breakpoints.count && vm->breakpoints.data[index] == address;
+}
+
+void gfusx_debug_check_watchpoints(gfusx_vm* vm, u32 addr, u32 size, gfusx_watch_kind kind) {
+    for (isize i = 0; i < vm->watchpoints.count; i++) {
+        const gfusx_watchpoint* watchpoint = &vm->watchpoints.data[i];
+        if ((watchpoint->kind & kind) == 0) continue;
+        if ((u64)addr + size <= watchpoint->address || (u64)watchpoint->address + watchpoint->size <= addr) continue;
+
+        gfusx_vm_stop(vm, GFUSX_STOP_WATCHPOINT, addr);
+        return;
+    }
+}
+
+void gfusx_debug_free_all(gfusx_vm* vm) {
+    kos_da_dealloc(&vm->breakpoints);
+    kos_da_dealloc(&vm->watchpoints);
+}
+
+// Only RAM and ROM pages are tracked, everything else always takes the slow path.
+static void gfusx_debug_update_watched_pages(gfusx_vm* vm, u32 address, u32 size) {
+    u64 first_page = address >> GFUSX_PAGE_SHIFT;
+    u64 last_page = ((u64)address + size - 1) >> GFUSX_PAGE_SHIFT;
+    for (u64 page_index = first_page; page_index <= last_page && page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        u64 page_start = page_index << GFUSX_PAGE_SHIFT;
+        u64 page_end = page_start + GFUSX_PAGE_SIZE;
+
+        u8 kinds = 0;
+        for (isize i = 0; i < vm->watchpoints.count; i++) {
+            const gfusx_watchpoint* watchpoint = &vm->watchpoints.data[i];
+            if (watchpoint->address < page_end && page_start < (u64)watchpoint->address + watchpoint->size) {
+                kinds |= (u8)watchpoint->kind;
+            }
+        }
+
+        vm->watched_pages[page_index] = kinds;
+        gfusx_mem_update_page_access(vm, (u32)page_index);
+    }
+}
+
+// Recompiled code is specialized on whether anything is watched at all.
+static void gfusx_debug_watching_changed(gfusx_vm* vm) {
+    gfusx_jit_invalidate_all(vm);
+}
@@ -0,0 +1,209 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+// memfd_create, MAP_NORESERVE and sigsetjmp are not part of strict ISO C mode
+#define _GNU_SOURCE
+
+#include "vm_internal.h"
+
+/// The fastmem backend reserves the whole 32-bit guest address space, plus a
+/// guard page past its end, and maps RAM and ROM into it at their arch.h
+/// offsets, so a guest access is a single host access at `fastmem + addr`.
+/// Everything else stays PROT_NONE. Accesses that hit it fault into a SIGSEGV
+/// handler, which jumps back to the engine loop so the instruction can be
+/// replayed through the page tables.
+///
+/// RAM and ROM live in a memfd that is mapped twice. The guest view carries
+/// the guest protections. The host view (`vm->ram`, `vm->rom`) is always
+/// writable, so the page tables and host side writes never fault.
+
+#if defined(__linux__) && UINTPTR_MAX > 0xFFFFFFFFu
+#    define GFUSX_HAS_FASTMEM 1
+#else
+#    define GFUSX_HAS_FASTMEM 0
+#endif
+
+#if GFUSX_HAS_FASTMEM
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define GFUSX_FASTMEM_RESERVE_SIZE ((usize)GFUSX_ADDRESS_PAGE_COUNT << GFUSX_PAGE_SHIFT)
+// Guest accesses are naturally aligned and end inside the address space, but
+// a stray one running past its end still has to fault inside the reservation,
+// where the handler knows the fault as its own, rather than in whatever the
+// host mapped right after it.
+#define GFUSX_FASTMEM_GUARD_SIZE ((usize)GFUSX_PAGE_SIZE)
+
+typedef struct gfusx_fastmem_context {
+    gfusx_vm* vm;
+    sigjmp_buf env;
+} gfusx_fastmem_context;
+
+static _Thread_local gfusx_fastmem_context* gfusx_fastmem_current;
+
+static pthread_once_t gfusx_fastmem_handler_once = PTHREAD_ONCE_INIT;
+static bool gfusx_fastmem_handler_installed;
+static struct sigaction gfusx_fastmem_previous_action;
+
+static void gfusx_fastmem_install_handler(void);
+static void gfusx_fastmem_signal_handler(int sig, siginfo_t* info, void* ucontext);
+
+bool gfusx_fastmem_create(gfusx_vm* vm) {
+    bool result = true;
+    int fd = -1;
+    u8* host_view = MAP_FAILED;
+    u8* guest_view = MAP_FAILED;
+
+    pthread_once(&gfusx_fastmem_handler_once, gfusx_fastmem_install_handler);
+    if (!gfusx_fastmem_handler_installed) kos_return_defer(false);
+
+    // guest pages are write protected one at a time
+    if (sysconf(_SC_PAGESIZE) != GFUSX_PAGE_SIZE) kos_return_defer(false);
+
+    fd = memfd_create("gfusx", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, GFU_MEM_SIZE) != 0) kos_return_defer(false);
+
+    host_view = mmap(NULL, GFU_MEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (host_view == MAP_FAILED) kos_return_defer(false);
+
+    guest_view = mmap(NULL, GFUSX_FASTMEM_RESERVE_SIZE + GFUSX_FASTMEM_GUARD_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (guest_view == MAP_FAILED) kos_return_defer(false);
+
+    if (MAP_FAILED == mmap(guest_view + GFU_MEM_OFFSET_MAIN_RAM, GFU_MEM_SIZE_MAIN_RAM, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)) {
+        kos_return_defer(false);
+    }
+
+    if (MAP_FAILED == mmap(guest_view + GFU_MEM_OFFSET_ROM, GFU_MEM_SIZE_ROM, PROT_READ, MAP_SHARED | MAP_FIXED, fd, GFU_MEM_SIZE_MAIN_RAM)) {
+        kos_return_defer(false);
+    }
+
+    vm->ram = host_view;
+    vm->rom = host_view + GFU_MEM_SIZE_MAIN_RAM;
+    vm->fastmem_view = guest_view;
+    vm->fastmem = guest_view;
+
+defer:;
+    // the mappings keep the memory alive
+    if (fd >= 0) close(fd);
+
+    if (!result) {
+        if (host_view != MAP_FAILED) munmap(host_view, GFU_MEM_SIZE);
+        if (guest_view != MAP_FAILED) munmap(guest_view, GFUSX_FASTMEM_RESERVE_SIZE + GFUSX_FASTMEM_GUARD_SIZE);
+    }
+
+    return result;
+}
+
+void gfusx_fastmem_destroy(gfusx_vm* vm) {
+    if (vm->fastmem_view == NULL) return;
+
+    munmap(vm->ram, GFU_MEM_SIZE);
+    munmap(vm->fastmem_view, GFUSX_FASTMEM_RESERVE_SIZE + GFUSX_FASTMEM_GUARD_SIZE);
+
+    vm->ram = NULL;
+    vm->rom = NULL;
+    vm->fastmem_view = NULL;
+    vm->fastmem = NULL;
+}
+
+void gfusx_fastmem_set_access(gfusx_vm* vm, u32 page_index, bool readable, bool writable) {
+    if (vm->fastmem_view == NULL) return;
+
+    // a write only page would still be readable on most hosts, so watched
+    // reads make the whole page inaccessible
+    int protection = !readable ? PROT_NONE : writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    int error = mprotect(vm->fastmem_view + ((usize)page_index << GFUSX_PAGE_SHIFT), GFUSX_PAGE_SIZE, protection);
+    kos_assert(error == 0);
+}
+
+void gfusx_fastmem_execute(gfusx_vm* vm, void (*engine)(gfusx_vm* vm), bool (*replay)(gfusx_vm* vm)) {
+    gfusx_fastmem_context context = {
+        .vm = vm,
+    };
+
+    // engines can be nested through host callbacks, so restore the outer one on the way out
+    gfusx_fastmem_context* previous = gfusx_fastmem_current;
+    gfusx_fastmem_current = &context;
+
+    // NOTE(local): The handler is installed with SA_NODEFER, so there is no
+    // signal mask to save and restore here.
+    if (sigsetjmp(context.env, 0) != 0) {
+        // a guest access faulted before it had any side effects
+        if (replay(vm)) goto done;
+    }
+
+    engine(vm);
+
+done:;
+    gfusx_fastmem_current = previous;
+}
+
+static void gfusx_fastmem_install_handler(void) {
+    struct sigaction action = {0};
+    action.sa_sigaction = gfusx_fastmem_signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    gfusx_fastmem_handler_installed = 0 == sigaction(SIGSEGV, &action, &gfusx_fastmem_previous_action);
+}
+
+static void gfusx_fastmem_signal_handler(int sig, siginfo_t* info, void* ucontext) {
+    gfusx_fastmem_context* context = gfusx_fastmem_current;
+    if (context != NULL) {
+        u8* view = context->vm->fastmem;
+        u8* fault_addr = info->si_addr;
+        if (view != NULL && fault_addr >= view && fault_addr < view + GFUSX_FASTMEM_RESERVE_SIZE + GFUSX_FASTMEM_GUARD_SIZE) {
+            siglongjmp(context->env, 1);
+        }
+    }
+
+    // not ours, hand it to whoever was there before
+    struct sigaction* previous = &gfusx_fastmem_previous_action;
+    if ((previous->sa_flags & SA_SIGINFO) != 0 && previous->sa_sigaction != NULL) {
+        previous->sa_sigaction(sig, info, ucontext);
+    } else if (previous->sa_handler != SIG_IGN && previous->sa_handler != SIG_DFL) {
+        previous->sa_handler(sig);
+    } else {
+        // returning re-runs the faulting access, which now kills the process as usual
+        signal(sig, SIG_DFL);
+    }
+}
+
+#else
+
+bool gfusx_fastmem_create(gfusx_vm* vm) {
+    return false;
+}
+
+void gfusx_fastmem_destroy(gfusx_vm* vm) {
+}
+
+void gfusx_fastmem_set_access(gfusx_vm* vm, u32 page_index, bool readable, bool writable) {
+}
+
+void gfusx_fastmem_execute(gfusx_vm* vm, void (*engine)(gfusx_vm* vm), bool (*replay)(gfusx_vm* vm)) {
+    engine(vm);
+}
+
+#endif
@@ -0,0 +1,803 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+/// The GTE is the fixed-point coprocessor behind COP2: it transforms and
+/// projects vertices, lights them, and has a few helpers for depth sorting and
+/// color interpolation. Results follow the hardware bit for bit, including the
+/// saturation flags and the reciprocal table its divider uses.
+
+typedef enum gfusx_gte_command {
+    GFUSX_GTE_RTPS = 0x01,
+    GFUSX_GTE_NCLIP = 0x06,
+    GFUSX_GTE_OP = 0x0C,
+    GFUSX_GTE_DPCS = 0x10,
+    GFUSX_GTE_INTPL = 0x11,
+    GFUSX_GTE_MVMVA = 0x12,
+    GFUSX_GTE_NCDS = 0x13,
+    GFUSX_GTE_CDP = 0x14,
+    GFUSX_GTE_NCDT = 0x16,
+    GFUSX_GTE_NCCS = 0x1B,
+    GFUSX_GTE_CC = 0x1C,
+    GFUSX_GTE_NCS = 0x1E,
+    GFUSX_GTE_NCT = 0x20,
+    GFUSX_GTE_SQR = 0x28,
+    GFUSX_GTE_DCPL = 0x29,
+    GFUSX_GTE_DPCT = 0x2A,
+    GFUSX_GTE_AVSZ3 = 0x2D,
+    GFUSX_GTE_AVSZ4 = 0x2E,
+    GFUSX_GTE_RTPT = 0x30,
+    GFUSX_GTE_GPF = 0x3D,
+    GFUSX_GTE_GPL = 0x3E,
+    GFUSX_GTE_NCCT = 0x3F,
+} gfusx_gte_command;
+
+// fields of the command word
+#define GFUSX_GTE_SHIFT(Command) ((((Command) >> 19) & 1) * 12)
+#define GFUSX_GTE_LM(Command) ((((Command) >> 10) & 1) != 0)
+#define GFUSX_GTE_MX(Command) (((Command) >> 17) & 3)
+#define GFUSX_GTE_VX(Command) (((Command) >> 15) & 3)
+#define GFUSX_GTE_TX(Command) (((Command) >> 13) & 3)
+
+// TODO(local): The GTE runs alongside the CPU and only stalls it when the next
+// COP2 instruction comes before the command is done. The whole command is
+// charged up front here.
+static const u8 gfusx_gte_command_cycles[64] = {
+    [GFUSX_GTE_RTPS] = 15,
+    [GFUSX_GTE_NCLIP] = 8,
+    [GFUSX_GTE_OP] = 6,
+    [GFUSX_GTE_DPCS] = 8,
+    [GFUSX_GTE_INTPL] = 8,
+    [GFUSX_GTE_MVMVA] = 8,
+    [GFUSX_GTE_NCDS] = 19,
+    [GFUSX_GTE_CDP] = 13,
+    [GFUSX_GTE_NCDT] = 44,
+    [GFUSX_GTE_NCCS] = 17,
+    [GFUSX_GTE_CC] = 11,
+    [GFUSX_GTE_NCS] = 14,
+    [GFUSX_GTE_NCT] = 30,
+    [GFUSX_GTE_SQR] = 5,
+    [GFUSX_GTE_DCPL] = 8,
+    [GFUSX_GTE_DPCT] = 17,
+    [GFUSX_GTE_AVSZ3] = 5,
+    [GFUSX_GTE_AVSZ4] = 6,
+    [GFUSX_GTE_RTPT] = 23,
+    [GFUSX_GTE_GPF] = 5,
+    [GFUSX_GTE_GPL] = 5,
+    [GFUSX_GTE_NCCT] = 39,
+};
+
+// The seed of the divider's Newton-Raphson step, indexed by the top bits of the
+// normalized divisor: max(0, (0x40000 / (i + 0x100) + 1) / 2 - 0x101).
+static const u8 gfusx_gte_unr_table[0x101] = {
+    0xFF, 0xFD, 0xFB, 0xF9, 0xF7, 0xF5, 0xF3, 0xF1, 0xEF, 0xEE, 0xEC, 0xEA, 0xE8, 0xE6, 0xE4, 0xE3,
+    0xE1, 0xDF, 0xDD, 0xDC, 0xDA, 0xD8, 0xD6, 0xD5, 0xD3, 0xD1, 0xD0, 0xCE, 0xCD, 0xCB, 0xC9, 0xC8,
+    0xC6, 0xC5, 0xC3, 0xC1, 0xC0, 0xBE, 0xBD, 0xBB, 0xBA, 0xB8, 0xB7, 0xB5, 0xB4, 0xB2, 0xB1, 0xB0,
+    0xAE, 0xAD, 0xAB, 0xAA, 0xA9, 0xA7, 0xA6, 0xA4, 0xA3, 0xA2, 0xA0, 0x9F, 0x9E, 0x9C, 0x9B, 0x9A,
+    0x99, 0x97, 0x96, 0x95, 0x94, 0x92, 0x91, 0x90, 0x8F, 0x8D, 0x8C, 0x8B, 0x8A, 0x89, 0x87, 0x86,
+    0x85, 0x84, 0x83, 0x82, 0x81, 0x7F, 0x7E, 0x7D, 0x7C, 0x7B, 0x7A, 0x79, 0x78, 0x77, 0x75, 0x74,
+    0x73, 0x72, 0x71, 0x70, 0x6F, 0x6E, 0x6D, 0x6C, 0x6B, 0x6A, 0x69, 0x68, 0x67, 0x66, 0x65, 0x64,
+    0x63, 0x62, 0x61, 0x60, 0x5F, 0x5E, 0x5D, 0x5D, 0x5C, 0x5B, 0x5A, 0x59, 0x58, 0x57, 0x56, 0x55,
+    0x54, 0x53, 0x53, 0x52, 0x51, 0x50, 0x4F, 0x4E, 0x4D, 0x4D, 0x4C, 0x4B, 0x4A, 0x49, 0x48, 0x48,
+    0x47, 0x46, 0x45, 0x44, 0x43, 0x43, 0x42, 0x41, 0x40, 0x3F, 0x3F, 0x3E, 0x3D, 0x3C, 0x3C, 0x3B,
+    0x3A, 0x39, 0x39, 0x38, 0x37, 0x36, 0x36, 0x35, 0x34, 0x33, 0x33, 0x32, 0x31, 0x31, 0x30, 0x2F,
+    0x2E, 0x2E, 0x2D, 0x2C, 0x2C, 0x2B, 0x2A, 0x2A, 0x29, 0x28, 0x28, 0x27, 0x26, 0x26, 0x25, 0x24,
+    0x24, 0x23, 0x22, 0x22, 0x21, 0x20, 0x20, 0x1F, 0x1E, 0x1E, 0x1D, 0x1D, 0x1C, 0x1B, 0x1B, 0x1A,
+    0x19, 0x19, 0x18, 0x18, 0x17, 0x16, 0x16, 0x15, 0x15, 0x14, 0x14, 0x13, 0x12, 0x12, 0x11, 0x11,
+    0x10, 0x0F, 0x0F, 0x0E, 0x0E, 0x0D, 0x0D, 0x0C, 0x0C, 0x0B, 0x0A, 0x0A, 0x09, 0x09, 0x08, 0x08,
+    0x07, 0x07, 0x06, 0x06, 0x05, 0x05, 0x04, 0x04, 0x03, 0x03, 0x02, 0x02, 0x01, 0x01, 0x00, 0x00,
+    0x00,
+};
+
+static const i32 gfusx_gte_zero_translation[4] = {0};
+
+static void gfusx_gte_transform_scalar(const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, i64* out, u32* flag);
+static void gfusx_gte_transform3_scalar(const gfusx_cop2_smatrix3* m, const i32* t, const gfusx_cop2_svector3* v, i64 (*out)[3], u32* flag);
+static void gfusx_gte_set_mac_ir_scalar(gfusx_vm* vm, const i64* value, u32 shift, bool lm);
+static i64 gfusx_gte_nclip_scalar(const gfusx_cop2_data_regs* data);
+
+static i64 gfusx_gte_check_mac(u32* flag, u32 index, i64 value);
+static void gfusx_gte_set_ir(gfusx_vm* vm, u32 index, i32 value, bool lm);
+static void gfusx_gte_set_mac0(gfusx_vm* vm, i64 value);
+static void gfusx_gte_set_ir0(gfusx_vm* vm, i32 value);
+static void gfusx_gte_set_otz(gfusx_vm* vm, i32 value);
+static void gfusx_gte_push_sz(gfusx_vm* vm, i32 value);
+static void gfusx_gte_push_sxy(gfusx_vm* vm, i32 x, i32 y);
+static void gfusx_gte_push_color(gfusx_vm* vm);
+static u32 gfusx_gte_leading_zeros(u32 value, u32 bits);
+static u32 gfusx_gte_divide(gfusx_vm* vm, u32 lhs, u32 rhs);
+static void gfusx_gte_transform_ir(gfusx_vm* vm, const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, u32 shift, bool lm);
+static void gfusx_gte_project(gfusx_vm* vm, const i64* view, u32 shift, bool lm, bool last);
+static void gfusx_gte_mvmva(gfusx_vm* vm, u32 command, u32 shift, bool lm);
+static void gfusx_gte_interpolate_color(gfusx_vm* vm, const i64* in, u32 shift, bool lm);
+static void gfusx_gte_normal_dots(gfusx_vm* vm, u32 count, i64 (*dots)[3]);
+static void gfusx_gte_light(gfusx_vm* vm, const i64* dots, u32 shift, bool lm);
+static void gfusx_gte_ncs(gfusx_vm* vm, const i64* dots, u32 shift, bool lm);
+static void gfusx_gte_nccs(gfusx_vm* vm, const i64* dots, u32 shift, bool lm);
+static void gfusx_gte_ncds(gfusx_vm* vm, const i64* dots, u32 shift, bool lm);
+static void gfusx_gte_dpcs(gfusx_vm* vm, gfusx_cop2_cbgr color, u32 shift, bool lm);
+static void gfusx_gte_color_times_ir(gfusx_vm* vm, i64* out);
+
+const gfusx_gte_kernels gfusx_gte_scalar_kernels = {
+    .name = "scalar",
+    .transform = gfusx_gte_transform_scalar,
+    .transform3 = gfusx_gte_transform3_scalar,
+    .set_mac_ir = gfusx_gte_set_mac_ir_scalar,
+    .nclip = gfusx_gte_nclip_scalar,
+};
+
+void gfusx_gte_power_on(gfusx_vm* vm) {
+    vm->cop2d = (gfusx_cop2_data_regs) {0};
+    vm->cop2c = (gfusx_cop2_data_ctrl) {0};
+    vm->cop2d.lzcr = 32;
+
+    const gfusx_gte_kernels* simd = gfusx_gte_simd_kernels();
+    vm->gte = vm->settings.cpu.gte_reference || simd == NULL ? &gfusx_gte_scalar_kernels : simd;
+}
+
+/// ======================================================================== ///
+/// Register Access.                                                         ///
+/// ======================================================================== ///
+
+u32 gfusx_gte_read_data(gfusx_vm* vm, u32 index) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    switch (index) {
+        default: return d->r[index];
+
+        // SXYP mirrors the newest screen coordinate
+        case 15: return d->r[14];
+
+        // IRGB and ORGB both read back IR1-3 as a 15-bit color
+        case 28:
+        case 29: {
+            u32 color = 0;
+            for (u32 i = 0; i < 3; i++) {
+                i32 channel = (i32)d->r[GFUSX_GTE_DATA_IR1 + i] >> 7;
+                if (channel < 0) channel = 0;
+                if (channel > 0x1F) channel = 0x1F;
+                color |= (u32)channel << (i * 5);
+            }
+
+            return color;
+        }
+    }
+}
+
+void gfusx_gte_write_data(gfusx_vm* vm, u32 index, u32 value) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    switch (index) {
+        default: d->r[index] = value; break;
+
+        // the 16-bit registers keep their value sign or zero extended, which is
+        // what reads return
+        case 1: case 3: case 5: case 8: case 9: case 10: case 11: {
+            d->r[index] = (u32)(i32)(i16)value;
+        } break;
+
+        case 7: case 16: case 17: case 18: case 19: {
+            d->r[index] = value & 0xFFFF;
+        } break;
+
+        // writing SXYP pushes onto the screen coordinate FIFO
+        case 15: {
+            d->sxy0 = d->sxy1;
+            d->sxy1 = d->sxy2;
+            d->r[14] = value;
+            d->r[15] = value;
+        } break;
+
+        // IRGB expands a 15-bit color into IR1-3
+        case 28: {
+            d->irgb = value & 0x7FFF;
+            d->ir1 = (i32)((value & 0x1F) << 7);
+            d->ir2 = (i32)(((value >> 5) & 0x1F) << 7);
+            d->ir3 = (i32)(((value >> 10) & 0x1F) << 7);
+        } break;
+
+        // writing LZCS counts its leading sign bits into LZCR
+        case 30: {
+            d->lzcs = (i32)value;
+            d->lzcr = (i32)gfusx_gte_leading_zeros((i32)value < 0 ? ~value : value, 32);
+        } break;
+
+        case 29: case 31: break;
+    }
+}
+
+u32 gfusx_gte_read_ctrl(gfusx_vm* vm, u32 index) {
+    return vm->cop2c.r[index];
+}
+
+void gfusx_gte_write_ctrl(gfusx_vm* vm, u32 index, u32 value) {
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+    switch (index) {
+        default: c->r[index] = value; break;
+
+        // RT33, L33, LB3, H, DQA, ZSF3 and ZSF4 are 16-bit and read back sign
+        // extended, even H which is used unsigned
+        case 4: case 12: case 20: case 26: case 27: case 29: case 30: {
+            c->r[index] = (u32)(i32)(i16)value;
+        } break;
+
+        case 31: {
+            c->flag = value & 0x7FFFF000;
+            if ((c->flag & GFUSX_GTE_FLAG_ERROR_MASK) != 0) c->flag |= GFUSX_GTE_FLAG_ERROR;
+        } break;
+    }
+}
+
+/// ======================================================================== ///
+/// Commands.                                                                ///
+/// ======================================================================== ///
+
+void gfusx_gte_execute(gfusx_vm* vm, u32 command) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+    u32 shift = GFUSX_GTE_SHIFT(command);
+    bool lm = GFUSX_GTE_LM(command);
+    u32 op = command & 0x3F;
+
+    c->flag = 0;
+    vm->cycle += gfusx_gte_command_cycles[op];
+
+    switch (op) {
+        default: {
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Unimplemented GTE command %02X.", op);
+        } break;
+
+        case GFUSX_GTE_RTPS: {
+            i64 view[3];
+            vm->gte->transform(&c->rmatrix, &c->trx, &d->v0.x, view, &c->flag);
+            gfusx_gte_project(vm, view, shift, lm, true);
+        } break;
+
+        case GFUSX_GTE_RTPT: {
+            i64 views[3][3];
+            vm->gte->transform3(&c->rmatrix, &c->trx, &d->v0, views, &c->flag);
+            for (u32 i = 0; i < 3; i++) gfusx_gte_project(vm, views[i], shift, lm, i == 2);
+        } break;
+
+        // MAC0 = SX0*SY1 + SX1*SY2 + SX2*SY0 - SX0*SY2 - SX1*SY0 - SX2*SY1
+        case GFUSX_GTE_NCLIP: gfusx_gte_set_mac0(vm, vm->gte->nclip(d)); break;
+
+        // MAC1-3 = IR x (RT11, RT22, RT33)
+        case GFUSX_GTE_OP: {
+            i64 d1 = c->rmatrix.m11, d2 = c->rmatrix.m22, d3 = c->rmatrix.m33;
+            i64 value[3] = {
+                d->ir3 * d2 - d->ir2 * d3,
+                d->ir1 * d3 - d->ir3 * d1,
+                d->ir2 * d1 - d->ir1 * d2,
+            };
+
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+        } break;
+
+        case GFUSX_GTE_DPCS: gfusx_gte_dpcs(vm, d->rgb, shift, lm); break;
+
+        // DPCS on every entry of the color FIFO, oldest first
+        case GFUSX_GTE_DPCT: {
+            for (u32 i = 0; i < 3; i++) {
+                gfusx_gte_dpcs(vm, d->rgb0, shift, lm);
+            }
+        } break;
+
+        // interpolates IR1-3 towards the far color
+        case GFUSX_GTE_INTPL: {
+            i64 in[3] = { (i64)d->ir1 * 0x1000, (i64)d->ir2 * 0x1000, (i64)d->ir3 * 0x1000 };
+            gfusx_gte_interpolate_color(vm, in, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+
+        case GFUSX_GTE_MVMVA: gfusx_gte_mvmva(vm, command, shift, lm); break;
+
+        case GFUSX_GTE_NCS: {
+            i64 dots[1][3];
+            gfusx_gte_normal_dots(vm, 1, dots);
+            gfusx_gte_ncs(vm, dots[0], shift, lm);
+        } break;
+
+        case GFUSX_GTE_NCT: {
+            i64 dots[3][3];
+            gfusx_gte_normal_dots(vm, 3, dots);
+            for (u32 i = 0; i < 3; i++) gfusx_gte_ncs(vm, dots[i], shift, lm);
+        } break;
+
+        case GFUSX_GTE_NCCS: {
+            i64 dots[1][3];
+            gfusx_gte_normal_dots(vm, 1, dots);
+            gfusx_gte_nccs(vm, dots[0], shift, lm);
+        } break;
+
+        case GFUSX_GTE_NCCT: {
+            i64 dots[3][3];
+            gfusx_gte_normal_dots(vm, 3, dots);
+            for (u32 i = 0; i < 3; i++) gfusx_gte_nccs(vm, dots[i], shift, lm);
+        } break;
+
+        case GFUSX_GTE_NCDS: {
+            i64 dots[1][3];
+            gfusx_gte_normal_dots(vm, 1, dots);
+            gfusx_gte_ncds(vm, dots[0], shift, lm);
+        } break;
+
+        case GFUSX_GTE_NCDT: {
+            i64 dots[3][3];
+            gfusx_gte_normal_dots(vm, 3, dots);
+            for (u32 i = 0; i < 3; i++) gfusx_gte_ncds(vm, dots[i], shift, lm);
+        } break;
+
+        // lights IR1-3, which already hold the light intensities
+        case GFUSX_GTE_CC: {
+            i16 ir[3] = { (i16)d->ir1, (i16)d->ir2, (i16)d->ir3 };
+            gfusx_gte_transform_ir(vm, &c->cmatrix, &c->rbk, ir, shift, lm);
+
+            i64 value[3];
+            gfusx_gte_color_times_ir(vm, value);
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+
+        // CC followed by depth cueing
+        case GFUSX_GTE_CDP: {
+            i16 ir[3] = { (i16)d->ir1, (i16)d->ir2, (i16)d->ir3 };
+            gfusx_gte_transform_ir(vm, &c->cmatrix, &c->rbk, ir, shift, lm);
+
+            i64 in[3];
+            gfusx_gte_color_times_ir(vm, in);
+            gfusx_gte_interpolate_color(vm, in, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+
+        // depth cues RGBC with IR1-3 as the light intensities
+        case GFUSX_GTE_DCPL: {
+            i64 in[3];
+            gfusx_gte_color_times_ir(vm, in);
+            gfusx_gte_interpolate_color(vm, in, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+
+        // MAC1-3 = IR1-3 squared
+        case GFUSX_GTE_SQR: {
+            i64 value[3] = { (i64)d->ir1 * d->ir1, (i64)d->ir2 * d->ir2, (i64)d->ir3 * d->ir3 };
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+        } break;
+
+        // OTZ = ZSF3 * (SZ1 + SZ2 + SZ3) / 0x1000
+        case GFUSX_GTE_AVSZ3: {
+            i64 value = (i64)c->zsf3 * (i64)((u32)d->sz1.z + d->sz2.z + d->sz3.z);
+            gfusx_gte_set_mac0(vm, value);
+            gfusx_gte_set_otz(vm, (i32)(value >> 12));
+        } break;
+
+        // OTZ = ZSF4 * (SZ0 + SZ1 + SZ2 + SZ3) / 0x1000
+        case GFUSX_GTE_AVSZ4: {
+            i64 value = (i64)c->zsf4 * (i64)((u32)d->sz0.z + d->sz1.z + d->sz2.z + d->sz3.z);
+            gfusx_gte_set_mac0(vm, value);
+            gfusx_gte_set_otz(vm, (i32)(value >> 12));
+        } break;
+
+        // MAC1-3 = IR0 * IR1-3
+        case GFUSX_GTE_GPF: {
+            i64 value[3] = { (i64)d->ir0 * d->ir1, (i64)d->ir0 * d->ir2, (i64)d->ir0 * d->ir3 };
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+
+        // MAC1-3 += IR0 * IR1-3
+        case GFUSX_GTE_GPL: {
+            i64 value[3] = {
+                (i64)d->mac1 * ((i64)1 << shift) + (i64)d->ir0 * d->ir1,
+                (i64)d->mac2 * ((i64)1 << shift) + (i64)d->ir0 * d->ir2,
+                (i64)d->mac3 * ((i64)1 << shift) + (i64)d->ir0 * d->ir3,
+            };
+
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+            gfusx_gte_push_color(vm);
+        } break;
+    }
+
+    if ((c->flag & GFUSX_GTE_FLAG_ERROR_MASK) != 0) c->flag |= GFUSX_GTE_FLAG_ERROR;
+}
+
+/// Second half of a perspective transform: projects a vertex already rotated
+/// and translated into view space onto the screen FIFOs. The last vertex of a
+/// command also gets its depth cueing factor.
+static void gfusx_gte_project(gfusx_vm* vm, const i64* view, u32 shift, bool lm, bool last) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+
+    // NOTE(local): Without the shift, IR3 is still saturated from MAC3, but its
+    // flag is only raised when MAC3 >> 12 is out of range.
+    u32 ir3_flag = c->flag & GFUSX_GTE_FLAG_IR(3);
+    vm->gte->set_mac_ir(vm, view, shift, lm);
+    if (shift == 0) {
+        i32 z = (i32)(view[2] >> 12);
+        c->flag = (c->flag & ~GFUSX_GTE_FLAG_IR(3)) | ir3_flag;
+        if (z < GFUSX_GTE_IR_MIN || z > GFUSX_GTE_IR_MAX) c->flag |= GFUSX_GTE_FLAG_IR(3);
+    }
+
+    gfusx_gte_push_sz(vm, (i32)(view[2] >> 12));
+
+    i64 scale = gfusx_gte_divide(vm, (u16)c->h, d->sz3.z);
+    i64 x = scale * d->ir1 + c->ofx;
+    i64 y = scale * d->ir2 + c->ofy;
+    // MAC0 ends up with the depth cueing factor, only the flags of these stick
+    gfusx_gte_set_mac0(vm, x);
+    gfusx_gte_set_mac0(vm, y);
+    gfusx_gte_push_sxy(vm, (i32)(x >> 16), (i32)(y >> 16));
+
+    if (last) {
+        i64 depth = scale * (i16)c->dqa + c->dqb;
+        gfusx_gte_set_mac0(vm, depth);
+        gfusx_gte_set_ir0(vm, (i32)(depth >> 12));
+    }
+}
+
+/// Multiplies a vector by one of the matrices and adds a translation, all of
+/// which are picked by the command.
+static void gfusx_gte_mvmva(gfusx_vm* vm, u32 command, u32 shift, bool lm) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+
+    gfusx_cop2_smatrix3 garbage;
+    const gfusx_cop2_smatrix3* m;
+    switch (GFUSX_GTE_MX(command)) {
+        default:
+        case 0: m = &c->rmatrix; break;
+        case 1: m = &c->lmatrix; break;
+        case 2: m = &c->cmatrix; break;
+
+        // NOTE(local): The fourth matrix does not exist, the hardware ends up
+        // multiplying with bits of RGBC, IR0 and the rotation matrix.
+        case 3: {
+            i16 r = (i16)(d->rgb.r << 4);
+            garbage = (gfusx_cop2_smatrix3) {
+                .m11 = (i16)-r, .m12 = r, .m13 = (i16)d->ir0,
+                .m21 = c->rmatrix.m13, .m22 = c->rmatrix.m13, .m23 = c->rmatrix.m13,
+                .m31 = c->rmatrix.m22, .m32 = c->rmatrix.m22, .m33 = c->rmatrix.m22,
+            };
+
+            m = &garbage;
+        } break;
+    }
+
+    i16 v[3];
+    switch (GFUSX_GTE_VX(command)) {
+        default:
+        case 0: v[0] = d->v0.x; v[1] = d->v0.y; v[2] = d->v0.z; break;
+        case 1: v[0] = d->v1.x; v[1] = d->v1.y; v[2] = d->v1.z; break;
+        case 2: v[0] = d->v2.x; v[1] = d->v2.y; v[2] = d->v2.z; break;
+        case 3: v[0] = (i16)d->ir1; v[1] = (i16)d->ir2; v[2] = (i16)d->ir3; break;
+    }
+
+    switch (GFUSX_GTE_TX(command)) {
+        default:
+        case 0: gfusx_gte_transform_ir(vm, m, &c->trx, v, shift, lm); break;
+        case 1: gfusx_gte_transform_ir(vm, m, &c->rbk, v, shift, lm); break;
+        case 3: gfusx_gte_transform_ir(vm, m, gfusx_gte_zero_translation, v, shift, lm); break;
+
+        // NOTE(local): Translating by the far color is broken on hardware. The
+        // first column only contributes its flags, and the result is the
+        // product of the other two.
+        case 2: {
+            for (u32 i = 0; i < 3; i++) {
+                const i16* row = &m->m11 + i * 3;
+                i64 first = gfusx_gte_check_mac(&c->flag, i + 1, (i64)(&c->rfc)[i] * 0x1000 + (i64)row[0] * v[0]);
+                gfusx_gte_set_ir(vm, i + 1, (i32)(first >> shift), false);
+            }
+
+            i64 value[3];
+            for (u32 i = 0; i < 3; i++) {
+                const i16* row = &m->m11 + i * 3;
+                i64 sum = gfusx_gte_check_mac(&c->flag, i + 1, (i64)row[1] * v[1]);
+                value[i] = gfusx_gte_check_mac(&c->flag, i + 1, sum + (i64)row[2] * v[2]);
+            }
+
+            vm->gte->set_mac_ir(vm, value, shift, lm);
+        } break;
+    }
+}
+
+/// MAC1-3 and IR1-3 = (t << 12) + m * v, shifted.
+static void gfusx_gte_transform_ir(gfusx_vm* vm, const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, u32 shift, bool lm) {
+    i64 value[3];
+    vm->gte->transform(m, t, v, value, &vm->cop2c.flag);
+    vm->gte->set_mac_ir(vm, value, shift, lm);
+}
+
+/// Moves MAC1-3 towards the far color by IR0:
+/// MAC1-3 = in + (FC - in) * IR0, shifted.
+static void gfusx_gte_interpolate_color(gfusx_vm* vm, const i64* in, u32 shift, bool lm) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+
+    // FC - in is saturated into IR1-3 without lm on the way
+    i64 distance[3] = {
+        (i64)c->rfc * 0x1000 - in[0],
+        (i64)c->gfc * 0x1000 - in[1],
+        (i64)c->bfc * 0x1000 - in[2],
+    };
+
+    vm->gte->set_mac_ir(vm, distance, shift, false);
+
+    i64 value[3] = {
+        (i64)d->ir1 * d->ir0 + in[0],
+        (i64)d->ir2 * d->ir0 + in[1],
+        (i64)d->ir3 * d->ir0 + in[2],
+    };
+
+    vm->gte->set_mac_ir(vm, value, shift, lm);
+}
+
+/// LLM * V0-2: the dot products of the first `count` normals with the three
+/// light directions.
+static void gfusx_gte_normal_dots(gfusx_vm* vm, u32 count, i64 (*dots)[3]) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+
+    if (count == 3) {
+        vm->gte->transform3(&c->lmatrix, gfusx_gte_zero_translation, &d->v0, dots, &c->flag);
+    } else {
+        vm->gte->transform(&c->lmatrix, gfusx_gte_zero_translation, &d->v0.x, dots[0], &c->flag);
+    }
+}
+
+/// IR1-3 = BK + LCM * (LLM * v): the light intensity of a normal, in color.
+static void gfusx_gte_light(gfusx_vm* vm, const i64* dots, u32 shift, bool lm) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    gfusx_cop2_data_ctrl* c = &vm->cop2c;
+
+    vm->gte->set_mac_ir(vm, dots, shift, lm);
+
+    i16 ir[3] = { (i16)d->ir1, (i16)d->ir2, (i16)d->ir3 };
+    gfusx_gte_transform_ir(vm, &c->cmatrix, &c->rbk, ir, shift, lm);
+}
+
+// normal color: the light color itself
+static void gfusx_gte_ncs(gfusx_vm* vm, const i64* dots, u32 shift, bool lm) {
+    gfusx_gte_light(vm, dots, shift, lm);
+    gfusx_gte_push_color(vm);
+}
+
+// normal color color: the light color times RGBC
+static void gfusx_gte_nccs(gfusx_vm* vm, const i64* dots, u32 shift, bool lm) {
+    gfusx_gte_light(vm, dots, shift, lm);
+
+    i64 value[3];
+    gfusx_gte_color_times_ir(vm, value);
+    vm->gte->set_mac_ir(vm, value, shift, lm);
+    gfusx_gte_push_color(vm);
+}
+
+// normal color depth cue: the light color times RGBC, moved towards the far color
+static void gfusx_gte_ncds(gfusx_vm* vm, const i64* dots, u32 shift, bool lm) {
+    gfusx_gte_light(vm, dots, shift, lm);
+
+    i64 in[3];
+    gfusx_gte_color_times_ir(vm, in);
+    gfusx_gte_interpolate_color(vm, in, shift, lm);
+    gfusx_gte_push_color(vm);
+}
+
+// depth cue a single color
+static void gfusx_gte_dpcs(gfusx_vm* vm, gfusx_cop2_cbgr color, u32 shift, bool lm) {
+    i64 in[3] = { (i64)color.r << 16, (i64)color.g << 16, (i64)color.b << 16 };
+    gfusx_gte_interpolate_color(vm, in, shift, lm);
+    gfusx_gte_push_color(vm);
+}
+
+// out = (RGBC << 4) * IR1-3, per channel
+static void gfusx_gte_color_times_ir(gfusx_vm* vm, i64* out) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    out[0] = ((i64)d->rgb.r << 4) * d->ir1;
+    out[1] = ((i64)d->rgb.g << 4) * d->ir2;
+    out[2] = ((i64)d->rgb.b << 4) * d->ir3;
+}
+
+/// ======================================================================== ///
+/// Results and Saturation.                                                  ///
+/// ======================================================================== ///
+
+// Raises the overflow flags for MAC`index` and returns the value wrapped to 44 bits.
+static i64 gfusx_gte_check_mac(u32* flag, u32 index, i64 value) {
+    if (value > GFUSX_GTE_MAC_MAX) {
+        *flag |= GFUSX_GTE_FLAG_MAC_POSITIVE(index);
+    } else if (value < GFUSX_GTE_MAC_MIN) {
+        *flag |= GFUSX_GTE_FLAG_MAC_NEGATIVE(index);
+    }
+
+    return (i64)((u64)value << 20) >> 20;
+}
+
+static void gfusx_gte_set_ir(gfusx_vm* vm, u32 index, i32 value, bool lm) {
+    i32 min = lm ? 0 : GFUSX_GTE_IR_MIN;
+    if (value < min) {
+        value = min;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_IR(index);
+    } else if (value > GFUSX_GTE_IR_MAX) {
+        value = GFUSX_GTE_IR_MAX;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_IR(index);
+    }
+
+    vm->cop2d.r[GFUSX_GTE_DATA_IR1 + index - 1] = (u32)value;
+}
+
+static void gfusx_gte_set_mac0(gfusx_vm* vm, i64 value) {
+    if (value > INT32_MAX) {
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_MAC0_POSITIVE;
+    } else if (value < INT32_MIN) {
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_MAC0_NEGATIVE;
+    }
+
+    vm->cop2d.mac0 = (i32)(u32)value;
+}
+
+static void gfusx_gte_set_ir0(gfusx_vm* vm, i32 value) {
+    if (value < 0) {
+        value = 0;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_IR0;
+    } else if (value > 0x1000) {
+        value = 0x1000;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_IR0;
+    }
+
+    vm->cop2d.ir0 = value;
+}
+
+static void gfusx_gte_set_otz(gfusx_vm* vm, i32 value) {
+    if (value < 0) {
+        value = 0;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SZ_OTZ;
+    } else if (value > 0xFFFF) {
+        value = 0xFFFF;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SZ_OTZ;
+    }
+
+    vm->cop2d.otz = value;
+}
+
+static void gfusx_gte_push_sz(gfusx_vm* vm, i32 value) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    if (value < 0) {
+        value = 0;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SZ_OTZ;
+    } else if (value > 0xFFFF) {
+        value = 0xFFFF;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SZ_OTZ;
+    }
+
+    d->sz0 = d->sz1;
+    d->sz1 = d->sz2;
+    d->sz2 = d->sz3;
+    d->r[19] = (u32)value;
+}
+
+static void gfusx_gte_push_sxy(gfusx_vm* vm, i32 x, i32 y) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+    if (x < -0x400) {
+        x = -0x400;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SX2;
+    } else if (x > 0x3FF) {
+        x = 0x3FF;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SX2;
+    }
+
+    if (y < -0x400) {
+        y = -0x400;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SY2;
+    } else if (y > 0x3FF) {
+        y = 0x3FF;
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_SY2;
+    }
+
+    d->sxy0 = d->sxy1;
+    d->sxy1 = d->sxy2;
+    d->sxy2 = (gfusx_cop2_svector2) { .x = (i16)x, .y = (i16)y };
+    d->sxyp = d->sxy2;
+}
+
+// Pushes MAC1-3 / 16 onto the color FIFO, with the code byte of RGBC.
+static void gfusx_gte_push_color(gfusx_vm* vm) {
+    gfusx_cop2_data_regs* d = &vm->cop2d;
+
+    u8 channels[3];
+    for (u32 i = 0; i < 3; i++) {
+        i32 channel = (i32)d->r[GFUSX_GTE_DATA_MAC1 + i] >> 4;
+        if (channel < 0) {
+            channel = 0;
+            vm->cop2c.flag |= GFUSX_GTE_FLAG_COLOR(i + 1);
+        } else if (channel > 0xFF) {
+            channel = 0xFF;
+            vm->cop2c.flag |= GFUSX_GTE_FLAG_COLOR(i + 1);
+        }
+
+        channels[i] = (u8)channel;
+    }
+
+    d->rgb0 = d->rgb1;
+    d->rgb1 = d->rgb2;
+    d->rgb2 = (gfusx_cop2_cbgr) { .r = channels[0], .g = channels[1], .b = channels[2], .c = d->rgb.c };
+}
+
+static u32 gfusx_gte_leading_zeros(u32 value, u32 bits) {
+    u32 count = 0;
+    for (u32 bit = 1u << (bits - 1); bit != 0 && (value & bit) == 0; bit >>= 1) {
+        count++;
+    }
+
+    return count;
+}
+
+/// The divider behind the perspective projection: lhs / rhs as 1.16 fixed
+/// point, through a table seeded reciprocal rather than an exact division.
+static u32 gfusx_gte_divide(gfusx_vm* vm, u32 lhs, u32 rhs) {
+    if (rhs * 2 <= lhs) {
+        vm->cop2c.flag |= GFUSX_GTE_FLAG_DIVIDE;
+        return 0x1FFFF;
+    }
+
+    u32 shift = gfusx_gte_leading_zeros(rhs, 16);
+    lhs <<= shift;
+    rhs <<= shift;
+
+    i32 divisor = (i32)(rhs | 0x8000);
+    i32 x = 0x101 + gfusx_gte_unr_table[((divisor & 0x7FFF) + 0x40) >> 7];
+    i32 e = ((divisor * -x) + 0x80) >> 8;
+    u32 reciprocal = (u32)(((x * (0x20000 + e)) + 0x80) >> 8);
+    u32 result = (u32)(((u64)lhs * reciprocal + 0x8000) >> 16);
+
+    return result > 0x1FFFF ? 0x1FFFF : result;
+}
+
+/// ======================================================================== ///
+/// Scalar Kernels.                                                          ///
+/// ======================================================================== ///
+
+static void gfusx_gte_transform_scalar(const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, i64* out, u32* flag) {
+    for (u32 i = 0; i < 3; i++) {
+        const i16* row = &m->m11 + i * 3;
+        i64 sum = gfusx_gte_check_mac(flag, i + 1, (i64)t[i] * 0x1000 + (i64)row[0] * v[0]);
+        sum = gfusx_gte_check_mac(flag, i + 1, sum + (i64)row[1] * v[1]);
+        out[i] = gfusx_gte_check_mac(flag, i + 1, sum + (i64)row[2] * v[2]);
+    }
+}
+
+static void gfusx_gte_transform3_scalar(const gfusx_cop2_smatrix3* m, const i32* t, const gfusx_cop2_svector3* v, i64 (*out)[3], u32* flag) {
+    for (u32 i = 0; i < 3; i++) {
+        gfusx_gte_transform_scalar(m, t, &v[i].x, out[i], flag);
+    }
+}
+
+static void gfusx_gte_set_mac_ir_scalar(gfusx_vm* vm, const i64* value, u32 shift, bool lm) {
+    for (u32 i = 0; i < 3; i++) {
+        gfusx_gte_check_mac(&vm->cop2c.flag, i + 1, value[i]);
+        i32 mac = (i32)(u32)(value[i] >> shift);
+        vm->cop2d.r[GFUSX_GTE_DATA_MAC1 + i] = (u32)mac;
+        gfusx_gte_set_ir(vm, i + 1, mac, lm);
+    }
+}
+
+static i64 gfusx_gte_nclip_scalar(const gfusx_cop2_data_regs* d) {
+    i64 x0 = d->sxy0.x, y0 = d->sxy0.y;
+    i64 x1 = d->sxy1.x, y1 = d->sxy1.y;
+    i64 x2 = d->sxy2.x, y2 = d->sxy2.y;
+    return x0 * y1 + x1 * y2 + x2 * y0 - x0 * y2 - x1 * y0 - x2 * y1;
+}
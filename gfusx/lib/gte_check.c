@@ -0,0 +1,216 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+/// Feeds the SIMD GTE kernels and the scalar reference ones the same random
+/// inputs and compares everything they produce. The inputs lean towards the
+/// ends of their ranges, since that is where the overflow and saturation flags
+/// come from.
+
+typedef struct gfusx_gte_check {
+    const gfusx_gte_kernels* simd;
+    FILE* stream;
+    u64 state;
+    u64 iteration;
+} gfusx_gte_check;
+
+static u64 gfusx_gte_check_next(gfusx_gte_check* check);
+static i16 gfusx_gte_check_i16(gfusx_gte_check* check);
+static i32 gfusx_gte_check_i32(gfusx_gte_check* check);
+static i64 gfusx_gte_check_mac_value(gfusx_gte_check* check);
+static void gfusx_gte_check_matrix(gfusx_gte_check* check, gfusx_cop2_smatrix3* m);
+static bool gfusx_gte_check_transform(gfusx_gte_check* check);
+static bool gfusx_gte_check_set_mac_ir(gfusx_gte_check* check, gfusx_vm* reference, gfusx_vm* candidate);
+static bool gfusx_gte_check_nclip(gfusx_gte_check* check);
+
+bool gfusx_gte_check_kernels(u64 seed, u64 iterations, FILE* stream) {
+    gfusx_gte_check check = {
+        .simd = gfusx_gte_simd_kernels(),
+        .stream = stream,
+        // xorshift never leaves 0
+        .state = seed != 0 ? seed : 1,
+    };
+
+    if (check.simd == NULL) {
+        fprintf(stream, "This host has no SIMD GTE kernels, there is nothing to compare.\n");
+        return true;
+    }
+
+    // the kernels only touch the COP2 registers, so these are never powered on
+    gfusx_vm* reference = calloc(1, sizeof *reference);
+    gfusx_vm* candidate = calloc(1, sizeof *candidate);
+    kos_assert(reference != NULL && candidate != NULL);
+
+    bool matched = true;
+    for (; check.iteration < iterations; check.iteration++) {
+        if (!gfusx_gte_check_transform(&check) || !gfusx_gte_check_set_mac_ir(&check, reference, candidate) || !gfusx_gte_check_nclip(&check)) {
+            matched = false;
+            break;
+        }
+    }
+
+    if (matched) {
+        fprintf(stream, "The %s and scalar GTE kernels matched on %llu random inputs.\n", check.simd->name, (unsigned long long)iterations);
+    }
+
+    free(reference);
+    free(candidate);
+    return matched;
+}
+
+static u64 gfusx_gte_check_next(gfusx_gte_check* check) {
+    check->state ^= check->state << 13;
+    check->state ^= check->state >> 7;
+    check->state ^= check->state << 17;
+    return check->state;
+}
+
+static i16 gfusx_gte_check_i16(gfusx_gte_check* check) {
+    static const i16 edges[] = { INT16_MIN, INT16_MIN + 1, -1, 0, 1, INT16_MAX - 1, INT16_MAX };
+
+    u64 bits = gfusx_gte_check_next(check);
+    if ((bits & 3) == 0) return edges[(bits >> 2) % (sizeof edges / sizeof edges[0])];
+    return (i16)(bits >> 16);
+}
+
+static i32 gfusx_gte_check_i32(gfusx_gte_check* check) {
+    static const i32 edges[] = { INT32_MIN, -1, 0, 1, INT32_MAX };
+
+    u64 bits = gfusx_gte_check_next(check);
+    if ((bits & 3) == 0) return edges[(bits >> 2) % (sizeof edges / sizeof edges[0])];
+
+    // mostly small translations, with the occasional one that overflows on its own
+    i32 value = (i32)(u32)(bits >> 32);
+    return (bits & 4) ? value : value >> 12;
+}
+
+// anywhere from well inside the 44-bit MAC range to a few bits past it
+static i64 gfusx_gte_check_mac_value(gfusx_gte_check* check) {
+    u64 bits = gfusx_gte_check_next(check);
+    u32 magnitude = 16 + (u32)(bits % 33);
+    i64 value = (i64)(gfusx_gte_check_next(check) >> (64 - magnitude));
+    return (bits & 64) ? -value : value;
+}
+
+static void gfusx_gte_check_matrix(gfusx_gte_check* check, gfusx_cop2_smatrix3* m) {
+    i16* elements = &m->m11;
+    for (u32 i = 0; i < 9; i++) {
+        elements[i] = gfusx_gte_check_i16(check);
+    }
+}
+
+static bool gfusx_gte_check_transform(gfusx_gte_check* check) {
+    gfusx_cop2_smatrix3 m = {0};
+    gfusx_gte_check_matrix(check, &m);
+
+    i32 t[3];
+    gfusx_cop2_svector3 v[3] = {0};
+    for (u32 i = 0; i < 3; i++) {
+        t[i] = gfusx_gte_check_i32(check);
+        v[i].x = gfusx_gte_check_i16(check);
+        v[i].y = gfusx_gte_check_i16(check);
+        v[i].z = gfusx_gte_check_i16(check);
+    }
+
+    // whatever FLAG held before the command has to be kept by both
+    u32 initial_flag = (u32)gfusx_gte_check_next(check) & GFUSX_GTE_FLAG_IR(1);
+
+    i64 reference_out[3][3], candidate_out[3][3];
+    u32 reference_flag = initial_flag, candidate_flag = initial_flag;
+    gfusx_gte_scalar_kernels.transform3(&m, t, v, reference_out, &reference_flag);
+    check->simd->transform3(&m, t, v, candidate_out, &candidate_flag);
+
+    i64 reference_single[3], candidate_single[3];
+    u32 reference_single_flag = initial_flag, candidate_single_flag = initial_flag;
+    gfusx_gte_scalar_kernels.transform(&m, t, &v[0].x, reference_single, &reference_single_flag);
+    check->simd->transform(&m, t, &v[0].x, candidate_single, &candidate_single_flag);
+
+    bool matched = 0 == memcmp(reference_out, candidate_out, sizeof reference_out) && reference_flag == candidate_flag;
+    matched = matched && 0 == memcmp(reference_single, candidate_single, sizeof reference_single) && reference_single_flag == candidate_single_flag;
+    if (matched) return true;
+
+    fprintf(check->stream, "transform differs at iteration %llu:\n", (unsigned long long)check->iteration);
+    fprintf(check->stream, "  matrix %d %d %d / %d %d %d / %d %d %d\n", m.m11, m.m12, m.m13, m.m21, m.m22, m.m23, m.m31, m.m32, m.m33);
+    fprintf(check->stream, "  translation %d %d %d, flag before %08X\n", t[0], t[1], t[2], initial_flag);
+    for (u32 i = 0; i < 3; i++) {
+        fprintf(check->stream, "  vertex %d %d %d\n", v[i].x, v[i].y, v[i].z);
+        fprintf(check->stream, "    scalar %lld %lld %lld\n", (long long)reference_out[i][0], (long long)reference_out[i][1], (long long)reference_out[i][2]);
+        fprintf(check->stream, "    %-6s %lld %lld %lld\n", check->simd->name, (long long)candidate_out[i][0], (long long)candidate_out[i][1], (long long)candidate_out[i][2]);
+    }
+
+    fprintf(check->stream, "  flag: scalar %08X, %s %08X\n", reference_flag, check->simd->name, candidate_flag);
+    fprintf(check->stream, "  first vertex alone: scalar %lld %lld %lld flag %08X, %s %lld %lld %lld flag %08X\n",
+        (long long)reference_single[0], (long long)reference_single[1], (long long)reference_single[2], reference_single_flag, check->simd->name,
+        (long long)candidate_single[0], (long long)candidate_single[1], (long long)candidate_single[2], candidate_single_flag);
+    return false;
+}
+
+static bool gfusx_gte_check_set_mac_ir(gfusx_gte_check* check, gfusx_vm* reference, gfusx_vm* candidate) {
+    i64 value[3];
+    for (u32 i = 0; i < 3; i++) {
+        value[i] = gfusx_gte_check_mac_value(check);
+    }
+
+    u64 bits = gfusx_gte_check_next(check);
+    // the commands only ever shift by 0 or 12
+    u32 shift = (bits & 1) ? 12 : 0;
+    bool lm = (bits & 2) != 0;
+
+    reference->cop2d = (gfusx_cop2_data_regs) {0};
+    reference->cop2c = (gfusx_cop2_data_ctrl) {0};
+    reference->cop2c.flag = (u32)(bits >> 32) & GFUSX_GTE_FLAG_DIVIDE;
+    candidate->cop2d = reference->cop2d;
+    candidate->cop2c = reference->cop2c;
+
+    gfusx_gte_scalar_kernels.set_mac_ir(reference, value, shift, lm);
+    check->simd->set_mac_ir(candidate, value, shift, lm);
+
+    if (0 == memcmp(&reference->cop2d, &candidate->cop2d, sizeof reference->cop2d) && 0 == memcmp(&reference->cop2c, &candidate->cop2c, sizeof reference->cop2c)) {
+        return true;
+    }
+
+    fprintf(check->stream, "set_mac_ir differs at iteration %llu:\n", (unsigned long long)check->iteration);
+    fprintf(check->stream, "  value %lld %lld %lld, shift %u, lm %d\n", (long long)value[0], (long long)value[1], (long long)value[2], shift, lm);
+    for (u32 i = 0; i < 3; i++) {
+        fprintf(check->stream, "  MAC%u: scalar %08X, %s %08X; IR%u: scalar %08X, %s %08X\n",
+            i + 1, reference->cop2d.r[GFUSX_GTE_DATA_MAC1 + i], check->simd->name, candidate->cop2d.r[GFUSX_GTE_DATA_MAC1 + i],
+            i + 1, reference->cop2d.r[GFUSX_GTE_DATA_IR1 + i], check->simd->name, candidate->cop2d.r[GFUSX_GTE_DATA_IR1 + i]);
+    }
+
+    fprintf(check->stream, "  flag: scalar %08X, %s %08X\n", reference->cop2c.flag, check->simd->name, candidate->cop2c.flag);
+    return false;
+}
+
+static bool gfusx_gte_check_nclip(gfusx_gte_check* check) {
+    gfusx_cop2_data_regs d = {0};
+    d.sxy0 = (gfusx_cop2_svector2) { gfusx_gte_check_i16(check), gfusx_gte_check_i16(check) };
+    d.sxy1 = (gfusx_cop2_svector2) { gfusx_gte_check_i16(check), gfusx_gte_check_i16(check) };
+    d.sxy2 = (gfusx_cop2_svector2) { gfusx_gte_check_i16(check), gfusx_gte_check_i16(check) };
+
+    i64 reference = gfusx_gte_scalar_kernels.nclip(&d);
+    i64 candidate = check->simd->nclip(&d);
+    if (reference == candidate) return true;
+
+    fprintf(check->stream, "nclip differs at iteration %llu:\n", (unsigned long long)check->iteration);
+    fprintf(check->stream, "  SXY0 %d %d, SXY1 %d %d, SXY2 %d %d\n", d.sxy0.x, d.sxy0.y, d.sxy1.x, d.sxy1.y, d.sxy2.x, d.sxy2.y);
+    fprintf(check->stream, "  scalar %lld, %s %lld\n", (long long)reference, check->simd->name, (long long)candidate);
+    return false;
+}
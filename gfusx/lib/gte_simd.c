@@ -0,0 +1,196 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+/// SIMD versions of the GTE kernels. They are compiled for their instruction
+/// set with target attributes and only picked at runtime once the host says it
+/// has it, so the rest of the emulator keeps building for the baseline.
+/// Everything has to match the scalar kernels in gte.c exactly, flags included.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#    define GFUSX_HAS_GTE_AVX2 1
+#else
+#    define GFUSX_HAS_GTE_AVX2 0
+#endif
+
+#if GFUSX_HAS_GTE_AVX2
+
+#include <immintrin.h>
+
+#define GFUSX_AVX2 __attribute__((target("avx2")))
+
+static GFUSX_AVX2 void gfusx_gte_transform_avx2(const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, i64* out, u32* flag);
+static GFUSX_AVX2 void gfusx_gte_transform3_avx2(const gfusx_cop2_smatrix3* m, const i32* t, const gfusx_cop2_svector3* v, i64 (*out)[3], u32* flag);
+static GFUSX_AVX2 void gfusx_gte_set_mac_ir_avx2(gfusx_vm* vm, const i64* value, u32 shift, bool lm);
+static GFUSX_AVX2 i64 gfusx_gte_nclip_avx2(const gfusx_cop2_data_regs* data);
+
+static const gfusx_gte_kernels gfusx_gte_avx2_kernels = {
+    .name = "avx2",
+    .transform = gfusx_gte_transform_avx2,
+    .transform3 = gfusx_gte_transform3_avx2,
+    .set_mac_ir = gfusx_gte_set_mac_ir_avx2,
+    .nclip = gfusx_gte_nclip_avx2,
+};
+
+const gfusx_gte_kernels* gfusx_gte_simd_kernels(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &gfusx_gte_avx2_kernels;
+    return NULL;
+}
+
+// The three rows of a result live in the low three 64-bit lanes, the fourth
+// one is always zero so it never raises a flag.
+
+// Collects the lanes of `sum` outside the 44-bit MAC range into `positive` and
+// `negative`, and wraps them to 44 bits like the hardware accumulator.
+static GFUSX_AVX2 __m256i gfusx_gte_check_mac_avx2(__m256i sum, __m256i* positive, __m256i* negative) {
+    const __m256i max = _mm256_set1_epi64x(GFUSX_GTE_MAC_MAX);
+    const __m256i min = _mm256_set1_epi64x(GFUSX_GTE_MAC_MIN);
+    const __m256i mask = _mm256_set1_epi64x(((i64)1 << 44) - 1);
+
+    *positive = _mm256_or_si256(*positive, _mm256_cmpgt_epi64(sum, max));
+    *negative = _mm256_or_si256(*negative, _mm256_cmpgt_epi64(min, sum));
+
+    // no 64-bit arithmetic shift before AVX-512, so sign extend by biasing
+    // into the unsigned range and back
+    __m256i biased = _mm256_and_si256(_mm256_sub_epi64(sum, min), mask);
+    return _mm256_add_epi64(biased, min);
+}
+
+static GFUSX_AVX2 u32 gfusx_gte_mac_flags_avx2(__m256i positive, __m256i negative) {
+    u32 positive_lanes = (u32)_mm256_movemask_pd(_mm256_castsi256_pd(positive));
+    u32 negative_lanes = (u32)_mm256_movemask_pd(_mm256_castsi256_pd(negative));
+
+    u32 flag = 0;
+    for (u32 i = 0; i < 3; i++) {
+        if (positive_lanes & (1u << i)) flag |= GFUSX_GTE_FLAG_MAC_POSITIVE(i + 1);
+        if (negative_lanes & (1u << i)) flag |= GFUSX_GTE_FLAG_MAC_NEGATIVE(i + 1);
+    }
+
+    return flag;
+}
+
+// The matrix columns and the translation of a transform, set up once and
+// shared by all vertices of a command.
+typedef struct gfusx_gte_transform_avx2_setup {
+    __m256i column0, column1, column2;
+    __m256i translation;
+} gfusx_gte_transform_avx2_setup;
+
+static GFUSX_AVX2 gfusx_gte_transform_avx2_setup gfusx_gte_transform_setup_avx2(const gfusx_cop2_smatrix3* m, const i32* t) {
+    // mul_epi32 multiplies the low halves of each 64-bit lane, sign extended
+    return (gfusx_gte_transform_avx2_setup) {
+        .column0 = _mm256_set_epi64x(0, m->m31, m->m21, m->m11),
+        .column1 = _mm256_set_epi64x(0, m->m32, m->m22, m->m12),
+        .column2 = _mm256_set_epi64x(0, m->m33, m->m23, m->m13),
+        .translation = _mm256_slli_epi64(_mm256_set_epi64x(0, t[2], t[1], t[0]), 12),
+    };
+}
+
+static GFUSX_AVX2 void gfusx_gte_transform_vertex_avx2(const gfusx_gte_transform_avx2_setup* setup, const i16* v, i64* out, __m256i* positive, __m256i* negative) {
+    __m256i sum = setup->translation;
+    sum = _mm256_add_epi64(sum, _mm256_mul_epi32(setup->column0, _mm256_set1_epi64x(v[0])));
+    sum = gfusx_gte_check_mac_avx2(sum, positive, negative);
+    sum = _mm256_add_epi64(sum, _mm256_mul_epi32(setup->column1, _mm256_set1_epi64x(v[1])));
+    sum = gfusx_gte_check_mac_avx2(sum, positive, negative);
+    sum = _mm256_add_epi64(sum, _mm256_mul_epi32(setup->column2, _mm256_set1_epi64x(v[2])));
+    sum = gfusx_gte_check_mac_avx2(sum, positive, negative);
+
+    i64 lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, sum);
+    out[0] = lanes[0];
+    out[1] = lanes[1];
+    out[2] = lanes[2];
+}
+
+static GFUSX_AVX2 void gfusx_gte_transform_avx2(const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, i64* out, u32* flag) {
+    __m256i positive = _mm256_setzero_si256();
+    __m256i negative = _mm256_setzero_si256();
+
+    gfusx_gte_transform_avx2_setup setup = gfusx_gte_transform_setup_avx2(m, t);
+    gfusx_gte_transform_vertex_avx2(&setup, v, out, &positive, &negative);
+
+    *flag |= gfusx_gte_mac_flags_avx2(positive, negative);
+}
+
+static GFUSX_AVX2 void gfusx_gte_transform3_avx2(const gfusx_cop2_smatrix3* m, const i32* t, const gfusx_cop2_svector3* v, i64 (*out)[3], u32* flag) {
+    __m256i positive = _mm256_setzero_si256();
+    __m256i negative = _mm256_setzero_si256();
+
+    // the flags are sticky over the whole command, so they are only gathered
+    // from the lanes once at the end
+    gfusx_gte_transform_avx2_setup setup = gfusx_gte_transform_setup_avx2(m, t);
+    for (u32 i = 0; i < 3; i++) {
+        gfusx_gte_transform_vertex_avx2(&setup, &v[i].x, out[i], &positive, &negative);
+    }
+
+    *flag |= gfusx_gte_mac_flags_avx2(positive, negative);
+}
+
+static GFUSX_AVX2 void gfusx_gte_set_mac_ir_avx2(gfusx_vm* vm, const i64* value, u32 shift, bool lm) {
+    __m256i positive = _mm256_setzero_si256();
+    __m256i negative = _mm256_setzero_si256();
+
+    __m256i sum = _mm256_set_epi64x(0, value[2], value[1], value[0]);
+    gfusx_gte_check_mac_avx2(sum, &positive, &negative);
+
+    // the low 32 bits of a right shift by at most 12 are the same whether it
+    // is arithmetic or logical, so the missing arithmetic one is not needed
+    sum = _mm256_srl_epi64(sum, _mm_cvtsi32_si128((int)shift));
+    __m128i mac = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(sum, _mm256_set_epi32(7, 7, 7, 7, 6, 4, 2, 0)));
+
+    __m128i ir = _mm_min_epi32(_mm_max_epi32(mac, _mm_set1_epi32(lm ? 0 : GFUSX_GTE_IR_MIN)), _mm_set1_epi32(GFUSX_GTE_IR_MAX));
+    u32 saturated = ~(u32)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ir, mac)));
+
+    const __m128i first_three = _mm_set_epi32(0, -1, -1, -1);
+    _mm_maskstore_epi32((int*)&vm->cop2d.r[GFUSX_GTE_DATA_MAC1], first_three, mac);
+    _mm_maskstore_epi32((int*)&vm->cop2d.r[GFUSX_GTE_DATA_IR1], first_three, ir);
+
+    u32 flag = gfusx_gte_mac_flags_avx2(positive, negative);
+    for (u32 i = 0; i < 3; i++) {
+        if (saturated & (1u << i)) flag |= GFUSX_GTE_FLAG_IR(i + 1);
+    }
+
+    vm->cop2c.flag |= flag;
+}
+
+static GFUSX_AVX2 i64 gfusx_gte_nclip_avx2(const gfusx_cop2_data_regs* d) {
+    // SX0*SY1 + SX1*SY2 + SX2*SY0 - (SX0*SY2 + SX1*SY0 + SX2*SY1); the 16-bit
+    // products are exact in 32 bits, only their sums need 64
+    __m128i x = _mm_set_epi32(0, d->sxy2.x, d->sxy1.x, d->sxy0.x);
+    __m128i y_next = _mm_set_epi32(0, d->sxy0.y, d->sxy2.y, d->sxy1.y);
+    __m128i y_prev = _mm_set_epi32(0, d->sxy1.y, d->sxy0.y, d->sxy2.y);
+
+    __m256i plus = _mm256_cvtepi32_epi64(_mm_mullo_epi32(x, y_next));
+    __m256i minus = _mm256_cvtepi32_epi64(_mm_mullo_epi32(x, y_prev));
+    __m256i difference = _mm256_sub_epi64(plus, minus);
+
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(difference), _mm256_extracti128_si256(difference, 1));
+    return _mm_cvtsi128_si64(sum) + _mm_extract_epi64(sum, 1);
+}
+
+#else
+
+const gfusx_gte_kernels* gfusx_gte_simd_kernels(void) {
+    return NULL;
+}
+
+#endif
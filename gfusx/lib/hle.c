@@ -0,0 +1,318 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <string.h>
+
+// Blocks handed out by malloc are aligned like the largest guest type.
+#define GFUSX_HLE_HEAP_ALIGNMENT 8u
+
+static const char* const gfusx_hle_function_names[GFUSX_HLE_FUNCTION_COUNT] = {
+#define X(Id, Name) [GFUSX_HLE_##Id] = Name,
+    GFUSX_HLE_FUNCTIONS(X)
+#undef X
+};
+
+static void gfusx_hle_copy(gfusx_vm* vm, u32 dst, u32 src, u32 size);
+static void gfusx_hle_fill(gfusx_vm* vm, u32 dst, u8 value, u32 size);
+static u32 gfusx_hle_string_length(gfusx_vm* vm, u32 str);
+static void gfusx_hle_init_heap(gfusx_vm* vm, u32 base, u32 size);
+static u32 gfusx_hle_malloc(gfusx_vm* vm, u32 size);
+static void gfusx_hle_free(gfusx_vm* vm, u32 address);
+static void gfusx_hle_insert_block(gfusx_hle_heap* heap, isize index, gfusx_hle_block block);
+static void gfusx_hle_remove_block(gfusx_hle_heap* heap, isize index);
+
+bool gfusx_vm_hle_attach(gfusx_vm* vm, u32 address, gfusx_hle_function function) {
+    kos_assert(function < GFUSX_HLE_FUNCTION_COUNT);
+    if ((address & 3) != 0 || address >= GFUSX_CODE_SIZE) return false;
+
+    gfusx_hle_entries* entries = &vm->hle_entries;
+    isize index = gfusx_hle_lower_bound(vm, address);
+    if (index < entries->count && entries->data[index].address == address) {
+        entries->data[index].function = function;
+    } else {
+        // the uncached interpreter only looks for entries if it was entered with any
+        if (entries->count == 0) gfusx_vm_reenter(vm);
+        kos_da_push(entries, (gfusx_hle_entry) {0});
+        memmove(&entries->data[index + 1], &entries->data[index], (usize)(entries->count - 1 - index) * sizeof *entries->data);
+        entries->data[index] = (gfusx_hle_entry) {
+            .address = address,
+            .function = function,
+        };
+    }
+
+    // code that is already decoded has to be decoded again to pick the entry up
+    gfusx_vm_invalidate_code(vm, address, 4);
+    return true;
+}
+
+isize gfusx_vm_hle_attach_symbols(gfusx_vm* vm, const gfusx_symbols* symbols) {
+    isize attached = 0;
+    for (isize i = 0; i < symbols->count; i++) {
+        const char* name = gfusx_symbol_name(symbols, &symbols->data[i]);
+        for (u32 function = 0; function < GFUSX_HLE_FUNCTION_COUNT; function++) {
+            if (0 != strcmp(name, gfusx_hle_function_names[function])) continue;
+            if (gfusx_vm_hle_attach(vm, symbols->data[i].address, (gfusx_hle_function)function)) attached++;
+            break;
+        }
+    }
+
+    return attached;
+}
+
+const char* gfusx_hle_function_name(gfusx_hle_function function) {
+    if (function >= GFUSX_HLE_FUNCTION_COUNT) return "unknown";
+    return gfusx_hle_function_names[function];
+}
+
+isize gfusx_hle_lower_bound(gfusx_vm* vm, u32 address) {
+    isize low = 0, high = vm->hle_entries.count;
+    while (low < high) {
+        isize middle = low + (high - low) / 2;
+        if (vm->hle_entries.data[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+const gfusx_hle_entry* gfusx_hle_find(gfusx_vm* vm, u32 address) {
+    isize index = gfusx_hle_lower_bound(vm, address);
+    if (index == vm->hle_entries.count || vm->hle_entries.data[index].address != address) return NULL;
+    return &vm->hle_entries.data[index];
+}
+
+void gfusx_hle_call(gfusx_vm* vm, gfusx_hle_function function) {
+    gfusx_mips_gpregs* gpr = &vm->gpr;
+    u64 bytes = 0;
+
+    switch (function) {
+        default: {
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Unknown HLE function %u.", (u32)function);
+        } break;
+
+        case GFUSX_HLE_MEMCPY: {
+            gfusx_hle_copy(vm, gpr->a0, gpr->a1, gpr->a2);
+            bytes = gpr->a2;
+            gpr->v0 = gpr->a0;
+        } break;
+
+        case GFUSX_HLE_MEMSET: {
+            gfusx_hle_fill(vm, gpr->a0, (u8)gpr->a1, gpr->a2);
+            bytes = gpr->a2;
+            gpr->v0 = gpr->a0;
+        } break;
+
+        case GFUSX_HLE_STRLEN: {
+            gpr->v0 = gfusx_hle_string_length(vm, gpr->a0);
+            bytes = (u64)gpr->v0 + 1;
+        } break;
+
+        case GFUSX_HLE_INIT_HEAP: gfusx_hle_init_heap(vm, gpr->a0, gpr->a1); break;
+        case GFUSX_HLE_MALLOC: gpr->v0 = gfusx_hle_malloc(vm, gpr->a0); break;
+        case GFUSX_HLE_FREE: gfusx_hle_free(vm, gpr->a0); break;
+    }
+
+    u32 call_cycles = vm->settings.hle.call_cycles != 0 ? vm->settings.hle.call_cycles : GFUSX_HLE_DEFAULT_CALL_CYCLES;
+    u32 byte_cycles = vm->settings.hle.byte_cycles != 0 ? vm->settings.hle.byte_cycles : GFUSX_HLE_DEFAULT_BYTE_CYCLES;
+    vm->cycle += call_cycles + bytes * byte_cycles;
+}
+
+void gfusx_hle_free_all(gfusx_vm* vm) {
+    kos_da_dealloc(&vm->hle_entries);
+    kos_da_dealloc(&vm->hle_heap);
+}
+
+void gfusx_hle_restore_heap(gfusx_vm* vm, const void* blocks, isize count) {
+    vm->hle_heap.count = 0;
+    for (isize i = 0; i < count; i++) {
+        gfusx_hle_block block;
+        memcpy(&block, (const u8*)blocks + (usize)i * sizeof block, sizeof block);
+        kos_da_push(&vm->hle_heap, block);
+    }
+}
+
+/// ======================================================================== ///
+/// Memory Routines.                                                         ///
+/// ======================================================================== ///
+
+// Both work a page at a time through the page tables where they can, and fall
+// back to single bytes through the slow path for MMIO, ROM and code pages.
+
+static void gfusx_hle_copy(gfusx_vm* vm, u32 dst, u32 src, u32 size) {
+    while (size > 0) {
+        u32 chunk = GFUSX_PAGE_SIZE - (dst & GFUSX_PAGE_MASK);
+        if (chunk > GFUSX_PAGE_SIZE - (src & GFUSX_PAGE_MASK)) chunk = GFUSX_PAGE_SIZE - (src & GFUSX_PAGE_MASK);
+        if (chunk > size) chunk = size;
+
+        u8* to = vm->write_pages[dst >> GFUSX_PAGE_SHIFT];
+        u8* from = vm->read_pages[src >> GFUSX_PAGE_SHIFT];
+        // NOTE(local): A destination just past the source repeats the overlapping
+        // bytes, like the forward copy loop the guest would run.
+        if (to != NULL && from != NULL && dst - src >= chunk) {
+            memmove(&to[dst & GFUSX_PAGE_MASK], &from[src & GFUSX_PAGE_MASK], chunk);
+            gfusx_mem_mark_dirty(vm, dst);
+        } else {
+            for (u32 i = 0; i < chunk; i++) {
+                gfusx_mem_write8_paged(vm, dst + i, gfusx_mem_read8_paged(vm, src + i));
+            }
+        }
+
+        dst += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+}
+
+static void gfusx_hle_fill(gfusx_vm* vm, u32 dst, u8 value, u32 size) {
+    while (size > 0) {
+        u32 chunk = GFUSX_PAGE_SIZE - (dst & GFUSX_PAGE_MASK);
+        if (chunk > size) chunk = size;
+
+        u8* to = vm->write_pages[dst >> GFUSX_PAGE_SHIFT];
+        if (to != NULL) {
+            memset(&to[dst & GFUSX_PAGE_MASK], value, chunk);
+            gfusx_mem_mark_dirty(vm, dst);
+        } else {
+            for (u32 i = 0; i < chunk; i++) {
+                gfusx_mem_write8_paged(vm, dst + i, value);
+            }
+        }
+
+        dst += chunk;
+        size -= chunk;
+    }
+}
+
+static u32 gfusx_hle_string_length(gfusx_vm* vm, u32 str) {
+    u32 length = 0;
+    for (;;) {
+        u32 addr = str + length;
+        u32 chunk = GFUSX_PAGE_SIZE - (addr & GFUSX_PAGE_MASK);
+
+        u8* page = vm->read_pages[addr >> GFUSX_PAGE_SHIFT];
+        if (page != NULL) {
+            const u8* start = &page[addr & GFUSX_PAGE_MASK];
+            const u8* end = memchr(start, 0, chunk);
+            if (end != NULL) return length + (u32)(end - start);
+            length += chunk;
+        } else {
+            // unmapped memory reads as zero, so this ends at the latest there
+            if (gfusx_mem_read8_paged(vm, addr) == 0) return length;
+            length++;
+        }
+    }
+}
+
+/// ======================================================================== ///
+/// Heap.                                                                    ///
+/// ======================================================================== ///
+
+static void gfusx_hle_init_heap(gfusx_vm* vm, u32 base, u32 size) {
+    gfusx_hle_heap* heap = &vm->hle_heap;
+    heap->count = 0;
+
+    u32 start = (base + GFUSX_HLE_HEAP_ALIGNMENT - 1) & ~(GFUSX_HLE_HEAP_ALIGNMENT - 1);
+    if (size < start - base + GFUSX_HLE_HEAP_ALIGNMENT) {
+        gfusx_vm_logf(vm, GFUSX_LC_CPU, "Heap of %u bytes at 0x%08X is too small to use.", size, base);
+        return;
+    }
+
+    u32 usable = (size - (start - base)) & ~(GFUSX_HLE_HEAP_ALIGNMENT - 1);
+    kos_da_push(heap, ((gfusx_hle_block) {.address = start, .size = usable}));
+}
+
+// first fit, splitting off whatever is left of the block
+static u32 gfusx_hle_malloc(gfusx_vm* vm, u32 size) {
+    gfusx_hle_heap* heap = &vm->hle_heap;
+    if (size == 0) size = 1;
+    if (size > UINT32_MAX - GFUSX_HLE_HEAP_ALIGNMENT) return 0;
+    size = (size + GFUSX_HLE_HEAP_ALIGNMENT - 1) & ~(GFUSX_HLE_HEAP_ALIGNMENT - 1);
+
+    for (isize i = 0; i < heap->count; i++) {
+        gfusx_hle_block* block = &heap->data[i];
+        if (block->used || block->size < size) continue;
+
+        u32 address = block->address;
+        if (block->size > size) {
+            gfusx_hle_block rest = {
+                .address = address + size,
+                .size = block->size - size,
+            };
+
+            block->size = size;
+            gfusx_hle_insert_block(heap, i + 1, rest);
+        }
+
+        heap->data[i].used = true;
+        return address;
+    }
+
+    if (heap->count == 0) {
+        gfusx_vm_logf(vm, GFUSX_LC_CPU, "malloc(%u) before InitHeap.", size);
+    }
+
+    return 0;
+}
+
+// merges the block with its free neighbours, so a later malloc can use them as one
+static void gfusx_hle_free(gfusx_vm* vm, u32 address) {
+    gfusx_hle_heap* heap = &vm->hle_heap;
+    if (address == 0) return;
+
+    isize index = -1;
+    for (isize i = 0; i < heap->count; i++) {
+        if (heap->data[i].address == address && heap->data[i].used) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        gfusx_vm_logf(vm, GFUSX_LC_CPU, "free(0x%08X) of memory that was not allocated.", address);
+        return;
+    }
+
+    heap->data[index].used = false;
+    if (index + 1 < heap->count && !heap->data[index + 1].used) {
+        heap->data[index].size += heap->data[index + 1].size;
+        gfusx_hle_remove_block(heap, index + 1);
+    }
+
+    if (index > 0 && !heap->data[index - 1].used) {
+        heap->data[index - 1].size += heap->data[index].size;
+        gfusx_hle_remove_block(heap, index);
+    }
+}
+
+static void gfusx_hle_insert_block(gfusx_hle_heap* heap, isize index, gfusx_hle_block block) {
+    kos_da_push(heap, block);
+    memmove(&heap->data[index + 1], &heap->data[index], (usize)(heap->count - 1 - index) * sizeof *heap->data);
+    heap->data[index] = block;
+}
+
+static void gfusx_hle_remove_block(gfusx_hle_heap* heap, isize index) {
+    memmove(&heap->data[index], &heap->data[index + 1], (usize)(heap->count - 1 - index) * sizeof *heap->data);
+    heap->count--;
+}
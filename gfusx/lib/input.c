@@ -0,0 +1,171 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#define GFUSX_INPUT_MAGIC "GFUI"
+#define GFUSX_INPUT_VERSION 1
+
+typedef struct gfusx_input_record {
+    u64 cycle;
+    gfusx_input_kind kind;
+    u32 source;
+    u32 value;
+} gfusx_input_record;
+
+static void gfusx_input_write_varint(gfusx_input_data* data, u64 value);
+static bool gfusx_input_read_varint(const gfusx_input_log* log, isize* position, u64* value);
+static bool gfusx_input_read_record(const gfusx_input_log* log, isize* position, gfusx_input_record* record);
+
+u32 gfusx_vm_input(gfusx_vm* vm, gfusx_input_kind kind, u32 source, u32 value) {
+    gfusx_input_log* log = vm->input;
+    if (log == NULL || log->desynced) return value;
+
+    if (log->mode == GFUSX_INPUT_RECORD) {
+        gfusx_input_write_varint(&log->data, vm->cycle - log->last_cycle);
+        kos_da_push(&log->data, (u8)kind);
+        gfusx_input_write_varint(&log->data, source);
+        gfusx_input_write_varint(&log->data, value);
+        log->last_cycle = vm->cycle;
+        return value;
+    }
+
+    gfusx_input_record record;
+    isize position = log->position;
+    if (!gfusx_input_read_record(log, &position, &record)) {
+        gfusx_vm_logf(vm, GFUSX_LC_INPUT, "Input replay ran out at cycle %llu.", (unsigned long long)vm->cycle);
+        log->desynced = true;
+        gfusx_vm_stop(vm, GFUSX_STOP_DESYNC, 0);
+        return value;
+    }
+
+    if (record.cycle != vm->cycle || record.kind != kind || record.source != source) {
+        gfusx_vm_logf(vm, GFUSX_LC_INPUT, "Input replay diverged at cycle %llu: expected input %d from 0x%08X at cycle %llu, got input %d from 0x%08X.",
+            (unsigned long long)vm->cycle, (int)record.kind, record.source, (unsigned long long)record.cycle, (int)kind, source);
+        log->desynced = true;
+        gfusx_vm_stop(vm, GFUSX_STOP_DESYNC, 0);
+        return value;
+    }
+
+    log->position = position;
+    log->last_cycle = record.cycle;
+    return record.value;
+}
+
+bool gfusx_vm_input_peek(gfusx_vm* vm, u64* cycle, gfusx_input_kind* kind, u32* source) {
+    gfusx_input_log* log = vm->input;
+    if (log == NULL || log->mode != GFUSX_INPUT_REPLAY || log->desynced) return false;
+
+    gfusx_input_record record;
+    isize position = log->position;
+    if (!gfusx_input_read_record(log, &position, &record)) return false;
+
+    if (cycle != NULL) *cycle = record.cycle;
+    if (kind != NULL) *kind = record.kind;
+    if (source != NULL) *source = record.source;
+    return true;
+}
+
+bool gfusx_input_log_load(gfusx_input_log* log, const char* file_path) {
+    bool result = true;
+
+    *log = (gfusx_input_log) {
+        .mode = GFUSX_INPUT_REPLAY,
+    };
+
+    FILE* stream = fopen(file_path, "rb");
+    if (stream == NULL) return false;
+
+    char magic[4];
+    u32 version;
+    u64 size;
+    if (1 != fread(magic, sizeof magic, 1, stream) || 0 != memcmp(magic, GFUSX_INPUT_MAGIC, sizeof magic)) kos_return_defer(false);
+    if (1 != fread(&version, sizeof version, 1, stream) || version != GFUSX_INPUT_VERSION) kos_return_defer(false);
+    if (1 != fread(&size, sizeof size, 1, stream) || size > PTRDIFF_MAX) kos_return_defer(false);
+
+    log->data.data = malloc(size == 0 ? 1 : (usize)size);
+    log->data.capacity = (isize)size;
+    if (log->data.data == NULL) kos_return_defer(false);
+
+    if (size != fread(log->data.data, 1, (usize)size, stream)) kos_return_defer(false);
+    log->data.count = (isize)size;
+
+defer:;
+    fclose(stream);
+    if (!result) gfusx_input_log_free(log);
+    return result;
+}
+
+bool gfusx_input_log_save(const gfusx_input_log* log, const char* file_path) {
+    FILE* stream = fopen(file_path, "wb");
+    if (stream == NULL) return false;
+
+    u32 version = GFUSX_INPUT_VERSION;
+    u64 size = (u64)log->data.count;
+
+    bool result = 1 == fwrite(GFUSX_INPUT_MAGIC, 4, 1, stream)
+        && 1 == fwrite(&version, sizeof version, 1, stream)
+        && 1 == fwrite(&size, sizeof size, 1, stream)
+        && (usize)size == fwrite(log->data.data, 1, (usize)size, stream);
+
+    if (0 != fclose(stream)) result = false;
+    return result;
+}
+
+void gfusx_input_log_free(gfusx_input_log* log) {
+    kos_da_dealloc(&log->data);
+    *log = (gfusx_input_log) {0};
+}
+
+static void gfusx_input_write_varint(gfusx_input_data* data, u64 value) {
+    do {
+        u8 byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        kos_da_push(data, byte);
+    } while (value != 0);
+}
+
+static bool gfusx_input_read_varint(const gfusx_input_log* log, isize* position, u64* value) {
+    *value = 0;
+    for (u32 shift = 0; shift < 64; shift += 7) {
+        if (*position >= log->data.count) return false;
+
+        u8 byte = log->data.data[(*position)++];
+        *value |= (u64)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+
+    return false;
+}
+
+static bool gfusx_input_read_record(const gfusx_input_log* log, isize* position, gfusx_input_record* record) {
+    u64 delta, source, value;
+    if (!gfusx_input_read_varint(log, position, &delta)) return false;
+    if (*position >= log->data.count) return false;
+    record->kind = (gfusx_input_kind)log->data.data[(*position)++];
+    if (!gfusx_input_read_varint(log, position, &source)) return false;
+    if (!gfusx_input_read_varint(log, position, &value)) return false;
+
+    record->cycle = log->last_cycle + delta;
+    record->source = (u32)source;
+    record->value = (u32)value;
+    return true;
+}
@@ -0,0 +1,634 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+// mmap's MAP_ANONYMOUS is not part of strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "vm_internal.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/// The recompiler translates runs of pre-decoded instructions into host code.
+/// Guest registers stay in the VM state; blocks only save on dispatch and on
+/// the per-instruction bookkeeping the interpreter would otherwise do. Simple
+/// ALU operations are emitted inline, everything else calls the interpreter's
+/// handler for the decoded instruction.
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#    define GFUSX_HAS_JIT 1
+#else
+#    define GFUSX_HAS_JIT 0
+#endif
+
+#if GFUSX_HAS_JIT
+
+#include <sys/mman.h>
+
+#define GFUSX_JIT_ARENA_SIZE (16u * 1024u * 1024u)
+// Worst case is an inlined load in a delay slot: the instruction cache check,
+// a handful of bookkeeping stores, the alignment check with its handler call,
+// the load itself and the out-of-line retire, a bit over 256.
+#define GFUSX_JIT_MAX_INST_SIZE 320
+#define GFUSX_JIT_MAX_BLOCK_INSTS 64
+
+typedef bool (*gfusx_jit_block)(gfusx_vm* vm);
+
+typedef struct gfusx_jit_page {
+    gfusx_jit_block blocks[GFUSX_PAGE_SIZE / 4];
+} gfusx_jit_page;
+
+struct gfusx_jit {
+    u8* arena;
+    usize arena_used;
+    gfusx_jit_page* pages[GFUSX_CODE_PAGE_COUNT];
+};
+
+typedef struct gfusx_jit_emitter {
+    u8* start;
+    u8* cursor;
+} gfusx_jit_emitter;
+
+#define GFUSX_VM_OFFSET(Field) ((u32)offsetof(gfusx_vm, Field))
+#define GFUSX_GPR_OFFSET(Reg) (GFUSX_VM_OFFSET(gpr.r) + (u32)(Reg) * 4)
+
+static void gfusx_jit_flush(gfusx_jit* jit);
+static gfusx_jit_block gfusx_jit_compile(gfusx_vm* vm, u32 pc);
+
+bool gfusx_jit_create(gfusx_vm* vm) {
+    gfusx_jit* jit = calloc(1, sizeof *jit);
+    if (jit == NULL) return false;
+
+    void* arena = mmap(NULL, GFUSX_JIT_ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        free(jit);
+        return false;
+    }
+
+    jit->arena = arena;
+    vm->jit = jit;
+    return true;
+}
+
+void gfusx_jit_destroy(gfusx_vm* vm) {
+    gfusx_jit* jit = vm->jit;
+    if (jit == NULL) return;
+
+    gfusx_jit_flush(jit);
+    munmap(jit->arena, GFUSX_JIT_ARENA_SIZE);
+    free(jit);
+    vm->jit = NULL;
+}
+
+void gfusx_jit_invalidate_page(gfusx_vm* vm, u32 page_index) {
+    gfusx_jit* jit = vm->jit;
+    if (jit == NULL || page_index >= GFUSX_CODE_PAGE_COUNT) return;
+
+    // NOTE(local): The host code stays in the arena until the next flush, only
+    // the lookup goes away.
+    free(jit->pages[page_index]);
+    jit->pages[page_index] = NULL;
+}
+
+void gfusx_jit_invalidate_all(gfusx_vm* vm) {
+    if (vm->jit == NULL) return;
+
+    for (u32 i = 0; i < GFUSX_CODE_PAGE_COUNT; i++) {
+        gfusx_jit_invalidate_page(vm, i);
+    }
+}
+
+void gfusx_jit_step(gfusx_vm* vm) {
+    gfusx_jit* jit = vm->jit;
+    for (;;) {
+        u32 pc = vm->pc;
+        u32 page_index = pc >> GFUSX_PAGE_SHIFT;
+        // recompiled code never calls the trace hook, so tracing has to interpret
+        if (jit == NULL || page_index >= GFUSX_CODE_PAGE_COUNT || (pc & 3) != 0 || vm->settings.debug.trace != NULL) {
+            if (gfusx_vm_interpret_inst(vm)) return;
+            continue;
+        }
+
+        gfusx_jit_page* page = jit->pages[page_index];
+        gfusx_jit_block block = page != NULL ? page->blocks[(pc & GFUSX_PAGE_MASK) >> 2] : NULL;
+        if (block == NULL) block = gfusx_jit_compile(vm, pc);
+
+        if (block(vm)) return;
+        // blocks only check the cycle target on their full retires
+        if (vm->cycle >= vm->cycle_target) return;
+    }
+}
+
+static void gfusx_jit_flush(gfusx_jit* jit) {
+    for (u32 i = 0; i < GFUSX_CODE_PAGE_COUNT; i++) {
+        free(jit->pages[i]);
+        jit->pages[i] = NULL;
+    }
+
+    jit->arena_used = 0;
+}
+
+/// ======================================================================== ///
+/// x86-64 Emitter.                                                          ///
+/// ======================================================================== ///
+
+// All guest state is addressed relative to rbx, which holds the VM pointer
+// for the lifetime of a block.
+
+static void gfusx_jit_emit8(gfusx_jit_emitter* e, u8 value) {
+    *e->cursor++ = value;
+}
+
+static void gfusx_jit_emit32(gfusx_jit_emitter* e, u32 value) {
+    memcpy(e->cursor, &value, sizeof value);
+    e->cursor += sizeof value;
+}
+
+static void gfusx_jit_emit64(gfusx_jit_emitter* e, u64 value) {
+    memcpy(e->cursor, &value, sizeof value);
+    e->cursor += sizeof value;
+}
+
+// mov eax, dword [rbx + offset]
+static void gfusx_jit_emit_load_eax(gfusx_jit_emitter* e, u32 offset) {
+    gfusx_jit_emit8(e, 0x8B);
+    gfusx_jit_emit8(e, 0x83);
+    gfusx_jit_emit32(e, offset);
+}
+
+// mov dword [rbx + offset], eax
+static void gfusx_jit_emit_store_eax(gfusx_jit_emitter* e, u32 offset) {
+    gfusx_jit_emit8(e, 0x89);
+    gfusx_jit_emit8(e, 0x83);
+    gfusx_jit_emit32(e, offset);
+}
+
+// mov dword [rbx + offset], imm32
+static void gfusx_jit_emit_store_imm32(gfusx_jit_emitter* e, u32 offset, u32 value) {
+    gfusx_jit_emit8(e, 0xC7);
+    gfusx_jit_emit8(e, 0x83);
+    gfusx_jit_emit32(e, offset);
+    gfusx_jit_emit32(e, value);
+}
+
+// mov byte [rbx + offset], imm8
+static void gfusx_jit_emit_store_imm8(gfusx_jit_emitter* e, u32 offset, u8 value) {
+    gfusx_jit_emit8(e, 0xC6);
+    gfusx_jit_emit8(e, 0x83);
+    gfusx_jit_emit32(e, offset);
+    gfusx_jit_emit8(e, value);
+}
+
+// mov rdi, rbx; mov rsi, imm64 (optional); mov rax, imm64; call rax
+static void gfusx_jit_emit_call(gfusx_jit_emitter* e, uintptr_t function, const void* arg) {
+    gfusx_jit_emit8(e, 0x48);
+    gfusx_jit_emit8(e, 0x89);
+    gfusx_jit_emit8(e, 0xDF);
+
+    if (arg != NULL) {
+        gfusx_jit_emit8(e, 0x48);
+        gfusx_jit_emit8(e, 0xBE);
+        gfusx_jit_emit64(e, (u64)(uintptr_t)arg);
+    }
+
+    gfusx_jit_emit8(e, 0x48);
+    gfusx_jit_emit8(e, 0xB8);
+    gfusx_jit_emit64(e, (u64)function);
+    gfusx_jit_emit8(e, 0xFF);
+    gfusx_jit_emit8(e, 0xD0);
+}
+
+// pop rbx; ret
+static void gfusx_jit_emit_return(gfusx_jit_emitter* e) {
+    gfusx_jit_emit8(e, 0x5B);
+    gfusx_jit_emit8(e, 0xC3);
+}
+
+/// Mirrors the instruction cache check in gfusx_vm_begin_inst, which only
+/// costs a compare against a constant on a hit.
+static void gfusx_jit_emit_icache_check(gfusx_jit_emitter* e, u32 pc) {
+    // cmp dword [rbx + icache_tags + index * 4], imm32
+    gfusx_jit_emit8(e, 0x81);
+    gfusx_jit_emit8(e, 0xBB);
+    gfusx_jit_emit32(e, GFUSX_VM_OFFSET(icache_tags) + gfusx_icache_index(pc) * 4);
+    gfusx_jit_emit32(e, pc);
+    // je over the miss
+    gfusx_jit_emit8(e, 0x74);
+    u8* skip = e->cursor;
+    gfusx_jit_emit8(e, 0);
+    // mov esi, imm32
+    gfusx_jit_emit8(e, 0xBE);
+    gfusx_jit_emit32(e, pc);
+    gfusx_jit_emit_call(e, (uintptr_t)gfusx_vm_icache_miss, NULL);
+    *skip = (u8)(e->cursor - skip - 1);
+}
+
+/// Mirrors the start of gfusx_vm_begin_inst for an instruction that might be
+/// sitting in a branch delay slot.
+static void gfusx_jit_emit_delay_slot_check(gfusx_jit_emitter* e) {
+    // cmp byte [rbx + next_is_delay_slot], 0
+    gfusx_jit_emit8(e, 0x80);
+    gfusx_jit_emit8(e, 0xBB);
+    gfusx_jit_emit32(e, GFUSX_VM_OFFSET(next_is_delay_slot));
+    gfusx_jit_emit8(e, 0x00);
+    // je over the two byte stores below
+    gfusx_jit_emit8(e, 0x74);
+    gfusx_jit_emit8(e, 14);
+    gfusx_jit_emit_store_imm8(e, GFUSX_VM_OFFSET(in_delay_slot), 1);
+    gfusx_jit_emit_store_imm8(e, GFUSX_VM_OFFSET(next_is_delay_slot), 0);
+}
+
+/// Mirrors gfusx_vm_maybe_cancel_delayed_load for a register written by an
+/// inlined operation.
+static void gfusx_jit_emit_cancel_delayed_load(gfusx_jit_emitter* e, u32 reg) {
+    gfusx_jit_emit_load_eax(e, GFUSX_VM_OFFSET(current_delayed_load));
+    // xor eax, 1
+    gfusx_jit_emit8(e, 0x83);
+    gfusx_jit_emit8(e, 0xF0);
+    gfusx_jit_emit8(e, 0x01);
+    // imul eax, eax, sizeof(gfusx_delayed_load_info)
+    static_assert(sizeof(gfusx_delayed_load_info) < 128);
+    gfusx_jit_emit8(e, 0x6B);
+    gfusx_jit_emit8(e, 0xC0);
+    gfusx_jit_emit8(e, (u8)sizeof(gfusx_delayed_load_info));
+    // cmp dword [rbx + rax + index], reg
+    gfusx_jit_emit8(e, 0x81);
+    gfusx_jit_emit8(e, 0xBC);
+    gfusx_jit_emit8(e, 0x03);
+    gfusx_jit_emit32(e, GFUSX_VM_OFFSET(delayed_load_info) + (u32)offsetof(gfusx_delayed_load_info, index));
+    gfusx_jit_emit32(e, reg);
+    // jne over the store below
+    gfusx_jit_emit8(e, 0x75);
+    gfusx_jit_emit8(e, 8);
+    // mov byte [rbx + rax + active], 0
+    gfusx_jit_emit8(e, 0xC6);
+    gfusx_jit_emit8(e, 0x84);
+    gfusx_jit_emit8(e, 0x03);
+    gfusx_jit_emit32(e, GFUSX_VM_OFFSET(delayed_load_info) + (u32)offsetof(gfusx_delayed_load_info, active));
+    gfusx_jit_emit8(e, 0x00);
+}
+
+/// Sends a misaligned load or store to its handler, which raises the address
+/// error, and leaves the block right after it. Aligned ones fall through to the
+/// inlined access or the handler call.
+static void gfusx_jit_emit_alignment_check(gfusx_jit_emitter* e, const gfusx_decoded_inst* inst, u32 mask) {
+    gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+    // add eax, imm32
+    gfusx_jit_emit8(e, 0x05);
+    gfusx_jit_emit32(e, inst->imm);
+    // test al, imm8; jz over the address error
+    gfusx_jit_emit8(e, 0xA8);
+    gfusx_jit_emit8(e, (u8)mask);
+    gfusx_jit_emit8(e, 0x74);
+    u8* skip = e->cursor;
+    gfusx_jit_emit8(e, 0);
+    gfusx_jit_emit_call(e, (uintptr_t)inst->handler, inst);
+    gfusx_jit_emit_call(e, (uintptr_t)gfusx_vm_retire, NULL);
+    gfusx_jit_emit_return(e);
+    *skip = (u8)(e->cursor - skip - 1);
+}
+
+/// Emits host code for the operations simple enough to not need their handler.
+/// Returns false if the instruction has to go through the interpreter instead.
+static bool gfusx_jit_emit_inline_op(gfusx_jit_emitter* e, const gfusx_decoded_inst* inst, u8* fastmem) {
+    switch (inst->op) {
+        default: return false;
+
+        // rt <- memory[rs + imm], available after the load delay slot
+        case GFUSX_OP_LW: {
+            // loads into $zero still have to hit memory for MMIO side effects
+            if (fastmem == NULL || inst->rt == 0) return false;
+
+            // the access has to come first, a fault replays the whole instruction
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+            // add eax, imm32
+            gfusx_jit_emit8(e, 0x05);
+            gfusx_jit_emit32(e, inst->imm);
+            // mov rcx, imm64; mov ecx, dword [rcx + rax]
+            gfusx_jit_emit8(e, 0x48);
+            gfusx_jit_emit8(e, 0xB9);
+            gfusx_jit_emit64(e, (u64)(uintptr_t)fastmem);
+            gfusx_jit_emit8(e, 0x8B);
+            gfusx_jit_emit8(e, 0x0C);
+            gfusx_jit_emit8(e, 0x01);
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rt);
+
+            // mov edx, dword [rbx + current_delayed_load]; imul edx, edx, sizeof(gfusx_delayed_load_info)
+            gfusx_jit_emit8(e, 0x8B);
+            gfusx_jit_emit8(e, 0x93);
+            gfusx_jit_emit32(e, GFUSX_VM_OFFSET(current_delayed_load));
+            gfusx_jit_emit8(e, 0x6B);
+            gfusx_jit_emit8(e, 0xD2);
+            gfusx_jit_emit8(e, (u8)sizeof(gfusx_delayed_load_info));
+
+            u32 info = GFUSX_VM_OFFSET(delayed_load_info);
+            // mov dword [rbx + rdx + value], ecx
+            gfusx_jit_emit8(e, 0x89);
+            gfusx_jit_emit8(e, 0x8C);
+            gfusx_jit_emit8(e, 0x13);
+            gfusx_jit_emit32(e, info + (u32)offsetof(gfusx_delayed_load_info, value));
+            // mov dword [rbx + rdx + index], rt
+            gfusx_jit_emit8(e, 0xC7);
+            gfusx_jit_emit8(e, 0x84);
+            gfusx_jit_emit8(e, 0x13);
+            gfusx_jit_emit32(e, info + (u32)offsetof(gfusx_delayed_load_info, index));
+            gfusx_jit_emit32(e, inst->rt);
+            // mov dword [rbx + rdx + mask], 0
+            gfusx_jit_emit8(e, 0xC7);
+            gfusx_jit_emit8(e, 0x84);
+            gfusx_jit_emit8(e, 0x13);
+            gfusx_jit_emit32(e, info + (u32)offsetof(gfusx_delayed_load_info, mask));
+            gfusx_jit_emit32(e, 0);
+            // mov byte [rbx + rdx + active], 1
+            gfusx_jit_emit8(e, 0xC6);
+            gfusx_jit_emit8(e, 0x84);
+            gfusx_jit_emit8(e, 0x13);
+            gfusx_jit_emit32(e, info + (u32)offsetof(gfusx_delayed_load_info, active));
+            gfusx_jit_emit8(e, 1);
+        } return true;
+
+        // memory[rs + imm] <- rt
+        case GFUSX_OP_SW: {
+            if (fastmem == NULL) return false;
+
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+            // add eax, imm32
+            gfusx_jit_emit8(e, 0x05);
+            gfusx_jit_emit32(e, inst->imm);
+            // mov ecx, dword [rbx + rt]
+            gfusx_jit_emit8(e, 0x8B);
+            gfusx_jit_emit8(e, 0x8B);
+            gfusx_jit_emit32(e, GFUSX_GPR_OFFSET(inst->rt));
+            // mov rdx, imm64; mov dword [rdx + rax], ecx
+            gfusx_jit_emit8(e, 0x48);
+            gfusx_jit_emit8(e, 0xBA);
+            gfusx_jit_emit64(e, (u64)(uintptr_t)fastmem);
+            gfusx_jit_emit8(e, 0x89);
+            gfusx_jit_emit8(e, 0x0C);
+            gfusx_jit_emit8(e, 0x02);
+            // shr eax, 12; mov byte [rbx + rax + dirty_pages], GFUSX_DIRTY_ALL
+            gfusx_jit_emit8(e, 0xC1);
+            gfusx_jit_emit8(e, 0xE8);
+            gfusx_jit_emit8(e, GFUSX_PAGE_SHIFT);
+            gfusx_jit_emit8(e, 0xC6);
+            gfusx_jit_emit8(e, 0x84);
+            gfusx_jit_emit8(e, 0x03);
+            gfusx_jit_emit32(e, GFUSX_VM_OFFSET(dirty_pages));
+            gfusx_jit_emit8(e, GFUSX_DIRTY_ALL);
+        } return true;
+
+        case GFUSX_OP_NOP: return true;
+
+        // rt <- rs + imm
+        case GFUSX_OP_ADDIU: {
+            if (inst->rt == GFU_REG_SP) return false;
+            if (inst->rt == 0) return true;
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rt);
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+            // add eax, imm32
+            gfusx_jit_emit8(e, 0x05);
+            gfusx_jit_emit32(e, inst->imm);
+            gfusx_jit_emit_store_eax(e, GFUSX_GPR_OFFSET(inst->rt));
+        } return true;
+
+        // rt <- imm << 16
+        case GFUSX_OP_LUI: {
+            if (inst->rt == GFU_REG_SP) return false;
+            if (inst->rt == 0) return true;
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rt);
+            gfusx_jit_emit_store_imm32(e, GFUSX_GPR_OFFSET(inst->rt), inst->imm);
+        } return true;
+
+        // rt <- rs OR imm
+        case GFUSX_OP_ORI: {
+            if (inst->rt == GFU_REG_SP) return false;
+            if (inst->rt == 0) return true;
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rt);
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+            // or eax, imm32
+            gfusx_jit_emit8(e, 0x0D);
+            gfusx_jit_emit32(e, inst->imm);
+            gfusx_jit_emit_store_eax(e, GFUSX_GPR_OFFSET(inst->rt));
+        } return true;
+
+        // rd <- rt << shamt
+        case GFUSX_OP_SLL: {
+            if (inst->rd == 0) return true;
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rd);
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rt));
+            // shl eax, imm8
+            gfusx_jit_emit8(e, 0xC1);
+            gfusx_jit_emit8(e, 0xE0);
+            gfusx_jit_emit8(e, inst->shamt);
+            gfusx_jit_emit_store_eax(e, GFUSX_GPR_OFFSET(inst->rd));
+        } return true;
+
+        // rd <- rs + rt
+        case GFUSX_OP_ADDU: {
+            if (inst->rd == GFU_REG_SP) return false;
+            if (inst->rd == 0) return true;
+
+            gfusx_jit_emit_cancel_delayed_load(e, inst->rd);
+            gfusx_jit_emit_load_eax(e, GFUSX_GPR_OFFSET(inst->rs));
+            // add eax, dword [rbx + rt]
+            gfusx_jit_emit8(e, 0x03);
+            gfusx_jit_emit8(e, 0x83);
+            gfusx_jit_emit32(e, GFUSX_GPR_OFFSET(inst->rt));
+            gfusx_jit_emit_store_eax(e, GFUSX_GPR_OFFSET(inst->rd));
+        } return true;
+    }
+}
+
+/// Compiles the block starting at `pc`. A block runs until the end of its page,
+/// until the delay slot of its first branch, until an op that can stop the VM,
+/// or until it hits the instruction limit. It returns true if execution has to
+/// leave the engine.
+static gfusx_jit_block gfusx_jit_compile(gfusx_vm* vm, u32 start_pc) {
+    gfusx_jit* jit = vm->jit;
+    u32 pc = start_pc;
+
+    usize max_block_size = GFUSX_JIT_MAX_BLOCK_INSTS * GFUSX_JIT_MAX_INST_SIZE + 16;
+    if (jit->arena_used + max_block_size > GFUSX_JIT_ARENA_SIZE) {
+        gfusx_jit_flush(jit);
+    }
+
+    u32 page_index = pc >> GFUSX_PAGE_SHIFT;
+    gfusx_jit_page* page = jit->pages[page_index];
+    if (page == NULL) {
+        page = calloc(1, sizeof *page);
+        kos_assert(page != NULL);
+        jit->pages[page_index] = page;
+    }
+
+    gfusx_jit_emitter e = {
+        .start = jit->arena + jit->arena_used,
+    };
+    e.cursor = e.start;
+
+    // push rbx; mov rbx, rdi
+    gfusx_jit_emit8(&e, 0x53);
+    gfusx_jit_emit8(&e, 0x48);
+    gfusx_jit_emit8(&e, 0x89);
+    gfusx_jit_emit8(&e, 0xFB);
+
+    bool after_branch = false;
+    bool after_load = false;
+    // with the cache isolated, loads and stores have to go through their handlers
+    bool isolated = (vm->cop0.status & GFUSX_COP0_STATUS_ISC) != 0;
+    // a watchpoint has to stop right after the access that hit it, which fastmem
+    // accesses do on their own by faulting into a replay
+    bool watched = vm->watchpoints.count != 0 && vm->fastmem == NULL;
+    // A block starts on a delay slot when the branch before it ended the
+    // previous block or stopped the VM. Nothing after the delay slot belongs to
+    // the block then, so it has to leave once the branch has been taken.
+    bool maybe_delay_slot = true;
+    if ((start_pc & GFUSX_PAGE_MASK) != 0) {
+        const gfusx_decoded_inst* previous = gfusx_vm_decoded_inst_at(vm, start_pc - 4);
+        maybe_delay_slot = (gfusx_op_flags_table[previous->op] & GFUSX_OPF_BRANCH) != 0 || previous->op == GFUSX_OP_BREAKPOINT;
+    }
+    u32 page_end = (page_index + 1) << GFUSX_PAGE_SHIFT;
+    for (u32 i = 0; i < GFUSX_JIT_MAX_BLOCK_INSTS && pc < page_end; i++, pc += 4) {
+        const gfusx_decoded_inst* inst = gfusx_vm_decoded_inst_at(vm, pc);
+        gfusx_op_flags flags = gfusx_op_flags_table[inst->op];
+        // only the first instruction or the one after a branch can be in a delay slot
+        bool dynamic = i == 0 || after_branch;
+        bool stops = (flags & (GFUSX_OPF_STOP | GFUSX_OPF_BLOCK_END)) != 0 || (watched && (flags & GFUSX_OPF_MEMORY) != 0);
+
+        gfusx_jit_emit_icache_check(&e, pc);
+        if (dynamic) gfusx_jit_emit_delay_slot_check(&e);
+        gfusx_jit_emit_store_imm32(&e, GFUSX_VM_OFFSET(code), inst->code);
+        gfusx_jit_emit_store_imm32(&e, GFUSX_VM_OFFSET(pc), pc + 4);
+        // add qword [rbx + cycle], imm8
+        gfusx_jit_emit8(&e, 0x48);
+        gfusx_jit_emit8(&e, 0x83);
+        gfusx_jit_emit8(&e, 0x83);
+        gfusx_jit_emit32(&e, GFUSX_VM_OFFSET(cycle));
+        gfusx_jit_emit8(&e, GFUSX_CYCLE_BIAS);
+
+        u32 alignment_mask = gfusx_op_alignment_mask(inst->op);
+        if (alignment_mask != 0) gfusx_jit_emit_alignment_check(&e, inst, alignment_mask);
+
+        if (!gfusx_jit_emit_inline_op(&e, inst, isolated ? NULL : vm->fastmem)) {
+            gfusx_jit_emit_call(&e, (uintptr_t)inst->handler, inst);
+        }
+
+        if (dynamic || after_load || stops) {
+            // a pending pc or register load, delay slot or stop has to go through the full retire
+            gfusx_jit_emit_call(&e, (uintptr_t)gfusx_vm_retire, NULL);
+            // test al, al; jz over the return
+            gfusx_jit_emit8(&e, 0x84);
+            gfusx_jit_emit8(&e, 0xC0);
+            gfusx_jit_emit8(&e, 0x74);
+            gfusx_jit_emit8(&e, 2);
+            gfusx_jit_emit_return(&e);
+
+            if (i == 0 && maybe_delay_slot) {
+                // cmp dword [rbx + pc], imm32; je over the return
+                gfusx_jit_emit8(&e, 0x81);
+                gfusx_jit_emit8(&e, 0xBB);
+                gfusx_jit_emit32(&e, GFUSX_VM_OFFSET(pc));
+                gfusx_jit_emit32(&e, pc + 4);
+                gfusx_jit_emit8(&e, 0x74);
+                gfusx_jit_emit8(&e, 4);
+                // xor eax, eax
+                gfusx_jit_emit8(&e, 0x31);
+                gfusx_jit_emit8(&e, 0xC0);
+                gfusx_jit_emit_return(&e);
+            }
+        } else {
+            // xor dword [rbx + current_delayed_load], 1
+            gfusx_jit_emit8(&e, 0x83);
+            gfusx_jit_emit8(&e, 0xB3);
+            gfusx_jit_emit32(&e, GFUSX_VM_OFFSET(current_delayed_load));
+            gfusx_jit_emit8(&e, 0x01);
+        }
+
+        if (after_branch || stops) break;
+
+        // with fastmem, stores to code fault and leave the block on their own
+        if ((flags & GFUSX_OPF_STORE) != 0 && vm->fastmem == NULL) {
+            // leave as soon as the store dropped this block's page, like the
+            // interpreter would start decoding the new code right away
+            // mov rax, imm64; cmp qword [rax], 0; jne over the return
+            gfusx_jit_emit8(&e, 0x48);
+            gfusx_jit_emit8(&e, 0xB8);
+            gfusx_jit_emit64(&e, (u64)(uintptr_t)&jit->pages[page_index]);
+            gfusx_jit_emit8(&e, 0x48);
+            gfusx_jit_emit8(&e, 0x83);
+            gfusx_jit_emit8(&e, 0x38);
+            gfusx_jit_emit8(&e, 0x00);
+            gfusx_jit_emit8(&e, 0x75);
+            gfusx_jit_emit8(&e, 4);
+            // xor eax, eax
+            gfusx_jit_emit8(&e, 0x31);
+            gfusx_jit_emit8(&e, 0xC0);
+            gfusx_jit_emit_return(&e);
+        }
+
+        after_branch = (flags & GFUSX_OPF_BRANCH) != 0;
+        after_load = (flags & GFUSX_OPF_LOAD) != 0;
+    }
+
+    // xor eax, eax
+    gfusx_jit_emit8(&e, 0x31);
+    gfusx_jit_emit8(&e, 0xC0);
+    gfusx_jit_emit_return(&e);
+
+    kos_assert((usize)(e.cursor - e.start) <= max_block_size);
+    jit->arena_used += (usize)(e.cursor - e.start);
+    // keep blocks 16 byte aligned
+    jit->arena_used = (jit->arena_used + 15) & ~(usize)15;
+
+    gfusx_jit_block block = (gfusx_jit_block)(uintptr_t)e.start;
+    page->blocks[(start_pc & GFUSX_PAGE_MASK) >> 2] = block;
+    return block;
+}
+
+#else
+
+struct gfusx_jit {
+    u8 unused;
+};
+
+bool gfusx_jit_create(gfusx_vm* vm) {
+    return false;
+}
+
+void gfusx_jit_destroy(gfusx_vm* vm) {
+}
+
+void gfusx_jit_invalidate_page(gfusx_vm* vm, u32 page_index) {
+}
+
+void gfusx_jit_invalidate_all(gfusx_vm* vm) {
+}
+
+void gfusx_jit_step(gfusx_vm* vm) {
+    while (!gfusx_vm_interpret_inst(vm)) {
+    }
+}
+
+#endif
@@ -0,0 +1,172 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+// mmap and fstat are not part of strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "vm_internal.h"
+
+#include <gamefu/elf.h>
+
+#if GFUSX_HAS_FILE_MAPPING
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+/// Where the host can, the file is mapped rather than read, and the whole host
+/// pages of every segment are mapped over guest memory copy-on-write. Only the
+/// headers and the partial pages at either end of a segment are read up front.
+/// Read-only data stays shared with the page cache, and writable data is copied
+/// a page at a time when it is first written.
+
+typedef struct gfusx_elf_file {
+    elf32_raw elf;
+    // -1 if the file was read into memory instead
+    int fd;
+    void* mapping;
+    usize mapping_size;
+} gfusx_elf_file;
+
+static bool gfusx_elf_open(gfusx_elf_file* file, const char* file_path);
+static void gfusx_elf_close(gfusx_elf_file* file);
+static bool gfusx_load_bytes(gfusx_vm* vm, const char* file_path, const gfusx_elf_file* file, u32 offset, u32 addr, u32 file_size, u32 memory_size);
+
+bool gfusx_vm_load_elf(gfusx_vm* vm, const char* file_path) {
+    bool result = true;
+
+    gfusx_elf_file file = { .fd = -1 };
+    if (!gfusx_elf_open(&file, file_path)) {
+        gfusx_vm_logf(vm, GFUSX_LC_LOADER, "Error reading ELF file '%s': %s", file_path, file.elf.error_message);
+        kos_return_defer(false);
+    }
+
+    elf32_raw elf = file.elf;
+    if (elf.header.ph_count != 0) {
+        for (elf32_word i = 0; i < elf.header.ph_count; i++) {
+            elf32_segment_header* segment = &elf.segments[i];
+            if (segment->type != ELF_SEG_LOAD) continue;
+
+            if ((u64)segment->offset + segment->file_size > elf.size || segment->file_size > segment->memory_size) {
+                gfusx_vm_logf(vm, GFUSX_LC_LOADER, "ELF file '%s' has a malformed segment %u.", file_path, i);
+                kos_return_defer(false);
+            }
+
+            if (!gfusx_load_bytes(vm, file_path, &file, segment->offset, segment->virtual_address, segment->file_size, segment->memory_size)) {
+                kos_return_defer(false);
+            }
+        }
+    } else {
+        // NOTE(local): fuasm only emits relocatable objects for now, which are
+        // loaded section by section where they were assembled.
+        for (elf32_word i = 0; i < elf.header.sh_count; i++) {
+            elf32_section_header* section = &elf.sections[i];
+            if ((section->flags & (ELF_SECTFLAG_ALLOC | ELF_SECTFLAG_EXECINSTR)) == 0) continue;
+
+            bool is_bss = section->type == ELF_SECT_NOBITS;
+            if (!is_bss && (u64)section->offset + section->size > elf.size) {
+                gfusx_vm_logf(vm, GFUSX_LC_LOADER, "ELF file '%s' has a malformed section %u.", file_path, i);
+                kos_return_defer(false);
+            }
+
+            if (!gfusx_load_bytes(vm, file_path, &file, section->offset, section->virtual_address, is_bss ? 0 : section->size, section->size)) {
+                kos_return_defer(false);
+            }
+        }
+    }
+
+    vm->pc = elf.header.entry;
+
+defer:;
+    gfusx_elf_close(&file);
+    return result;
+}
+
+static bool gfusx_elf_open(gfusx_elf_file* file, const char* file_path) {
+#if GFUSX_HAS_FILE_MAPPING
+    struct stat info;
+    file->fd = open(file_path, O_RDONLY);
+    if (file->fd >= 0 && fstat(file->fd, &info) == 0 && info.st_size > 0 && (u64)info.st_size <= UINT32_MAX) {
+        file->mapping = mmap(NULL, (usize)info.st_size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+        if (file->mapping != MAP_FAILED) {
+            file->mapping_size = (usize)info.st_size;
+            // only reads from the data, it just isn't const
+            file->elf = elf32_read_raw_from_bytes(file->mapping, (elf32_word)file->mapping_size);
+            return file->elf.error_message == nullptr;
+        }
+
+        file->mapping = NULL;
+    }
+
+    // anything mmap can't handle goes through a plain read, which also reports the error
+    if (file->fd >= 0) close(file->fd);
+    file->fd = -1;
+#endif
+
+    file->elf = elf32_read_raw_from_file(file_path);
+    return file->elf.error_message == nullptr;
+}
+
+static void gfusx_elf_close(gfusx_elf_file* file) {
+    elf32_raw_free(&file->elf);
+#if GFUSX_HAS_FILE_MAPPING
+    // mappings over guest memory keep their own reference to the file
+    if (file->mapping != NULL) munmap(file->mapping, file->mapping_size);
+    if (file->fd >= 0) close(file->fd);
+#endif
+    *file = (gfusx_elf_file) { .fd = -1 };
+}
+
+static bool gfusx_load_bytes(gfusx_vm* vm, const char* file_path, const gfusx_elf_file* file, u32 offset, u32 addr, u32 file_size, u32 memory_size) {
+    const u8* data = file->elf.data + offset;
+
+    // the whole host pages in the middle are mapped, the rest is copied
+    u32 mapped_begin = 0, mapped_end = 0;
+#if GFUSX_HAS_FILE_MAPPING
+    if (file->fd >= 0) {
+        u32 host_page_size = (u32)sysconf(_SC_PAGESIZE);
+        u32 head = (host_page_size - offset % host_page_size) % host_page_size;
+        u32 size = head < file_size ? (file_size - head) / host_page_size * host_page_size : 0;
+        if (size != 0 && gfusx_mem_map_file(vm, addr + head, file->fd, offset + head, size)) {
+            mapped_begin = head;
+            mapped_end = head + size;
+        }
+    }
+#endif
+
+    if (!gfusx_vm_write_bytes(vm, addr, data, mapped_begin) || !gfusx_vm_write_bytes(vm, addr + mapped_end, data + mapped_end, file_size - mapped_end)) {
+        gfusx_vm_logf(vm, GFUSX_LC_LOADER, "ELF file '%s' loads 0x%X bytes at 0x%08X, outside of RAM and ROM.", file_path, file_size, addr);
+        return false;
+    }
+    // everything past the file contents is zero filled
+    static const u8 zeroes[GFUSX_PAGE_SIZE] = {0};
+    for (u32 offset = file_size; offset < memory_size;) {
+        u32 chunk = memory_size - offset < GFUSX_PAGE_SIZE ? memory_size - offset : GFUSX_PAGE_SIZE;
+        if (!gfusx_vm_write_bytes(vm, addr + offset, zeroes, chunk)) {
+            gfusx_vm_logf(vm, GFUSX_LC_LOADER, "ELF file '%s' reserves 0x%X bytes at 0x%08X, outside of RAM and ROM.", file_path, memory_size, addr);
+            return false;
+        }
+
+        offset += chunk;
+    }
+
+    return true;
+}
@@ -0,0 +1,206 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <string.h>
+
+/// The candidate is given a few cycles at a time. Interpreters stop on exactly
+/// that cycle, block engines only once the cycle target is checked again, which
+/// is mostly at the end of the block. The smallest budget would make them leave
+/// after the first instruction of every block and never run one whole. The
+/// reference is then run up to the cycle the candidate stopped at, and if it
+/// goes past it the candidate catches up in turn until the two meet. Engines
+/// that never meet are a cycle mismatch, not a reason to keep going.
+
+// About one block's worth of instructions.
+#define GFUSX_LOCKSTEP_STEP_CYCLES 32
+// Each side overshoots by at most a block, so this is plenty to meet.
+#define GFUSX_LOCKSTEP_CATCH_UP_TRIES 16
+
+static gfusx_stop_reason gfusx_lockstep_run_to(gfusx_vm* vm, u64 cycle);
+static bool gfusx_lockstep_compare(gfusx_vm* reference, gfusx_vm* candidate, gfusx_stop_reason reference_stop, gfusx_stop_reason candidate_stop, gfusx_lockstep_report* report);
+static bool gfusx_lockstep_compare_memory(gfusx_vm* reference, gfusx_vm* candidate, gfusx_lockstep_report* report);
+static void gfusx_lockstep_set_mismatch(gfusx_lockstep_report* report, gfusx_lockstep_mismatch mismatch, u32 index, u64 reference_value, u64 candidate_value);
+
+bool gfusx_lockstep_run(gfusx_vm* reference, gfusx_vm* candidate, u64 cycle_budget, gfusx_lockstep_report* report) {
+    *report = (gfusx_lockstep_report) {
+        .good_pc = reference->pc,
+        .good_cycle = reference->cycle,
+    };
+
+    u64 cycle_end = cycle_budget > UINT64_MAX - reference->cycle ? UINT64_MAX : reference->cycle + cycle_budget;
+
+    for (;;) {
+        // never hand the candidate more than is left of the budget
+        u64 step = candidate->cycle >= cycle_end ? 0 : cycle_end - candidate->cycle;
+        if (step > GFUSX_LOCKSTEP_STEP_CYCLES) step = GFUSX_LOCKSTEP_STEP_CYCLES;
+
+        gfusx_stop_reason candidate_stop = gfusx_lockstep_run_to(candidate, candidate->cycle + step);
+        gfusx_stop_reason reference_stop = gfusx_lockstep_run_to(reference, candidate->cycle);
+
+        // if they still differ after this, the compare below reports the cycles
+        for (u32 tries = 0; tries < GFUSX_LOCKSTEP_CATCH_UP_TRIES; tries++) {
+            if (candidate_stop != GFUSX_STOP_BUDGET || reference_stop != GFUSX_STOP_BUDGET) break;
+            if (candidate->cycle == reference->cycle) break;
+
+            if (candidate->cycle < reference->cycle) {
+                candidate_stop = gfusx_lockstep_run_to(candidate, reference->cycle);
+            } else {
+                reference_stop = gfusx_lockstep_run_to(reference, candidate->cycle);
+            }
+        }
+
+        // an address error leaves the candidate right before the instruction
+        // that raised it, which the reference stops on without running it
+        if (candidate_stop == GFUSX_STOP_ADDRESS_ERROR && reference_stop == GFUSX_STOP_BUDGET && reference->cycle == candidate->cycle) {
+            gfusx_vm_step(reference);
+            reference_stop = reference->stop_reason != GFUSX_STOP_NONE ? reference->stop_reason : GFUSX_STOP_BUDGET;
+        }
+
+        report->checks++;
+        report->pc = reference->pc;
+        report->cycle = reference->cycle;
+        if (!gfusx_lockstep_compare(reference, candidate, reference_stop, candidate_stop, report)) return false;
+
+        report->good_pc = reference->pc;
+        report->good_cycle = reference->cycle;
+
+        if (reference_stop != GFUSX_STOP_BUDGET || reference->cycle >= cycle_end) return true;
+    }
+}
+
+void gfusx_lockstep_print_report(FILE* stream, const gfusx_lockstep_report* report) {
+    if (report->mismatch == GFUSX_LOCKSTEP_MATCH) {
+        fprintf(stream, "Engines matched over %llu checks.\n", (unsigned long long)report->checks);
+        return;
+    }
+
+    fprintf(stream, "Engines diverged at check %llu, last matched at pc %08X, cycle %llu.\n", (unsigned long long)report->checks, report->good_pc, (unsigned long long)report->good_cycle);
+    fprintf(stream, "  reference now at pc %08X, cycle %llu\n", report->pc, (unsigned long long)report->cycle);
+
+    switch (report->mismatch) {
+        case GFUSX_LOCKSTEP_MATCH: break;
+
+        case GFUSX_LOCKSTEP_STOP: {
+            fprintf(stream, "  stop: reference %s, candidate %s\n", gfusx_stop_reason_name((gfusx_stop_reason)report->reference_value), gfusx_stop_reason_name((gfusx_stop_reason)report->candidate_value));
+        } break;
+
+        case GFUSX_LOCKSTEP_PC: {
+            fprintf(stream, "  pc: reference %08llX, candidate %08llX\n", (unsigned long long)report->reference_value, (unsigned long long)report->candidate_value);
+        } break;
+
+        case GFUSX_LOCKSTEP_CYCLE: {
+            fprintf(stream, "  cycle: reference %llu, candidate %llu\n", (unsigned long long)report->reference_value, (unsigned long long)report->candidate_value);
+        } break;
+
+        case GFUSX_LOCKSTEP_GPR: {
+            if (report->index == 32) {
+                fprintf(stream, "  hi:");
+            } else if (report->index == 33) {
+                fprintf(stream, "  lo:");
+            } else {
+                fprintf(stream, "  r%u:", report->index);
+            }
+
+            fprintf(stream, " reference %08llX, candidate %08llX\n", (unsigned long long)report->reference_value, (unsigned long long)report->candidate_value);
+        } break;
+
+        case GFUSX_LOCKSTEP_MEMORY: {
+            fprintf(stream, "  byte at %08X: reference %02llX, candidate %02llX\n", report->index, (unsigned long long)report->reference_value, (unsigned long long)report->candidate_value);
+        } break;
+    }
+}
+
+static gfusx_stop_reason gfusx_lockstep_run_to(gfusx_vm* vm, u64 cycle) {
+    if (vm->cycle >= cycle) return GFUSX_STOP_BUDGET;
+    return gfusx_vm_run(vm, cycle - vm->cycle);
+}
+
+static bool gfusx_lockstep_compare(gfusx_vm* reference, gfusx_vm* candidate, gfusx_stop_reason reference_stop, gfusx_stop_reason candidate_stop, gfusx_lockstep_report* report) {
+    if (reference_stop != candidate_stop) {
+        gfusx_lockstep_set_mismatch(report, GFUSX_LOCKSTEP_STOP, 0, reference_stop, candidate_stop);
+        return false;
+    }
+
+    // engines that could not meet are at different pcs too, the cycles say why
+    if (reference->cycle != candidate->cycle) {
+        gfusx_lockstep_set_mismatch(report, GFUSX_LOCKSTEP_CYCLE, 0, reference->cycle, candidate->cycle);
+        return false;
+    }
+
+    if (reference->pc != candidate->pc) {
+        gfusx_lockstep_set_mismatch(report, GFUSX_LOCKSTEP_PC, 0, reference->pc, candidate->pc);
+        return false;
+    }
+
+    // r0 to r31, hi and lo
+    for (u32 i = 0; i < 34; i++) {
+        if (reference->gpr.r[i] != candidate->gpr.r[i]) {
+            gfusx_lockstep_set_mismatch(report, GFUSX_LOCKSTEP_GPR, i, reference->gpr.r[i], candidate->gpr.r[i]);
+            return false;
+        }
+    }
+
+    return gfusx_lockstep_compare_memory(reference, candidate, report);
+}
+
+/// Only the pages either VM wrote since the last check can differ, the rest
+/// were compared before. This runs after every block, so the dirty bytes are
+/// looked at eight pages at a time rather than through
+/// gfusx_mem_take_dirty_pages, which would cost more than the blocks do.
+static bool gfusx_lockstep_compare_memory(gfusx_vm* reference, gfusx_vm* candidate, gfusx_lockstep_report* report) {
+    static_assert(GFUSX_CODE_PAGE_COUNT % 8 == 0);
+    const u64 owner_bits = 0x0101010101010101ull * GFUSX_DIRTY_LOCKSTEP;
+
+    for (u32 first_page = 0; first_page < GFUSX_CODE_PAGE_COUNT; first_page += 8) {
+        u64 reference_dirty, candidate_dirty;
+        memcpy(&reference_dirty, &reference->dirty_pages[first_page], sizeof reference_dirty);
+        memcpy(&candidate_dirty, &candidate->dirty_pages[first_page], sizeof candidate_dirty);
+        if (((reference_dirty | candidate_dirty) & owner_bits) == 0) continue;
+
+        for (u32 page_index = first_page; page_index < first_page + 8; page_index++) {
+            if (((reference->dirty_pages[page_index] | candidate->dirty_pages[page_index]) & GFUSX_DIRTY_LOCKSTEP) == 0) continue;
+
+            reference->dirty_pages[page_index] &= (u8)~GFUSX_DIRTY_LOCKSTEP;
+            candidate->dirty_pages[page_index] &= (u8)~GFUSX_DIRTY_LOCKSTEP;
+
+            const u8* reference_page = gfusx_mem_host_page(reference, page_index);
+            const u8* candidate_page = gfusx_mem_host_page(candidate, page_index);
+            if (0 == memcmp(reference_page, candidate_page, GFUSX_PAGE_SIZE)) continue;
+
+            u32 offset = 0;
+            while (reference_page[offset] == candidate_page[offset]) offset++;
+
+            u32 address = (page_index << GFUSX_PAGE_SHIFT) + offset;
+            gfusx_lockstep_set_mismatch(report, GFUSX_LOCKSTEP_MEMORY, address, reference_page[offset], candidate_page[offset]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void gfusx_lockstep_set_mismatch(gfusx_lockstep_report* report, gfusx_lockstep_mismatch mismatch, u32 index, u64 reference_value, u64 candidate_value) {
+    report->mismatch = mismatch;
+    report->index = index;
+    report->reference_value = reference_value;
+    report->candidate_value = candidate_value;
+}
@@ -0,0 +1,530 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#define _DEFAULT_SOURCE
+#include "vm_internal.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define GFUSX_LOG_RECORD_COUNT 256
+#define GFUSX_LOG_PAYLOAD_SIZE 232
+#define GFUSX_LOG_SITE_COUNT 64
+#define GFUSX_LOG_LINE_SIZE 1024
+
+/// A message as it sits in the queue: the format and its arguments in the order
+/// they are converted, integers, doubles and pointers as 8 bytes each and
+/// strings as a u16 length followed by their bytes.
+typedef struct gfusx_log_record {
+    const char* format;
+    u16 size;
+    u8 payload[GFUSX_LOG_PAYLOAD_SIZE];
+} gfusx_log_record;
+
+/// Rate limiting state for a call site, found by its format string. A site keeps
+/// its slot until its window is over, so the count always applies in full.
+typedef struct gfusx_log_site {
+    const char* format;
+    u64 window;
+    u32 count;
+    u32 suppressed;
+} gfusx_log_site;
+
+/// A single producer, single consumer queue. The VM's thread pushes, and the
+/// drain thread or, once the VM is powered off, the VM's thread pops.
+struct gfusx_log {
+    gfusx_log_record records[GFUSX_LOG_RECORD_COUNT];
+    _Atomic usize head;
+    _Atomic usize tail;
+    _Atomic u32 dropped;
+
+    // only touched by the VM's thread
+    gfusx_log_site sites[GFUSX_LOG_SITE_COUNT];
+    u32 rate_limit;
+
+    // the list of queues the drain thread looks at, guarded by the registry lock
+    gfusx_log* next;
+};
+
+/// The conversion specification the format cursor is on, with the cursor moved
+/// past it. `width` and `precision` are -1 when absent, and -2 when given as `*`.
+typedef struct gfusx_log_spec {
+    char flags[8];
+    int width;
+    int precision;
+    char length[3];
+    char conversion;
+} gfusx_log_spec;
+
+static pthread_mutex_t gfusx_log_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gfusx_log_wake = PTHREAD_COND_INITIALIZER;
+static gfusx_log* gfusx_log_registry;
+// whether the drain thread should keep running, guarded by the registry lock
+static bool gfusx_log_draining;
+// set by the first message since the drain thread last looked, so only that one
+// has to take the lock to wake it
+static _Atomic bool gfusx_log_wake_pending;
+
+// held while starting or joining the drain thread, which runs for as long as
+// there are queues
+static pthread_mutex_t gfusx_log_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t gfusx_log_drain_thread;
+
+static void gfusx_log_wake_drain_thread(void);
+static void* gfusx_log_drain_main(void* arg);
+static void gfusx_log_drain(gfusx_log* log, FILE* stream);
+static bool gfusx_log_allow(gfusx_vm* vm, const char* format);
+static void gfusx_log_flush_site(gfusx_log* log, const gfusx_log_site* site);
+static void gfusx_log_enqueue(gfusx_log* log, const char* format, ...);
+static void gfusx_log_enqueue_v(gfusx_log* log, const char* format, va_list v);
+static bool gfusx_log_parse_spec(const char** cursor, gfusx_log_spec* spec);
+static void gfusx_log_format(const gfusx_log_record* record, char* line, usize line_size);
+
+void gfusx_log_create(gfusx_vm* vm) {
+    vm->log_mask = ~vm->settings.log.disabled_classes;
+    vm->log = calloc(1, sizeof *vm->log);
+    if (vm->log == NULL) {
+        vm->log_mask = 0;
+        return;
+    }
+
+    vm->log->rate_limit = vm->settings.log.rate_limit == 0 ? GFUSX_LOG_DEFAULT_RATE_LIMIT : vm->settings.log.rate_limit;
+
+    pthread_mutex_lock(&gfusx_log_thread_lock);
+
+    pthread_mutex_lock(&gfusx_log_registry_lock);
+    vm->log->next = gfusx_log_registry;
+    gfusx_log_registry = vm->log;
+    bool start = !gfusx_log_draining;
+    gfusx_log_draining = true;
+    pthread_mutex_unlock(&gfusx_log_registry_lock);
+
+    if (start) {
+        int error = pthread_create(&gfusx_log_drain_thread, NULL, gfusx_log_drain_main, NULL);
+        kos_assert(error == 0);
+    }
+
+    pthread_mutex_unlock(&gfusx_log_thread_lock);
+}
+
+void gfusx_log_destroy(gfusx_vm* vm) {
+    gfusx_log* log = vm->log;
+    if (log == NULL) return;
+
+    pthread_mutex_lock(&gfusx_log_thread_lock);
+
+    // the drain thread holds the lock while it takes messages off the queues,
+    // so it is done with this one once it is out of the list
+    pthread_mutex_lock(&gfusx_log_registry_lock);
+    for (gfusx_log** link = &gfusx_log_registry; *link != NULL; link = &(*link)->next) {
+        if (*link == log) {
+            *link = log->next;
+            break;
+        }
+    }
+
+    // the last queue takes the drain thread with it
+    bool stop = gfusx_log_registry == NULL;
+    if (stop) {
+        gfusx_log_draining = false;
+        pthread_cond_signal(&gfusx_log_wake);
+    }
+    pthread_mutex_unlock(&gfusx_log_registry_lock);
+
+    if (stop) pthread_join(gfusx_log_drain_thread, NULL);
+    pthread_mutex_unlock(&gfusx_log_thread_lock);
+
+    for (isize i = 0; i < GFUSX_LOG_SITE_COUNT; i++) {
+        gfusx_log_flush_site(log, &log->sites[i]);
+    }
+
+    gfusx_log_drain(log, stderr);
+    free(log);
+
+    vm->log = NULL;
+    vm->log_mask = 0;
+}
+
+void gfusx_vm_log_push(gfusx_vm* vm, gfusx_log_class log_class, const char* format, ...) {
+    if (vm->log == NULL || !gfusx_log_allow(vm, format)) return;
+
+    va_list v;
+    va_start(v, format);
+    gfusx_log_enqueue_v(vm->log, format, v);
+    va_end(v);
+
+    gfusx_log_wake_drain_thread();
+}
+
+static void gfusx_log_wake_drain_thread(void) {
+    if (atomic_exchange(&gfusx_log_wake_pending, true)) return;
+
+    pthread_mutex_lock(&gfusx_log_registry_lock);
+    pthread_cond_signal(&gfusx_log_wake);
+    pthread_mutex_unlock(&gfusx_log_registry_lock);
+}
+
+/// Sleeps until a message is queued, takes everything queued off under the
+/// lock, and prints it after letting go, so a slow stderr never holds up a VM
+/// powering on or off.
+static void* gfusx_log_drain_main(void* arg) {
+    pthread_mutex_lock(&gfusx_log_registry_lock);
+
+    for (;;) {
+        while (gfusx_log_draining && !atomic_load(&gfusx_log_wake_pending)) {
+            pthread_cond_wait(&gfusx_log_wake, &gfusx_log_registry_lock);
+        }
+
+        atomic_store(&gfusx_log_wake_pending, false);
+        bool draining = gfusx_log_draining;
+
+        char* text = NULL;
+        size_t text_size = 0;
+        FILE* buffer = open_memstream(&text, &text_size);
+        kos_assert(buffer != NULL);
+
+        for (gfusx_log* log = gfusx_log_registry; log != NULL; log = log->next) {
+            gfusx_log_drain(log, buffer);
+        }
+
+        pthread_mutex_unlock(&gfusx_log_registry_lock);
+
+        fclose(buffer);
+        if (text_size != 0) fwrite(text, 1, text_size, stderr);
+        free(text);
+
+        if (!draining) return NULL;
+        pthread_mutex_lock(&gfusx_log_registry_lock);
+    }
+}
+
+/// Prints every queued message.
+static void gfusx_log_drain(gfusx_log* log, FILE* stream) {
+    usize tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+    usize head = atomic_load_explicit(&log->head, memory_order_acquire);
+
+    char line[GFUSX_LOG_LINE_SIZE];
+    for (; tail != head; tail++) {
+        gfusx_log_format(&log->records[tail % GFUSX_LOG_RECORD_COUNT], line, sizeof line);
+        fprintf(stream, "%s\n", line);
+        atomic_store_explicit(&log->tail, tail + 1, memory_order_release);
+    }
+
+    u32 dropped = atomic_exchange_explicit(&log->dropped, 0, memory_order_relaxed);
+    if (dropped != 0) {
+        fprintf(stream, "%u log messages were dropped, the queue was full.\n", dropped);
+    }
+}
+
+/// Applies the rate limit of the call site with this format. Sites are found by
+/// linear probing, and a new one takes the first slot that is empty or whose
+/// window is over.
+static bool gfusx_log_allow(gfusx_vm* vm, const char* format) {
+    gfusx_log* log = vm->log;
+    u64 window = vm->cycle / GFUSX_LOG_RATE_WINDOW;
+
+    usize first = ((uintptr_t)format >> 3) % GFUSX_LOG_SITE_COUNT;
+    gfusx_log_site* site = NULL;
+    gfusx_log_site* open_site = NULL;
+    for (usize i = 0; i < GFUSX_LOG_SITE_COUNT; i++) {
+        gfusx_log_site* candidate = &log->sites[(first + i) % GFUSX_LOG_SITE_COUNT];
+        if (candidate->format == format) {
+            site = candidate;
+            break;
+        }
+
+        if (candidate->format == NULL) {
+            if (open_site == NULL) open_site = candidate;
+            break;
+        }
+
+        if (open_site == NULL && candidate->window != window) open_site = candidate;
+    }
+
+    if (site == NULL) {
+        // more sites are logging this window than there are slots, the rest go unlimited
+        if (open_site == NULL) return true;
+        site = open_site;
+    }
+
+    if (site->format != format || site->window != window) {
+        gfusx_log_flush_site(log, site);
+        *site = (gfusx_log_site) {
+            .format = format,
+            .window = window,
+        };
+    }
+
+    if (site->count >= log->rate_limit) {
+        site->suppressed++;
+        return false;
+    }
+
+    site->count++;
+    return true;
+}
+
+static void gfusx_log_flush_site(gfusx_log* log, const gfusx_log_site* site) {
+    if (site->suppressed != 0) {
+        gfusx_log_enqueue(log, "%u more messages like \"%s\" were suppressed.", site->suppressed, site->format);
+    }
+}
+
+static void gfusx_log_enqueue(gfusx_log* log, const char* format, ...) {
+    va_list v;
+    va_start(v, format);
+    gfusx_log_enqueue_v(log, format, v);
+    va_end(v);
+}
+
+static void gfusx_log_enqueue_v(gfusx_log* log, const char* format, va_list v) {
+    usize head = atomic_load_explicit(&log->head, memory_order_relaxed);
+    usize tail = atomic_load_explicit(&log->tail, memory_order_acquire);
+    if (head - tail == GFUSX_LOG_RECORD_COUNT) {
+        atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    gfusx_log_record* record = &log->records[head % GFUSX_LOG_RECORD_COUNT];
+    record->format = format;
+
+    usize size = 0;
+    const char* cursor = format;
+    gfusx_log_spec spec;
+    while (gfusx_log_parse_spec(&cursor, &spec)) {
+        // arguments that no longer fit are still taken, just not kept; the
+        // formatter stops at the end of the payload
+        if (spec.width == -2) {
+            i64 width = va_arg(v, int);
+            if (size + 8 <= GFUSX_LOG_PAYLOAD_SIZE) memcpy(record->payload + size, &width, 8);
+            size += 8;
+        }
+
+        if (spec.precision == -2) {
+            spec.precision = va_arg(v, int);
+            i64 precision = spec.precision;
+            if (size + 8 <= GFUSX_LOG_PAYLOAD_SIZE) memcpy(record->payload + size, &precision, 8);
+            size += 8;
+        }
+
+        u64 value = 0;
+        switch (spec.conversion) {
+            default: continue;
+
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': {
+                if (0 == strcmp(spec.length, "l")) value = (u64)va_arg(v, long);
+                else if (0 == strcmp(spec.length, "ll")) value = (u64)va_arg(v, long long);
+                else if (0 == strcmp(spec.length, "z")) value = (u64)va_arg(v, size_t);
+                else if (0 == strcmp(spec.length, "t")) value = (u64)va_arg(v, ptrdiff_t);
+                else if (0 == strcmp(spec.length, "j")) value = (u64)va_arg(v, intmax_t);
+                else value = (u64)va_arg(v, int);
+            } break;
+
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double d = 0 == strcmp(spec.length, "L") ? (double)va_arg(v, long double) : va_arg(v, double);
+                memcpy(&value, &d, sizeof d);
+            } break;
+
+            case 'p': {
+                value = (u64)(uintptr_t)va_arg(v, void*);
+            } break;
+
+            case 's': {
+                const char* string = va_arg(v, const char*);
+                if (string == NULL) string = "(null)";
+
+                usize length = spec.precision >= 0 ? strnlen(string, (usize)spec.precision) : strlen(string);
+                usize room = size + 2 < GFUSX_LOG_PAYLOAD_SIZE ? GFUSX_LOG_PAYLOAD_SIZE - size - 2 : 0;
+                if (length > room) length = room;
+
+                if (size + 2 <= GFUSX_LOG_PAYLOAD_SIZE) {
+                    u16 stored = (u16)length;
+                    memcpy(record->payload + size, &stored, 2);
+                    memcpy(record->payload + size + 2, string, length);
+                }
+
+                size += 2 + length;
+            } continue;
+        }
+
+        if (size + 8 <= GFUSX_LOG_PAYLOAD_SIZE) memcpy(record->payload + size, &value, 8);
+        size += 8;
+    }
+
+    record->size = (u16)(size < GFUSX_LOG_PAYLOAD_SIZE ? size : GFUSX_LOG_PAYLOAD_SIZE);
+    atomic_store_explicit(&log->head, head + 1, memory_order_release);
+}
+
+/// Moves the cursor to the next conversion specification that takes arguments
+/// and parses it. Returns false at the end of the format.
+static bool gfusx_log_parse_spec(const char** cursor, gfusx_log_spec* spec) {
+    const char* p = *cursor;
+    for (;;) {
+        while (*p != 0 && *p != '%') p++;
+        if (*p == 0) {
+            *cursor = p;
+            return false;
+        }
+
+        p++;
+        if (*p != '%') break;
+        p++;
+    }
+
+    *spec = (gfusx_log_spec) {
+        .width = -1,
+        .precision = -1,
+    };
+
+    usize flag_count = 0;
+    while (*p != 0 && strchr("-+ #0", *p) != NULL) {
+        if (flag_count + 1 < sizeof spec->flags) spec->flags[flag_count++] = *p;
+        p++;
+    }
+
+    if (*p == '*') {
+        spec->width = -2;
+        p++;
+    } else if (isdigit((unsigned char)*p)) {
+        spec->width = 0;
+        while (isdigit((unsigned char)*p)) spec->width = spec->width * 10 + (*p++ - '0');
+    }
+
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->precision = -2;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (isdigit((unsigned char)*p)) spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    usize length_count = 0;
+    while (*p != 0 && strchr("hlzjtL", *p) != NULL) {
+        if (length_count + 1 < sizeof spec->length) spec->length[length_count++] = *p;
+        p++;
+    }
+
+    spec->conversion = *p;
+    if (*p != 0) p++;
+
+    *cursor = p;
+    return true;
+}
+
+/// Formats a queued message the way the printf family would have.
+static void gfusx_log_format(const gfusx_log_record* record, char* line, usize line_size) {
+    usize line_length = 0;
+    usize offset = 0;
+
+    const char* cursor = record->format;
+    for (;;) {
+        const char* literal = cursor;
+        gfusx_log_spec spec;
+        bool has_spec = gfusx_log_parse_spec(&cursor, &spec);
+
+        // the text in front of the specification, with `%%` collapsed
+        for (const char* p = literal; p < cursor && line_length + 1 < line_size; p++) {
+            if (*p == '%') {
+                if (p[1] != '%') break;
+                p++;
+            }
+
+            line[line_length++] = *p;
+        }
+
+        if (!has_spec) break;
+
+        i64 width = spec.width;
+        i64 precision = spec.precision;
+        if (spec.width == -2) {
+            if (offset + 8 > record->size) break;
+            memcpy(&width, record->payload + offset, 8);
+            offset += 8;
+        }
+
+        if (spec.precision == -2) {
+            if (offset + 8 > record->size) break;
+            memcpy(&precision, record->payload + offset, 8);
+            offset += 8;
+        }
+
+        // rebuild the specification with every `*` filled in
+        char format[32];
+        int format_length = snprintf(format, sizeof format, "%%%s", spec.flags);
+        if (width >= 0) format_length += snprintf(format + format_length, sizeof format - (usize)format_length, "%d", (int)width);
+        if (spec.conversion == 's') {
+            format_length += snprintf(format + format_length, sizeof format - (usize)format_length, ".*s");
+        } else {
+            if (precision >= 0) format_length += snprintf(format + format_length, sizeof format - (usize)format_length, ".%d", (int)precision);
+            snprintf(format + format_length, sizeof format - (usize)format_length, "%s%c", spec.length, spec.conversion);
+        }
+
+        char* out = line + line_length;
+        usize room = line_size - line_length;
+        int written = 0;
+
+        if (spec.conversion == 's') {
+            if (offset + 2 > record->size) break;
+            u16 length;
+            memcpy(&length, record->payload + offset, 2);
+            offset += 2;
+            if (offset + length > record->size) break;
+            written = snprintf(out, room, format, (int)length, (const char*)record->payload + offset);
+            offset += length;
+        } else if (strchr("diuoxXcfFeEgGaAp", spec.conversion) != NULL && spec.conversion != 0) {
+            if (offset + 8 > record->size) break;
+            u64 value;
+            memcpy(&value, record->payload + offset, 8);
+            offset += 8;
+
+            if (strchr("fFeEgGaA", spec.conversion) != NULL) {
+                double d;
+                memcpy(&d, &value, sizeof d);
+                if (0 == strcmp(spec.length, "L")) written = snprintf(out, room, format, (long double)d);
+                else written = snprintf(out, room, format, d);
+            } else if (spec.conversion == 'p') {
+                written = snprintf(out, room, format, (void*)(uintptr_t)value);
+            } else if (0 == strcmp(spec.length, "l")) {
+                written = snprintf(out, room, format, (long)value);
+            } else if (0 == strcmp(spec.length, "ll")) {
+                written = snprintf(out, room, format, (long long)value);
+            } else if (0 == strcmp(spec.length, "z")) {
+                written = snprintf(out, room, format, (size_t)value);
+            } else if (0 == strcmp(spec.length, "t")) {
+                written = snprintf(out, room, format, (ptrdiff_t)value);
+            } else if (0 == strcmp(spec.length, "j")) {
+                written = snprintf(out, room, format, (intmax_t)value);
+            } else {
+                written = snprintf(out, room, format, (int)value);
+            }
+        }
+
+        if (written > 0) {
+            line_length += (usize)written < room ? (usize)written : room - 1;
+        }
+    }
+
+    line[line_length] = 0;
+}
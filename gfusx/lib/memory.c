@@ -0,0 +1,347 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+// mmap's MAP_ANONYMOUS is not part of strict ISO C mode
+#define _DEFAULT_SOURCE
+
+#include "vm_internal.h"
+
+/// Without fastmem, RAM and ROM are anonymous mappings where the host has
+/// them, so the loader can map file pages over them in place.
+
+#if GFUSX_HAS_FILE_MAPPING
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+static u8* gfusx_mem_allocate(usize size);
+static void gfusx_mem_free(u8* memory, usize size);
+static u8* gfusx_mem_backing(gfusx_vm* vm, u32 addr);
+static gfusx_mmio_region* gfusx_mem_find_mmio(gfusx_vm* vm, u32 addr);
+
+bool gfusx_mem_create(gfusx_vm* vm) {
+    if (vm->settings.memory.fastmem && !gfusx_fastmem_create(vm)) {
+        gfusx_vm_logf(vm, GFUSX_LC_MEMORY, "Fastmem is not available on this host, using the page tables instead.");
+        vm->settings.memory.fastmem = false;
+    }
+
+    if (!vm->settings.memory.fastmem) {
+        vm->ram = gfusx_mem_allocate(GFU_MEM_SIZE_MAIN_RAM);
+        vm->rom = gfusx_mem_allocate(GFU_MEM_SIZE_ROM);
+    }
+
+    // NOTE(local): Most of these are never touched, so they stay untouched zero pages on the host.
+    vm->read_pages = calloc(GFUSX_ADDRESS_PAGE_COUNT, sizeof *vm->read_pages);
+    vm->write_pages = calloc(GFUSX_ADDRESS_PAGE_COUNT, sizeof *vm->write_pages);
+
+    if (vm->ram == NULL || vm->rom == NULL || vm->read_pages == NULL || vm->write_pages == NULL) {
+        gfusx_mem_destroy(vm);
+        return false;
+    }
+
+    for (u32 offset = 0; offset < GFU_MEM_SIZE_MAIN_RAM; offset += GFUSX_PAGE_SIZE) {
+        u32 page_index = (GFU_MEM_OFFSET_MAIN_RAM + offset) >> GFUSX_PAGE_SHIFT;
+        vm->read_pages[page_index] = vm->ram + offset;
+        vm->write_pages[page_index] = vm->ram + offset;
+    }
+
+    // ROM is never written by the guest, so its write pages stay NULL
+    for (u32 offset = 0; offset < GFU_MEM_SIZE_ROM; offset += GFUSX_PAGE_SIZE) {
+        u32 page_index = (GFU_MEM_OFFSET_ROM + offset) >> GFUSX_PAGE_SHIFT;
+        vm->read_pages[page_index] = vm->rom + offset;
+    }
+
+    return true;
+}
+
+void gfusx_mem_destroy(gfusx_vm* vm) {
+    if (vm->fastmem_view != NULL) {
+        gfusx_fastmem_destroy(vm);
+    } else {
+        gfusx_mem_free(vm->ram, GFU_MEM_SIZE_MAIN_RAM);
+        gfusx_mem_free(vm->rom, GFU_MEM_SIZE_ROM);
+    }
+
+    free(vm->read_pages);
+    free(vm->write_pages);
+    kos_da_dealloc(&vm->mmio_regions);
+
+    vm->ram = NULL;
+    vm->rom = NULL;
+    vm->read_pages = NULL;
+    vm->write_pages = NULL;
+}
+
+void gfusx_mem_update_page_access(gfusx_vm* vm, u32 page_index) {
+    if (page_index >= GFUSX_CODE_PAGE_COUNT) return;
+
+    u32 addr = page_index << GFUSX_PAGE_SHIFT;
+    u8* backing = gfusx_mem_backing(vm, addr);
+    u8 watched = vm->watched_pages[page_index];
+
+    u8* read_page = (watched & GFUSX_WATCH_READ) != 0 ? NULL : backing;
+    u8* write_page = backing;
+    if (addr - GFU_MEM_OFFSET_MAIN_RAM >= GFU_MEM_SIZE_MAIN_RAM || vm->decoded_pages[page_index] != NULL || (watched & GFUSX_WATCH_WRITE) != 0) {
+        write_page = NULL;
+    }
+
+    // most calls change nothing, and those should not cost an mprotect
+    if (vm->read_pages[page_index] == read_page && vm->write_pages[page_index] == write_page) return;
+
+    vm->read_pages[page_index] = read_page;
+    vm->write_pages[page_index] = write_page;
+    gfusx_fastmem_set_access(vm, page_index, read_page != NULL, write_page != NULL);
+}
+
+bool gfusx_vm_map_mmio(gfusx_vm* vm, u32 base, u32 size, gfusx_mmio_read read, gfusx_mmio_write write, void* user_data) {
+    if (size == 0 || (base & GFUSX_PAGE_MASK) != 0 || (size & GFUSX_PAGE_MASK) != 0) return false;
+    if ((u64)base + size > (u64)GFUSX_ADDRESS_PAGE_COUNT << GFUSX_PAGE_SHIFT) return false;
+    if (base < GFU_MEM_SIZE) return false;
+
+    for (isize i = 0; i < vm->mmio_regions.count; i++) {
+        gfusx_mmio_region* region = &vm->mmio_regions.data[i];
+        if (base < region->base + region->size && region->base < base + size) {
+            return false;
+        }
+    }
+
+    gfusx_mmio_region region = {
+        .base = base,
+        .size = size,
+        .read = read,
+        .write = write,
+        .user_data = user_data,
+    };
+
+    kos_da_push(&vm->mmio_regions, region);
+    return true;
+}
+
+bool gfusx_vm_write_bytes(gfusx_vm* vm, u32 addr, const void* data, usize size) {
+    if (size == 0) return true;
+    if ((u64)addr + size > GFU_MEM_SIZE) return false;
+
+    // RAM and ROM are adjacent, but not in the same host allocation
+    const u8* bytes = data;
+    while (size > 0) {
+        u32 chunk = addr < GFU_MEM_OFFSET_ROM ? GFU_MEM_OFFSET_ROM - addr : GFU_MEM_SIZE - addr;
+        if (chunk > size) chunk = (u32)size;
+
+        memcpy(gfusx_mem_backing(vm, addr), bytes, chunk);
+        gfusx_vm_invalidate_code(vm, addr, chunk);
+        memset(&vm->dirty_pages[addr >> GFUSX_PAGE_SHIFT], GFUSX_DIRTY_ALL, ((addr + chunk - 1) >> GFUSX_PAGE_SHIFT) - (addr >> GFUSX_PAGE_SHIFT) + 1);
+
+        addr += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+u8 gfusx_vm_read8(gfusx_vm* vm, u32 addr) {
+    return gfusx_mem_read8_paged(vm, addr);
+}
+
+u16 gfusx_vm_read16(gfusx_vm* vm, u32 addr) {
+    return gfusx_mem_read16_paged(vm, addr);
+}
+
+u32 gfusx_vm_read32(gfusx_vm* vm, u32 addr) {
+    return gfusx_mem_read32_paged(vm, addr);
+}
+
+void gfusx_vm_write8(gfusx_vm* vm, u32 addr, u8 value) {
+    gfusx_mem_write8_paged(vm, addr, value);
+}
+
+void gfusx_vm_write16(gfusx_vm* vm, u32 addr, u16 value) {
+    gfusx_mem_write16_paged(vm, addr, value);
+}
+
+void gfusx_vm_write32(gfusx_vm* vm, u32 addr, u32 value) {
+    gfusx_mem_write32_paged(vm, addr, value);
+}
+
+u8* gfusx_mem_host_page(gfusx_vm* vm, u32 page_index) {
+    return gfusx_mem_backing(vm, page_index << GFUSX_PAGE_SHIFT);
+}
+
+void gfusx_mem_take_dirty_pages(gfusx_vm* vm, u8 owner, u8* pending) {
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        pending[page_index] = (vm->dirty_pages[page_index] & owner) != 0;
+        vm->dirty_pages[page_index] &= (u8)~owner;
+    }
+}
+
+u8* gfusx_mem_overwrite_page(gfusx_vm* vm, u32 page_index, u8 owner) {
+    gfusx_vm_invalidate_code(vm, page_index << GFUSX_PAGE_SHIFT, GFUSX_PAGE_SIZE);
+    vm->dirty_pages[page_index] |= (u8)~owner;
+    return gfusx_mem_host_page(vm, page_index);
+}
+
+bool gfusx_mem_map_file(gfusx_vm* vm, u32 addr, int fd, u64 offset, u32 size) {
+#if GFUSX_HAS_FILE_MAPPING
+    if (vm->fastmem_view != NULL || size == 0) return false;
+
+    // the whole range has to be in one of RAM or ROM, on a host page boundary in both
+    u8* host = gfusx_mem_backing(vm, addr);
+    if (host == NULL || gfusx_mem_backing(vm, addr + size - 1) != host + size - 1) return false;
+
+    usize host_page_size = (usize)sysconf(_SC_PAGESIZE);
+    if ((uintptr_t)host % host_page_size != 0 || offset % host_page_size != 0 || size % host_page_size != 0) return false;
+
+    // MAP_PRIVATE leaves the pages shared with the page cache until something
+    // writes to them, and then copies only the written page
+    if (MAP_FAILED == mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, (off_t)offset)) {
+        // a failed MAP_FIXED may have unmapped the range already, so put zero pages back
+        mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        return false;
+    }
+
+    gfusx_vm_invalidate_code(vm, addr, size);
+    memset(&vm->dirty_pages[addr >> GFUSX_PAGE_SHIFT], GFUSX_DIRTY_ALL, size >> GFUSX_PAGE_SHIFT);
+    return true;
+#else
+    return false;
+#endif
+}
+
+u32 gfusx_mem_read_slow(gfusx_vm* vm, u32 addr, u32 size) {
+    // the guest never gets here misaligned, only host side accesses do, and
+    // those may straddle a page or a region
+    if ((addr & (size - 1)) != 0) {
+        u32 value = 0;
+        for (u32 i = 0; i < size; i++) {
+            value |= (u32)gfusx_mem_read8_paged(vm, addr + i) << (i * 8);
+        }
+
+        return value;
+    }
+
+    if (vm->watchpoints.count != 0) gfusx_debug_check_watchpoints(vm, addr, size, GFUSX_WATCH_READ);
+
+    // only watched pages get here for RAM and ROM
+    u8* backing = gfusx_mem_backing(vm, addr);
+    if (backing != NULL) {
+        switch (size) {
+            default: kos_assert(false && "unsupported access size"); return 0;
+            case 1: return gfusx_mem_load8(backing);
+            case 2: return gfusx_mem_load16(backing);
+            case 4: return gfusx_mem_load32(backing);
+        }
+    }
+
+    gfusx_mmio_region* region = gfusx_mem_find_mmio(vm, addr);
+    if (region != NULL && region->read != NULL) {
+        u32 value = region->read(vm, region->user_data, addr, size);
+        // devices may answer with anything the host hands them, so a replay
+        // has to see the same values
+        if (vm->input != NULL) value = gfusx_vm_input(vm, GFUSX_INPUT_PORT, addr, value);
+        return value;
+    }
+
+    // TODO(local): Raise a bus error.
+    gfusx_vm_logf(vm, GFUSX_LC_MEMORY, "%u byte read from unmapped address 0x%08X.", size, addr);
+    return 0;
+}
+
+void gfusx_mem_write_slow(gfusx_vm* vm, u32 addr, u32 value, u32 size) {
+    if ((addr & (size - 1)) != 0) {
+        for (u32 i = 0; i < size; i++) {
+            gfusx_mem_write8_paged(vm, addr + i, (u8)(value >> (i * 8)));
+        }
+
+        return;
+    }
+
+    if (vm->watchpoints.count != 0) gfusx_debug_check_watchpoints(vm, addr, size, GFUSX_WATCH_WRITE);
+
+    if (addr - GFU_MEM_OFFSET_MAIN_RAM < GFU_MEM_SIZE_MAIN_RAM) {
+        // the page may hold pre-decoded code, which is stale from here on
+        gfusx_vm_invalidate_code(vm, addr, size);
+
+        u8* backing = gfusx_mem_backing(vm, addr);
+        switch (size) {
+            default: kos_assert(false && "unsupported access size"); return;
+            case 1: gfusx_mem_store8(backing, (u8)value); break;
+            case 2: gfusx_mem_store16(backing, (u16)value); break;
+            case 4: gfusx_mem_store32(backing, value); break;
+        }
+
+        gfusx_mem_mark_dirty(vm, addr);
+        return;
+    }
+
+    if (addr - GFU_MEM_OFFSET_ROM < GFU_MEM_SIZE_ROM) {
+        gfusx_vm_logf(vm, GFUSX_LC_MEMORY, "Ignoring %u byte write to ROM at 0x%08X.", size, addr);
+        return;
+    }
+
+    gfusx_mmio_region* region = gfusx_mem_find_mmio(vm, addr);
+    if (region != NULL && region->write != NULL) {
+        region->write(vm, region->user_data, addr, value, size);
+        return;
+    }
+
+    // TODO(local): Raise a bus error.
+    gfusx_vm_logf(vm, GFUSX_LC_MEMORY, "%u byte write to unmapped address 0x%08X.", size, addr);
+}
+
+static u8* gfusx_mem_allocate(usize size) {
+#if GFUSX_HAS_FILE_MAPPING
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+#else
+    return calloc(size, 1);
+#endif
+}
+
+static void gfusx_mem_free(u8* memory, usize size) {
+    if (memory == NULL) return;
+#if GFUSX_HAS_FILE_MAPPING
+    munmap(memory, size);
+#else
+    free(memory);
+#endif
+}
+
+static u8* gfusx_mem_backing(gfusx_vm* vm, u32 addr) {
+    if (addr - GFU_MEM_OFFSET_MAIN_RAM < GFU_MEM_SIZE_MAIN_RAM) {
+        return vm->ram + (addr - GFU_MEM_OFFSET_MAIN_RAM);
+    }
+
+    if (addr - GFU_MEM_OFFSET_ROM < GFU_MEM_SIZE_ROM) {
+        return vm->rom + (addr - GFU_MEM_OFFSET_ROM);
+    }
+
+    return NULL;
+}
+
+static gfusx_mmio_region* gfusx_mem_find_mmio(gfusx_vm* vm, u32 addr) {
+    for (isize i = 0; i < vm->mmio_regions.count; i++) {
+        gfusx_mmio_region* region = &vm->mmio_regions.data[i];
+        if (addr - region->base < region->size) {
+            return region;
+        }
+    }
+
+    return NULL;
+}
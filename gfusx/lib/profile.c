@@ -0,0 +1,200 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#define GFUSX_PROFILE_INITIAL_CAPACITY 1024
+
+/// The samples of one function, or of one address outside of any.
+typedef struct gfusx_profile_row {
+    const gfusx_symbol* symbol;
+    u32 address;
+    u64 count;
+} gfusx_profile_row;
+
+static void gfusx_profiler_sample(gfusx_vm* vm, void* user_data, u64 cycle);
+static void gfusx_profiler_add(gfusx_profiler* profiler, u32 pc, u64 count);
+static gfusx_profile_row* gfusx_profiler_rows(const gfusx_profiler* profiler, const gfusx_symbols* symbols, isize* row_count);
+static void gfusx_profile_row_name(const gfusx_profile_row* row, const gfusx_symbols* symbols, char* buffer, usize buffer_size);
+static int gfusx_profile_row_compare_address(const void* a, const void* b);
+static int gfusx_profile_row_compare_count(const void* a, const void* b);
+
+void gfusx_profiler_begin(gfusx_vm* vm, gfusx_profiler* profiler, u64 interval) {
+    kos_assert(interval != 0);
+    profiler->interval = interval;
+    profiler->event = gfusx_vm_schedule(vm, vm->cycle + interval, gfusx_profiler_sample, profiler);
+}
+
+void gfusx_profiler_end(gfusx_vm* vm, gfusx_profiler* profiler) {
+    // loading a savestate or seeking back brings the sample event that was
+    // pending then back under its old id, so look for it rather than the id
+    for (isize i = 0; i < vm->events.count; i++) {
+        const gfusx_event* event = &vm->events.data[i];
+        if (event->callback != gfusx_profiler_sample || event->user_data != profiler) continue;
+
+        gfusx_vm_cancel_event(vm, event->id);
+        i = -1;
+    }
+
+    profiler->event = 0;
+}
+
+void gfusx_profiler_free(gfusx_profiler* profiler) {
+    free(profiler->buckets);
+    *profiler = (gfusx_profiler) {0};
+}
+
+void gfusx_profiler_print(FILE* stream, const gfusx_profiler* profiler, const gfusx_symbols* symbols) {
+    isize row_count = 0;
+    gfusx_profile_row* rows = gfusx_profiler_rows(profiler, symbols, &row_count);
+    if (row_count != 0) qsort(rows, (usize)row_count, sizeof *rows, gfusx_profile_row_compare_count);
+
+    fprintf(stream, "%llu samples, one every %llu cycles.\n", (unsigned long long)profiler->sample_count, (unsigned long long)profiler->interval);
+    fprintf(stream, "%10s %7s %7s  %s\n", "samples", "self%", "total%", "function");
+
+    u64 running = 0;
+    for (isize i = 0; i < row_count; i++) {
+        char name[256];
+        gfusx_profile_row_name(&rows[i], symbols, name, sizeof name);
+
+        running += rows[i].count;
+        double self = 100.0 * (double)rows[i].count / (double)profiler->sample_count;
+        double total = 100.0 * (double)running / (double)profiler->sample_count;
+        fprintf(stream, "%10llu %6.2f%% %6.2f%%  %s\n", (unsigned long long)rows[i].count, self, total, name);
+    }
+
+    free(rows);
+}
+
+bool gfusx_profiler_write_collapsed(const gfusx_profiler* profiler, const gfusx_symbols* symbols, const char* file_path) {
+    FILE* stream = fopen(file_path, "w");
+    if (stream == NULL) return false;
+
+    isize row_count = 0;
+    gfusx_profile_row* rows = gfusx_profiler_rows(profiler, symbols, &row_count);
+    for (isize i = 0; i < row_count; i++) {
+        char name[256];
+        gfusx_profile_row_name(&rows[i], symbols, name, sizeof name);
+        fprintf(stream, "%s %llu\n", name, (unsigned long long)rows[i].count);
+    }
+
+    free(rows);
+    return 0 == fclose(stream);
+}
+
+static void gfusx_profiler_sample(gfusx_vm* vm, void* user_data, u64 cycle) {
+    gfusx_profiler* profiler = user_data;
+
+    // if the engine ran past several intervals before coming back, the pc it
+    // stopped at stands in for all of them
+    u64 weight = (vm->cycle - cycle) / profiler->interval + 1;
+    gfusx_profiler_add(profiler, vm->pc, weight);
+    profiler->sample_count += weight;
+
+    profiler->event = gfusx_vm_schedule(vm, cycle + weight * profiler->interval, gfusx_profiler_sample, profiler);
+}
+
+static void gfusx_profiler_add(gfusx_profiler* profiler, u32 pc, u64 count) {
+    // keep the table at most half full
+    if (profiler->used * 2 >= profiler->capacity) {
+        gfusx_profile_bucket* old_buckets = profiler->buckets;
+        isize old_capacity = profiler->capacity;
+
+        profiler->capacity = old_capacity == 0 ? GFUSX_PROFILE_INITIAL_CAPACITY : old_capacity * 2;
+        profiler->buckets = calloc((usize)profiler->capacity, sizeof *profiler->buckets);
+        profiler->used = 0;
+
+        for (isize i = 0; i < old_capacity; i++) {
+            if (old_buckets[i].count != 0) gfusx_profiler_add(profiler, old_buckets[i].pc, old_buckets[i].count);
+        }
+
+        free(old_buckets);
+    }
+
+    usize mask = (usize)profiler->capacity - 1;
+    usize index = ((pc >> 2) * 0x9E3779B1u) & mask;
+    while (profiler->buckets[index].count != 0 && profiler->buckets[index].pc != pc) {
+        index = (index + 1) & mask;
+    }
+
+    gfusx_profile_bucket* bucket = &profiler->buckets[index];
+    if (bucket->count == 0) {
+        bucket->pc = pc;
+        profiler->used++;
+    }
+
+    bucket->count += count;
+}
+
+// folds the histogram into one row per function, in no particular order
+static gfusx_profile_row* gfusx_profiler_rows(const gfusx_profiler* profiler, const gfusx_symbols* symbols, isize* row_count) {
+    gfusx_profile_row* rows = malloc((usize)(profiler->used == 0 ? 1 : profiler->used) * sizeof *rows);
+
+    isize count = 0;
+    for (isize i = 0; i < profiler->capacity; i++) {
+        const gfusx_profile_bucket* bucket = &profiler->buckets[i];
+        if (bucket->count == 0) continue;
+
+        const gfusx_symbol* symbol = symbols == NULL ? NULL : gfusx_symbols_find(symbols, bucket->pc);
+        rows[count++] = (gfusx_profile_row) {
+            .symbol = symbol,
+            .address = symbol == NULL ? bucket->pc : symbol->address,
+            .count = bucket->count,
+        };
+    }
+
+    if (count != 0) qsort(rows, (usize)count, sizeof *rows, gfusx_profile_row_compare_address);
+
+    isize merged = 0;
+    for (isize i = 0; i < count; i++) {
+        // an address outside of every function cannot be the start of one
+        if (merged != 0 && rows[merged - 1].address == rows[i].address) {
+            rows[merged - 1].count += rows[i].count;
+        } else {
+            rows[merged++] = rows[i];
+        }
+    }
+
+    *row_count = merged;
+    return rows;
+}
+
+static void gfusx_profile_row_name(const gfusx_profile_row* row, const gfusx_symbols* symbols, char* buffer, usize buffer_size) {
+    if (row->symbol != NULL) {
+        snprintf(buffer, buffer_size, "%s", gfusx_symbol_name(symbols, row->symbol));
+    } else {
+        snprintf(buffer, buffer_size, "0x%08X", row->address);
+    }
+}
+
+static int gfusx_profile_row_compare_address(const void* a, const void* b) {
+    const gfusx_profile_row* row_a = a;
+    const gfusx_profile_row* row_b = b;
+
+    return row_a->address < row_b->address ? -1 : row_a->address > row_b->address;
+}
+
+static int gfusx_profile_row_compare_count(const void* a, const void* b) {
+    const gfusx_profile_row* row_a = a;
+    const gfusx_profile_row* row_b = b;
+
+    if (row_a->count != row_b->count) return row_a->count > row_b->count ? -1 : 1;
+    return row_a->address < row_b->address ? -1 : row_a->address > row_b->address;
+}
@@ -0,0 +1,319 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#define GFUSX_REWIND_PAGE_WORDS (GFUSX_PAGE_SIZE / sizeof(u64))
+// every run of changed words costs a four byte header, and there can be at most
+// one run for every two words
+#define GFUSX_REWIND_MAX_ENCODED_PAGE (GFUSX_PAGE_SIZE + 4 * (GFUSX_REWIND_PAGE_WORDS / 2 + 1))
+
+/// Starts every frame in the buffer. It is followed by `event_count` pending
+/// events, `heap_block_count` HLE heap blocks, then `page_count` pages, each a
+/// gfusx_rewind_page and its encoded data, and then by `size` once more so the
+/// buffer can be walked backwards.
+typedef struct gfusx_rewind_frame {
+    u32 size;
+    u32 page_count;
+    u32 event_count;
+    u32 heap_block_count;
+    gfusx_event_id next_event_id;
+    gfusx_cpu_state cpu;
+} gfusx_rewind_frame;
+
+/// The encoded data of a page is a list of runs, each a u16 count of unchanged
+/// words to skip and a u16 count of changed words, which follow as the XOR of
+/// their old and new values.
+typedef struct gfusx_rewind_page {
+    u32 page_index;
+    u32 size;
+} gfusx_rewind_page;
+
+static void gfusx_rewind_reserve_scratch(gfusx_rewind* rewind, usize size);
+static void gfusx_rewind_read(const gfusx_rewind* rewind, usize offset, void* data, usize size);
+static void gfusx_rewind_write(gfusx_rewind* rewind, usize offset, const void* data, usize size);
+static void gfusx_rewind_drop_oldest(gfusx_rewind* rewind);
+static usize gfusx_rewind_read_newest(gfusx_rewind* rewind);
+static usize gfusx_rewind_encode_page(u8* out, const u8* page, u8* shadow);
+static void gfusx_rewind_undo_page(const u8* in, usize size, u8* page, u8* shadow);
+static u64 gfusx_rewind_load_word(const u8* page, usize index);
+static void gfusx_rewind_store_word(u8* page, usize index, u64 value);
+
+bool gfusx_rewind_init(gfusx_rewind* rewind, gfusx_vm* vm, usize budget) {
+    *rewind = (gfusx_rewind) {
+        .buffer = malloc(budget),
+        .capacity = budget,
+        .shadow = malloc(GFUSX_CODE_SIZE),
+    };
+
+    if (budget < sizeof(gfusx_rewind_frame) + sizeof(u32) || rewind->buffer == NULL || rewind->shadow == NULL) {
+        gfusx_rewind_free(rewind);
+        return false;
+    }
+
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        memcpy(rewind->shadow + (usize)page_index * GFUSX_PAGE_SIZE, gfusx_mem_host_page(vm, page_index), GFUSX_PAGE_SIZE);
+    }
+
+    u8 pending[GFUSX_CODE_PAGE_COUNT];
+    gfusx_mem_take_dirty_pages(vm, GFUSX_DIRTY_REWIND, pending);
+
+    return true;
+}
+
+void gfusx_rewind_free(gfusx_rewind* rewind) {
+    free(rewind->buffer);
+    free(rewind->shadow);
+    free(rewind->scratch);
+    *rewind = (gfusx_rewind) {0};
+}
+
+void gfusx_rewind_push(gfusx_vm* vm, gfusx_rewind* rewind) {
+    u8 pending[GFUSX_CODE_PAGE_COUNT];
+    gfusx_mem_take_dirty_pages(vm, GFUSX_DIRTY_REWIND, pending);
+
+    usize pending_count = 0;
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        pending_count += pending[page_index];
+    }
+
+    usize events_size = (usize)vm->events.count * sizeof(gfusx_event);
+    usize heap_size = (usize)vm->hle_heap.count * sizeof(gfusx_hle_block);
+    gfusx_rewind_reserve_scratch(rewind, sizeof(gfusx_rewind_frame) + events_size + heap_size + pending_count * (sizeof(gfusx_rewind_page) + GFUSX_REWIND_MAX_ENCODED_PAGE) + sizeof(u32));
+
+    gfusx_rewind_frame frame = {
+        .event_count = (u32)vm->events.count,
+        .heap_block_count = (u32)vm->hle_heap.count,
+        .next_event_id = vm->next_event_id,
+    };
+
+    gfusx_vm_get_cpu_state(vm, &frame.cpu);
+
+    // the events and heap blocks are few, so they are kept whole
+    usize size = sizeof frame;
+    if (events_size != 0) memcpy(rewind->scratch + size, vm->events.data, events_size);
+    size += events_size;
+    if (heap_size != 0) memcpy(rewind->scratch + size, vm->hle_heap.data, heap_size);
+    size += heap_size;
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        if (!pending[page_index]) continue;
+
+        const u8* page = gfusx_mem_host_page(vm, page_index);
+        u8* shadow = rewind->shadow + (usize)page_index * GFUSX_PAGE_SIZE;
+
+        usize encoded_size = gfusx_rewind_encode_page(rewind->scratch + size + sizeof(gfusx_rewind_page), page, shadow);
+        // written to, but back to how it was
+        if (encoded_size == 0) continue;
+
+        gfusx_rewind_page header = {
+            .page_index = page_index,
+            .size = (u32)encoded_size,
+        };
+
+        memcpy(rewind->scratch + size, &header, sizeof header);
+        size += sizeof header + encoded_size;
+        frame.page_count++;
+    }
+
+    size += sizeof(u32);
+    frame.size = (u32)size;
+    memcpy(rewind->scratch, &frame, sizeof frame);
+    memcpy(rewind->scratch + size - sizeof(u32), &frame.size, sizeof(u32));
+
+    // NOTE(local): The shadow already moved on, so a frame that does not fit
+    // breaks the chain and everything before it has to go.
+    if (size > rewind->capacity) {
+        rewind->head = rewind->tail = rewind->used = 0;
+        rewind->frame_count = 0;
+        return;
+    }
+
+    while (rewind->capacity - rewind->used < size) {
+        gfusx_rewind_drop_oldest(rewind);
+    }
+
+    gfusx_rewind_write(rewind, rewind->head, rewind->scratch, size);
+    rewind->head = (rewind->head + size) % rewind->capacity;
+    rewind->used += size;
+    rewind->frame_count++;
+}
+
+isize gfusx_rewind_seek(gfusx_vm* vm, gfusx_rewind* rewind, isize frames) {
+    if (rewind->frame_count == 0) return -1;
+
+    // the oldest frame only holds its changes from the one dropped before it
+    if (frames > rewind->frame_count - 1) frames = rewind->frame_count - 1;
+    if (frames < 0) frames = 0;
+
+    // throw away everything written since the newest frame first, so memory
+    // matches the shadow again
+    u8 pending[GFUSX_CODE_PAGE_COUNT];
+    gfusx_mem_take_dirty_pages(vm, GFUSX_DIRTY_REWIND, pending);
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        if (!pending[page_index]) continue;
+
+        u8* page = gfusx_mem_overwrite_page(vm, page_index, GFUSX_DIRTY_REWIND);
+        memcpy(page, rewind->shadow + (usize)page_index * GFUSX_PAGE_SIZE, GFUSX_PAGE_SIZE);
+    }
+
+    for (isize i = 0; i < frames; i++) {
+        usize size = gfusx_rewind_read_newest(rewind);
+
+        gfusx_rewind_frame frame;
+        memcpy(&frame, rewind->scratch, sizeof frame);
+
+        const u8* cursor = rewind->scratch + sizeof frame + (usize)frame.event_count * sizeof(gfusx_event) + (usize)frame.heap_block_count * sizeof(gfusx_hle_block);
+        for (u32 j = 0; j < frame.page_count; j++) {
+            gfusx_rewind_page header;
+            memcpy(&header, cursor, sizeof header);
+            cursor += sizeof header;
+
+            u8* page = gfusx_mem_overwrite_page(vm, header.page_index, GFUSX_DIRTY_REWIND);
+            u8* shadow = rewind->shadow + (usize)header.page_index * GFUSX_PAGE_SIZE;
+            gfusx_rewind_undo_page(cursor, header.size, page, shadow);
+            cursor += header.size;
+        }
+
+        rewind->head = (rewind->head + rewind->capacity - size) % rewind->capacity;
+        rewind->used -= size;
+        rewind->frame_count--;
+    }
+
+    gfusx_rewind_read_newest(rewind);
+
+    gfusx_rewind_frame frame;
+    memcpy(&frame, rewind->scratch, sizeof frame);
+    gfusx_vm_set_cpu_state(vm, &frame.cpu);
+    const u8* events = rewind->scratch + sizeof frame;
+    gfusx_vm_restore_events(vm, events, frame.event_count, frame.next_event_id);
+    gfusx_hle_restore_heap(vm, events + (usize)frame.event_count * sizeof(gfusx_event), frame.heap_block_count);
+
+    return frames;
+}
+
+static void gfusx_rewind_reserve_scratch(gfusx_rewind* rewind, usize size) {
+    if (rewind->scratch_capacity >= size) return;
+
+    free(rewind->scratch);
+    rewind->scratch = malloc(size);
+    kos_assert(rewind->scratch != NULL);
+    rewind->scratch_capacity = size;
+}
+
+static void gfusx_rewind_read(const gfusx_rewind* rewind, usize offset, void* data, usize size) {
+    usize first = rewind->capacity - offset;
+    if (first > size) first = size;
+
+    memcpy(data, rewind->buffer + offset, first);
+    memcpy((u8*)data + first, rewind->buffer, size - first);
+}
+
+static void gfusx_rewind_write(gfusx_rewind* rewind, usize offset, const void* data, usize size) {
+    usize first = rewind->capacity - offset;
+    if (first > size) first = size;
+
+    memcpy(rewind->buffer + offset, data, first);
+    memcpy(rewind->buffer, (const u8*)data + first, size - first);
+}
+
+static void gfusx_rewind_drop_oldest(gfusx_rewind* rewind) {
+    u32 size;
+    gfusx_rewind_read(rewind, rewind->tail, &size, sizeof size);
+
+    rewind->tail = (rewind->tail + size) % rewind->capacity;
+    rewind->used -= size;
+    rewind->frame_count--;
+}
+
+/// Copies the newest frame into the scratch buffer and returns its size.
+static usize gfusx_rewind_read_newest(gfusx_rewind* rewind) {
+    u32 size;
+    gfusx_rewind_read(rewind, (rewind->head + rewind->capacity - sizeof size) % rewind->capacity, &size, sizeof size);
+
+    gfusx_rewind_reserve_scratch(rewind, size);
+    gfusx_rewind_read(rewind, (rewind->head + rewind->capacity - size) % rewind->capacity, rewind->scratch, size);
+
+    return size;
+}
+
+/// Encodes how `page` differs from `shadow` and brings the shadow up to date.
+/// Returns 0 if they were the same.
+static usize gfusx_rewind_encode_page(u8* out, const u8* page, u8* shadow) {
+    usize size = 0;
+    usize i = 0;
+
+    while (i < GFUSX_REWIND_PAGE_WORDS) {
+        usize skip_start = i;
+        while (i < GFUSX_REWIND_PAGE_WORDS && gfusx_rewind_load_word(page, i) == gfusx_rewind_load_word(shadow, i)) i++;
+        if (i == GFUSX_REWIND_PAGE_WORDS) break;
+
+        usize changed_start = i;
+        while (i < GFUSX_REWIND_PAGE_WORDS && gfusx_rewind_load_word(page, i) != gfusx_rewind_load_word(shadow, i)) i++;
+
+        u16 run[2] = { (u16)(changed_start - skip_start), (u16)(i - changed_start) };
+        memcpy(out + size, run, sizeof run);
+        size += sizeof run;
+
+        for (usize j = changed_start; j < i; j++) {
+            u64 word = gfusx_rewind_load_word(page, j);
+            u64 delta = word ^ gfusx_rewind_load_word(shadow, j);
+            memcpy(out + size, &delta, sizeof delta);
+            size += sizeof delta;
+            gfusx_rewind_store_word(shadow, j, word);
+        }
+    }
+
+    return size;
+}
+
+/// Takes both `page` and `shadow` back to how they were before the encoded
+/// changes. They have to match going in.
+static void gfusx_rewind_undo_page(const u8* in, usize size, u8* page, u8* shadow) {
+    usize i = 0;
+    usize offset = 0;
+
+    while (offset < size) {
+        u16 run[2];
+        memcpy(run, in + offset, sizeof run);
+        offset += sizeof run;
+        i += run[0];
+
+        for (u16 j = 0; j < run[1]; j++, i++) {
+            u64 delta;
+            memcpy(&delta, in + offset, sizeof delta);
+            offset += sizeof delta;
+            u64 word = gfusx_rewind_load_word(shadow, i) ^ delta;
+            gfusx_rewind_store_word(shadow, i, word);
+            gfusx_rewind_store_word(page, i, word);
+        }
+    }
+}
+
+/// Pages are compared a word at a time, through memcpy since guest memory has
+/// no alignment promise for u64. Only ever XORed, so the byte order is moot.
+static u64 gfusx_rewind_load_word(const u8* page, usize index) {
+    u64 word;
+    memcpy(&word, page + index * sizeof word, sizeof word);
+    return word;
+}
+
+static void gfusx_rewind_store_word(u8* page, usize index, u64 value) {
+    memcpy(page + index * sizeof value, &value, sizeof value);
+}
@@ -0,0 +1,183 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+static void gfusx_savestate_mark_changed(gfusx_savestates* states, u8* pending, isize from, isize to);
+static const u8* gfusx_savestate_page_at(const gfusx_savestate_pages* versions, u32 snapshot);
+
+isize gfusx_vm_save_state(gfusx_vm* vm, gfusx_savestates* states) {
+    u32 snapshot_index = (u32)states->snapshots.count;
+
+    gfusx_snapshot snapshot = {
+        .next_event_id = vm->next_event_id,
+    };
+
+    gfusx_vm_get_cpu_state(vm, &snapshot.cpu);
+    for (isize i = 0; i < vm->events.count; i++) {
+        kos_da_push(&snapshot.events, vm->events.data[i]);
+    }
+
+    for (isize i = 0; i < vm->hle_heap.count; i++) {
+        kos_da_push(&snapshot.hle_heap, vm->hle_heap.data[i]);
+    }
+
+    // NOTE(local): After loading an older snapshot, memory also differs from the
+    // newest one in every page saved since, so those have to be saved again.
+    u8 pending[GFUSX_CODE_PAGE_COUNT];
+    gfusx_mem_take_dirty_pages(vm, GFUSX_DIRTY_SAVESTATE, pending);
+    if (snapshot_index == 0) {
+        memset(pending, 1, sizeof pending);
+    } else {
+        gfusx_savestate_mark_changed(states, pending, states->current, snapshot_index - 1);
+    }
+
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        if (!pending[page_index]) continue;
+
+        gfusx_savestate_page page = {
+            .snapshot = snapshot_index,
+            .data = malloc(GFUSX_PAGE_SIZE),
+        };
+
+        kos_assert(page.data != NULL);
+        memcpy(page.data, gfusx_mem_host_page(vm, page_index), GFUSX_PAGE_SIZE);
+
+        kos_da_push(&states->pages[page_index], page);
+        kos_da_push(&snapshot.pages, page_index);
+    }
+
+    kos_da_push(&states->snapshots, snapshot);
+    states->current = snapshot_index;
+
+    return snapshot_index;
+}
+
+bool gfusx_vm_load_state(gfusx_vm* vm, gfusx_savestates* states, isize snapshot_index) {
+    if (snapshot_index < 0 || snapshot_index >= states->snapshots.count) return false;
+
+    u8 pending[GFUSX_CODE_PAGE_COUNT];
+    gfusx_mem_take_dirty_pages(vm, GFUSX_DIRTY_SAVESTATE, pending);
+    gfusx_savestate_mark_changed(states, pending, states->current, snapshot_index);
+
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        if (!pending[page_index]) continue;
+
+        u8* page = gfusx_mem_overwrite_page(vm, page_index, GFUSX_DIRTY_SAVESTATE);
+        memcpy(page, gfusx_savestate_page_at(&states->pages[page_index], (u32)snapshot_index), GFUSX_PAGE_SIZE);
+    }
+
+    const gfusx_snapshot* snapshot = &states->snapshots.data[snapshot_index];
+    gfusx_vm_set_cpu_state(vm, &snapshot->cpu);
+    gfusx_vm_restore_events(vm, snapshot->events.data, snapshot->events.count, snapshot->next_event_id);
+    gfusx_hle_restore_heap(vm, snapshot->hle_heap.data, snapshot->hle_heap.count);
+    states->current = snapshot_index;
+
+    return true;
+}
+
+void gfusx_vm_get_cpu_state(gfusx_vm* vm, gfusx_cpu_state* cpu) {
+    *cpu = (gfusx_cpu_state) {
+        .gpr = vm->gpr,
+        .cop0 = vm->cop0,
+        .cop2d = vm->cop2d,
+        .cop2c = vm->cop2c,
+        .pc = vm->pc,
+        .code = vm->code,
+        .cycle = vm->cycle,
+        .previous_cycles = vm->previous_cycles,
+        .delayed_load_info = { vm->delayed_load_info[0], vm->delayed_load_info[1] },
+        .current_delayed_load = vm->current_delayed_load,
+        .next_is_delay_slot = vm->next_is_delay_slot,
+        .in_delay_slot = vm->in_delay_slot,
+    };
+
+    memcpy(cpu->icache_tags, vm->icache_tags, sizeof cpu->icache_tags);
+}
+
+void gfusx_vm_set_cpu_state(gfusx_vm* vm, const gfusx_cpu_state* cpu) {
+    vm->gpr = cpu->gpr;
+    vm->cop0 = cpu->cop0;
+    vm->cop2d = cpu->cop2d;
+    vm->cop2c = cpu->cop2c;
+    vm->pc = cpu->pc;
+    vm->code = cpu->code;
+    vm->cycle = cpu->cycle;
+    vm->previous_cycles = cpu->previous_cycles;
+    memcpy(vm->icache_tags, cpu->icache_tags, sizeof vm->icache_tags);
+    vm->delayed_load_info[0] = cpu->delayed_load_info[0];
+    vm->delayed_load_info[1] = cpu->delayed_load_info[1];
+    vm->current_delayed_load = cpu->current_delayed_load;
+    vm->next_is_delay_slot = cpu->next_is_delay_slot;
+    vm->in_delay_slot = cpu->in_delay_slot;
+    vm->stop_reason = GFUSX_STOP_NONE;
+}
+
+void gfusx_savestates_free(gfusx_savestates* states) {
+    for (u32 page_index = 0; page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        gfusx_savestate_pages* versions = &states->pages[page_index];
+        for (isize i = 0; i < versions->count; i++) {
+            free(versions->data[i].data);
+        }
+
+        kos_da_dealloc(versions);
+    }
+
+    for (isize i = 0; i < states->snapshots.count; i++) {
+        kos_da_dealloc(&states->snapshots.data[i].pages);
+        kos_da_dealloc(&states->snapshots.data[i].events);
+        kos_da_dealloc(&states->snapshots.data[i].hle_heap);
+    }
+
+    kos_da_dealloc(&states->snapshots);
+    states->current = 0;
+}
+
+/// Marks every page saved by a snapshot after the older of `from` and `to`, up
+/// to and including the newer one, as those are the pages that can differ
+/// between the two.
+static void gfusx_savestate_mark_changed(gfusx_savestates* states, u8* pending, isize from, isize to) {
+    isize first = (from < to ? from : to) + 1;
+    isize last = from < to ? to : from;
+
+    for (isize i = first; i <= last; i++) {
+        const gfusx_page_indices* pages = &states->snapshots.data[i].pages;
+        for (isize j = 0; j < pages->count; j++) {
+            pending[pages->data[j]] = 1;
+        }
+    }
+}
+
+/// Returns the newest version of a page saved no later than `snapshot`. The
+/// first version is always from the full snapshot, so there is one.
+static const u8* gfusx_savestate_page_at(const gfusx_savestate_pages* versions, u32 snapshot) {
+    isize low = 0;
+    isize high = versions->count - 1;
+    while (low < high) {
+        isize middle = (low + high + 1) / 2;
+        if (versions->data[middle].snapshot <= snapshot) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return versions->data[low].data;
+}
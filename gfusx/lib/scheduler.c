@@ -0,0 +1,122 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+static bool gfusx_event_before(const gfusx_event* a, const gfusx_event* b);
+static void gfusx_events_sift_up(gfusx_events* events, isize index);
+static void gfusx_events_sift_down(gfusx_events* events, isize index);
+static void gfusx_events_remove(gfusx_events* events, isize index);
+
+gfusx_event_id gfusx_vm_schedule(gfusx_vm* vm, u64 cycle, gfusx_event_callback callback, void* user_data) {
+    gfusx_event event = {
+        .cycle = cycle,
+        .id = ++vm->next_event_id,
+        .callback = callback,
+        .user_data = user_data,
+    };
+
+    kos_da_push(&vm->events, event);
+    gfusx_events_sift_up(&vm->events, vm->events.count - 1);
+
+    // scheduled from a device handler, so the engine has to leave earlier than planned
+    if (cycle < vm->cycle_target) {
+        vm->cycle_target = cycle;
+    }
+
+    return event.id;
+}
+
+bool gfusx_vm_cancel_event(gfusx_vm* vm, gfusx_event_id id) {
+    for (isize i = 0; i < vm->events.count; i++) {
+        if (vm->events.data[i].id == id) {
+            gfusx_events_remove(&vm->events, i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void gfusx_vm_run_events(gfusx_vm* vm) {
+    while (vm->events.count != 0 && vm->events.data[0].cycle <= vm->cycle) {
+        gfusx_event event = vm->events.data[0];
+        gfusx_events_remove(&vm->events, 0);
+        event.callback(vm, event.user_data, event.cycle);
+    }
+}
+
+void gfusx_vm_free_events(gfusx_vm* vm) {
+    kos_da_dealloc(&vm->events);
+}
+
+void gfusx_vm_restore_events(gfusx_vm* vm, const void* events, isize count, gfusx_event_id next_event_id) {
+    vm->events.count = 0;
+    for (isize i = 0; i < count; i++) {
+        gfusx_event event;
+        memcpy(&event, (const u8*)events + (usize)i * sizeof event, sizeof event);
+        kos_da_push(&vm->events, event);
+    }
+
+    vm->next_event_id = next_event_id;
+}
+
+static bool gfusx_event_before(const gfusx_event* a, const gfusx_event* b) {
+    if (a->cycle != b->cycle) return a->cycle < b->cycle;
+    return a->id < b->id;
+}
+
+static void gfusx_events_sift_up(gfusx_events* events, isize index) {
+    while (index > 0) {
+        isize parent = (index - 1) / 2;
+        if (!gfusx_event_before(&events->data[index], &events->data[parent])) break;
+
+        gfusx_event temp = events->data[index];
+        events->data[index] = events->data[parent];
+        events->data[parent] = temp;
+        index = parent;
+    }
+}
+
+static void gfusx_events_sift_down(gfusx_events* events, isize index) {
+    for (;;) {
+        isize smallest = index;
+        isize left = index * 2 + 1;
+        isize right = left + 1;
+
+        if (left < events->count && gfusx_event_before(&events->data[left], &events->data[smallest])) smallest = left;
+        if (right < events->count && gfusx_event_before(&events->data[right], &events->data[smallest])) smallest = right;
+        if (smallest == index) break;
+
+        gfusx_event temp = events->data[index];
+        events->data[index] = events->data[smallest];
+        events->data[smallest] = temp;
+        index = smallest;
+    }
+}
+
+static void gfusx_events_remove(gfusx_events* events, isize index) {
+    events->count--;
+    if (index == events->count) return;
+
+    events->data[index] = events->data[events->count];
+    gfusx_events_sift_down(events, index);
+    gfusx_events_sift_up(events, index);
+}
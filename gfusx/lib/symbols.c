@@ -0,0 +1,139 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <gamefu/elf.h>
+
+static int gfusx_symbol_compare(const void* a, const void* b);
+static bool gfusx_symbol_is_function(const elf32_raw* elf, const elf32_symbol* symbol);
+
+bool gfusx_symbols_load(gfusx_symbols* symbols, const char* file_path) {
+    bool result = true;
+    *symbols = (gfusx_symbols) {0};
+
+    elf32_raw elf = elf32_read_raw_from_file(file_path);
+    if (elf.error_message != nullptr) kos_return_defer(false);
+
+    elf32_section_header* symtab = NULL;
+    for (elf32_word i = 0; i < elf.header.sh_count; i++) {
+        if (elf.sections[i].type == ELF_SECT_SYMTAB) {
+            symtab = &elf.sections[i];
+            break;
+        }
+    }
+
+    if (symtab == NULL || symtab->link >= elf.header.sh_count) kos_return_defer(false);
+
+    elf32_section_header* strtab = &elf.sections[symtab->link];
+    if ((u64)symtab->offset + symtab->size > elf.size || (u64)strtab->offset + strtab->size > elf.size || strtab->size == 0) {
+        kos_return_defer(false);
+    }
+
+    // the names are kept as the string table they came from
+    symbols->names = malloc(strtab->size);
+    memcpy(symbols->names, elf.data + strtab->offset, strtab->size);
+    symbols->names[strtab->size - 1] = 0;
+
+    // NOTE(local): Like the loader, this assumes the ELF file is in host byte
+    // order, which holds for everything the GameFU toolchain writes on x86.
+    for (elf32_word offset = 0; offset + sizeof(elf32_symbol) <= symtab->size; offset += sizeof(elf32_symbol)) {
+        elf32_symbol symbol;
+        memcpy(&symbol, elf.data + symtab->offset + offset, sizeof symbol);
+        if (!gfusx_symbol_is_function(&elf, &symbol) || symbol.name == 0 || symbol.name >= strtab->size) continue;
+
+        u32 address = symbol.value;
+        if (elf.header.type == ELF_FILE_REL) {
+            address += elf.sections[symbol.shndx].virtual_address;
+        }
+
+        gfusx_symbol entry = {
+            .address = address,
+            .size = symbol.size,
+            .name = symbol.name,
+        };
+
+        kos_da_push(symbols, entry);
+    }
+
+    if (symbols->count != 0) {
+        qsort(symbols->data, (usize)symbols->count, sizeof *symbols->data, gfusx_symbol_compare);
+    }
+
+    // when several symbols share an address, the first one after sorting wins
+    isize kept = 0;
+    for (isize i = 0; i < symbols->count; i++) {
+        if (kept != 0 && symbols->data[kept - 1].address == symbols->data[i].address) continue;
+        symbols->data[kept++] = symbols->data[i];
+    }
+
+    symbols->count = kept;
+
+defer:;
+    if (!result) gfusx_symbols_free(symbols);
+    elf32_raw_free(&elf);
+    return result;
+}
+
+void gfusx_symbols_free(gfusx_symbols* symbols) {
+    kos_da_dealloc(symbols);
+    free(symbols->names);
+    *symbols = (gfusx_symbols) {0};
+}
+
+const gfusx_symbol* gfusx_symbols_find(const gfusx_symbols* symbols, u32 address) {
+    // the last symbol at or before the address
+    isize low = 0, high = symbols->count;
+    while (low < high) {
+        isize middle = low + (high - low) / 2;
+        if (symbols->data[middle].address <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == 0) return NULL;
+
+    const gfusx_symbol* symbol = &symbols->data[low - 1];
+    if (symbol->size != 0 && address - symbol->address >= symbol->size) return NULL;
+
+    return symbol;
+}
+
+static int gfusx_symbol_compare(const void* a, const void* b) {
+    const gfusx_symbol* symbol_a = a;
+    const gfusx_symbol* symbol_b = b;
+
+    if (symbol_a->address != symbol_b->address) return symbol_a->address < symbol_b->address ? -1 : 1;
+    // prefer the symbol that knows its size
+    if (symbol_a->size != symbol_b->size) return symbol_a->size > symbol_b->size ? -1 : 1;
+    return symbol_a->name < symbol_b->name ? -1 : symbol_a->name > symbol_b->name;
+}
+
+static bool gfusx_symbol_is_function(const elf32_raw* elf, const elf32_symbol* symbol) {
+    if (symbol->shndx == ELF_SHN_UNDEF || symbol->shndx >= elf->header.sh_count) return false;
+
+    int type = ELF32_ST_TYPE(symbol->info);
+    if (type == ELF_SYMTYPE_FUNC) return true;
+
+    // assembler labels usually have no type, so anything in executable code counts
+    return type == ELF_SYMTYPE_NOTYPE && 0 != (elf->sections[symbol->shndx].flags & ELF_SECTFLAG_EXECINSTR);
+}
@@ -0,0 +1,376 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#include <pthread.h>
+
+#define GFUSX_TRACE_MAGIC "GFUT"
+#define GFUSX_TRACE_VERSION 1
+
+#define GFUSX_TRACE_CHUNK_SIZE (1u << 20)
+#define GFUSX_TRACE_CHUNK_COUNT 4
+#define GFUSX_TRACE_CODE_CACHE_SIZE 4096
+#define GFUSX_TRACE_READ_BUFFER_SIZE (1u << 16)
+#define GFUSX_TRACE_REGISTER_COUNT 34
+
+// the flags byte at the start of every record; the remaining bits count the
+// registers that changed
+#define GFUSX_TRACE_SEQUENTIAL_PC (1u << 0)
+#define GFUSX_TRACE_CACHED_CODE (1u << 1)
+#define GFUSX_TRACE_CHANGED_SHIFT 2
+
+// flags, pc delta, code, and a register index and value delta per register
+#define GFUSX_TRACE_MAX_RECORD_SIZE (1 + 5 + 4 + GFUSX_TRACE_REGISTER_COUNT * (1 + 5))
+
+/// What the writer and reader both know about the trace so far. Every record
+/// is encoded against it:
+///   - a flags byte,
+///   - unless the pc follows the previous one, the zigzag varint difference,
+///   - unless the code cache already has the code for the pc, the code,
+///   - and for every changed register its index and the zigzag varint
+///     difference to its previous value.
+typedef struct gfusx_trace_model {
+    u32 pc;
+    gfusx_mips_gpregs gpr;
+    u32 code_cache_pc[GFUSX_TRACE_CODE_CACHE_SIZE];
+    u32 code_cache_code[GFUSX_TRACE_CODE_CACHE_SIZE];
+} gfusx_trace_model;
+
+struct gfusx_trace_writer {
+    FILE* stream;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // chunk n % GFUSX_TRACE_CHUNK_COUNT is the n-th to be filled and written;
+    // these and `finished` and `failed` are guarded by the lock
+    u8* chunks[GFUSX_TRACE_CHUNK_COUNT];
+    usize chunk_sizes[GFUSX_TRACE_CHUNK_COUNT];
+    u64 submitted;
+    u64 written;
+    bool finished;
+    bool failed;
+
+    // only touched by the VM's thread
+    usize current_size;
+    u32 next_pc;
+    gfusx_trace_model model;
+    gfusx_trace_hook previous_trace;
+    void* previous_trace_user_data;
+};
+
+struct gfusx_trace_reader {
+    FILE* stream;
+    u8 buffer[GFUSX_TRACE_READ_BUFFER_SIZE];
+    usize buffer_size;
+    usize buffer_position;
+    gfusx_trace_model model;
+};
+
+static void gfusx_trace_record(gfusx_vm* vm, void* user_data);
+static void gfusx_trace_submit(gfusx_trace_writer* writer);
+static void* gfusx_trace_writer_main(void* arg);
+static usize gfusx_trace_write_varint(u8* out, u32 value);
+static bool gfusx_trace_read_byte(gfusx_trace_reader* reader, u8* byte);
+static bool gfusx_trace_read_varint(gfusx_trace_reader* reader, u32* value);
+
+static u32 gfusx_trace_zigzag(i32 value) {
+    return ((u32)value << 1) ^ (u32)(value >> 31);
+}
+
+static i32 gfusx_trace_unzigzag(u32 value) {
+    return (i32)(value >> 1) ^ -(i32)(value & 1);
+}
+
+gfusx_trace_writer* gfusx_trace_begin(gfusx_vm* vm, const char* file_path) {
+    gfusx_trace_writer* writer = calloc(1, sizeof *writer);
+    if (writer == NULL) return NULL;
+
+    writer->stream = fopen(file_path, "wb");
+    if (writer->stream == NULL) {
+        free(writer);
+        return NULL;
+    }
+
+    for (int i = 0; i < GFUSX_TRACE_CHUNK_COUNT; i++) {
+        writer->chunks[i] = malloc(GFUSX_TRACE_CHUNK_SIZE);
+        kos_assert(writer->chunks[i] != NULL);
+    }
+
+    writer->next_pc = vm->pc;
+    writer->model.pc = vm->pc - 4;
+    writer->model.gpr = vm->gpr;
+
+    // the header is the first thing in the first chunk
+    u8* header = writer->chunks[0];
+    u32 version = GFUSX_TRACE_VERSION;
+    memcpy(header, GFUSX_TRACE_MAGIC, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &writer->model.pc, 4);
+    memcpy(header + 12, writer->model.gpr.r, sizeof writer->model.gpr.r);
+    writer->current_size = 12 + sizeof writer->model.gpr.r;
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    int error = pthread_create(&writer->thread, NULL, gfusx_trace_writer_main, writer);
+    kos_assert(error == 0);
+
+    writer->previous_trace = vm->settings.debug.trace;
+    writer->previous_trace_user_data = vm->settings.debug.trace_user_data;
+    vm->settings.debug.trace = gfusx_trace_record;
+    vm->settings.debug.trace_user_data = writer;
+
+    return writer;
+}
+
+bool gfusx_trace_end(gfusx_vm* vm, gfusx_trace_writer* writer) {
+    vm->settings.debug.trace = writer->previous_trace;
+    vm->settings.debug.trace_user_data = writer->previous_trace_user_data;
+
+    gfusx_trace_submit(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->finished = true;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    bool result = !writer->failed;
+    if (0 != fclose(writer->stream)) result = false;
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->cond);
+    for (int i = 0; i < GFUSX_TRACE_CHUNK_COUNT; i++) {
+        free(writer->chunks[i]);
+    }
+
+    free(writer);
+    return result;
+}
+
+static void gfusx_trace_record(gfusx_vm* vm, void* user_data) {
+    gfusx_trace_writer* writer = user_data;
+    gfusx_trace_model* model = &writer->model;
+
+    if (writer->current_size + GFUSX_TRACE_MAX_RECORD_SIZE > GFUSX_TRACE_CHUNK_SIZE) {
+        gfusx_trace_submit(writer);
+    }
+
+    // the hook runs once the pc already points past the instruction
+    u32 pc = writer->next_pc;
+    writer->next_pc = vm->pc;
+
+    u8* out = writer->chunks[writer->submitted % GFUSX_TRACE_CHUNK_COUNT] + writer->current_size;
+    usize size = 1;
+    u8 flags = 0;
+
+    if (pc == model->pc + 4) {
+        flags |= GFUSX_TRACE_SEQUENTIAL_PC;
+    } else {
+        size += gfusx_trace_write_varint(out + size, gfusx_trace_zigzag((i32)(pc - (model->pc + 4))));
+    }
+
+    model->pc = pc;
+
+    u32 slot = (pc >> 2) & (GFUSX_TRACE_CODE_CACHE_SIZE - 1);
+    if (model->code_cache_pc[slot] == pc && model->code_cache_code[slot] == vm->code) {
+        flags |= GFUSX_TRACE_CACHED_CODE;
+    } else {
+        memcpy(out + size, &vm->code, 4);
+        size += 4;
+        model->code_cache_pc[slot] = pc;
+        model->code_cache_code[slot] = vm->code;
+    }
+
+    u32 changed_count = 0;
+    for (u32 i = 0; i < GFUSX_TRACE_REGISTER_COUNT; i++) {
+        u32 value = vm->gpr.r[i];
+        if (value == model->gpr.r[i]) continue;
+
+        out[size++] = (u8)i;
+        size += gfusx_trace_write_varint(out + size, gfusx_trace_zigzag((i32)(value - model->gpr.r[i])));
+        model->gpr.r[i] = value;
+        changed_count++;
+    }
+
+    out[0] = flags | (u8)(changed_count << GFUSX_TRACE_CHANGED_SHIFT);
+    writer->current_size += size;
+
+    if (writer->previous_trace != NULL) {
+        writer->previous_trace(vm, writer->previous_trace_user_data);
+    }
+}
+
+/// Hands the chunk being filled to the writer thread, waiting for a free one
+/// if the writer has fallen behind.
+static void gfusx_trace_submit(gfusx_trace_writer* writer) {
+    pthread_mutex_lock(&writer->lock);
+
+    writer->chunk_sizes[writer->submitted % GFUSX_TRACE_CHUNK_COUNT] = writer->current_size;
+    writer->submitted++;
+    pthread_cond_broadcast(&writer->cond);
+
+    while (writer->submitted - writer->written == GFUSX_TRACE_CHUNK_COUNT) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    writer->current_size = 0;
+}
+
+static void* gfusx_trace_writer_main(void* arg) {
+    gfusx_trace_writer* writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->written == writer->submitted && !writer->finished) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+
+        if (writer->written == writer->submitted) break;
+
+        usize index = writer->written % GFUSX_TRACE_CHUNK_COUNT;
+        pthread_mutex_unlock(&writer->lock);
+
+        bool ok = writer->chunk_sizes[index] == fwrite(writer->chunks[index], 1, writer->chunk_sizes[index], writer->stream);
+
+        pthread_mutex_lock(&writer->lock);
+        if (!ok) writer->failed = true;
+        writer->written++;
+        pthread_cond_broadcast(&writer->cond);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+gfusx_trace_reader* gfusx_trace_open(const char* file_path) {
+    gfusx_trace_reader* reader = calloc(1, sizeof *reader);
+    if (reader == NULL) return NULL;
+
+    reader->stream = fopen(file_path, "rb");
+    if (reader->stream == NULL) {
+        free(reader);
+        return NULL;
+    }
+
+    char magic[4];
+    u32 version;
+    bool valid = 1 == fread(magic, sizeof magic, 1, reader->stream) && 0 == memcmp(magic, GFUSX_TRACE_MAGIC, sizeof magic)
+        && 1 == fread(&version, sizeof version, 1, reader->stream) && version == GFUSX_TRACE_VERSION
+        && 1 == fread(&reader->model.pc, sizeof reader->model.pc, 1, reader->stream)
+        && 1 == fread(reader->model.gpr.r, sizeof reader->model.gpr.r, 1, reader->stream);
+
+    if (!valid) {
+        gfusx_trace_close(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+bool gfusx_trace_next(gfusx_trace_reader* reader, gfusx_trace_entry* entry) {
+    gfusx_trace_model* model = &reader->model;
+
+    u8 flags;
+    if (!gfusx_trace_read_byte(reader, &flags)) return false;
+
+    u32 pc = model->pc + 4;
+    if ((flags & GFUSX_TRACE_SEQUENTIAL_PC) == 0) {
+        u32 delta;
+        if (!gfusx_trace_read_varint(reader, &delta)) return false;
+        pc += (u32)gfusx_trace_unzigzag(delta);
+    }
+
+    model->pc = pc;
+
+    u32 slot = (pc >> 2) & (GFUSX_TRACE_CODE_CACHE_SIZE - 1);
+    if ((flags & GFUSX_TRACE_CACHED_CODE) == 0) {
+        u8 code[4];
+        for (int i = 0; i < 4; i++) {
+            if (!gfusx_trace_read_byte(reader, &code[i])) return false;
+        }
+
+        model->code_cache_pc[slot] = pc;
+        memcpy(&model->code_cache_code[slot], code, 4);
+    }
+
+    *entry = (gfusx_trace_entry) {
+        .pc = pc,
+        .code = model->code_cache_code[slot],
+    };
+
+    u32 changed_count = flags >> GFUSX_TRACE_CHANGED_SHIFT;
+    for (u32 i = 0; i < changed_count; i++) {
+        u8 reg;
+        u32 delta;
+        if (!gfusx_trace_read_byte(reader, &reg) || reg >= GFUSX_TRACE_REGISTER_COUNT) return false;
+        if (!gfusx_trace_read_varint(reader, &delta)) return false;
+
+        model->gpr.r[reg] += (u32)gfusx_trace_unzigzag(delta);
+        entry->changed |= 1ull << reg;
+    }
+
+    entry->gpr = model->gpr;
+    return true;
+}
+
+void gfusx_trace_close(gfusx_trace_reader* reader) {
+    if (reader == NULL) return;
+
+    fclose(reader->stream);
+    free(reader);
+}
+
+static usize gfusx_trace_write_varint(u8* out, u32 value) {
+    usize size = 0;
+    while (value >= 0x80) {
+        out[size++] = (u8)(value | 0x80);
+        value >>= 7;
+    }
+
+    out[size++] = (u8)value;
+    return size;
+}
+
+static bool gfusx_trace_read_byte(gfusx_trace_reader* reader, u8* byte) {
+    if (reader->buffer_position == reader->buffer_size) {
+        reader->buffer_size = fread(reader->buffer, 1, sizeof reader->buffer, reader->stream);
+        reader->buffer_position = 0;
+        if (reader->buffer_size == 0) return false;
+    }
+
+    *byte = reader->buffer[reader->buffer_position++];
+    return true;
+}
+
+static bool gfusx_trace_read_varint(gfusx_trace_reader* reader, u32* value) {
+    *value = 0;
+    for (u32 shift = 0; shift < 35; shift += 7) {
+        u8 byte;
+        if (!gfusx_trace_read_byte(reader, &byte)) return false;
+
+        *value |= (u32)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,1212 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#include "vm_internal.h"
+
+#define X(Id, Name, Flags) static GFUSX_ALWAYS_INLINE void gfusx_op_##Name(gfusx_vm* vm, const gfusx_decoded_inst* inst);
+GFUSX_OPS(X)
+#undef X
+
+static const gfusx_inst_handler gfusx_op_handlers[GFUSX_OP_COUNT] = {
+#define X(Id, Name, Flags) [GFUSX_OP_##Id] = gfusx_op_##Name,
+    GFUSX_OPS(X)
+#undef X
+};
+
+const gfusx_op_flags gfusx_op_flags_table[GFUSX_OP_COUNT] = {
+#define X(Id, Name, Flags) [GFUSX_OP_##Id] = Flags,
+    GFUSX_OPS(X)
+#undef X
+};
+
+// TODO(local): Raise a bus error instead of executing a NOP outside of code memory.
+static const gfusx_decoded_inst gfusx_out_of_bounds_inst = {
+    .handler = gfusx_op_nop,
+    .op = GFUSX_OP_NOP,
+};
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_vm_read_code(gfusx_vm* vm, u32 addr);
+static GFUSX_ALWAYS_INLINE const gfusx_decoded_inst* gfusx_vm_fetch_decoded(gfusx_vm* vm, u32 pc);
+static void gfusx_vm_decode(gfusx_decoded_inst* inst, u32 code, u32 addr);
+static gfusx_decoded_page* gfusx_vm_decode_page(gfusx_vm* vm, u32 page_index);
+static void gfusx_vm_find_idle_loops(gfusx_decoded_page* page, u32 page_addr);
+static void gfusx_vm_patch_page(gfusx_vm* vm, gfusx_decoded_page* page, u32 page_addr);
+static void gfusx_vm_patch_inst(gfusx_vm* vm, gfusx_decoded_inst* inst, u32 addr);
+static void gfusx_vm_patch_hle_entry(gfusx_decoded_inst* inst, gfusx_hle_function function);
+static void gfusx_vm_patch_breakpoint(gfusx_decoded_inst* inst);
+static bool gfusx_vm_is_idle_loop(const gfusx_decoded_inst* insts, u32 count);
+static bool gfusx_vm_idle_inst_regs(const gfusx_decoded_inst* inst, u64* reads, u64* writes, bool* delayed);
+
+/// ======================================================================== ///
+/// Virtual Machine.                                                         ///
+/// ======================================================================== ///
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_begin_inst(gfusx_vm* vm, const gfusx_decoded_inst* inst);
+static void gfusx_vm_undo_begin_inst(gfusx_vm* vm);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_exec_code(gfusx_vm* vm, const gfusx_decoded_inst* inst);
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_retire_inst(gfusx_vm* vm);
+static void gfusx_vm_execute(gfusx_vm* vm);
+static void gfusx_vm_run_engine(gfusx_vm* vm);
+static bool gfusx_vm_replay_faulted_inst(gfusx_vm* vm);
+static void gfusx_vm_free_retired_pages(gfusx_vm* vm);
+static void gfusx_vm_step_threaded(gfusx_vm* vm);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_exception(gfusx_vm* vm, gfusx_exception_kind kind, bool bd, bool cop0);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_maybe_cancel_delayed_load(gfusx_vm* vm, gfu_register reg);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_call_stack_set_sp(gfusx_vm* vm, u32 old_sp, u32 new_sp);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_delayed_load(gfusx_vm* vm, gfu_register reg, u32 value, u32 mask);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_delayed_pc_load(gfusx_vm* vm, u32 value, bool from_link);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_do_branch(gfusx_vm* vm, u32 target, bool from_link);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_potential_return_addr(gfusx_vm* vm, u32 return_addr, u32 sp);
+static GFUSX_ALWAYS_INLINE void gfusx_vm_call_stack_jump(gfusx_vm* vm, u32 target);
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_cache_isolated(gfusx_vm* vm);
+static void gfusx_vm_isolated_store(gfusx_vm* vm, u32 addr);
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_can_skip_idle(gfusx_vm* vm);
+static void gfusx_vm_idle_loop(gfusx_vm* vm);
+
+const char* gfusx_stop_reason_name(gfusx_stop_reason reason) {
+    switch (reason) {
+        case GFUSX_STOP_NONE: return "none";
+        case GFUSX_STOP_BUDGET: return "budget";
+        case GFUSX_STOP_EXIT: return "exit";
+        case GFUSX_STOP_BREAK: return "break";
+        case GFUSX_STOP_DESYNC: return "desync";
+        case GFUSX_STOP_BREAKPOINT: return "breakpoint";
+        case GFUSX_STOP_WATCHPOINT: return "watchpoint";
+        case GFUSX_STOP_ADDRESS_ERROR: return "address-error";
+        case GFUSX_STOP_DIVERGED: return "diverged";
+    }
+
+    return "<unknown>";
+}
+
+void gfusx_vm_power_on(gfusx_vm* vm) {
+    gfusx_settings settings = vm->settings;
+    *vm = (gfusx_vm) {
+        .settings = settings,
+    };
+
+    gfusx_log_create(vm);
+    memset(vm->icache_tags, 0xFF, sizeof vm->icache_tags);
+    vm->breakpoint_pc = UINT32_MAX;
+
+    bool memory_created = gfusx_mem_create(vm);
+    kos_assert(memory_created);
+
+    gfusx_gte_power_on(vm);
+
+    if (vm->settings.cpu.engine == GFUSX_ENGINE_DEFAULT) {
+        vm->settings.cpu.engine = GFUSX_ENGINE_THREADED_INTERPRETER;
+    }
+
+    if (vm->settings.cpu.engine == GFUSX_ENGINE_RECOMPILER && !gfusx_jit_create(vm)) {
+        gfusx_vm_logf(vm, GFUSX_LC_CPU, "The recompiler is not available on this host, using the interpreter instead.");
+        vm->settings.cpu.engine = GFUSX_ENGINE_THREADED_INTERPRETER;
+    }
+
+    if (vm->settings.cpu.engine == GFUSX_ENGINE_PRECOMPILED && !gfusx_aot_create(vm)) {
+        gfusx_vm_logf(vm, GFUSX_LC_CPU, "No precompiled program was given, using the interpreter instead.");
+        vm->settings.cpu.engine = GFUSX_ENGINE_THREADED_INTERPRETER;
+    }
+}
+
+void gfusx_vm_power_off(gfusx_vm* vm) {
+    gfusx_vm_invalidate_code(vm, 0, GFUSX_CODE_SIZE);
+    gfusx_vm_free_retired_pages(vm);
+    gfusx_jit_destroy(vm);
+    gfusx_aot_destroy(vm);
+    gfusx_mem_destroy(vm);
+    gfusx_vm_free_events(vm);
+    gfusx_hle_free_all(vm);
+    gfusx_debug_free_all(vm);
+    gfusx_log_destroy(vm);
+    *vm = (gfusx_vm) {0};
+}
+
+void gfusx_vm_dump_regs(gfusx_vm* vm, FILE* stream) {
+    fprintf(stream, "code: %08X\n", vm->code);
+    fprintf(stream, "pc: %u\n", vm->pc);
+    fprintf(stream, "gpr:\n");
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 8; j++) {
+            fprintf(stream, "  %08X", vm->gpr.r[j + i * 8]);
+        }
+
+        fprintf(stream, "\n");
+    }
+
+    fprintf(stream, "  %08X  %08X\n", vm->gpr.hi, vm->gpr.lo);
+
+    fprintf(stream, "\n");
+}
+
+void gfusx_vm_invalidate_code(gfusx_vm* vm, u32 addr, u32 size) {
+    if (size == 0) return;
+
+    u64 first_page = addr >> GFUSX_PAGE_SHIFT;
+    u64 last_page = ((u64)addr + size - 1) >> GFUSX_PAGE_SHIFT;
+    for (u64 page_index = first_page; page_index <= last_page && page_index < GFUSX_CODE_PAGE_COUNT; page_index++) {
+        gfusx_decoded_page* page = vm->decoded_pages[page_index];
+        if (page == NULL) continue;
+
+        // recompiled blocks point into the decoded page, so they have to go first
+        if (vm->jit != NULL) gfusx_jit_invalidate_page(vm, (u32)page_index);
+        if (vm->aot != NULL) gfusx_aot_invalidate_page(vm, (u32)page_index);
+
+        // a guest store can get here while the page is still executing, so it
+        // is only freed once the engine has been left
+        page->next_retired = vm->retired_decoded_pages;
+        vm->retired_decoded_pages = page;
+        vm->decoded_pages[page_index] = NULL;
+        gfusx_mem_update_page_access(vm, (u32)page_index);
+    }
+}
+
+static void gfusx_vm_free_retired_pages(gfusx_vm* vm) {
+    while (vm->retired_decoded_pages != NULL) {
+        gfusx_decoded_page* page = vm->retired_decoded_pages;
+        vm->retired_decoded_pages = page->next_retired;
+        free(page);
+    }
+}
+
+// `patched` only matters uncached, where attached routines and breakpoints have
+// to be looked up for every instruction rather than once per decoded page
+static GFUSX_ALWAYS_INLINE void gfusx_vm_step_impl(gfusx_vm* vm, bool cached, bool patched) {
+    bool leave;
+    do {
+        const gfusx_decoded_inst* inst;
+        gfusx_decoded_inst uncached_inst;
+        if (cached) {
+            inst = gfusx_vm_fetch_decoded(vm, vm->pc);
+        } else {
+            gfusx_vm_decode(&uncached_inst, gfusx_vm_read_code(vm, vm->pc), vm->pc);
+            if (patched) gfusx_vm_patch_inst(vm, &uncached_inst, vm->pc);
+
+            inst = &uncached_inst;
+        }
+
+        gfusx_vm_begin_inst(vm, inst);
+        gfusx_vm_exec_code(vm, inst);
+        leave = gfusx_vm_retire_inst(vm);
+    } while (!leave);
+}
+
+void gfusx_vm_step(gfusx_vm* vm) {
+    vm->cycle_target = UINT64_MAX;
+    vm->single_step = true;
+    vm->stop_reason = GFUSX_STOP_NONE;
+    gfusx_vm_execute(vm);
+    gfusx_vm_run_events(vm);
+}
+
+gfusx_stop_reason gfusx_vm_run(gfusx_vm* vm, u64 cycle_budget) {
+    u64 cycle_end = cycle_budget > UINT64_MAX - vm->cycle ? UINT64_MAX : vm->cycle + cycle_budget;
+    vm->single_step = false;
+    vm->stop_reason = GFUSX_STOP_NONE;
+
+    // run straight until the next event is due, rather than having every
+    // device check in on every instruction
+    while (vm->cycle < cycle_end) {
+        gfusx_vm_run_events(vm);
+        if (vm->stop_reason != GFUSX_STOP_NONE) break;
+
+        u64 next_event_cycle = gfusx_vm_next_event_cycle(vm);
+        vm->cycle_target = next_event_cycle < cycle_end ? next_event_cycle : cycle_end;
+        gfusx_vm_execute(vm);
+        if (vm->stop_reason != GFUSX_STOP_NONE) break;
+    }
+
+    if (vm->stop_reason == GFUSX_STOP_NONE) {
+        vm->stop_reason = GFUSX_STOP_BUDGET;
+    }
+
+    return vm->stop_reason;
+}
+
+static void gfusx_vm_execute(gfusx_vm* vm) {
+    gfusx_vm_free_retired_pages(vm);
+    // anything may have changed while outside, so idle loops are measured again
+    vm->idle_loop_pc = UINT32_MAX;
+
+    if (vm->fastmem != NULL) {
+        gfusx_fastmem_execute(vm, gfusx_vm_run_engine, gfusx_vm_replay_faulted_inst);
+    } else {
+        gfusx_vm_run_engine(vm);
+    }
+}
+
+static void gfusx_vm_run_engine(gfusx_vm* vm) {
+    switch (vm->settings.cpu.engine) {
+        default:
+        case GFUSX_ENGINE_THREADED_INTERPRETER: gfusx_vm_step_threaded(vm); break;
+        case GFUSX_ENGINE_CACHED_INTERPRETER: gfusx_vm_step_impl(vm, true, false); break;
+        case GFUSX_ENGINE_INTERPRETER: {
+            // picked once per entry, adding the first one makes the engine reenter
+            if (vm->hle_entries.count != 0 || vm->breakpoints.count != 0) {
+                gfusx_vm_step_impl(vm, false, true);
+            } else {
+                gfusx_vm_step_impl(vm, false, false);
+            }
+        } break;
+        case GFUSX_ENGINE_RECOMPILER: gfusx_jit_step(vm); break;
+        case GFUSX_ENGINE_PRECOMPILED: gfusx_aot_step(vm); break;
+    }
+}
+
+const gfusx_decoded_inst* gfusx_vm_decoded_inst_at(gfusx_vm* vm, u32 pc) {
+    return gfusx_vm_fetch_decoded(vm, pc);
+}
+
+bool gfusx_vm_retire(gfusx_vm* vm) {
+    return gfusx_vm_retire_inst(vm);
+}
+
+/// Finishes an instruction whose fastmem access faulted. Nothing but the
+/// bookkeeping in gfusx_vm_begin_inst has happened for it yet, so it is simply
+/// executed again with fastmem turned off.
+static bool gfusx_vm_replay_faulted_inst(gfusx_vm* vm) {
+    gfusx_decoded_inst inst;
+    gfusx_vm_decode(&inst, vm->code, vm->pc - 4);
+
+    u8* fastmem = vm->fastmem;
+    vm->fastmem = NULL;
+    gfusx_vm_exec_code(vm, &inst);
+    vm->fastmem = fastmem;
+
+    return gfusx_vm_retire_inst(vm);
+}
+
+bool gfusx_vm_interpret_inst(gfusx_vm* vm) {
+    const gfusx_decoded_inst* inst = gfusx_vm_fetch_decoded(vm, vm->pc);
+    gfusx_vm_begin_inst(vm, inst);
+    gfusx_vm_exec_code(vm, inst);
+    return gfusx_vm_retire_inst(vm);
+}
+
+#if GFUSX_HAS_COMPUTED_GOTO
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/// Same contract as the cached interpreter, but every handler is inlined into
+/// its own dispatch site and jumps straight to the next one, so each op gets
+/// its own indirect branch instead of all of them sharing a single switch.
+static void gfusx_vm_step_threaded(gfusx_vm* vm) {
+    const gfusx_decoded_inst* inst = gfusx_vm_fetch_decoded(vm, vm->pc);
+    gfusx_vm_begin_inst(vm, inst);
+
+#if GFUSX_HAS_COMPUTED_GOTO
+    static const void* const dispatch_table[GFUSX_OP_COUNT] = {
+#    define X(Id, Name, Flags) [GFUSX_OP_##Id] = &&op_##Id,
+        GFUSX_OPS(X)
+#    undef X
+    };
+
+    goto *dispatch_table[inst->op];
+
+#    define X(Id, Name, Flags)                     \
+    op_##Id:                                       \
+        gfusx_op_##Name(vm, inst);                 \
+        if (gfusx_vm_retire_inst(vm)) return;      \
+        inst = gfusx_vm_fetch_decoded(vm, vm->pc); \
+        gfusx_vm_begin_inst(vm, inst);             \
+        goto *dispatch_table[inst->op];
+    GFUSX_OPS(X)
+#    undef X
+#else
+    for (;;) {
+        switch (inst->op) {
+#    define X(Id, Name, Flags) \
+            case GFUSX_OP_##Id: gfusx_op_##Name(vm, inst); break;
+            GFUSX_OPS(X)
+#    undef X
+        }
+
+        if (gfusx_vm_retire_inst(vm)) return;
+        inst = gfusx_vm_fetch_decoded(vm, vm->pc);
+        gfusx_vm_begin_inst(vm, inst);
+    }
+#endif
+}
+
+#if GFUSX_HAS_COMPUTED_GOTO
+#    pragma GCC diagnostic pop
+#endif
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_vm_read_code(gfusx_vm* vm, u32 addr) {
+    if (addr >= GFUSX_CODE_SIZE) return 0;
+
+    // fetches never hit watchpoints, so they go around the slow path
+    u8* page = vm->read_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL) page = gfusx_mem_host_page(vm, addr >> GFUSX_PAGE_SHIFT);
+    return gfusx_mem_load32(&page[addr & GFUSX_PAGE_MASK]);
+}
+
+static GFUSX_ALWAYS_INLINE const gfusx_decoded_inst* gfusx_vm_fetch_decoded(gfusx_vm* vm, u32 pc) {
+    u32 page_index = pc >> GFUSX_PAGE_SHIFT;
+    if (page_index >= GFUSX_CODE_PAGE_COUNT) return &gfusx_out_of_bounds_inst;
+
+    gfusx_decoded_page* page = vm->decoded_pages[page_index];
+    if (page == NULL) page = gfusx_vm_decode_page(vm, page_index);
+
+    return &page->insts[(pc & GFUSX_PAGE_MASK) >> 2];
+}
+
+static gfusx_decoded_page* gfusx_vm_decode_page(gfusx_vm* vm, u32 page_index) {
+    gfusx_decoded_page* page = malloc(sizeof *page);
+    kos_assert(page != NULL);
+
+    u32 page_addr = page_index << GFUSX_PAGE_SHIFT;
+    for (u32 i = 0; i < GFUSX_PAGE_SIZE / 4; i++) {
+        u32 addr = page_addr + i * 4;
+        gfusx_vm_decode(&page->insts[i], gfusx_vm_read_code(vm, addr), addr);
+    }
+
+    // patched instructions are never part of an idle loop, so they go first
+    gfusx_vm_patch_page(vm, page, page_addr);
+    gfusx_vm_find_idle_loops(page, page_addr);
+
+    vm->decoded_pages[page_index] = page;
+    gfusx_mem_update_page_access(vm, page_index);
+    return page;
+}
+
+// Swaps the first instruction of every routine attached on the page for its
+// native version, and every instruction with a breakpoint for one that stops.
+// A breakpoint on an attached routine stops before the routine runs.
+static void gfusx_vm_patch_page(gfusx_vm* vm, gfusx_decoded_page* page, u32 page_addr) {
+    for (isize i = gfusx_hle_lower_bound(vm, page_addr); i < vm->hle_entries.count; i++) {
+        const gfusx_hle_entry* entry = &vm->hle_entries.data[i];
+        if (entry->address - page_addr >= GFUSX_PAGE_SIZE) break;
+        gfusx_vm_patch_hle_entry(&page->insts[(entry->address - page_addr) >> 2], entry->function);
+    }
+
+    for (isize i = gfusx_debug_breakpoint_lower_bound(vm, page_addr); i < vm->breakpoints.count; i++) {
+        u32 address = vm->breakpoints.data[i];
+        if (address - page_addr >= GFUSX_PAGE_SIZE) break;
+        gfusx_vm_patch_breakpoint(&page->insts[(address - page_addr) >> 2]);
+    }
+}
+
+// The same for a single instruction decoded on its own.
+static void gfusx_vm_patch_inst(gfusx_vm* vm, gfusx_decoded_inst* inst, u32 addr) {
+    const gfusx_hle_entry* entry = gfusx_hle_find(vm, addr);
+    if (entry != NULL) gfusx_vm_patch_hle_entry(inst, entry->function);
+    if (gfusx_debug_has_breakpoint(vm, addr)) gfusx_vm_patch_breakpoint(inst);
+}
+
+// the original instruction is kept in `code` for traces and disassembly
+static void gfusx_vm_patch_hle_entry(gfusx_decoded_inst* inst, gfusx_hle_function function) {
+    inst->op = GFUSX_OP_HLE;
+    inst->handler = gfusx_op_handlers[GFUSX_OP_HLE];
+    inst->imm = (u32)function;
+    inst->hints = GFUSX_HINT_NONE;
+}
+
+// the original instruction is decoded again from `code` once it runs
+static void gfusx_vm_patch_breakpoint(gfusx_decoded_inst* inst) {
+    inst->op = GFUSX_OP_BREAKPOINT;
+    inst->handler = gfusx_op_handlers[GFUSX_OP_BREAKPOINT];
+    inst->hints = GFUSX_HINT_NONE;
+}
+
+/// Hints the backward branches of a page that close an idle loop: a short loop
+/// without stores, calls or other branches, in which every register it reads is
+/// either left alone or written by the loop itself first. Running an iteration
+/// of one more or less then only changes the cycle count, so whole iterations
+/// can be skipped until something outside of the CPU changes what it reads.
+static void gfusx_vm_find_idle_loops(gfusx_decoded_page* page, u32 page_addr) {
+    // the delay slot has to be on the page as well
+    for (u32 i = 0; i + 1 < GFUSX_PAGE_SIZE / 4; i++) {
+        gfusx_decoded_inst* branch = &page->insts[i];
+        if (branch->op != GFUSX_OP_BEQ && branch->op != GFUSX_OP_BNE) continue;
+
+        u32 branch_addr = page_addr + i * 4;
+        if (branch->imm < page_addr || branch->imm > branch_addr) continue;
+
+        u32 first = (branch->imm - page_addr) >> 2;
+        u32 count = i + 2 - first;
+        if (count > GFUSX_IDLE_LOOP_MAX_INSTS) continue;
+
+        if (gfusx_vm_is_idle_loop(&page->insts[first], count)) {
+            branch->hints |= GFUSX_HINT_IDLE_LOOP;
+        }
+    }
+}
+
+// `insts` runs from the branch target up to the delay slot
+static bool gfusx_vm_is_idle_loop(const gfusx_decoded_inst* insts, u32 count) {
+    u64 written = 0, written_ever = 0, live_in = 0, pending_load = 0;
+    for (u32 i = 0; i < count; i++) {
+        // the closing branch has to be the only one
+        bool is_branch = (gfusx_op_flags_table[insts[i].op] & GFUSX_OPF_BRANCH) != 0;
+        if (is_branch != (i == count - 2)) return false;
+
+        u64 reads, writes;
+        bool delayed;
+        if (!gfusx_vm_idle_inst_regs(&insts[i], &reads, &writes, &delayed)) return false;
+
+        // a load lands after the next instruction, which still reads the old value
+        live_in |= reads & ~written;
+        written |= pending_load;
+        pending_load = delayed ? writes : 0;
+        if (!delayed) written |= writes;
+        written_ever |= writes;
+    }
+
+    // a load in the delay slot would land in the next iteration
+    if (pending_load != 0) return false;
+
+    return (live_in & written_ever) == 0;
+}
+
+#define GFUSX_IDLE_REG(Index) ((u64)1 << (Index))
+#define GFUSX_IDLE_REG_HI GFUSX_IDLE_REG(32)
+#define GFUSX_IDLE_REG_LO GFUSX_IDLE_REG(33)
+
+// Returns false for anything that may have an effect besides writing registers.
+static bool gfusx_vm_idle_inst_regs(const gfusx_decoded_inst* inst, u64* reads, u64* writes, bool* delayed) {
+    u64 rs = GFUSX_IDLE_REG(inst->rs), rt = GFUSX_IDLE_REG(inst->rt), rd = GFUSX_IDLE_REG(inst->rd);
+    *reads = 0;
+    *writes = 0;
+    *delayed = false;
+
+    switch (inst->op) {
+        default: return false;
+
+        case GFUSX_OP_NOP: break;
+        case GFUSX_OP_LUI: *writes = rt; break;
+        case GFUSX_OP_ADDIU:
+        case GFUSX_OP_ORI: *reads = rs; *writes = rt; break;
+        case GFUSX_OP_SLL: *reads = rt; *writes = rd; break;
+        case GFUSX_OP_ADD:
+        case GFUSX_OP_ADDU: *reads = rs | rt; *writes = rd; break;
+        case GFUSX_OP_MFHI: *reads = GFUSX_IDLE_REG_HI; *writes = rd; break;
+        case GFUSX_OP_MFLO: *reads = GFUSX_IDLE_REG_LO; *writes = rd; break;
+        case GFUSX_OP_BEQ:
+        case GFUSX_OP_BNE: *reads = rs | rt; break;
+
+        case GFUSX_OP_LB:
+        case GFUSX_OP_LBU:
+        case GFUSX_OP_LH:
+        case GFUSX_OP_LHU:
+        case GFUSX_OP_LW: *reads = rs; *writes = rt; *delayed = true; break;
+
+        // coprocessor registers only change through instructions that are not allowed here
+        case GFUSX_OP_MFC0:
+        case GFUSX_OP_MFC2:
+        case GFUSX_OP_CFC2: *writes = rt; *delayed = true; break;
+    }
+
+    // r0 never changes
+    *reads &= ~GFUSX_IDLE_REG(0);
+    *writes &= ~GFUSX_IDLE_REG(0);
+    return true;
+}
+
+#undef GFUSX_IDLE_REG
+#undef GFUSX_IDLE_REG_HI
+#undef GFUSX_IDLE_REG_LO
+
+static void gfusx_vm_decode(gfusx_decoded_inst* inst, u32 code, u32 addr) {
+    gfu_inst raw;
+    raw.raw = code;
+
+    *inst = (gfusx_decoded_inst) {
+        .code = code,
+        .rs = raw.rs,
+        .rt = raw.rt,
+        .rd = raw.rd,
+        .shamt = raw.shamt,
+    };
+
+    // branch and jump targets are relative to the delay slot
+    u32 next_pc = addr + 4;
+    gfusx_op op = GFUSX_OP_UNIMPLEMENTED;
+
+    // shortcut the NOP
+    if (code == 0) {
+        op = GFUSX_OP_NOP;
+        goto done;
+    }
+
+    switch (raw.opcode) {
+        default: break;
+
+        case GFU_OPCODE_JAL: {
+            op = GFUSX_OP_JAL;
+            inst->imm = (next_pc & 0xF0000000) | (raw.addr << 2);
+        } break;
+
+        case GFU_OPCODE_BEQ: {
+            op = GFUSX_OP_BEQ;
+            inst->imm = next_pc + ((u32)(i16)raw.imm << 2);
+        } break;
+
+        case GFU_OPCODE_BNE: {
+            op = GFUSX_OP_BNE;
+            inst->imm = next_pc + ((u32)(i16)raw.imm << 2);
+        } break;
+
+        case GFU_OPCODE_ADDIU: {
+            op = GFUSX_OP_ADDIU;
+            inst->imm = (u32)(i16)raw.imm;
+        } break;
+
+        case GFU_OPCODE_ORI: {
+            op = GFUSX_OP_ORI;
+            inst->imm = raw.imm;
+        } break;
+
+        case GFU_OPCODE_LUI: {
+            op = GFUSX_OP_LUI;
+            inst->imm = (u32)raw.imm << 16;
+        } break;
+
+#define GFUSX_DECODE_MEM(Id)                 \
+        case GFU_OPCODE_##Id: {              \
+            op = GFUSX_OP_##Id;              \
+            inst->imm = (u32)(i16)raw.imm;   \
+        } break;
+        GFUSX_DECODE_MEM(LB)
+        GFUSX_DECODE_MEM(LBU)
+        GFUSX_DECODE_MEM(LH)
+        GFUSX_DECODE_MEM(LHU)
+        GFUSX_DECODE_MEM(LW)
+        GFUSX_DECODE_MEM(SB)
+        GFUSX_DECODE_MEM(SH)
+        GFUSX_DECODE_MEM(SW)
+        GFUSX_DECODE_MEM(LWL)
+        GFUSX_DECODE_MEM(LWR)
+        GFUSX_DECODE_MEM(SWL)
+        GFUSX_DECODE_MEM(SWR)
+        GFUSX_DECODE_MEM(LWC2)
+        GFUSX_DECODE_MEM(SWC2)
+#undef GFUSX_DECODE_MEM
+
+        case GFU_OPCODE_COP0: {
+            switch (raw.rs) {
+                default: break;
+                case GFU_RSC0_MFC0: op = GFUSX_OP_MFC0; break;
+                case GFU_RSC0_MTC0: op = GFUSX_OP_MTC0; break;
+                case GFU_RSC0_C0: {
+                    if (raw.funct == GFU_FUNCTC0_WAIT) op = GFUSX_OP_WAIT;
+                } break;
+            }
+        } break;
+
+        case GFU_OPCODE_COP2: {
+            // GTE commands set the top bit of rs and keep their fields in the rest
+            if ((raw.rs & GFU_RSC2_C2) != 0) {
+                op = GFUSX_OP_COP2;
+                inst->imm = code & 0x1FFFFFF;
+                break;
+            }
+
+            switch (raw.rs) {
+                default: break;
+                case GFU_RSC2_MFC2: op = GFUSX_OP_MFC2; break;
+                case GFU_RSC2_CFC2: op = GFUSX_OP_CFC2; break;
+                case GFU_RSC2_MTC2: op = GFUSX_OP_MTC2; break;
+                case GFU_RSC2_CTC2: op = GFUSX_OP_CTC2; break;
+            }
+        } break;
+
+        case GFU_OPCODE_SPECIAL: {
+            switch (raw.funct) {
+                default: op = GFUSX_OP_UNIMPLEMENTED_SPECIAL; break;
+                case GFU_FUNCT_SLL: op = GFUSX_OP_SLL; break;
+                case GFU_FUNCT_ADD: op = GFUSX_OP_ADD; break;
+                case GFU_FUNCT_ADDU: op = GFUSX_OP_ADDU; break;
+                case GFU_FUNCT_MFHI: op = GFUSX_OP_MFHI; break;
+                case GFU_FUNCT_MFLO: op = GFUSX_OP_MFLO; break;
+                case GFU_FUNCT_MULT: op = GFUSX_OP_MULT; break;
+                case GFU_FUNCT_MULTU: op = GFUSX_OP_MULTU; break;
+                case GFU_FUNCT_DIV: op = GFUSX_OP_DIV; break;
+                case GFU_FUNCT_DIVU: op = GFUSX_OP_DIVU; break;
+
+                case GFU_FUNCT_SYSCALL: {
+                    op = GFUSX_OP_SYSCALL;
+                    inst->imm = GFU_GET_CODE(code);
+                } break;
+
+                case GFU_FUNCT_BREAK: {
+                    op = GFUSX_OP_BREAK;
+                    inst->imm = GFU_GET_CODE(code);
+                } break;
+            }
+        } break;
+    }
+
+done:;
+    inst->op = (u16)op;
+    inst->handler = gfusx_op_handlers[op];
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_begin_inst(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (vm->icache_tags[gfusx_icache_index(vm->pc)] != vm->pc) {
+        gfusx_vm_icache_miss(vm, vm->pc);
+    }
+
+    if (vm->next_is_delay_slot) {
+        vm->in_delay_slot = true;
+        vm->next_is_delay_slot = false;
+    }
+
+    vm->code = inst->code;
+    vm->pc += 4;
+    vm->cycle += GFUSX_CYCLE_BIAS;
+}
+
+// NOTE(local): Only the tags are emulated, the words themselves always come from
+// memory. Code that is overwritten without flushing the cache runs the new
+// instructions right away, where hardware would keep running the stale ones.
+void gfusx_vm_icache_miss(gfusx_vm* vm, u32 pc) {
+    u32 addr = pc & ~3u;
+    u32 line_end = (addr | (GFUSX_ICACHE_LINE_SIZE - 1)) + 1;
+
+    u32 word_count = 0;
+    for (; addr != line_end; addr += 4, word_count++) {
+        vm->icache_tags[gfusx_icache_index(addr)] = addr;
+    }
+
+    vm->cycle += GFUSX_ICACHE_MISS_CYCLES + word_count * GFUSX_ICACHE_WORD_CYCLES;
+}
+
+/// Undoes everything gfusx_vm_begin_inst did and sets the load delay slots up
+/// so that retiring changes nothing either, which leaves the VM right before
+/// the instruction that is executing. Only for instructions that have not
+/// changed anything yet.
+static void gfusx_vm_undo_begin_inst(gfusx_vm* vm) {
+    vm->pc -= 4;
+    vm->cycle -= GFUSX_CYCLE_BIAS;
+    if (vm->in_delay_slot) {
+        vm->in_delay_slot = false;
+        vm->next_is_delay_slot = true;
+    }
+
+    // retiring flips back to these, and applies the slot that retiring the
+    // previous instruction already applied and cleared
+    vm->current_delayed_load ^= 1;
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_exec_code(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    inst->handler(vm, inst);
+}
+
+/// Finishes the instruction that just executed: flips the load delay slots and
+/// applies a pending branch. Returns true once the cycle target is reached, or
+/// when single stepping and a branch delay slot has run.
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_retire_inst(gfusx_vm* vm) {
+    bool leave = vm->cycle >= vm->cycle_target;
+
+    vm->current_delayed_load ^= 1;
+    gfusx_delayed_load_info* delayed_load = &vm->delayed_load_info[vm->current_delayed_load];
+    bool from_link = false;
+
+    if (delayed_load->active) {
+        u32* reg = &vm->gpr.r[delayed_load->index];
+        *reg = (*reg & delayed_load->mask) | delayed_load->value;
+        delayed_load->active = false;
+    }
+
+    if (delayed_load->pc_active) {
+        vm->pc = delayed_load->pc_value;
+        from_link = delayed_load->from_link;
+        delayed_load->pc_active = false;
+        delayed_load->from_link = false;
+
+        if (vm->call_stack != NULL) {
+            gfusx_vm_call_stack_jump(vm, vm->pc);
+        }
+    }
+
+    if (vm->in_delay_slot) {
+        vm->in_delay_slot = false;
+        leave |= vm->single_step;
+        // TODO(local): branch test
+    }
+
+    if (vm->settings.debug.trace != NULL) {
+        // breakpoints and address errors stop before their instruction has run
+        bool has_run = vm->stop_reason != GFUSX_STOP_BREAKPOINT && vm->stop_reason != GFUSX_STOP_ADDRESS_ERROR;
+        if (has_run) vm->settings.debug.trace(vm, vm->settings.debug.trace_user_data);
+    }
+
+    return leave;
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_exception(gfusx_vm* vm, gfusx_exception_kind kind, bool bd, bool cop0) {
+    // TODO(local): Exception handling.
+}
+
+// NOTE(local): Without an exception handler to run, the address error stops
+// the VM instead, on the instruction that raised it.
+void gfusx_vm_address_error(gfusx_vm* vm, u32 addr, bool store) {
+    gfusx_vm_undo_begin_inst(vm);
+    vm->cop0.bad_vaddr = addr;
+
+    gfusx_vm_logf(vm, GFUSX_LC_CPU, "Misaligned %s of 0x%08X from 0x%08X.", store ? "store" : "load", addr, vm->pc);
+    gfusx_vm_exception(vm, store ? GFUSX_EX_ADDRESS_ERROR_STORE : GFUSX_EX_ADDRESS_ERROR_LOAD, vm->next_is_delay_slot, false);
+    gfusx_vm_stop(vm, GFUSX_STOP_ADDRESS_ERROR, addr);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_maybe_cancel_delayed_load(gfusx_vm* vm, gfu_register reg) {
+    u32 other = vm->current_delayed_load ^ 1;
+    if (vm->delayed_load_info[other].index == (u32)reg) {
+        vm->delayed_load_info[other].active = false;
+    }
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_call_stack_set_sp(gfusx_vm* vm, u32 old_sp, u32 new_sp) {
+    // only giving stack space back can end a call
+    if (vm->call_stack != NULL && new_sp > old_sp) {
+        gfusx_call_stack_release(vm, new_sp);
+    }
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_delayed_load(gfusx_vm* vm, gfu_register reg, u32 value, u32 mask) {
+    kos_assert(reg < 32);
+    gfusx_delayed_load_info* delayed_load = &vm->delayed_load_info[vm->current_delayed_load];
+    delayed_load->active = true;
+    delayed_load->index = reg;
+    delayed_load->mask = mask;
+    delayed_load->value = value;
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_delayed_pc_load(gfusx_vm* vm, u32 value, bool from_link) {
+    gfusx_delayed_load_info* delayed_load = &vm->delayed_load_info[vm->current_delayed_load];
+    delayed_load->pc_active = true;
+    delayed_load->pc_value = value;
+    delayed_load->from_link = from_link;
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_do_branch(gfusx_vm* vm, u32 target, bool from_link) {
+    vm->next_is_delay_slot = true;
+    gfusx_vm_delayed_pc_load(vm, target, from_link);
+}
+
+// a jump to the return address of the innermost call is its return
+static GFUSX_ALWAYS_INLINE void gfusx_vm_call_stack_jump(gfusx_vm* vm, u32 target) {
+    gfusx_call_stack* call_stack = vm->call_stack;
+    if (call_stack->count != 0 && call_stack->data[call_stack->count - 1].return_addr == target) {
+        gfusx_call_stack_return(vm);
+    }
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_vm_potential_return_addr(gfusx_vm* vm, u32 return_addr, u32 sp) {
+    if (vm->call_stack != NULL) {
+        // the branch to the callee is already pending
+        u32 function = vm->delayed_load_info[vm->current_delayed_load].pc_value;
+        gfusx_call_stack_call(vm, function, return_addr, sp);
+    }
+}
+
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_cache_isolated(gfusx_vm* vm) {
+    return (vm->cop0.status & GFUSX_COP0_STATUS_ISC) != 0;
+}
+
+// NOTE(local): The data cache is the scratchpad on this CPU and is not emulated,
+// and only the tags of the instruction cache are kept, so isolated loads read 0
+// and isolated stores only do something with the caches swapped. Any store to
+// an instruction cache line then invalidates it, which is how the BIOS flushes it.
+static void gfusx_vm_isolated_store(gfusx_vm* vm, u32 addr) {
+    if ((vm->cop0.status & GFUSX_COP0_STATUS_SWC) == 0) return;
+
+    u32 line = addr & ~(GFUSX_ICACHE_LINE_SIZE - 1);
+    for (u32 i = 0; i < GFUSX_ICACHE_LINE_SIZE; i += 4) {
+        vm->icache_tags[gfusx_icache_index(line + i)] = GFUSX_ICACHE_INVALID;
+    }
+}
+
+// Single steps and traces want every instruction, and without a target there
+// is nothing to skip to.
+static GFUSX_ALWAYS_INLINE bool gfusx_vm_can_skip_idle(gfusx_vm* vm) {
+    return !vm->settings.cpu.no_idle_skip && !vm->single_step && vm->settings.debug.trace == NULL && vm->cycle_target != UINT64_MAX;
+}
+
+/// Called when the branch of an idle loop is taken. The first time around only
+/// measures how many cycles an iteration takes, after that as many whole
+/// iterations are skipped as fit before the cycle target. An idle loop ends up
+/// in the same state after any number of them, so this is exact: the engine
+/// still leaves on the same instruction and cycle as it would have without
+/// skipping, and the next event gets to change what the loop is waiting on.
+static void gfusx_vm_idle_loop(gfusx_vm* vm) {
+    // the branch already moved the pc onto its delay slot
+    u32 branch_pc = vm->pc - 4;
+    if (vm->idle_loop_pc != branch_pc) {
+        vm->idle_loop_pc = branch_pc;
+        vm->idle_loop_cycle = vm->cycle;
+        return;
+    }
+
+    u64 iteration_cycles = vm->cycle - vm->idle_loop_cycle;
+    if (iteration_cycles != 0 && vm->cycle < vm->cycle_target && gfusx_vm_can_skip_idle(vm)) {
+        vm->cycle += (vm->cycle_target - vm->cycle) / iteration_cycles * iteration_cycles;
+    }
+
+    vm->idle_loop_cycle = vm->cycle;
+}
+
+/// ======================================================================== ///
+/// Operations.                                                              ///
+/// ======================================================================== ///
+
+#define _RS_ vm->gpr.r[inst->rs]
+#define _RT_ vm->gpr.r[inst->rt]
+#define _RD_ vm->gpr.r[inst->rd]
+
+static void gfusx_op_nop(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+}
+
+static void gfusx_op_unimplemented(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_vm_logf(vm, GFUSX_LC_CPU, "Unimplemented opcode %02X.", GFU_GET_OPCODE(inst->code));
+}
+
+static void gfusx_op_unimplemented_special(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_vm_logf(vm, GFUSX_LC_CPU, "Unimplemented SPECIAL funct %02X.", GFU_GET_FUNCT(inst->code));
+}
+
+static void gfusx_op_jal(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_vm_maybe_cancel_delayed_load(vm, GFU_REG_RA);
+    u32 return_addr = vm->pc + 4; // +8, but the previous +4 was in the caller
+    vm->gpr.ra = return_addr;
+    gfusx_vm_do_branch(vm, inst->imm, true);
+    gfusx_vm_potential_return_addr(vm, return_addr, vm->gpr.sp);
+}
+
+static void gfusx_op_beq(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (_RS_ == _RT_) {
+        gfusx_vm_do_branch(vm, inst->imm, false);
+        if ((inst->hints & GFUSX_HINT_IDLE_LOOP) != 0) gfusx_vm_idle_loop(vm);
+    }
+}
+
+static void gfusx_op_bne(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (_RS_ != _RT_) {
+        gfusx_vm_do_branch(vm, inst->imm, false);
+        if ((inst->hints & GFUSX_HINT_IDLE_LOOP) != 0) gfusx_vm_idle_loop(vm);
+    }
+}
+
+// rt <- rs + imm
+static void gfusx_op_addiu(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    u32 new_value = _RS_ + inst->imm;
+    if (inst->rt == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RT_, new_value);
+    _RT_ = new_value;
+}
+
+// rt <- rs OR imm
+static void gfusx_op_ori(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    u32 new_value = _RS_ | inst->imm;
+    if (inst->rt == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RT_, new_value);
+    _RT_ = new_value;
+}
+
+// rt <- imm << 16
+static void gfusx_op_lui(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    if (inst->rt == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RT_, inst->imm);
+    _RT_ = inst->imm;
+}
+
+// rd <- rt << shamt
+static void gfusx_op_sll(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rd) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rd);
+    _RD_ = (u32)(_RT_ << inst->shamt);
+}
+
+// rd <- rs + rt
+static void gfusx_op_add(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 rs = _RS_, rt = _RT_;
+    u32 new_value = rs + rt;
+
+    if (inst->rd == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RD_, new_value);
+    if (vm->settings.debug.debug) {
+        bool overflow = ((rs ^ new_value) & (rt ^ new_value)) >> 31;
+        if (overflow) {
+            vm->pc -= 4;
+            gfusx_vm_logf(vm, GFUSX_LC_CPU, "Signed overflow in ADD instruction from 0x%08X.", vm->pc);
+            gfusx_vm_exception(vm, GFUSX_EX_ARITHMETIC_OVERFLOW, vm->in_delay_slot, false);
+            return;
+        }
+    }
+
+    if (inst->rd != 0) {
+        gfusx_vm_maybe_cancel_delayed_load(vm, inst->rd);
+        _RD_ = new_value;
+    }
+}
+
+// rd <- rs + rt
+static void gfusx_op_addu(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rd) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rd);
+    u32 new_value = _RS_ + _RT_;
+    if (inst->rd == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RD_, new_value);
+    _RD_ = new_value;
+}
+
+// rd <- hi
+static void gfusx_op_mfhi(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rd) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rd);
+    if (inst->rd == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RD_, vm->gpr.hi);
+    _RD_ = vm->gpr.hi;
+}
+
+// rd <- lo
+static void gfusx_op_mflo(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (0 == inst->rd) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rd);
+    if (inst->rd == GFU_REG_SP) gfusx_vm_call_stack_set_sp(vm, _RD_, vm->gpr.lo);
+    _RD_ = vm->gpr.lo;
+}
+
+// TODO(local): The multiply/divide unit runs alongside the pipeline on hardware,
+// and reading hi/lo before it is done stalls. Results are available immediately here.
+
+// hi:lo <- rs * rt
+static void gfusx_op_mult(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u64 result = (u64)((i64)(i32)_RS_ * (i64)(i32)_RT_);
+    vm->gpr.lo = (u32)result;
+    vm->gpr.hi = (u32)(result >> 32);
+}
+
+static void gfusx_op_multu(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u64 result = (u64)_RS_ * (u64)_RT_;
+    vm->gpr.lo = (u32)result;
+    vm->gpr.hi = (u32)(result >> 32);
+}
+
+// lo <- rs / rt, hi <- rs % rt
+// NOTE(local): Dividing by zero does not trap, the R3000 leaves the dividend in
+// hi and -1 or +1 in lo depending on its sign. 0x80000000 / -1 gives itself.
+static void gfusx_op_div(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    i32 rs = (i32)_RS_, rt = (i32)_RT_;
+    if (rt == 0) {
+        vm->gpr.hi = (u32)rs;
+        vm->gpr.lo = rs < 0 ? 1 : 0xFFFFFFFF;
+    } else if ((u32)rs == 0x80000000 && rt == -1) {
+        vm->gpr.hi = 0;
+        vm->gpr.lo = 0x80000000;
+    } else {
+        vm->gpr.hi = (u32)(rs % rt);
+        vm->gpr.lo = (u32)(rs / rt);
+    }
+}
+
+static void gfusx_op_divu(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 rs = _RS_, rt = _RT_;
+    if (rt == 0) {
+        vm->gpr.hi = rs;
+        vm->gpr.lo = 0xFFFFFFFF;
+    } else {
+        vm->gpr.hi = rs % rt;
+        vm->gpr.lo = rs / rt;
+    }
+}
+
+// rt <- memory[rs + imm], or 0 while the cache is isolated, available after the
+// load delay slot
+#define GFUSX_OP_LOAD(Name, Mask, Read)                            \
+static void gfusx_op_##Name(gfusx_vm* vm, const gfusx_decoded_inst* inst) { \
+    u32 addr = _RS_ + inst->imm;                                   \
+    if (!gfusx_mem_aligned(vm, addr, Mask, false)) return;         \
+    u32 value = gfusx_vm_cache_isolated(vm) ? 0 : Read;            \
+    if (0 == inst->rt) return;                                     \
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);              \
+    gfusx_vm_delayed_load(vm, inst->rt, value, 0);                 \
+}
+
+GFUSX_OP_LOAD(lb, 0, gfusx_mem_sext8(gfusx_mem_read8(vm, addr)))
+GFUSX_OP_LOAD(lbu, 0, gfusx_mem_read8(vm, addr))
+GFUSX_OP_LOAD(lh, 1, gfusx_mem_sext16(gfusx_mem_read16(vm, addr)))
+GFUSX_OP_LOAD(lhu, 1, gfusx_mem_read16(vm, addr))
+GFUSX_OP_LOAD(lw, 3, gfusx_mem_read32(vm, addr))
+#undef GFUSX_OP_LOAD
+
+// rt <- the bytes of the word at rs + imm from there to its end, into the top
+// of rt, available after the load delay slot. A pending load of rt is left
+// alone: it lands first and these merge on top of it, which is how an LWL and
+// LWR pair picks up each other's bytes.
+#define GFUSX_OP_LOAD_PARTIAL(Name)                                \
+static void gfusx_op_##Name(gfusx_vm* vm, const gfusx_decoded_inst* inst) { \
+    u32 addr = _RS_ + inst->imm;                                   \
+    u32 word = gfusx_vm_cache_isolated(vm) ? 0 : gfusx_mem_read32(vm, addr & ~3u); \
+    if (0 == inst->rt) return;                                     \
+    gfusx_vm_delayed_load(vm, inst->rt, gfusx_mem_##Name##_value(word, addr), gfusx_mem_##Name##_mask(addr)); \
+}
+
+GFUSX_OP_LOAD_PARTIAL(lwl)
+// rt <- the bytes of the word at rs + imm from its start to there, into the bottom of rt
+GFUSX_OP_LOAD_PARTIAL(lwr)
+#undef GFUSX_OP_LOAD_PARTIAL
+
+// memory[rs + imm] <- rt, or only the cache while it is isolated
+#define GFUSX_OP_STORE(Name, Mask, Write)                          \
+static void gfusx_op_##Name(gfusx_vm* vm, const gfusx_decoded_inst* inst) { \
+    u32 addr = _RS_ + inst->imm;                                   \
+    if (!gfusx_mem_aligned(vm, addr, Mask, true)) return;          \
+    if (gfusx_vm_cache_isolated(vm)) {                             \
+        gfusx_vm_isolated_store(vm, addr);                         \
+        return;                                                    \
+    }                                                              \
+    Write;                                                         \
+}
+
+GFUSX_OP_STORE(sb, 0, gfusx_mem_write8(vm, addr, (u8)_RT_))
+GFUSX_OP_STORE(sh, 1, gfusx_mem_write16(vm, addr, (u16)_RT_))
+GFUSX_OP_STORE(sw, 3, gfusx_mem_write32(vm, addr, _RT_))
+GFUSX_OP_STORE(swc2, 3, gfusx_mem_write32(vm, addr, gfusx_gte_read_data(vm, inst->rt)))
+// the top or bottom bytes of rt into the word at rs + imm, the counterparts of LWL and LWR
+GFUSX_OP_STORE(swl, 0, gfusx_mem_write32(vm, addr & ~3u, gfusx_mem_swl_merge(gfusx_mem_read32(vm, addr & ~3u), _RT_, addr)))
+GFUSX_OP_STORE(swr, 0, gfusx_mem_write32(vm, addr & ~3u, gfusx_mem_swr_merge(gfusx_mem_read32(vm, addr & ~3u), _RT_, addr)))
+#undef GFUSX_OP_STORE
+
+// TODO(local): Most COP0 registers are read-only or only partly writable.
+
+// rt <- cop0[rd], available after the load delay slot
+static void gfusx_op_mfc0(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 value = vm->cop0.r[inst->rd];
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    gfusx_vm_delayed_load(vm, inst->rt, value, 0);
+}
+
+// cop0[rd] <- rt
+static void gfusx_op_mtc0(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    bool was_isolated = gfusx_vm_cache_isolated(vm);
+    vm->cop0.r[inst->rd] = _RT_;
+
+    // recompiled loads and stores go straight to memory, so they are only
+    // inlined while the cache is not isolated
+    if (was_isolated != gfusx_vm_cache_isolated(vm) && vm->jit != NULL) {
+        gfusx_jit_invalidate_all(vm);
+    }
+}
+
+// NOTE(local): Without an exception handler to run, SYSCALL is treated as the
+// guest asking to exit with the status in $a0.
+// TODO(local): COP2 instructions should raise a coprocessor unusable exception
+// while CU2 is clear in the status register.
+
+// rt <- cop2 data[rd], available after the load delay slot
+static void gfusx_op_mfc2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 value = gfusx_gte_read_data(vm, inst->rd);
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    gfusx_vm_delayed_load(vm, inst->rt, value, 0);
+}
+
+// rt <- cop2 control[rd], available after the load delay slot
+static void gfusx_op_cfc2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 value = gfusx_gte_read_ctrl(vm, inst->rd);
+    if (0 == inst->rt) return;
+    gfusx_vm_maybe_cancel_delayed_load(vm, inst->rt);
+    gfusx_vm_delayed_load(vm, inst->rt, value, 0);
+}
+
+// cop2 data[rd] <- rt
+static void gfusx_op_mtc2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_gte_write_data(vm, inst->rd, _RT_);
+}
+
+// cop2 control[rd] <- rt
+static void gfusx_op_ctc2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_gte_write_ctrl(vm, inst->rd, _RT_);
+}
+
+static void gfusx_op_cop2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_gte_execute(vm, inst->imm);
+}
+
+// cop2 data[rt] <- memory[rs + imm], or 0 while the cache is isolated
+static void gfusx_op_lwc2(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 addr = _RS_ + inst->imm;
+    if (!gfusx_mem_aligned(vm, addr, 3, false)) return;
+    gfusx_gte_write_data(vm, inst->rt, gfusx_vm_cache_isolated(vm) ? 0 : gfusx_mem_read32(vm, addr));
+}
+
+static void gfusx_op_syscall(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_vm_stop(vm, GFUSX_STOP_EXIT, vm->gpr.a0);
+}
+
+static void gfusx_op_break(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    gfusx_vm_stop(vm, GFUSX_STOP_BREAK, inst->imm);
+}
+
+// Stands in for the first instruction of an attached routine, see gfusx_vm_hle_attach.
+static void gfusx_op_hle(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    // a load in the delay slot of the call would have landed long before the
+    // routine is done with its arguments
+    gfusx_delayed_load_info* pending = &vm->delayed_load_info[vm->current_delayed_load ^ 1];
+    if (pending->active) {
+        u32* reg = &vm->gpr.r[pending->index];
+        *reg = (*reg & pending->mask) | pending->value;
+        pending->active = false;
+    }
+
+    gfusx_hle_call(vm, (gfusx_hle_function)inst->imm);
+
+    vm->pc = vm->gpr.ra;
+    if (vm->call_stack != NULL) {
+        gfusx_vm_call_stack_jump(vm, vm->pc);
+    }
+}
+
+// NOTE(local): WAIT idles until an interrupt arrives. Nothing raises interrupts
+// yet, so it waits for the next scheduled event instead, which is where one
+// would come from, and execution carries on after it from there.
+static void gfusx_op_wait(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    if (vm->cycle < vm->cycle_target && gfusx_vm_can_skip_idle(vm)) {
+        vm->cycle = vm->cycle_target;
+    }
+}
+
+/// Stands in for an instruction with a breakpoint. Stopping leaves the VM right
+/// before the instruction. Once execution carries on from there, on the same
+/// cycle, the original instruction runs instead.
+static void gfusx_op_breakpoint(gfusx_vm* vm, const gfusx_decoded_inst* inst) {
+    u32 pc = vm->pc - 4;
+    u64 cycle = vm->cycle - GFUSX_CYCLE_BIAS;
+
+    if (vm->breakpoint_pc != pc || vm->breakpoint_cycle != cycle) {
+        gfusx_vm_undo_begin_inst(vm);
+        vm->breakpoint_pc = pc;
+        vm->breakpoint_cycle = cycle;
+        gfusx_vm_stop(vm, GFUSX_STOP_BREAKPOINT, pc);
+        return;
+    }
+
+    vm->breakpoint_pc = UINT32_MAX;
+
+    gfusx_decoded_inst original;
+    gfusx_vm_decode(&original, inst->code, pc);
+    const gfusx_hle_entry* entry = gfusx_hle_find(vm, pc);
+    if (entry != NULL) gfusx_vm_patch_hle_entry(&original, entry->function);
+    gfusx_vm_exec_code(vm, &original);
+}
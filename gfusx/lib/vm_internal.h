@@ -0,0 +1,628 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUSX - GameFU Station Emulator                                        ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#ifndef GFUSX_VM_INTERNAL_H_
+#define GFUSX_VM_INTERNAL_H_
+
+#include <gamefu/gfusx.h>
+
+#include <string.h>
+
+#if defined(__clang__) || defined(__GNUC__)
+#    define GFUSX_ALWAYS_INLINE inline __attribute__((__always_inline__))
+#else
+#    define GFUSX_ALWAYS_INLINE inline
+#endif
+
+// Labels as values let the threaded interpreter jump straight from one handler
+// to the next; without them it falls back to a switch over the decoded op.
+#if defined(__clang__) || defined(__GNUC__)
+#    define GFUSX_HAS_COMPUTED_GOTO 1
+#else
+#    define GFUSX_HAS_COMPUTED_GOTO 0
+#endif
+
+// mmap lets the loader map program files into guest memory instead of copying them.
+#if defined(__unix__) || defined(__APPLE__)
+#    define GFUSX_HAS_FILE_MAPPING 1
+#else
+#    define GFUSX_HAS_FILE_MAPPING 0
+#endif
+
+/// ======================================================================== ///
+/// Pre-decoded Instructions.                                                ///
+/// ======================================================================== ///
+
+typedef struct gfusx_decoded_inst gfusx_decoded_inst;
+typedef void (*gfusx_inst_handler)(gfusx_vm* vm, const gfusx_decoded_inst* inst);
+
+typedef enum gfusx_op_flags {
+    GFUSX_OPF_NONE = 0,
+    // May schedule a pc load and turn the next instruction into a delay slot.
+    GFUSX_OPF_BRANCH = 1 << 0,
+    // May stop the VM, so execution has to leave the engine right after it.
+    GFUSX_OPF_STOP = 1 << 1,
+    // Schedules a delayed register load, which lands when the next instruction retires.
+    GFUSX_OPF_LOAD = 1 << 2,
+    // Writes guest memory, which may throw away the code currently running.
+    GFUSX_OPF_STORE = 1 << 3,
+    // Changes CPU state that recompiled code is specialized on, so no block runs past it.
+    GFUSX_OPF_BLOCK_END = 1 << 4,
+    // Reads or writes guest memory, which may hit a watchpoint.
+    GFUSX_OPF_MEMORY = 1 << 5,
+} gfusx_op_flags;
+
+/// Every operation the interpreter can execute, with the opcode and funct
+/// fields flattened into a single value.
+#define GFUSX_OPS(X) \
+    X(NOP, nop, GFUSX_OPF_NONE) \
+    X(UNIMPLEMENTED, unimplemented, GFUSX_OPF_NONE) \
+    X(UNIMPLEMENTED_SPECIAL, unimplemented_special, GFUSX_OPF_NONE) \
+    X(JAL, jal, GFUSX_OPF_BRANCH) \
+    X(BEQ, beq, GFUSX_OPF_BRANCH) \
+    X(BNE, bne, GFUSX_OPF_BRANCH) \
+    X(ADDIU, addiu, GFUSX_OPF_NONE) \
+    X(ORI, ori, GFUSX_OPF_NONE) \
+    X(LUI, lui, GFUSX_OPF_NONE) \
+    X(LB, lb, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(LBU, lbu, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(LH, lh, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(LHU, lhu, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(LW, lw, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(SB, sb, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(SH, sh, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(SW, sw, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(LWL, lwl, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(LWR, lwr, GFUSX_OPF_LOAD | GFUSX_OPF_MEMORY) \
+    X(SWL, swl, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(SWR, swr, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(SLL, sll, GFUSX_OPF_NONE) \
+    X(ADD, add, GFUSX_OPF_NONE) \
+    X(ADDU, addu, GFUSX_OPF_NONE) \
+    X(MFHI, mfhi, GFUSX_OPF_NONE) \
+    X(MFLO, mflo, GFUSX_OPF_NONE) \
+    X(MULT, mult, GFUSX_OPF_NONE) \
+    X(MULTU, multu, GFUSX_OPF_NONE) \
+    X(DIV, div, GFUSX_OPF_NONE) \
+    X(DIVU, divu, GFUSX_OPF_NONE) \
+    X(MFC0, mfc0, GFUSX_OPF_LOAD) \
+    X(MTC0, mtc0, GFUSX_OPF_BLOCK_END) \
+    X(MFC2, mfc2, GFUSX_OPF_LOAD) \
+    X(CFC2, cfc2, GFUSX_OPF_LOAD) \
+    X(MTC2, mtc2, GFUSX_OPF_NONE) \
+    X(CTC2, ctc2, GFUSX_OPF_NONE) \
+    X(COP2, cop2, GFUSX_OPF_NONE) \
+    X(LWC2, lwc2, GFUSX_OPF_MEMORY) \
+    X(SWC2, swc2, GFUSX_OPF_STORE | GFUSX_OPF_MEMORY) \
+    X(SYSCALL, syscall, GFUSX_OPF_STOP) \
+    X(BREAK, break, GFUSX_OPF_STOP) \
+    X(WAIT, wait, GFUSX_OPF_STOP) \
+    X(HLE, hle, GFUSX_OPF_BLOCK_END) \
+    X(BREAKPOINT, breakpoint, GFUSX_OPF_STOP)
+
+typedef enum gfusx_op {
+#define X(Id, Name, Flags) GFUSX_OP_##Id,
+    GFUSX_OPS(X)
+#undef X
+    GFUSX_OP_COUNT,
+} gfusx_op;
+
+/// What decoding a whole page found out about an instruction from its neighbours.
+/// Instructions decoded on their own, like the uncached interpreter does, never
+/// have any.
+typedef enum gfusx_inst_hints {
+    GFUSX_HINT_NONE = 0,
+    // A backward branch closing a loop that changes nothing but the cycle count
+    // from one iteration to the next, see gfusx_vm_find_idle_loops.
+    GFUSX_HINT_IDLE_LOOP = 1 << 0,
+} gfusx_inst_hints;
+
+// The longest loop body, delay slot included, that is looked at for idling.
+#define GFUSX_IDLE_LOOP_MAX_INSTS 8
+
+/// A guest instruction with its fields already extracted. `imm` holds whatever
+/// the operation wants out of the immediate field: the zero- or sign-extended
+/// value, or the absolute branch or jump target.
+struct gfusx_decoded_inst {
+    gfusx_inst_handler handler;
+    u32 code;
+    u32 imm;
+    u8 rs, rt, rd, shamt;
+    u16 op;
+    u8 hints; // gfusx_inst_hints
+};
+
+struct gfusx_decoded_page {
+    gfusx_decoded_inst insts[GFUSX_PAGE_SIZE / 4];
+    gfusx_decoded_page* next_retired;
+};
+
+extern const gfusx_op_flags gfusx_op_flags_table[GFUSX_OP_COUNT];
+
+/// Returns the low address bits that have to be clear for the load or store
+/// `op`, or 0 if it takes any address.
+static GFUSX_ALWAYS_INLINE u32 gfusx_op_alignment_mask(gfusx_op op) {
+    switch (op) {
+        default: return 0;
+        case GFUSX_OP_LH:
+        case GFUSX_OP_LHU:
+        case GFUSX_OP_SH: return 1;
+        case GFUSX_OP_LW:
+        case GFUSX_OP_SW:
+        case GFUSX_OP_LWC2:
+        case GFUSX_OP_SWC2: return 3;
+    }
+}
+
+/// Returns the decoded instruction at `pc`, decoding its page first if needed.
+const gfusx_decoded_inst* gfusx_vm_decoded_inst_at(gfusx_vm* vm, u32 pc);
+/// Out-of-line version of the per-instruction epilogue for recompiled code.
+/// Returns true once execution has to leave the engine.
+bool gfusx_vm_retire(gfusx_vm* vm);
+/// Makes the engine leave after the current instruction, with the given reason.
+static GFUSX_ALWAYS_INLINE void gfusx_vm_stop(gfusx_vm* vm, gfusx_stop_reason reason, u32 code) {
+    vm->stop_reason = reason;
+    vm->stop_code = code;
+    vm->cycle_target = 0;
+}
+
+/// Makes the engine leave after the current instruction without stopping the
+/// run, so that it is entered again with the VM as it is set up now.
+static GFUSX_ALWAYS_INLINE void gfusx_vm_reenter(gfusx_vm* vm) {
+    if (vm->cycle < vm->cycle_target) {
+        vm->cycle_target = vm->cycle;
+    }
+}
+
+/// Refills the instruction cache line holding `pc`, from `pc` to the end of the
+/// line, and charges the bus time for it.
+void gfusx_vm_icache_miss(gfusx_vm* vm, u32 pc);
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_icache_index(u32 addr) {
+    return (addr >> 2) & (GFUSX_ICACHE_WORD_COUNT - 1);
+}
+
+/// Runs a single instruction through the cached interpreter, for code the
+/// recompiler cannot handle. Returns true once execution has to leave the engine.
+bool gfusx_vm_interpret_inst(gfusx_vm* vm);
+
+/// ======================================================================== ///
+/// Logging.                                                                 ///
+/// ======================================================================== ///
+
+/// Sets up the log queue and enabled classes from the VM's settings.
+void gfusx_log_create(gfusx_vm* vm);
+/// Prints whatever is still queued and frees the queue.
+void gfusx_log_destroy(gfusx_vm* vm);
+
+/// ======================================================================== ///
+/// Memory.                                                                  ///
+/// ======================================================================== ///
+
+bool gfusx_mem_create(gfusx_vm* vm);
+void gfusx_mem_destroy(gfusx_vm* vm);
+
+/// Points the page table entries of a RAM or ROM page at its memory, apart from
+/// the accesses that have to take the slow path: stores to ROM, stores to pages
+/// with pre-decoded code, so the first one throws the code away, and whatever a
+/// watchpoint on the page watches. Has to be called whenever one of those changes.
+void gfusx_mem_update_page_access(gfusx_vm* vm, u32 page_index);
+
+/// Maps `size` bytes of a file over RAM or ROM at `addr`, copy-on-write, instead
+/// of copying them in. Returns false if the range can't be mapped on this host,
+/// with fastmem, or off a host page boundary, in which case nothing changed.
+bool gfusx_mem_map_file(gfusx_vm* vm, u32 addr, int fd, u64 offset, u32 size);
+
+/// Misaligned accesses also end up here, and are split into bytes.
+u32 gfusx_mem_read_slow(gfusx_vm* vm, u32 addr, u32 size);
+void gfusx_mem_write_slow(gfusx_vm* vm, u32 addr, u32 value, u32 size);
+
+/// Maps RAM and ROM into a reservation of the whole guest address space and
+/// points `vm->ram` and `vm->rom` at their host view. Returns false if the
+/// host does not support it.
+bool gfusx_fastmem_create(gfusx_vm* vm);
+void gfusx_fastmem_destroy(gfusx_vm* vm);
+void gfusx_fastmem_set_access(gfusx_vm* vm, u32 page_index, bool readable, bool writable);
+/// Runs `engine`. Whenever a fastmem access faults, `replay` has to finish the
+/// faulting instruction through the page tables; the engine is re-entered
+/// unless it returns true.
+void gfusx_fastmem_execute(gfusx_vm* vm, void (*engine)(gfusx_vm* vm), bool (*replay)(gfusx_vm* vm));
+
+/// Returns the host view of a RAM or ROM page.
+u8* gfusx_mem_host_page(gfusx_vm* vm, u32 page_index);
+/// Sets `pending[i]` for every page with the `owner` dirty bit set, and clears it.
+void gfusx_mem_take_dirty_pages(gfusx_vm* vm, u8 owner, u8* pending);
+/// Returns the host view of a page that `owner` is about to overwrite from
+/// outside of the VM, after throwing its code away and marking it dirty for
+/// everyone else.
+u8* gfusx_mem_overwrite_page(gfusx_vm* vm, u32 page_index, u8 owner);
+
+// Guest memory is little endian. These are the only places that access it as
+// anything wider than a byte, so they are the ones to audit. Going through
+// memcpy keeps them safe for any alignment while still compiling to a single
+// host move, plus a byte swap on big endian hosts.
+
+static GFUSX_ALWAYS_INLINE u16 gfusx_bswap16(u16 value) {
+#if defined(__clang__) || defined(__GNUC__)
+    return __builtin_bswap16(value);
+#else
+    return (u16)((value >> 8) | (value << 8));
+#endif
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_bswap32(u32 value) {
+#if defined(__clang__) || defined(__GNUC__)
+    return __builtin_bswap32(value);
+#else
+    return (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+#endif
+}
+
+static GFUSX_ALWAYS_INLINE u8 gfusx_mem_load8(const u8* host) {
+    return *host;
+}
+
+static GFUSX_ALWAYS_INLINE u16 gfusx_mem_load16(const u8* host) {
+#if GFUSX_IS_NATIVE_MIXED_ENDIAN
+    return (u16)(host[0] | (host[1] << 8));
+#else
+    u16 value;
+    memcpy(&value, host, sizeof value);
+    return GFUSX_IS_NATIVE_LITTLE_ENDIAN ? value : gfusx_bswap16(value);
+#endif
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_load32(const u8* host) {
+#if GFUSX_IS_NATIVE_MIXED_ENDIAN
+    return (u32)host[0] | ((u32)host[1] << 8) | ((u32)host[2] << 16) | ((u32)host[3] << 24);
+#else
+    u32 value;
+    memcpy(&value, host, sizeof value);
+    return GFUSX_IS_NATIVE_LITTLE_ENDIAN ? value : gfusx_bswap32(value);
+#endif
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_store8(u8* host, u8 value) {
+    *host = value;
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_store16(u8* host, u16 value) {
+#if GFUSX_IS_NATIVE_MIXED_ENDIAN
+    host[0] = (u8)value;
+    host[1] = (u8)(value >> 8);
+#else
+    if (!GFUSX_IS_NATIVE_LITTLE_ENDIAN) value = gfusx_bswap16(value);
+    memcpy(host, &value, sizeof value);
+#endif
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_store32(u8* host, u32 value) {
+#if GFUSX_IS_NATIVE_MIXED_ENDIAN
+    host[0] = (u8)value;
+    host[1] = (u8)(value >> 8);
+    host[2] = (u8)(value >> 16);
+    host[3] = (u8)(value >> 24);
+#else
+    if (!GFUSX_IS_NATIVE_LITTLE_ENDIAN) value = gfusx_bswap32(value);
+    memcpy(host, &value, sizeof value);
+#endif
+}
+
+// Sign extension for LB and LH, done on the loaded value.
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_sext8(u8 value) {
+    return (u32)(i32)(i8)value;
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_sext16(u16 value) {
+    return (u32)(i32)(i16)value;
+}
+
+// LWL, LWR, SWL and SWR work on the aligned word holding `addr`, of which they
+// only move the bytes from `addr` up to its end or from its start up to `addr`.
+// The loads are given as the mask of register bits they keep and the bits that
+// go in their place, which is how the load delay slot lands them.
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_lwl_mask(u32 addr) {
+    return 0x00FFFFFFu >> ((addr & 3) * 8);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_lwl_value(u32 word, u32 addr) {
+    return word << (24 - (addr & 3) * 8);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_lwr_mask(u32 addr) {
+    return 0xFFFFFF00u << (24 - (addr & 3) * 8);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_lwr_value(u32 word, u32 addr) {
+    return word >> ((addr & 3) * 8);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_swl_merge(u32 word, u32 reg, u32 addr) {
+    return (word & (0xFFFFFF00u << ((addr & 3) * 8))) | (reg >> (24 - (addr & 3) * 8));
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_swr_merge(u32 word, u32 reg, u32 addr) {
+    return (word & (0x00FFFFFFu >> (24 - (addr & 3) * 8))) | (reg << ((addr & 3) * 8));
+}
+
+// Only ever called once a store has gone through to RAM, so the page index is
+// always in range without a check.
+static GFUSX_ALWAYS_INLINE void gfusx_mem_mark_dirty(gfusx_vm* vm, u32 addr) {
+    vm->dirty_pages[addr >> GFUSX_PAGE_SHIFT] = GFUSX_DIRTY_ALL;
+}
+
+// Accesses through the page tables, which never fault. A misaligned one could
+// run off the end of its page, so it takes the slow path like an unmapped one.
+
+static GFUSX_ALWAYS_INLINE u8 gfusx_mem_read8_paged(gfusx_vm* vm, u32 addr) {
+    u8* page = vm->read_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL) return (u8)gfusx_mem_read_slow(vm, addr, 1);
+    return page[addr & GFUSX_PAGE_MASK];
+}
+
+static GFUSX_ALWAYS_INLINE u16 gfusx_mem_read16_paged(gfusx_vm* vm, u32 addr) {
+    u8* page = vm->read_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL || (addr & 1) != 0) return (u16)gfusx_mem_read_slow(vm, addr, 2);
+    return gfusx_mem_load16(&page[addr & GFUSX_PAGE_MASK]);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_read32_paged(gfusx_vm* vm, u32 addr) {
+    u8* page = vm->read_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL || (addr & 3) != 0) return gfusx_mem_read_slow(vm, addr, 4);
+    return gfusx_mem_load32(&page[addr & GFUSX_PAGE_MASK]);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write8_paged(gfusx_vm* vm, u32 addr, u8 value) {
+    u8* page = vm->write_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL) {
+        gfusx_mem_write_slow(vm, addr, value, 1);
+        return;
+    }
+
+    page[addr & GFUSX_PAGE_MASK] = value;
+    gfusx_mem_mark_dirty(vm, addr);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write16_paged(gfusx_vm* vm, u32 addr, u16 value) {
+    u8* page = vm->write_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL || (addr & 1) != 0) {
+        gfusx_mem_write_slow(vm, addr, value, 2);
+        return;
+    }
+
+    gfusx_mem_store16(&page[addr & GFUSX_PAGE_MASK], value);
+    gfusx_mem_mark_dirty(vm, addr);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write32_paged(gfusx_vm* vm, u32 addr, u32 value) {
+    u8* page = vm->write_pages[addr >> GFUSX_PAGE_SHIFT];
+    if (page == NULL || (addr & 3) != 0) {
+        gfusx_mem_write_slow(vm, addr, value, 4);
+        return;
+    }
+
+    gfusx_mem_store32(&page[addr & GFUSX_PAGE_MASK], value);
+    gfusx_mem_mark_dirty(vm, addr);
+}
+
+/// Raises the address error exception for the load or store that is executing.
+/// The VM stops with GFUSX_STOP_ADDRESS_ERROR right before the instruction, so
+/// the instruction must not have changed anything yet.
+void gfusx_vm_address_error(gfusx_vm* vm, u32 addr, bool store);
+
+// Loads and stores check their address with this before anything else, so the
+// guest accesses below only ever see naturally aligned ones. Those can't run
+// past the end of a page, a region or the address space.
+static GFUSX_ALWAYS_INLINE bool gfusx_mem_aligned(gfusx_vm* vm, u32 addr, u32 mask, bool store) {
+    if ((addr & mask) == 0) return true;
+    gfusx_vm_address_error(vm, addr, store);
+    return false;
+}
+
+// Guest accesses. With fastmem these are a single host access, which faults
+// into the engine loop if it has to take the slow path. Host side accesses
+// outside of the engine have to use the paged versions instead.
+
+static GFUSX_ALWAYS_INLINE u8 gfusx_mem_read8(gfusx_vm* vm, u32 addr) {
+    if (vm->fastmem != NULL) return vm->fastmem[addr];
+    return gfusx_mem_read8_paged(vm, addr);
+}
+
+static GFUSX_ALWAYS_INLINE u16 gfusx_mem_read16(gfusx_vm* vm, u32 addr) {
+    if (vm->fastmem != NULL) return gfusx_mem_load16(&vm->fastmem[addr]);
+    return gfusx_mem_read16_paged(vm, addr);
+}
+
+static GFUSX_ALWAYS_INLINE u32 gfusx_mem_read32(gfusx_vm* vm, u32 addr) {
+    if (vm->fastmem != NULL) return gfusx_mem_load32(&vm->fastmem[addr]);
+    return gfusx_mem_read32_paged(vm, addr);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write8(gfusx_vm* vm, u32 addr, u8 value) {
+    if (vm->fastmem != NULL) {
+        vm->fastmem[addr] = value;
+        gfusx_mem_mark_dirty(vm, addr);
+        return;
+    }
+
+    gfusx_mem_write8_paged(vm, addr, value);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write16(gfusx_vm* vm, u32 addr, u16 value) {
+    if (vm->fastmem != NULL) {
+        gfusx_mem_store16(&vm->fastmem[addr], value);
+        gfusx_mem_mark_dirty(vm, addr);
+        return;
+    }
+
+    gfusx_mem_write16_paged(vm, addr, value);
+}
+
+static GFUSX_ALWAYS_INLINE void gfusx_mem_write32(gfusx_vm* vm, u32 addr, u32 value) {
+    if (vm->fastmem != NULL) {
+        gfusx_mem_store32(&vm->fastmem[addr], value);
+        gfusx_mem_mark_dirty(vm, addr);
+        return;
+    }
+
+    gfusx_mem_write32_paged(vm, addr, value);
+}
+
+/// ======================================================================== ///
+/// Scheduling.                                                              ///
+/// ======================================================================== ///
+
+/// Returns the cycle of the earliest pending event, or UINT64_MAX.
+static GFUSX_ALWAYS_INLINE u64 gfusx_vm_next_event_cycle(gfusx_vm* vm) {
+    return vm->events.count == 0 ? UINT64_MAX : vm->events.data[0].cycle;
+}
+
+/// Runs every event that is due, including ones scheduled by the events themselves.
+void gfusx_vm_run_events(gfusx_vm* vm);
+void gfusx_vm_free_events(gfusx_vm* vm);
+/// Replaces the pending events with `count` gfusx_events saved earlier, already
+/// in heap order. They are copied bytewise, so `events` need not be aligned.
+void gfusx_vm_restore_events(gfusx_vm* vm, const void* events, isize count, gfusx_event_id next_event_id);
+
+/// ======================================================================== ///
+/// High Level Emulation.                                                    ///
+/// ======================================================================== ///
+
+// Attached routines replace their first decoded instruction with GFUSX_OP_HLE,
+// which holds the function in `imm`.
+
+/// Returns the index of the first entry at or after `address`.
+isize gfusx_hle_lower_bound(gfusx_vm* vm, u32 address);
+/// Returns the entry attached at `address`, or NULL.
+const gfusx_hle_entry* gfusx_hle_find(gfusx_vm* vm, u32 address);
+/// Runs the native version of `function` on the arguments in the guest's
+/// registers and charges its cycles. Returning to the caller is up to the op.
+void gfusx_hle_call(gfusx_vm* vm, gfusx_hle_function function);
+void gfusx_hle_free_all(gfusx_vm* vm);
+/// Replaces the heap with `count` gfusx_hle_blocks saved earlier. They are
+/// copied bytewise, so `blocks` need not be aligned.
+void gfusx_hle_restore_heap(gfusx_vm* vm, const void* blocks, isize count);
+
+/// ======================================================================== ///
+/// Debugging.                                                               ///
+/// ======================================================================== ///
+
+// Breakpoints replace their decoded instruction with GFUSX_OP_BREAKPOINT, which
+// keeps the original one in `code`.
+
+/// Returns the index of the first breakpoint at or after `address`.
+isize gfusx_debug_breakpoint_lower_bound(gfusx_vm* vm, u32 address);
+bool gfusx_debug_has_breakpoint(gfusx_vm* vm, u32 address);
+/// Stops the VM if a `kind` access of `size` bytes at `addr` hits a watchpoint.
+/// Called by the slow path, which every access to a watched page takes.
+void gfusx_debug_check_watchpoints(gfusx_vm* vm, u32 addr, u32 size, gfusx_watch_kind kind);
+void gfusx_debug_free_all(gfusx_vm* vm);
+
+/// ======================================================================== ///
+/// Profiling.                                                               ///
+/// ======================================================================== ///
+
+// These keep `vm->call_stack` up to date, which has to be set.
+
+/// Pushes a frame for a call to `function` made with $sp at `sp`.
+void gfusx_call_stack_call(gfusx_vm* vm, u32 function, u32 return_addr, u32 sp);
+/// Pops every frame that was called with $sp at or below `sp`.
+void gfusx_call_stack_release(gfusx_vm* vm, u32 sp);
+/// Pops the innermost frame.
+void gfusx_call_stack_return(gfusx_vm* vm);
+
+/// ======================================================================== ///
+/// Geometry Transformation Engine.                                          ///
+/// ======================================================================== ///
+
+// MAC1-3 are 44-bit accumulators, IR1-3 16-bit.
+#define GFUSX_GTE_MAC_MAX (((i64)1 << 43) - 1)
+#define GFUSX_GTE_MAC_MIN (-((i64)1 << 43))
+#define GFUSX_GTE_IR_MAX 0x7FFF
+#define GFUSX_GTE_IR_MIN (-0x8000)
+
+// data register indices that kernels write through `r`
+#define GFUSX_GTE_DATA_IR1 9
+#define GFUSX_GTE_DATA_MAC1 25
+
+/// The inner loops of the GTE commands. There is a scalar reference version of
+/// each and SIMD versions where the host has them; all of them have to produce
+/// exactly the same registers and flags.
+struct gfusx_gte_kernels {
+    const char* name;
+    /// out[i] = (t[i] << 12) + m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2],
+    /// checked for overflow and wrapped to 44 bits after every addition.
+    void (*transform)(const gfusx_cop2_smatrix3* m, const i32* t, const i16* v, i64* out, u32* flag);
+    /// The same for the three consecutive vectors at `v`, sharing the setup of
+    /// the matrix and translation.
+    void (*transform3)(const gfusx_cop2_smatrix3* m, const i32* t, const gfusx_cop2_svector3* v, i64 (*out)[3], u32* flag);
+    /// MAC1-3 = value[i] >> shift and IR1-3 = MAC1-3 saturated, after checking
+    /// value[i] for overflow.
+    void (*set_mac_ir)(gfusx_vm* vm, const i64* value, u32 shift, bool lm);
+    /// Twice the signed area of the screen triangle in SXY0-2.
+    i64 (*nclip)(const gfusx_cop2_data_regs* data);
+};
+
+extern const gfusx_gte_kernels gfusx_gte_scalar_kernels;
+/// Returns the fastest SIMD kernels the host supports, or NULL if there are none.
+const gfusx_gte_kernels* gfusx_gte_simd_kernels(void);
+
+/// Picks the kernels `vm->settings` asks for and resets the GTE registers.
+void gfusx_gte_power_on(gfusx_vm* vm);
+u32 gfusx_gte_read_data(gfusx_vm* vm, u32 index);
+void gfusx_gte_write_data(gfusx_vm* vm, u32 index, u32 value);
+u32 gfusx_gte_read_ctrl(gfusx_vm* vm, u32 index);
+void gfusx_gte_write_ctrl(gfusx_vm* vm, u32 index, u32 value);
+/// Runs the command in the low 25 bits of a COP2 instruction.
+void gfusx_gte_execute(gfusx_vm* vm, u32 command);
+
+/// ======================================================================== ///
+/// Savestates.                                                              ///
+/// ======================================================================== ///
+
+void gfusx_vm_get_cpu_state(gfusx_vm* vm, gfusx_cpu_state* cpu);
+void gfusx_vm_set_cpu_state(gfusx_vm* vm, const gfusx_cpu_state* cpu);
+
+/// ======================================================================== ///
+/// Recompiler.                                                              ///
+/// ======================================================================== ///
+
+/// Returns false if the host cannot run recompiled code, in which case the VM
+/// falls back to the threaded interpreter.
+bool gfusx_jit_create(gfusx_vm* vm);
+void gfusx_jit_destroy(gfusx_vm* vm);
+void gfusx_jit_invalidate_page(gfusx_vm* vm, u32 page_index);
+/// Drops every block, for when code was compiled against CPU state that changed.
+void gfusx_jit_invalidate_all(gfusx_vm* vm);
+void gfusx_jit_step(gfusx_vm* vm);
+
+/// ======================================================================== ///
+/// Precompiled Code.                                                        ///
+/// ======================================================================== ///
+
+/// Returns false if no program was given in the settings, in which case the VM
+/// falls back to the threaded interpreter.
+bool gfusx_aot_create(gfusx_vm* vm);
+void gfusx_aot_destroy(gfusx_vm* vm);
+void gfusx_aot_invalidate_page(gfusx_vm* vm, u32 page_index);
+void gfusx_aot_step(gfusx_vm* vm);
+
+#endif /* GFUSX_VM_INTERNAL_H_ */
@@ -24,9 +24,231 @@
 #define GFUARCH_IMPLEMENTATION
 #include <gamefu/arch.h>
 
+#define GFU_ELF_IMPL
+#include <gamefu/elf.h>
+
 #include <gamefu/gfusx.h>
 
+#include <time.h>
+
+#define GFUSX_DEFAULT_CYCLE_BUDGET 100000000ull
+// prime, so the samples do not line up with the period of a loop
+#define GFUSX_DEFAULT_PROFILE_INTERVAL 997ull
+// fixed, so a mismatch --check-gte finds shows up again on the next run
+#define GFUSX_GTE_CHECK_SEED 0x9E3779B97F4A7C15ull
+
+// Builds made with `nob aot` link in a program compiled by gfusx-aot under this
+// name, and run it on the precompiled engine unless told otherwise.
+#ifdef GFUSX_AOT_PROGRAM
+extern const gfusx_aot_program GFUSX_AOT_PROGRAM;
+static const gfusx_aot_program* const gfusx_linked_program = &GFUSX_AOT_PROGRAM;
+#else
+static const gfusx_aot_program* const gfusx_linked_program = NULL;
+#endif
+
+static int gfusx_run_demo(void);
+static void gfusx_print_usage(FILE* stream, const char* program);
+static bool gfusx_parse_engine(const char* name, gfusx_cpu_engine* engine);
+static const char* gfusx_engine_name(gfusx_cpu_engine engine);
+static void gfusx_print_job(FILE* stream, const gfusx_job* job);
+static bool gfusx_append_results(const char* path, const gfusx_job* jobs, isize job_count, gfusx_cpu_engine engine);
+
+static void gfusx_trace_dump_regs(gfusx_vm* vm, void* user_data) {
+    gfusx_vm_dump_regs(vm, user_data);
+}
+
 int main(int argc, char** argv) {
+    if (argc < 2) {
+        return gfusx_run_demo();
+    }
+
+    int result = 0;
+    gfusx_job* jobs = calloc((usize)argc, sizeof *jobs);
+    isize job_count = 0;
+    u64 cycle_budget = GFUSX_DEFAULT_CYCLE_BUDGET;
+    const char* input_path = NULL;
+    bool record_input = false;
+    const char* trace_path = NULL;
+    u64 profile_interval = 0;
+    const char* profile_path = NULL;
+    bool call_graph = false;
+    const char* call_graph_path = NULL;
+    const char* results_path = NULL;
+    bool lockstep = false;
+    gfusx_cpu_engine lockstep_reference = GFUSX_ENGINE_INTERPRETER;
+    gfusx_batch_options options = {0};
+    if (gfusx_linked_program != NULL) {
+        options.settings.cpu.engine = GFUSX_ENGINE_PRECOMPILED;
+        options.settings.cpu.aot_program = gfusx_linked_program;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (0 == strcmp("-h", arg) || 0 == strcmp("--help", arg)) {
+            gfusx_print_usage(stdout, argv[0]);
+            kos_return_defer(0);
+        } else if (0 == strcmp("-j", arg) && i + 1 < argc) {
+            options.thread_count = atoi(argv[++i]);
+        } else if (0 == strcmp("--cycles", arg) && i + 1 < argc) {
+            cycle_budget = strtoull(argv[++i], NULL, 0);
+        } else if (0 == strcmp("--engine", arg) && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!gfusx_parse_engine(name, &options.settings.cpu.engine)) {
+                fprintf(stderr, "Unknown engine '%s'.\n", name);
+                kos_return_defer(1);
+            }
+        } else if (0 == strcmp("--lockstep", arg) && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (!gfusx_parse_engine(name, &lockstep_reference)) {
+                fprintf(stderr, "Unknown engine '%s'.\n", name);
+                kos_return_defer(1);
+            }
+
+            lockstep = true;
+        } else if (0 == strcmp("--fastmem", arg)) {
+            options.settings.memory.fastmem = true;
+        } else if (0 == strcmp("--gte-reference", arg)) {
+            options.settings.cpu.gte_reference = true;
+        } else if (0 == strcmp("--check-gte", arg) && i + 1 < argc) {
+            u64 iterations = strtoull(argv[++i], NULL, 0);
+            kos_return_defer(gfusx_gte_check_kernels(GFUSX_GTE_CHECK_SEED, iterations, stdout) ? 0 : 1);
+        } else if (0 == strcmp("--no-idle-skip", arg)) {
+            options.settings.cpu.no_idle_skip = true;
+        } else if (0 == strcmp("--hle", arg)) {
+            options.settings.hle.enabled = true;
+        } else if (0 == strcmp("--hle-call-cycles", arg) && i + 1 < argc) {
+            options.settings.hle.call_cycles = (u32)strtoul(argv[++i], NULL, 0);
+            options.settings.hle.enabled = true;
+        } else if (0 == strcmp("--hle-byte-cycles", arg) && i + 1 < argc) {
+            options.settings.hle.byte_cycles = (u32)strtoul(argv[++i], NULL, 0);
+            options.settings.hle.enabled = true;
+        } else if (0 == strcmp("--record", arg) && i + 1 < argc) {
+            input_path = argv[++i];
+            record_input = true;
+        } else if (0 == strcmp("--replay", arg) && i + 1 < argc) {
+            input_path = argv[++i];
+            record_input = false;
+        } else if (0 == strcmp("--trace", arg) && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (0 == strcmp("--profile", arg)) {
+            if (profile_interval == 0) profile_interval = GFUSX_DEFAULT_PROFILE_INTERVAL;
+        } else if (0 == strcmp("--profile-interval", arg) && i + 1 < argc) {
+            profile_interval = strtoull(argv[++i], NULL, 0);
+        } else if (0 == strcmp("--profile-out", arg) && i + 1 < argc) {
+            profile_path = argv[++i];
+            if (profile_interval == 0) profile_interval = GFUSX_DEFAULT_PROFILE_INTERVAL;
+        } else if (0 == strcmp("--call-graph", arg)) {
+            call_graph = true;
+        } else if (0 == strcmp("--call-graph-out", arg) && i + 1 < argc) {
+            call_graph_path = argv[++i];
+            call_graph = true;
+        } else if (0 == strcmp("--results", arg) && i + 1 < argc) {
+            results_path = argv[++i];
+        } else if (0 == strcmp("--pin", arg)) {
+            options.pin_threads = true;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option '%s'.\n", arg);
+            gfusx_print_usage(stderr, argv[0]);
+            kos_return_defer(1);
+        } else {
+            jobs[job_count++] = (gfusx_job) {
+                .elf_path = arg,
+            };
+        }
+    }
+
+    if (job_count == 0) {
+        fprintf(stderr, "No input files provided.\n");
+        kos_return_defer(1);
+    }
+
+    if (record_input && job_count != 1) {
+        fprintf(stderr, "Input can only be recorded for a single program.\n");
+        kos_return_defer(1);
+    }
+
+    if (trace_path != NULL && job_count != 1) {
+        fprintf(stderr, "Only a single program can be traced.\n");
+        kos_return_defer(1);
+    }
+
+    if ((profile_interval != 0 || call_graph) && job_count != 1) {
+        fprintf(stderr, "Only a single program can be profiled.\n");
+        kos_return_defer(1);
+    }
+
+    bool wants_precompiled = options.settings.cpu.engine == GFUSX_ENGINE_PRECOMPILED || (lockstep && lockstep_reference == GFUSX_ENGINE_PRECOMPILED);
+    if (wants_precompiled && gfusx_linked_program == NULL) {
+        fprintf(stderr, "This build has no precompiled program, build one with 'nob aot <program.elf>'.\n");
+        kos_return_defer(1);
+    }
+
+    // both VMs would need their own copy of the log
+    if (lockstep && input_path != NULL) {
+        fprintf(stderr, "Input can't be recorded or replayed while checking in lockstep.\n");
+        kos_return_defer(1);
+    }
+
+    for (isize i = 0; i < job_count; i++) {
+        jobs[i].cycle_budget = cycle_budget;
+        jobs[i].input_path = input_path;
+        jobs[i].record_input = record_input;
+        jobs[i].trace_path = trace_path;
+        jobs[i].profile_interval = profile_interval;
+        jobs[i].profile_path = profile_path;
+        jobs[i].call_graph = call_graph;
+        jobs[i].call_graph_path = call_graph_path;
+        jobs[i].lockstep = lockstep;
+        jobs[i].lockstep_reference = lockstep_reference;
+    }
+
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+    gfusx_run_batch(jobs, job_count, &options);
+    timespec_get(&end, TIME_UTC);
+
+    isize failed_count = 0;
+    isize desync_count = 0;
+    isize diverged_count = 0;
+    u64 total_cycles = 0;
+
+    // one tab separated line per job, in the order they were given
+    fprintf(stdout, "path\tstatus\texit_code\tcycles\tpc");
+    for (int i = 0; i < 32; i++) fprintf(stdout, "\tr%d", i);
+    fprintf(stdout, "\thi\tlo\n");
+
+    for (isize i = 0; i < job_count; i++) {
+        gfusx_print_job(stdout, &jobs[i]);
+        if (!jobs[i].loaded) failed_count++;
+        if (jobs[i].loaded && jobs[i].stop_reason == GFUSX_STOP_DESYNC) desync_count++;
+        if (jobs[i].loaded && jobs[i].stop_reason == GFUSX_STOP_DIVERGED) diverged_count++;
+        total_cycles += jobs[i].cycles;
+    }
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%td jobs, %td failed to load, %td desynced, %llu cycles in %.3fs.\n", job_count, failed_count, desync_count, (unsigned long long)total_cycles, seconds);
+
+    if (results_path != NULL && !gfusx_append_results(results_path, jobs, job_count, options.settings.cpu.engine)) {
+        fprintf(stderr, "Could not write results file '%s'.\n", results_path);
+        result = 1;
+    }
+
+    for (isize i = 0; i < job_count; i++) {
+        if (!jobs[i].loaded || jobs[i].stop_reason != GFUSX_STOP_DIVERGED) continue;
+        fprintf(stderr, "'%s' on the %s engine against the %s engine:\n", jobs[i].elf_path, gfusx_engine_name(options.settings.cpu.engine), gfusx_engine_name(lockstep_reference));
+        gfusx_lockstep_print_report(stderr, &jobs[i].lockstep_report);
+    }
+
+    if (lockstep) fprintf(stderr, "%td jobs diverged from the %s engine.\n", diverged_count, gfusx_engine_name(lockstep_reference));
+
+    if (failed_count != 0 || desync_count != 0 || diverged_count != 0) result = 1;
+
+defer:;
+    free(jobs);
+    return result;
+}
+
+static int gfusx_run_demo(void) {
     fprintf(stderr, "Hello, GFUSX!\n");
 
     u32 program[] = {
@@ -38,9 +260,11 @@ int main(int argc, char** argv) {
     };
 
     gfusx_vm vm = {0};
+    vm.settings.debug.trace = gfusx_trace_dump_regs;
+    vm.settings.debug.trace_user_data = stderr;
     gfusx_vm_power_on(&vm);
 
-    memcpy(vm.icache_code, program, sizeof(program));
+    gfusx_vm_write_bytes(&vm, GFU_MEM_OFFSET_MAIN_RAM, program, sizeof(program));
     gfusx_vm_dump_regs(&vm, stderr);
     gfusx_vm_step(&vm);
 
@@ -48,3 +272,106 @@ int main(int argc, char** argv) {
 
     return 0;
 }
+
+static void gfusx_print_usage(FILE* stream, const char* program) {
+    fprintf(stream, "Usage: %s [options] <file.elf>...\n", program);
+    fprintf(stream, "Runs every ELF file on its own VM and prints the results as tab separated values.\n");
+    fprintf(stream, "With no arguments, runs a small built-in demo with register tracing.\n\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  -j <n>             Number of worker threads. Defaults to one per core.\n");
+    fprintf(stream, "  --cycles <n>       Cycle budget per program. Defaults to %llu.\n", GFUSX_DEFAULT_CYCLE_BUDGET);
+    fprintf(stream, "  --engine <name>    interpreter, cached, threaded, recompiler or precompiled.\n");
+    fprintf(stream, "                     Precompiled is the default in builds made with 'nob aot'.\n");
+    fprintf(stream, "  --lockstep <name>  Run a second VM on this engine alongside every program and\n");
+    fprintf(stream, "                     stop at the first point the two differ.\n");
+    fprintf(stream, "  --fastmem          Use the fastmem backend where available.\n");
+    fprintf(stream, "  --gte-reference    Run GTE commands through the scalar reference kernels.\n");
+    fprintf(stream, "  --check-gte <n>    Compare the SIMD GTE kernels with the scalar ones on n random\n");
+    fprintf(stream, "                     inputs and exit.\n");
+    fprintf(stream, "  --no-idle-skip     Interpret idle loops and WAIT rather than skipping to the next event.\n");
+    fprintf(stream, "  --hle              Run memcpy, memset, strlen and the heap functions natively,\n");
+    fprintf(stream, "                     found through the symbol table of the program.\n");
+    fprintf(stream, "  --hle-call-cycles <n>\n");
+    fprintf(stream, "                     Cycles charged per native call, which turns on --hle. Defaults to %u.\n", GFUSX_HLE_DEFAULT_CALL_CYCLES);
+    fprintf(stream, "  --hle-byte-cycles <n>\n");
+    fprintf(stream, "                     Cycles charged per byte a native call touches, which turns on --hle.\n");
+    fprintf(stream, "                     Defaults to %u.\n", GFUSX_HLE_DEFAULT_BYTE_CYCLES);
+    fprintf(stream, "  --record <file>    Record every input of the program to a log.\n");
+    fprintf(stream, "  --replay <file>    Replay a recorded input log for every program.\n");
+    fprintf(stream, "  --trace <file>     Write an execution trace of the program, see gfutrace.\n");
+    fprintf(stream, "  --profile          Sample the pc of the program and print a profile at exit.\n");
+    fprintf(stream, "  --profile-interval <n>\n");
+    fprintf(stream, "                     Cycles between samples, which turns on profiling. Defaults to %llu.\n", GFUSX_DEFAULT_PROFILE_INTERVAL);
+    fprintf(stream, "  --profile-out <file>\n");
+    fprintf(stream, "                     Write the profile as collapsed stacks instead of printing it.\n");
+    fprintf(stream, "  --call-graph       Track guest calls and print the cycles spent per function at exit.\n");
+    fprintf(stream, "  --call-graph-out <file>\n");
+    fprintf(stream, "                     Write the call graph as collapsed stacks instead of printing it.\n");
+    fprintf(stream, "  --results <file>   Append the host time and guest instructions per second of every\n");
+    fprintf(stream, "                     program to a tab separated results file.\n");
+    fprintf(stream, "  --pin              Pin worker threads to cores.\n");
+}
+
+static bool gfusx_parse_engine(const char* name, gfusx_cpu_engine* engine) {
+    if (0 == strcmp("interpreter", name)) {
+        *engine = GFUSX_ENGINE_INTERPRETER;
+    } else if (0 == strcmp("cached", name)) {
+        *engine = GFUSX_ENGINE_CACHED_INTERPRETER;
+    } else if (0 == strcmp("threaded", name)) {
+        *engine = GFUSX_ENGINE_THREADED_INTERPRETER;
+    } else if (0 == strcmp("recompiler", name)) {
+        *engine = GFUSX_ENGINE_RECOMPILER;
+    } else if (0 == strcmp("precompiled", name)) {
+        *engine = GFUSX_ENGINE_PRECOMPILED;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static const char* gfusx_engine_name(gfusx_cpu_engine engine) {
+    switch (engine) {
+        case GFUSX_ENGINE_DEFAULT: return "threaded";
+        case GFUSX_ENGINE_INTERPRETER: return "interpreter";
+        case GFUSX_ENGINE_CACHED_INTERPRETER: return "cached";
+        case GFUSX_ENGINE_THREADED_INTERPRETER: return "threaded";
+        case GFUSX_ENGINE_RECOMPILER: return "recompiler";
+        case GFUSX_ENGINE_PRECOMPILED: return "precompiled";
+    }
+
+    return "<unknown>";
+}
+
+static void gfusx_print_job(FILE* stream, const gfusx_job* job) {
+    const char* status = job->loaded ? gfusx_stop_reason_name(job->stop_reason) : "load-error";
+    fprintf(stream, "%s\t%s\t%u\t%llu\t%08X", job->elf_path, status, job->exit_code, (unsigned long long)job->cycles, job->pc);
+    for (int i = 0; i < 34; i++) {
+        fprintf(stream, "\t%08X", job->gpr.r[i]);
+    }
+
+    fprintf(stream, "\n");
+}
+
+// one line per job, with a header if the file is new, so runs can be collected into one file
+static bool gfusx_append_results(const char* path, const gfusx_job* jobs, isize job_count, gfusx_cpu_engine engine) {
+    FILE* stream = fopen(path, "a");
+    if (stream == NULL) return false;
+
+    fseek(stream, 0, SEEK_END);
+    if (ftell(stream) == 0) {
+        fprintf(stream, "path\tengine\tstatus\tcycles\tinstructions\tseconds\tinstructions_per_second\n");
+    }
+
+    for (isize i = 0; i < job_count; i++) {
+        const gfusx_job* job = &jobs[i];
+        if (!job->loaded) continue;
+
+        u64 instructions = job->cycles / GFUSX_CYCLE_BIAS;
+        double ips = job->seconds > 0 ? (double)instructions / job->seconds : 0;
+        fprintf(stream, "%s\t%s\t%s\t%llu\t%llu\t%.6f\t%.0f\n", job->elf_path, gfusx_engine_name(engine), gfusx_stop_reason_name(job->stop_reason),
+                (unsigned long long)job->cycles, (unsigned long long)instructions, job->seconds, ips);
+    }
+
+    return 0 == fclose(stream);
+}
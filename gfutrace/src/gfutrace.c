@@ -0,0 +1,254 @@
+/// ======================================================================== ///
+/// This file is part of the GameFU Station fantasy console project.         ///
+///   GFUTRACE - GameFU Station Trace Tool                                   ///
+/// ------------------------------------------------------------------------ ///
+/// Copyright (C) 2025  L. C. Atticus <contact@nashiora.com>                 ///
+///                                                                          ///
+/// This program is free software: you can redistribute it and/or modify     ///
+/// it under the terms of the GNU Affero General Public License as published ///
+/// by the Free Software Foundation, either version 3 of the License, or     ///
+/// (at your option) any later version.                                      ///
+///                                                                          ///
+/// This program is distributed in the hope that it will be useful,          ///
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of           ///
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            ///
+/// GNU General Public License for more details.                             ///
+///                                                                          ///
+/// You should have received a copy of the GNU General Public License        ///
+/// along with this program.  If not, see <https://www.gnu.org/licenses/>.   ///
+/// ======================================================================== ///
+
+#define KOS_IMPLEMENTATION
+#include <kos.h>
+
+#define GFUARCH_IMPLEMENTATION
+#include <gamefu/arch.h>
+
+#define GFU_ELF_IMPL
+#include <gamefu/elf.h>
+
+#include <gamefu/gfusx.h>
+
+#include <errno.h>
+#include <stdint.h>
+
+#define GFUTRACE_DEFAULT_DIFF_COUNT 16
+#define GFUTRACE_DEFAULT_CONTEXT 8
+
+static void gfutrace_print_usage(FILE* stream, const char* program);
+static bool gfutrace_parse_count(const char* text, isize* count);
+static int gfutrace_dump(const char* path);
+static int gfutrace_diff(const char* path_a, const char* path_b, isize max_count);
+static int gfutrace_divergence(const char* path_a, const char* path_b, isize context);
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        gfutrace_print_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    const char* command = argv[1];
+    if (0 == strcmp("dump", command)) {
+        return gfutrace_dump(argv[2]);
+    }
+
+    if (argc < 4) {
+        gfutrace_print_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    bool is_diff = 0 == strcmp("diff", command);
+    if (!is_diff && 0 != strcmp("divergence", command)) {
+        fprintf(stderr, "Unknown command '%s'.\n", command);
+        gfutrace_print_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    // each command takes only its own option
+    const char* count_option = is_diff ? "--count" : "--context";
+    isize count = is_diff ? GFUTRACE_DEFAULT_DIFF_COUNT : GFUTRACE_DEFAULT_CONTEXT;
+    for (int i = 4; i < argc; i++) {
+        if (0 == strcmp(count_option, argv[i]) && i + 1 < argc) {
+            const char* value = argv[++i];
+            if (!gfutrace_parse_count(value, &count)) {
+                fprintf(stderr, "Expected a non-negative number for %s, got '%s'.\n", count_option, value);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[i]);
+            gfutrace_print_usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+
+    if (is_diff) {
+        return gfutrace_diff(argv[2], argv[3], count);
+    }
+
+    return gfutrace_divergence(argv[2], argv[3], count);
+}
+
+static void gfutrace_print_usage(FILE* stream, const char* program) {
+    fprintf(stream, "Usage: %s <command> <trace>...\n", program);
+    fprintf(stream, "Reads execution traces written by `gfusx --trace`.\n\n");
+    fprintf(stream, "Commands:\n");
+    fprintf(stream, "  dump <trace>                           Print every retired instruction.\n");
+    fprintf(stream, "  diff <a> <b> [--count <n>]             Print up to n differing instructions, then the totals.\n");
+    fprintf(stream, "  divergence <a> <b> [--context <n>]     Print where the traces first differ, and the n instructions before.\n");
+}
+
+// only plain decimal numbers, so a typo isn't quietly read as zero
+static bool gfutrace_parse_count(const char* text, isize* count) {
+    if (*text < '0' || *text > '9') return false;
+
+    char* end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > PTRDIFF_MAX) return false;
+
+    *count = (isize)value;
+    return true;
+}
+
+static const char* gfutrace_reg_name(int reg, char buffer[8]) {
+    if (reg == 32) return "hi";
+    if (reg == 33) return "lo";
+    snprintf(buffer, 8, "r%d", reg);
+    return buffer;
+}
+
+static void gfutrace_print_entry(FILE* stream, const char* prefix, isize index, const gfusx_trace_entry* entry) {
+    fprintf(stream, "%s%td\t%08X\t%08X", prefix, index, entry->pc, entry->code);
+    for (int i = 0; i < 34; i++) {
+        if (0 == (entry->changed & (1ull << i))) continue;
+        char name[8];
+        fprintf(stream, "\t%s=%08X", gfutrace_reg_name(i, name), entry->gpr.r[i]);
+    }
+
+    fprintf(stream, "\n");
+}
+
+static bool gfutrace_entries_equal(const gfusx_trace_entry* a, const gfusx_trace_entry* b) {
+    return a->pc == b->pc && a->code == b->code && a->changed == b->changed && 0 == memcmp(&a->gpr, &b->gpr, sizeof a->gpr);
+}
+
+// prints every field two entries disagree on
+static void gfutrace_print_difference(FILE* stream, const gfusx_trace_entry* a, const gfusx_trace_entry* b) {
+    if (a->pc != b->pc) fprintf(stream, "  pc: %08X vs %08X\n", a->pc, b->pc);
+    if (a->code != b->code) fprintf(stream, "  code: %08X vs %08X\n", a->code, b->code);
+    for (int i = 0; i < 34; i++) {
+        if (a->gpr.r[i] == b->gpr.r[i]) continue;
+        char name[8];
+        fprintf(stream, "  %s: %08X vs %08X\n", gfutrace_reg_name(i, name), a->gpr.r[i], b->gpr.r[i]);
+    }
+}
+
+static gfusx_trace_reader* gfutrace_open(const char* path) {
+    gfusx_trace_reader* reader = gfusx_trace_open(path);
+    if (reader == NULL) fprintf(stderr, "Could not read trace file '%s'.\n", path);
+    return reader;
+}
+
+static int gfutrace_dump(const char* path) {
+    gfusx_trace_reader* reader = gfutrace_open(path);
+    if (reader == NULL) return 1;
+
+    gfusx_trace_entry entry;
+    for (isize index = 0; gfusx_trace_next(reader, &entry); index++) {
+        gfutrace_print_entry(stdout, "", index, &entry);
+    }
+
+    gfusx_trace_close(reader);
+    return 0;
+}
+
+static int gfutrace_diff(const char* path_a, const char* path_b, isize max_count) {
+    int result = 0;
+
+    gfusx_trace_reader* a = gfutrace_open(path_a);
+    gfusx_trace_reader* b = gfutrace_open(path_b);
+    if (a == NULL || b == NULL) kos_return_defer(1);
+
+    isize index = 0;
+    isize difference_count = 0;
+    isize length_a = 0, length_b = 0;
+
+    gfusx_trace_entry entry_a, entry_b;
+    for (;; index++) {
+        bool has_a = gfusx_trace_next(a, &entry_a);
+        bool has_b = gfusx_trace_next(b, &entry_b);
+        if (has_a) length_a++;
+        if (has_b) length_b++;
+        if (!has_a || !has_b) {
+            // the rest of the longer trace is counted, not compared
+            while (has_a && gfusx_trace_next(a, &entry_a)) length_a++;
+            while (has_b && gfusx_trace_next(b, &entry_b)) length_b++;
+            break;
+        }
+
+        if (gfutrace_entries_equal(&entry_a, &entry_b)) continue;
+
+        if (difference_count < max_count) {
+            gfutrace_print_entry(stdout, "< ", index, &entry_a);
+            gfutrace_print_entry(stdout, "> ", index, &entry_b);
+        }
+
+        difference_count++;
+    }
+
+    fprintf(stdout, "%td differing instructions, %td vs %td instructions.\n", difference_count, length_a, length_b);
+    if (difference_count != 0 || length_a != length_b) result = 1;
+
+defer:;
+    if (a != NULL) gfusx_trace_close(a);
+    if (b != NULL) gfusx_trace_close(b);
+    return result;
+}
+
+static int gfutrace_divergence(const char* path_a, const char* path_b, isize context) {
+    int result = 0;
+
+    gfusx_trace_reader* a = gfutrace_open(path_a);
+    gfusx_trace_reader* b = gfutrace_open(path_b);
+    gfusx_trace_entry* history = NULL;
+    if (a == NULL || b == NULL) kos_return_defer(1);
+
+    // the last `context` entries both traces agreed on, as a ring
+    if (context > 0) history = calloc((usize)context, sizeof *history);
+
+    gfusx_trace_entry entry_a, entry_b;
+    for (isize index = 0;; index++) {
+        bool has_a = gfusx_trace_next(a, &entry_a);
+        bool has_b = gfusx_trace_next(b, &entry_b);
+        if (!has_a && !has_b) {
+            fprintf(stdout, "The traces are identical, %td instructions.\n", index);
+            kos_return_defer(0);
+        }
+
+        if (has_a && has_b && gfutrace_entries_equal(&entry_a, &entry_b)) {
+            if (context > 0) history[index % context] = entry_a;
+            continue;
+        }
+
+        fprintf(stdout, "The traces diverge at instruction %td.\n", index);
+
+        isize first = index < context ? 0 : index - context;
+        for (isize i = first; i < index; i++) {
+            gfutrace_print_entry(stdout, "  ", i, &history[i % context]);
+        }
+
+        if (has_a) gfutrace_print_entry(stdout, "< ", index, &entry_a);
+        else fprintf(stdout, "< %td\tend of trace\n", index);
+        if (has_b) gfutrace_print_entry(stdout, "> ", index, &entry_b);
+        else fprintf(stdout, "> %td\tend of trace\n", index);
+
+        if (has_a && has_b) gfutrace_print_difference(stdout, &entry_a, &entry_b);
+        kos_return_defer(1);
+    }
+
+defer:;
+    free(history);
+    if (a != NULL) gfusx_trace_close(a);
+    if (b != NULL) gfusx_trace_close(b);
+    return result;
+}
@@ -53,7 +53,14 @@ bool link_exe(const char* exe, Nob_File_Paths* obj_files, Nob_File_Paths* lib_fi
 
     Nob_Cmd cmd = {0};
 
-    int rebuild_status = nob_needs_rebuild(exe, obj_files->items, obj_files->count);
+    // libraries we build ourselves are inputs too, flags like -lpthread are not
+    Nob_File_Paths inputs = {0};
+    nob_da_append_many(&inputs, obj_files->items, obj_files->count);
+    for (size_t i = 0; i < lib_files->count; i++) {
+        if (lib_files->items[i][0] != '-') nob_da_append(&inputs, lib_files->items[i]);
+    }
+
+    int rebuild_status = nob_needs_rebuild(exe, inputs.items, inputs.count);
     if (rebuild_status < 0) nob_return_defer(false);
     if (0 == rebuild_status) nob_return_defer(true);
 
@@ -67,6 +74,37 @@ bool link_exe(const char* exe, Nob_File_Paths* obj_files, Nob_File_Paths* lib_fi
         nob_return_defer(false);
     }
 
+defer:;
+    nob_cmd_free(cmd);
+    nob_da_free(inputs);
+    return result;
+}
+
+bool link_lib(const char* lib, Nob_File_Paths* obj_files) {
+    nob_log(NOB_INFO, ">  Archiving library '%s'.", lib);
+
+    bool result = true;
+
+    Nob_Cmd cmd = {0};
+
+    int rebuild_status = nob_needs_rebuild(lib, obj_files->items, obj_files->count);
+    if (rebuild_status < 0) nob_return_defer(false);
+    if (0 == rebuild_status) nob_return_defer(true);
+
+    // ar only adds and replaces members, so start over to drop removed sources
+    if (nob_file_exists(lib) > 0) {
+        gfu_nob_try(false, nob_delete_file(lib));
+    }
+
+    nob_ar(&cmd);
+    nob_ar_flags(&cmd);
+    nob_ar_output(&cmd, lib);
+    nob_da_append_many(&cmd, obj_files->items, obj_files->count);
+
+    if (!nob_cmd_run_sync(cmd)) {
+        nob_return_defer(false);
+    }
+
 defer:;
     nob_cmd_free(cmd);
     return result;
@@ -87,10 +125,13 @@ typedef struct project {
 } project;
 
 static project choir = {0};
+static project libgfusx = {0};
 static project fuld = {0};
 static project fuasm = {0};
 static project fucc = {0};
 static project gfusx = {0};
+static project gfutrace = {0};
+static project gfusx_aot = {0};
 
 static bool build_project(project p) {
     nob_log(NOB_INFO, ">> Building project '%s'.", p.name);
@@ -116,8 +157,7 @@ static bool build_project(project p) {
         gfu_nob_try(false, link_exe(outfile, &obj_files, &p.libraries));
     } else if (p.kind == BUILD_STATIC) {
         outfile = gfu_nob_lib_a(nob_temp_sprintf(".build/%s", p.name));
-        nob_log(NOB_ERROR, "Can't build a static library yet.");
-        nob_return_defer(false);
+        gfu_nob_try(false, link_lib(outfile, &obj_files));
     } else {
         outfile = gfu_nob_lib_so(nob_temp_sprintf(".build/%s", p.name));
         nob_log(NOB_ERROR, "Can't build a dynamic library yet.");
@@ -193,11 +233,171 @@ defer:;
 
 static bool build_gfusx() {
     bool result = true;
+    gfu_nob_try(false, build_project(libgfusx));
     gfu_nob_try(false, build_project(gfusx));
 defer:;
     return result;
 }
 
+static bool build_gfutrace() {
+    bool result = true;
+    gfu_nob_try(false, build_project(libgfusx));
+    gfu_nob_try(false, build_project(gfutrace));
+defer:;
+    return result;
+}
+
+static bool build_gfusx_aot() {
+    bool result = true;
+    gfu_nob_try(false, build_project(libgfusx));
+    gfu_nob_try(false, build_project(gfusx_aot));
+defer:;
+    return result;
+}
+
+// The symbol gfusx-aot defines for the program, which gfusx picks up when
+// built with GFUSX_AOT_PROGRAM set to it.
+#define AOT_PROGRAM_NAME "gfusx_linked_aot_program"
+
+// Compiles a GameFU program to C with gfusx-aot and builds gfusx with it linked
+// in, as .build/gfusx-<program>, which runs it on the precompiled engine.
+static bool build_aot(const char* elf_path) {
+    Nob_String_View elf_name = gfu_nob_sv_file_name(nob_sv_from_cstr(elf_path));
+    nob_log(NOB_INFO, ">> Precompiling '"SV_Fmt"'.", SV_Arg(elf_name));
+
+    bool result = true;
+
+    Nob_Cmd cmd = {0};
+    Nob_File_Paths obj_files = {0};
+
+    const char* source_path = nob_temp_sprintf(".build/aot/"SV_Fmt".c", SV_Arg(elf_name));
+    const char* program_obj = nob_temp_sprintf(".build/aot/"SV_Fmt".o", SV_Arg(elf_name));
+    const char* main_obj = nob_temp_sprintf(".build/aot/gfusx-"SV_Fmt".o", SV_Arg(elf_name));
+    const char* exe = gfu_nob_exe(nob_temp_sprintf(".build/gfusx-"SV_Fmt, SV_Arg(elf_name)));
+
+    gfu_nob_try(false, nob_mkdir_if_not_exists(".build/aot"));
+
+    // the program is cheap to compile again, and whether it changed is only known by looking
+    nob_cmd_append(&cmd, gfu_nob_exe(".build/gfusx-aot"), elf_path, "-o", source_path, "--name", AOT_PROGRAM_NAME);
+    gfu_nob_try(false, nob_cmd_run_sync_and_reset(&cmd));
+
+    // this is the code that runs instead of the interpreter, so it is the one part built optimized
+    nob_cc(&cmd);
+    nob_cc_output(&cmd, program_obj);
+    nob_cmd_append(&cmd, "-c");
+    nob_cc_inputs(&cmd, source_path);
+    for (size_t i = 0; i < gfusx.include_paths.count; i++) {
+        nob_cmd_append(&cmd, nob_temp_sprintf("-I%s", gfusx.include_paths.items[i]));
+    }
+    nob_cc_flags(&cmd);
+    nob_cmd_append(&cmd, "-O2");
+    gfu_nob_try(false, nob_cmd_run_sync_and_reset(&cmd));
+
+    nob_cc(&cmd);
+    nob_cc_output(&cmd, main_obj);
+    nob_cmd_append(&cmd, "-c");
+    nob_cc_inputs(&cmd, "gfusx/src/gfusx.c");
+    for (size_t i = 0; i < gfusx.include_paths.count; i++) {
+        nob_cmd_append(&cmd, nob_temp_sprintf("-I%s", gfusx.include_paths.items[i]));
+    }
+    nob_cc_flags(&cmd);
+    nob_cmd_append(&cmd, "-DGFUSX_AOT_PROGRAM="AOT_PROGRAM_NAME);
+    gfu_nob_try(false, nob_cmd_run_sync_and_reset(&cmd));
+
+    nob_da_append(&obj_files, main_obj);
+    nob_da_append(&obj_files, program_obj);
+    gfu_nob_try(false, link_exe(exe, &obj_files, &gfusx.libraries));
+
+    nob_log(NOB_INFO, "   Built '%s'.", exe);
+
+defer:;
+    nob_cmd_free(cmd);
+    nob_da_free(obj_files);
+    return result;
+}
+
+#define GTE_CHECK_DEFAULT_ITERATIONS "1000000"
+
+// Compares the SIMD GTE kernels in gfusx/lib/gte_simd.c with the scalar ones on random inputs.
+static bool run_gte_check(const char* iterations) {
+    nob_log(NOB_INFO, ">> Checking the GTE kernels.");
+
+    bool result = true;
+
+    Nob_Cmd cmd = {0};
+    nob_cmd_append(&cmd, gfu_nob_exe(".build/gfusx"), "--check-gte", iterations);
+    gfu_nob_try(false, nob_cmd_run_sync(cmd));
+
+defer:;
+    nob_cmd_free(cmd);
+    return result;
+}
+
+#define BENCH_DEFAULT_CYCLES "200000000"
+
+static const char* bench_engines[] = {
+    "interpreter",
+    "cached",
+    "threaded",
+    "recompiler",
+};
+
+// Assembles every program in gfusx/bench and runs all of them under each CPU engine
+// for the same cycle budget, one at a time so they don't compete for the host.
+static bool run_bench(const char* cycles) {
+    nob_log(NOB_INFO, ">> Running benchmarks.");
+
+    bool result = true;
+    const char* results_path = ".build/bench/results.tsv";
+
+    Nob_Cmd cmd = {0};
+    Nob_File_Paths bench_sources = {0};
+    Nob_File_Paths bench_objects = {0};
+    Nob_String_Builder results = {0};
+
+    gfu_nob_try(false, nob_mkdir_if_not_exists(".build/bench"));
+    gfu_nob_try(false, gfu_nob_read_entire_dir_recursive_ext("gfusx/bench", ".fus", &bench_sources));
+
+    for (size_t i = 0; i < bench_sources.count; i++) {
+        const char* source_path = bench_sources.items[i];
+        Nob_String_View source_name = gfu_nob_sv_file_name(nob_sv_from_cstr(source_path));
+        const char* object_path = nob_temp_sprintf(".build/bench/"SV_Fmt".o", SV_Arg(source_name));
+
+        nob_cmd_append(&cmd, gfu_nob_exe(".build/fuasm"), source_path, object_path);
+        gfu_nob_try(false, nob_cmd_run_sync_and_reset(&cmd));
+        nob_da_append(&bench_objects, object_path);
+    }
+
+    // results are appended to, so start from an empty file
+    if (nob_file_exists(results_path) > 0) {
+        gfu_nob_try(false, nob_delete_file(results_path));
+    }
+
+    for (size_t i = 0; i < NOB_ARRAY_LEN(bench_engines); i++) {
+        const char* engine = bench_engines[i];
+        nob_log(NOB_INFO, ">  Engine '%s'.", engine);
+
+        // the final guest state of every program, to compare between engines
+        Nob_Fd state = nob_fd_open_for_write(nob_temp_sprintf(".build/bench/%s.tsv", engine));
+        if (state == NOB_INVALID_FD) nob_return_defer(false);
+
+        nob_cmd_append(&cmd, gfu_nob_exe(".build/gfusx"), "-j", "1", "--cycles", cycles, "--engine", engine, "--results", results_path);
+        nob_da_append_many(&cmd, bench_objects.items, bench_objects.count);
+        gfu_nob_try(false, nob_cmd_run_sync_redirect_and_reset(&cmd, (Nob_Cmd_Redirect) { .fdout = &state }));
+    }
+
+    gfu_nob_try(false, nob_read_entire_file(results_path, &results));
+    printf(SV_Fmt, (int)results.count, results.items);
+    nob_log(NOB_INFO, "   Results written to '%s'.", results_path);
+
+defer:;
+    nob_cmd_free(cmd);
+    nob_da_free(bench_sources);
+    nob_da_free(bench_objects);
+    nob_sb_free(results);
+    return result;
+}
+
 static bool clean(bool commit) {
     bool result = true;
 
@@ -275,6 +475,15 @@ int main(int argc, char** argv) {
     nob_da_append(&fucc.include_paths, "fucc/include");
     nob_da_append(&fucc.libraries, gfu_nob_lib_a("third-party/choir/.build/libchoir"));
 
+    // the emulator core, which every tool built around it links
+    libgfusx.name = "libgfusx";
+    libgfusx.kind = BUILD_STATIC;
+    gfu_nob_try(1, gfu_nob_read_entire_dir_recursive_ext("gfusx/lib", ".c", &libgfusx.source_paths));
+    nob_da_append(&libgfusx.include_paths, "include");
+    nob_da_append(&libgfusx.include_paths, "gfusx/include");
+    nob_da_append(&libgfusx.include_paths, "third-party/kos");
+    nob_da_append(&libgfusx.include_paths, "third-party/elf");
+
     gfusx.name = "gfusx";
     gfusx.kind = BUILD_EXE;
     gfu_nob_try(1, gfu_nob_read_entire_dir_recursive_ext("gfusx/src", ".c", &gfusx.source_paths));
@@ -282,7 +491,34 @@ int main(int argc, char** argv) {
     nob_da_append(&gfusx.include_paths, "gfusx/include");
     nob_da_append(&gfusx.include_paths, "third-party/kos");
     nob_da_append(&gfusx.include_paths, "third-party/elf");
-    nob_da_append(&gfusx.include_paths, "gfusx/include");
+    nob_da_append(&gfusx.libraries, gfu_nob_lib_a(".build/libgfusx"));
+#ifndef _WIN32
+    nob_da_append(&gfusx.libraries, "-lpthread");
+#endif
+
+    gfutrace.name = "gfutrace";
+    gfutrace.kind = BUILD_EXE;
+    gfu_nob_try(1, gfu_nob_read_entire_dir_recursive_ext("gfutrace/src", ".c", &gfutrace.source_paths));
+    nob_da_append(&gfutrace.include_paths, "include");
+    nob_da_append(&gfutrace.include_paths, "gfusx/include");
+    nob_da_append(&gfutrace.include_paths, "third-party/kos");
+    nob_da_append(&gfutrace.include_paths, "third-party/elf");
+    nob_da_append(&gfutrace.libraries, gfu_nob_lib_a(".build/libgfusx"));
+#ifndef _WIN32
+    nob_da_append(&gfutrace.libraries, "-lpthread");
+#endif
+
+    gfusx_aot.name = "gfusx-aot";
+    gfusx_aot.kind = BUILD_EXE;
+    gfu_nob_try(1, gfu_nob_read_entire_dir_recursive_ext("gfusx-aot/src", ".c", &gfusx_aot.source_paths));
+    nob_da_append(&gfusx_aot.include_paths, "include");
+    nob_da_append(&gfusx_aot.include_paths, "gfusx/include");
+    nob_da_append(&gfusx_aot.include_paths, "third-party/kos");
+    nob_da_append(&gfusx_aot.include_paths, "third-party/elf");
+    nob_da_append(&gfusx_aot.libraries, gfu_nob_lib_a(".build/libgfusx"));
+#ifndef _WIN32
+    nob_da_append(&gfusx_aot.libraries, "-lpthread");
+#endif
 
     gfu_nob_try(1, nob_mkdir_if_not_exists(".build"));
 
@@ -290,6 +526,28 @@ int main(int argc, char** argv) {
         const char* cmd = argv[1];
         if (0 == strcmp("gfusx", cmd)) {
             return build_gfusx() ? 0 : 1;
+        } else if (0 == strcmp("gfutrace", cmd)) {
+            return build_gfutrace() ? 0 : 1;
+        } else if (0 == strcmp("gfusx-aot", cmd)) {
+            return build_gfusx_aot() ? 0 : 1;
+        } else if (0 == strcmp("aot", cmd)) {
+            if (argc < 3) {
+                nob_log(NOB_ERROR, "Usage: nob aot <program.elf>");
+                return 1;
+            }
+
+            gfu_nob_try(1, build_gfusx_aot());
+            return build_aot(argv[2]) ? 0 : 1;
+        } else if (0 == strcmp("gte-check", cmd)) {
+            const char* iterations = argc >= 3 ? argv[2] : GTE_CHECK_DEFAULT_ITERATIONS;
+            gfu_nob_try(1, build_gfusx());
+            return run_gte_check(iterations) ? 0 : 1;
+        } else if (0 == strcmp("bench", cmd)) {
+            const char* cycles = argc >= 3 ? argv[2] : BENCH_DEFAULT_CYCLES;
+            gfu_nob_try(1, build_choir());
+            gfu_nob_try(1, build_fuasm());
+            gfu_nob_try(1, build_gfusx());
+            return run_bench(cycles) ? 0 : 1;
         }
     }
 
@@ -298,6 +556,8 @@ int main(int argc, char** argv) {
     gfu_nob_try(1, build_fuasm());
     gfu_nob_try(1, build_fucc());
     gfu_nob_try(1, build_gfusx());
+    gfu_nob_try(1, build_gfutrace());
+    gfu_nob_try(1, build_gfusx_aot());
 
 defer:;
     return result;